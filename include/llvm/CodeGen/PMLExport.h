@@ -28,6 +28,7 @@
 
 namespace llvm {
 
+  class tool_output_file;
   class MachineLoop;
 
   /// Provides information about machine instructions, can be overloaded for
@@ -84,6 +85,17 @@ namespace llvm {
     virtual void serialize(MachineFunction &MF) =0;
 
     virtual void writeOutput(yaml::Output *Output) =0;
+
+    /// flushOutput - Write the entries serialized since the last flush as a
+    /// separate document and release them. Called after every function when
+    /// streaming the export, exporters that do not override this keep their
+    /// entries until writeOutput is called.
+    virtual void flushOutput(yaml::Output *Output) {}
+
+    /// takeOutput - Move the entries serialized since the last call into Doc,
+    /// which owns them afterwards. Used for sharded exports, exporters that
+    /// do not override this keep their entries until writeOutput is called.
+    virtual void takeOutput(yaml::PMLDoc &Doc) {}
   };
 
 
@@ -121,6 +133,13 @@ namespace llvm {
       yaml::PMLDoc *DocPtr = &YDoc; *Output << DocPtr;
     }
 
+    virtual void flushOutput(yaml::Output *Output) {
+      if (!YDoc.empty()) writeOutput(Output);
+      YDoc.clear();
+    }
+
+    virtual void takeOutput(yaml::PMLDoc &Doc) { Doc.mergePML(YDoc); }
+
     yaml::PMLDoc& getPMLDoc() { return YDoc; }
 
     virtual bool doExportInstruction(const Instruction* Instr) {
@@ -170,6 +189,13 @@ namespace llvm {
       yaml::PMLDoc *DocPtr = &YDoc; *Output << DocPtr;
     }
 
+    virtual void flushOutput(yaml::Output *Output) {
+      if (!YDoc.empty()) writeOutput(Output);
+      YDoc.clear();
+    }
+
+    virtual void takeOutput(yaml::PMLDoc &Doc) { Doc.mergePML(YDoc); }
+
     yaml::PMLDoc& getPMLDoc() { return YDoc; }
 
     virtual bool doExportInstruction(const MachineInstr *Instr) {
@@ -225,6 +251,13 @@ namespace llvm {
       yaml::PMLDoc *DocPtr = &YDoc; *Output << DocPtr;
     }
 
+    virtual void flushOutput(yaml::Output *Output) {
+      if (!YDoc.empty()) writeOutput(Output);
+      YDoc.clear();
+    }
+
+    virtual void takeOutput(yaml::PMLDoc &Doc) { Doc.mergePML(YDoc); }
+
     yaml::PMLDoc& getPMLDoc() { return YDoc; }
 
   private:
@@ -267,6 +300,19 @@ namespace llvm {
     typedef std::list<MachineFunction*>    MFQueue;
     typedef std::set<MachineFunction*>     MFSet;
 
+    /// A document of a sharded export and the file it is written to.
+    struct ExportShard {
+      std::string   Function;
+      std::string   FileName;
+      yaml::PMLDoc *Doc;
+      bool          Changed;
+
+      ExportShard(StringRef function, StringRef filename, yaml::PMLDoc *doc)
+        : Function(function), FileName(filename), Doc(doc), Changed(false) {}
+    };
+
+    typedef std::vector<ExportShard>       ShardList;
+
     ExportList Exporters;
 
     PMLInstrInfo *PII;
@@ -275,10 +321,19 @@ namespace llvm {
     std::string BitcodeFile;
     StringList  Roots;
     bool        SerializeAll;
+    StringRef   TargetTriple;
+
+    /// The export file and its YAML stream, opened by openOutput.
+    tool_output_file *OutFile;
+    yaml::Output     *Output;
 
     MFSet   FoundFunctions;
     MFQueue Queue;
 
+    /// The shards of a sharded export, and the names used for their files.
+    ShardList        Shards;
+    std::set<std::string> ShardNames;
+
   protected:
     /// Constructor to be used by sub-classes, passes the pass ID to the super
     /// class. You need to setup a PMLInstrInfo using setPMLInstrInfo before
@@ -303,6 +358,13 @@ namespace llvm {
         Exporters.pop_back();
       }
       if (PII) delete PII;
+      // Only set if the shards were not written.
+      for (ShardList::iterator it = Shards.begin(), ie = Shards.end();
+           it != ie; ++it)
+        delete it->Doc;
+      // Only set if the export was not finalized, discards the file.
+      delete Output;
+      delete OutFile;
     }
 
     PMLInstrInfo *getPMLInstrInfo() { return PII; }
@@ -335,6 +397,33 @@ namespace llvm {
 
     void addToQueue(MachineFunction *MF);
 
+    /// openOutput - Open the export file, unless it is already open. Returns
+    /// false if the file could not be opened.
+    bool openOutput();
+
+    /// closeOutput - Close the export file and keep it.
+    void closeOutput();
+
+    /// addShard - Move the entries serialized so far into a new shard of the
+    /// export, written to a file derived from the export file and Name.
+    void addShard(StringRef Function, StringRef Name);
+
+    /// getNumShards - Get the number of shards of a sharded export.
+    unsigned getNumShards() const { return Shards.size(); }
+
+    /// writeShard - Write a shard to its file and release its document. The
+    /// file is left untouched if its contents did not change. Different
+    /// shards may be written concurrently.
+    void writeShard(unsigned Index);
+
+    /// writeShards - Write all shards of a sharded export. Targets may
+    /// override this to write the shards concurrently.
+    virtual void writeShards();
+
+    /// finalizeShards - Write the shards and the manifest listing them to
+    /// the export file.
+    void finalizeShards(const Module &M);
+
   };
 
 } // end namespace llvm
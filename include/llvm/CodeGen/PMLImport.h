@@ -33,6 +33,9 @@ namespace llvm {
   class PMLQuery;
   class PMLBitcodeQuery;
   class PMLMCQuery;
+  class PMLImport;
+  class PMLIndex;
+  class MemoryBuffer;
 
   /// TODO maybe move this code to PML.h, reuse for export and relation graph.
   typedef StringMap<StringRef> PMLLabelMap;
@@ -85,6 +88,12 @@ namespace llvm {
 
     /// Get a unique label of a memory instruction
     virtual yaml::Name getMemInstrLabel(const yaml::ProgramPoint *PP) = 0;
+
+    /// Get a call instruction of a block by its callsite label, i.e., by the
+    /// index of the call among all call instructions of the block. Return
+    /// NULL if there is no such call.
+    virtual yaml::Instruction *getCallSite(const yaml::Name &Block,
+                                           unsigned Label) const = 0;
   };
 
   //===--------------------------------------------------------------------===//
@@ -98,6 +107,7 @@ namespace llvm {
   private:
     typedef StringMap<BlockT*> BlockMap;
     typedef StringMap<StringMap<int> > MemInstrLabelMap;
+    typedef StringMap<std::vector<yaml::Instruction*> > CallSiteMap;
 
     yaml::Function<BlockT> *Function;
 
@@ -105,6 +115,8 @@ namespace llvm {
     BlockMap Blocks;
     /// Map of block ID -> (instr ID -> MemInstrLabel)
     MemInstrLabelMap MemInstrLabels;
+    /// Map of block ID -> call instructions, indexed by callsite label
+    CallSiteMap CallSites;
 
     PMLFunctionInfoT() : PMLFunctionInfo(bitcode), Function(0) {}
 
@@ -134,6 +146,9 @@ namespace llvm {
 
     virtual yaml::Name getMemInstrLabel(const yaml::ProgramPoint *PP);
 
+    virtual yaml::Instruction *getCallSite(const yaml::Name &Block,
+                                           unsigned Label) const;
+
     BlockT* getBlock(const yaml::Name &Name) const;
 
     yaml::Function<BlockT> *getFunction() const {
@@ -158,6 +173,9 @@ namespace llvm {
     yaml::ReprLevel Level;
     bool IsBitcode;
 
+    /// The import to load functions from on demand, if any.
+    PMLImport *Loader;
+
     /// Map of function label (mapsto) -> ID (name)
     PMLLabelMap  FunctionLabels;
 
@@ -167,7 +185,8 @@ namespace llvm {
     PMLLevelInfo(const PMLLevelInfo&); // Not implemented
     const PMLLevelInfo &operator=(const PMLLevelInfo&); // Not implemented
   public:
-    PMLLevelInfo(yaml::ReprLevel lvl) : Level(lvl)
+    PMLLevelInfo(yaml::ReprLevel lvl, PMLImport *loader = 0)
+    : Level(lvl), Loader(loader)
     {
       IsBitcode = (lvl == yaml::level_bitcode);
     }
@@ -187,6 +206,10 @@ namespace llvm {
     void addFunctionInfo(yaml::BitcodeFunction &F);
     void addFunctionInfo(yaml::MachineFunction &F);
 
+    /// Add a mapping of a function label to a function ID (name), for
+    /// functions that are not loaded yet.
+    void addFunctionLabel(StringRef Label, StringRef Name);
+
     bool hasFunctionMapping(const Function &F) const {
       return !getFunctionInfo(F).hasMapping();
     }
@@ -214,6 +237,12 @@ namespace llvm {
 
     bool Initialized;
 
+    /// Binary PML indices to load functions from on demand.
+    std::vector<PMLIndex*> Indices;
+
+    /// The parsed PML files. Some strings of YDoc refer into the buffers.
+    std::vector<MemoryBuffer*> Buffers;
+
   public:
     static char ID;
 
@@ -224,9 +253,7 @@ namespace llvm {
       initializePMLImportPass(Registry);
     }
 
-    ~PMLImport() {
-      deletePMLIndex();
-    }
+    ~PMLImport();
 
     void getAnalysisUsage(AnalysisUsage &AU) const {
       AU.setPreservesAll();
@@ -250,6 +277,11 @@ namespace llvm {
     PMLMCQuery* createMCQuery(Pass &AnalysisProvider, const MachineFunction &MF,
                      yaml::ReprLevel SrcLevel = yaml::level_machinecode);
 
+    /// Load the blocks, value facts and profile entries of a function from
+    /// the PML indices, unless already loaded. Returns true if new infos have
+    /// been loaded.
+    bool loadFunction(yaml::ReprLevel Level, StringRef Name);
+
   private:
 
     // TODO at some point we could use the PML level field to encode a phase
@@ -362,6 +394,14 @@ namespace llvm {
 
   public:
 
+    /// Get the criticality of a single block from the pre-calculated
+    /// criticality map, or Default if the block is not in the map.
+    double getCriticality(BlockDoubleMap &Criticalities,
+                          const BasicBlock &BB, double Default = 1.0);
+
+    /// Get the names of the imported callees of a call instruction. Returns
+    /// false if no callees are known or if any callee is unknown.
+    bool getCallees(const Instruction &I, std::vector<StringRef> &Callees);
   };
 
   class PMLMCQuery : public PMLQuery {
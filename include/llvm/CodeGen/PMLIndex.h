@@ -0,0 +1,107 @@
+//==- PMLIndex.h - Binary index of PML documents --------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A PML index holds the contents of PML documents split into one record per
+// function and representation level. It is built once from the YAML files
+// and memory-mapped by PMLImport, which then only parses the records of the
+// functions that are actually queried.
+//
+// All integers of the file are 64 bit little endian:
+//   Header:  magic "PMLINDEX", version, number of records
+//   Records: level, name offset, name size, label offset, label size,
+//            data offset, data size
+// followed by the names and the data of the records. Offsets are relative to
+// the start of the file. The data of a record is a null-terminated PML
+// document holding the function, and the value facts, flow facts and
+// profile entries referring to it. Record 0 holds all entries that do not
+// belong to a single function, e.g., relation graphs and timing summaries.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CODEGEN_PMLINDEX_H
+#define LLVM_CODEGEN_PMLINDEX_H
+
+#include "llvm/PML.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+  class MemoryBuffer;
+  class raw_ostream;
+
+  class PMLIndex {
+  private:
+    /// The memory-mapped index file.
+    OwningPtr<MemoryBuffer> Buffer;
+
+    unsigned NumRecords;
+
+    /// Map of function name -> record, for each representation level.
+    StringMap<unsigned> BitcodeRecords;
+    StringMap<unsigned> MachineRecords;
+
+    /// Flags indicating whether a record has already been loaded.
+    std::vector<bool> Loaded;
+
+    PMLIndex(const PMLIndex&); // Not implemented
+    const PMLIndex &operator=(const PMLIndex&); // Not implemented
+
+    uint64_t getField(unsigned Record, unsigned Field) const;
+
+    /// loadRecord - Parse a record and merge it into Doc, unless the record
+    /// has been loaded before. Returns true if the record has been loaded.
+    bool loadRecord(unsigned Record, yaml::PMLDoc &Doc);
+
+  public:
+    PMLIndex() : NumRecords(0) {}
+
+    ~PMLIndex();
+
+    /// isPMLIndex - Check if a file starts with the magic of a PML index.
+    static bool isPMLIndex(StringRef Magic);
+
+    /// write - Write the contents of a PML document as index.
+    static void write(yaml::PMLDoc &Doc, raw_ostream &OS);
+
+    /// open - Read the index table of a PML index, takes ownership of the
+    /// buffer. Returns false and sets ErrMsg if the index is malformed.
+    bool open(MemoryBuffer *Buf, std::string &ErrMsg);
+
+    unsigned getNumRecords() const { return NumRecords; }
+
+    yaml::ReprLevel getLevel(unsigned Record) const {
+      return (yaml::ReprLevel)getField(Record, 0);
+    }
+
+    /// getName - Get the ID (name) of the function of a record.
+    StringRef getName(unsigned Record) const;
+
+    /// getLabel - Get the label (mapsto) of the function of a record.
+    StringRef getLabel(unsigned Record) const;
+
+    /// loadModule - Merge the entries not belonging to a function into Doc.
+    bool loadModule(yaml::PMLDoc &Doc) { return loadRecord(0, Doc); }
+
+    /// loadFunction - Merge the entries of a function at the given level into
+    /// Doc. Returns false if the function is unknown or already loaded.
+    bool loadFunction(yaml::ReprLevel Level, StringRef Name,
+                      yaml::PMLDoc &Doc);
+
+    /// loadAll - Merge all records that have not been loaded so far into Doc.
+    void loadAll(yaml::PMLDoc &Doc);
+  };
+
+}
+
+#endif
@@ -975,6 +975,55 @@ struct MappingTraits< Timing* > {
 
 YAML_IS_PTR_SEQUENCE_VECTOR(Timing)
 
+// Preemption Costs
+//////////////////////////////////////////////////////////////////////////////
+
+/// Worst-case stack cache costs (in bytes) of a task preemption at a program
+/// point. Restoring is the total cost, the remaining entries break it down.
+struct PreemptionCost {
+  ProgramPoint *Reference;
+  Name Origin;
+  uint64_t Saving;
+  uint64_t Restoring;
+  uint64_t RestoringExplicit;
+  uint64_t LocalEnsure;
+  uint64_t GlobalEnsure;
+  uint64_t ReserveGain;
+
+  PreemptionCost()
+  : Reference(0), Origin(""), Saving(0), Restoring(0), RestoringExplicit(0),
+    LocalEnsure(0), GlobalEnsure(0), ReserveGain(0)
+  {
+  }
+  ~PreemptionCost() {
+    if (Reference) delete Reference;
+  }
+
+  void setReference(ProgramPoint *PP) {
+    if (Reference) delete Reference;
+    Reference = PP;
+  }
+private:
+  PreemptionCost(const PreemptionCost&);            // Disable copy constructor
+  PreemptionCost* operator=(const PreemptionCost&); // Disable assignment
+};
+template <>
+struct MappingTraits< PreemptionCost* > {
+  static void mapping(IO &io, PreemptionCost *&P) {
+    if (!P) P = new PreemptionCost();
+    io.mapRequired("reference",          P->Reference);
+    io.mapOptional("origin",             P->Origin);
+    io.mapRequired("saving",             P->Saving);
+    io.mapRequired("restoring",          P->Restoring);
+    io.mapOptional("restoring-explicit", P->RestoringExplicit);
+    io.mapOptional("local-ensure",       P->LocalEnsure);
+    io.mapOptional("global-ensure",      P->GlobalEnsure);
+    io.mapOptional("reserve-gain",       P->ReserveGain);
+  }
+};
+
+YAML_IS_PTR_SEQUENCE_VECTOR(PreemptionCost)
+
 // PML Documents
 //////////////////////////////////////////////////////////////////////////////
 
@@ -987,6 +1036,7 @@ struct PMLDoc {
   std::vector<FlowFact*>  FlowFacts;
   std::vector<ValueFact*> ValueFacts;
   std::vector<Timing*>    Timings;
+  std::vector<PreemptionCost*> PreemptionCosts;
 
   PMLDoc()
     : FormatVersion("pml-0.1"), TargetTriple("") {}
@@ -995,13 +1045,17 @@ struct PMLDoc {
     : FormatVersion("pml-0.1"),
       TargetTriple(TargetTriple) {}
 
-  ~PMLDoc() {
+  ~PMLDoc() { clear(); }
+
+  /// Delete all childs of the document, keeping format and triple.
+  void clear() {
     DELETE_PTR_VEC(BitcodeFunctions);
     DELETE_PTR_VEC(MachineFunctions);
     DELETE_PTR_VEC(RelationGraphs);
     DELETE_PTR_VEC(ValueFacts);
     DELETE_PTR_VEC(FlowFacts);
     DELETE_PTR_VEC(Timings);
+    DELETE_PTR_VEC(PreemptionCosts);
   }
   /// Add a function, which is owned by the document afterwards
   void addFunction(BitcodeFunction *F) {
@@ -1027,7 +1081,8 @@ struct PMLDoc {
   bool empty() {
     return BitcodeFunctions.empty() && MachineFunctions.empty() &&
            RelationGraphs.empty() && ValueFacts.empty() &&
-           FlowFacts.empty() && Timings.empty();
+           FlowFacts.empty() && Timings.empty() &&
+           PreemptionCosts.empty();
   }
 
   /// Merge another PML doc into this one, transferring ownership of all childs.
@@ -1060,6 +1115,10 @@ struct PMLDoc {
                             Doc.Timings.begin(),
                             Doc.Timings.end());
     Doc.Timings.clear();
+    PreemptionCosts.insert(PreemptionCosts.end(),
+                            Doc.PreemptionCosts.begin(),
+                            Doc.PreemptionCosts.end());
+    Doc.PreemptionCosts.clear();
   }
 
 private:
@@ -1078,6 +1137,7 @@ struct MappingTraits< PMLDoc* > {
     io.mapOptional("flowfacts",  doc->FlowFacts);
     io.mapOptional("valuefacts", doc->ValueFacts);
     io.mapOptional("timing",     doc->Timings);
+    io.mapOptional("preemption-costs", doc->PreemptionCosts);
   }
 };
 
@@ -1100,6 +1160,48 @@ struct PMLDocList {
   }
 };
 
+// PML Manifests
+//////////////////////////////////////////////////////////////////////////////
+
+/// A document of a sharded PML export.
+struct PMLShard {
+  /// The function exported to the shard, empty for module-level information.
+  Name Function;
+  /// The file holding the shard, relative to the manifest.
+  Name File;
+
+  PMLShard() {}
+  PMLShard(const Name &function, const Name &file)
+  : Function(function), File(file) {}
+};
+template <>
+struct MappingTraits< PMLShard > {
+  static void mapping(IO &io, PMLShard &S) {
+    io.mapOptional("function", S.Function, Name(""));
+    io.mapRequired("file",     S.File);
+  }
+};
+YAML_IS_SEQUENCE_VECTOR(PMLShard)
+
+/// The manifest of a sharded PML export, listing the documents of the export.
+struct PMLManifest {
+  StringRef FormatVersion;
+  StringRef TargetTriple;
+  std::vector<PMLShard> Shards;
+
+  PMLManifest(StringRef TargetTriple)
+    : FormatVersion("pml-0.1-manifest"),
+      TargetTriple(TargetTriple) {}
+};
+template <>
+struct MappingTraits< PMLManifest > {
+  static void mapping(IO &io, PMLManifest &M) {
+    io.mapRequired("format", M.FormatVersion);
+    io.mapRequired("triple", M.TargetTriple);
+    io.mapRequired("shards", M.Shards);
+  }
+};
+
 } // end namespace yaml
 } // end namespace llvm
 
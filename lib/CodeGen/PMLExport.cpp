@@ -18,6 +18,7 @@
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/ADT/OwningPtr.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/ScalarEvolution.h"
@@ -32,12 +33,17 @@
 #include "llvm/CodeGen/PMLExport.h"
 #include "llvm/CodeGen/PseudoSourceValue.h"
 #include "llvm/Support/CFG.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/YAMLTraits.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Target/TargetInstrInfo.h"
 
+#include <cctype>
+
 
 using namespace llvm;
 
@@ -50,8 +56,21 @@ STATISTIC( NumAnnotatedBounds,
            "Number of user-annotated header bounds exported");
 
 STATISTIC( NumMemExp,   "Number of exported load from array infos");
+
+STATISTIC( NumShardsWritten,   "Number of PML shards written");
+STATISTIC( NumShardsUnchanged, "Number of PML shards kept unchanged");
 }
 
+static cl::opt<bool> StreamingExport("mserialize-streaming",
+   cl::desc("Write the PML export of each function as soon as it is "
+            "serialized instead of keeping the whole module in memory"),
+   cl::init(false), cl::Hidden);
+
+static cl::opt<bool> ShardedExport("mserialize-shards",
+   cl::desc("Write the PML export of each function to a separate file and "
+            "a manifest listing the files to the export file"),
+   cl::init(false), cl::Hidden);
+
 /// Unfortunately, the interface for accessing successors differs
 /// between machine block and bitcode block, therefore we need this
 /// trait in order to avoid code duplication
@@ -459,6 +478,10 @@ void PMLMachineExport::serialize(MachineFunction &MF)
         IsBundled = false;
       }
 
+      // Bundle headers are not emitted, only export the bundled instructions
+      if (Ins->isBundle())
+        continue;
+
       // Do not export any Pseudo instructions with zero size
       if (Ins->isPseudo() && !Ins->isInlineAsm())
         continue;
@@ -1168,13 +1191,15 @@ PMLModuleExportPass::PMLModuleExportPass(char &id, TargetMachine &TM,
                                          StringRef filename,
                                          ArrayRef<std::string> roots,
                                          bool SerializeAll)
-  : MachineModulePass(id), PII(0), OutFileName(filename), Roots(roots), SerializeAll(SerializeAll)
+  : MachineModulePass(id), PII(0), OutFileName(filename), Roots(roots), SerializeAll(SerializeAll),
+    TargetTriple(TM.getTargetTriple()), OutFile(0), Output(0)
 {
 }
 
 PMLModuleExportPass::PMLModuleExportPass(TargetMachine &TM, StringRef filename,
                               ArrayRef<std::string> roots, PMLInstrInfo *pii, bool SerializeAll)
-  : MachineModulePass(ID), PII(pii), OutFileName(filename), Roots(roots), SerializeAll(SerializeAll)
+  : MachineModulePass(ID), PII(pii), OutFileName(filename), Roots(roots), SerializeAll(SerializeAll),
+    TargetTriple(TM.getTargetTriple()), OutFile(0), Output(0)
 {
 }
 
@@ -1196,6 +1221,13 @@ bool PMLModuleExportPass::runOnMachineModule(const Module &M)
 
   FoundFunctions.clear();
   Queue.clear();
+
+  if (ShardedExport) {
+    // reserve the name of the shard holding the module-level information
+    ShardNames.insert("module");
+  } else if (StreamingExport) {
+    openOutput();
+  }
   if (SerializeAll) {
     // Queue all functions
     for (Module::const_iterator it = M.begin(); it != M.end(); ++it) {
@@ -1219,6 +1251,18 @@ bool PMLModuleExportPass::runOnMachineModule(const Module &M)
     }
 
     addCalleesToQueue(M, MMI, *MF);
+
+    if (ShardedExport) {
+      addShard(MF->getName(), MF->getName());
+    }
+
+    // write the entries of the function right away and free them, instead of
+    // holding the PML of the whole module in memory until doFinalization.
+    if (StreamingExport && Output) {
+      for (size_t i=0; i < Exporters.size(); i++) {
+        Exporters[i]->flushOutput(Output);
+      }
+    }
   }
 
   return false;
@@ -1245,35 +1289,52 @@ bool PMLModuleExportPass::doInitialization(Module &M) {
   return false;
 }
 
-bool PMLModuleExportPass::doFinalization(Module &M) {
-  tool_output_file *OutFile;
-  yaml::Output *Output;
-  std::string ErrorInfo;
+bool PMLModuleExportPass::openOutput() {
+  if (Output) return true;
 
+  std::string ErrorInfo;
   OutFile = new tool_output_file(OutFileName.str().c_str(), ErrorInfo);
   if (!ErrorInfo.empty()) {
     delete OutFile;
+    OutFile = 0;
     errs() << "[mc2yml] Opening Export File failed: " << OutFileName << "\n";
     errs() << "[mc2yml] Reason: " << ErrorInfo;
     return false;
   }
-  else {
-    Output = new yaml::Output(OutFile->os());
-  }
+  Output = new yaml::Output(OutFile->os());
+  return true;
+}
 
-  for (ExportList::iterator it = Exporters.begin(), ie = Exporters.end();
-       it != ie; ++it)
-  {
-    (*it)->finalize(M);
-    (*it)->writeOutput(Output);
+void PMLModuleExportPass::closeOutput() {
+  if (!OutFile) return;
+
+  OutFile->keep();
+  delete Output;
+  delete OutFile;
+  Output = 0;
+  OutFile = 0;
+}
+
+bool PMLModuleExportPass::doFinalization(Module &M) {
+  if (!openOutput()) {
+    return false;
   }
 
-  if (OutFile) {
-    OutFile->keep();
-    delete Output;
-    delete OutFile;
+  if (ShardedExport) {
+    finalizeShards(M);
+  } else {
+    // When streaming, only the entries not flushed so far and the
+    // module-level information of the exporters remain to be written.
+    for (ExportList::iterator it = Exporters.begin(), ie = Exporters.end();
+         it != ie; ++it)
+    {
+      (*it)->finalize(M);
+      (*it)->writeOutput(Output);
+    }
   }
 
+  closeOutput();
+
   if (!BitcodeFile.empty()) {
     std::string ErrorInfo;
     tool_output_file BitcodeStream(BitcodeFile.c_str(), ErrorInfo);
@@ -1288,6 +1349,100 @@ bool PMLModuleExportPass::doFinalization(Module &M) {
   return false;
 }
 
+void PMLModuleExportPass::addShard(StringRef Function, StringRef Name) {
+  // derive a file name that is valid and unique within the export
+  std::string Base;
+  for (StringRef::iterator i = Name.begin(), ie = Name.end(); i != ie; ++i) {
+    Base += (isalnum(*i) || *i == '_' || *i == '-' || *i == '.') ? *i : '_';
+  }
+  std::string Unique = Base;
+  for (unsigned i = 1; !ShardNames.insert(Unique).second; i++) {
+    Unique = Base + "-" + utostr(i);
+  }
+
+  SmallString<128> FileName(OutFileName);
+  sys::path::replace_extension(FileName, Unique + ".pml");
+
+  yaml::PMLDoc *Doc = new yaml::PMLDoc(TargetTriple);
+  for (size_t i=0; i < Exporters.size(); i++) {
+    Exporters[i]->takeOutput(*Doc);
+  }
+
+  Shards.push_back(ExportShard(Function, FileName, Doc));
+}
+
+void PMLModuleExportPass::writeShard(unsigned Index) {
+  ExportShard &S = Shards[Index];
+
+  std::string Buffer;
+  {
+    raw_string_ostream OS(Buffer);
+    yaml::Output Out(OS);
+    Out << S.Doc;
+  }
+
+  delete S.Doc;
+  S.Doc = 0;
+
+  // keep unchanged shards untouched, so that they can be reused by tools
+  // and build systems without reloading them
+  OwningPtr<MemoryBuffer> Old;
+  if (!MemoryBuffer::getFile(S.FileName, Old) && Old->getBuffer() == Buffer) {
+    return;
+  }
+
+  std::string ErrorInfo;
+  tool_output_file File(S.FileName.c_str(), ErrorInfo);
+  if (!ErrorInfo.empty()) {
+    errs() << "[mc2yml] Opening Export File failed: " << S.FileName << "\n";
+    errs() << "[mc2yml] Reason: " << ErrorInfo;
+    return;
+  }
+  File.os() << Buffer;
+  File.keep();
+  S.Changed = true;
+}
+
+void PMLModuleExportPass::writeShards() {
+  for (unsigned i = 0, ie = Shards.size(); i != ie; i++) {
+    writeShard(i);
+  }
+}
+
+void PMLModuleExportPass::finalizeShards(const Module &M) {
+  // the module-level information of the exporters goes to a separate shard
+  for (ExportList::iterator it = Exporters.begin(), ie = Exporters.end();
+       it != ie; ++it)
+  {
+    (*it)->finalize(M);
+  }
+  ShardNames.erase("module");
+  addShard("", "module");
+  if (Shards.back().Doc->empty()) {
+    delete Shards.back().Doc;
+    Shards.pop_back();
+  }
+
+  writeShards();
+
+  yaml::PMLManifest Manifest(TargetTriple);
+  for (ShardList::iterator it = Shards.begin(), ie = Shards.end(); it != ie;
+       ++it)
+  {
+    if (it->Changed)
+      NumShardsWritten++;
+    else
+      NumShardsUnchanged++;
+
+    Manifest.Shards.push_back(yaml::PMLShard(
+      StringRef(it->Function), sys::path::filename(it->FileName)));
+  }
+  *Output << Manifest;
+
+  Shards.clear();
+  ShardNames.clear();
+}
+
 void PMLModuleExportPass::addToQueue(const Module &M, MachineModuleInfo &MMI,
                                      std::string FnName)
 {
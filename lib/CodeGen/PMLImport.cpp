@@ -15,8 +15,10 @@
 
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/CodeGen/PMLImport.h"
+#include "llvm/CodeGen/PMLIndex.h"
 #include "llvm/CodeGen/MachineDominators.h"
 #include "llvm/CodeGen/MachinePostDominators.h"
 #include "llvm/CodeGen/MachineFunction.h"
@@ -27,13 +29,18 @@
 #include "llvm/Support/YAMLTraits.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 
 using namespace llvm;
 
 
 static cl::list<std::string> ImportFiles("mimport-pml",
-   cl::desc("Read external analysis results from PML file"));
+   cl::desc("Read external analysis results from PML file or PML index"));
+
+static cl::opt<std::string> WriteIndexFile("mimport-pml-write-index",
+   cl::desc("Write the imported PML files as binary PML index to FILE"),
+   cl::init(""), cl::Hidden);
 
 INITIALIZE_PASS(PMLImport, "pml-import", "PML Import", false, true)
 
@@ -41,6 +48,18 @@ char PMLImport::ID = 0;
 
 void PMLImport::anchor() {}
 
+PMLImport::~PMLImport() {
+  deletePMLIndex();
+  while (!Indices.empty()) {
+    delete Indices.back();
+    Indices.pop_back();
+  }
+  while (!Buffers.empty()) {
+    delete Buffers.back();
+    Buffers.pop_back();
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 static void printErrorMessages(const llvm::SMDiagnostic &Diag, void *) {
@@ -65,6 +84,34 @@ void PMLImport::initializePass()
   for (cl::list<std::string>::iterator filename = ImportFiles.begin(),
        ie = ImportFiles.end(); filename != ie; filename++)
   {
+    // PML indices are mapped into memory, functions are only parsed when
+    // they are queried.
+    SmallString<8> Magic;
+    if (!sys::fs::get_magic(*filename, 8, Magic) &&
+        PMLIndex::isPMLIndex(Magic))
+    {
+      OwningPtr<MemoryBuffer> Buf;
+      if (MemoryBuffer::getFile(*filename, Buf, -1, false)) {
+        report_fatal_error("PMLImport: error reading PML index.");
+      }
+
+      PMLIndex *Index = new PMLIndex();
+      std::string ErrMsg;
+      if (!Index->open(Buf.take(), ErrMsg)) {
+        report_fatal_error("PMLImport: invalid PML index " + *filename +
+                           ": " + ErrMsg);
+      }
+      Indices.push_back(Index);
+
+      // An index is written from the whole document.
+      if (WriteIndexFile.empty()) {
+        Index->loadModule(YDoc);
+      } else {
+        Index->loadAll(YDoc);
+      }
+      continue;
+    }
+
     OwningPtr<MemoryBuffer> Buf;
     if (MemoryBuffer::getFileOrSTDIN(*filename, Buf)) {
       // TODO print error code
@@ -82,13 +129,58 @@ void PMLImport::initializePass()
     }
 
     Docs.mergeInto(YDoc);
+
+    // The triple and the hashes of the merged documents still refer to the
+    // buffer.
+    Buffers.push_back(Buf.take());
   }
 
   rebuildPMLIndex();
 
+  if (!WriteIndexFile.empty()) {
+    std::string ErrorInfo;
+    tool_output_file Out(WriteIndexFile.c_str(), ErrorInfo,
+                         sys::fs::F_Binary);
+    if (!ErrorInfo.empty()) {
+      report_fatal_error("PMLImport: error writing PML index: " + ErrorInfo);
+    }
+    PMLIndex::write(YDoc, Out.os());
+    Out.keep();
+  }
+
   Initialized = true;
 }
 
+bool PMLImport::loadFunction(yaml::ReprLevel Level, StringRef Name)
+{
+  yaml::PMLDoc Part;
+
+  bool Loaded = false;
+  for (std::vector<PMLIndex*>::iterator i = Indices.begin(),
+       ie = Indices.end(); i != ie; i++)
+  {
+    Loaded |= (*i)->loadFunction(Level, Name, Part);
+  }
+  if (!Loaded) return false;
+
+  for (std::vector<yaml::BitcodeFunction*>::iterator
+       i = Part.BitcodeFunctions.begin(), ie = Part.BitcodeFunctions.end();
+       i != ie; i++)
+  {
+    BitcodeLevel->addFunctionInfo(**i);
+  }
+  for (std::vector<yaml::MachineFunction*>::iterator
+       i = Part.MachineFunctions.begin(), ie = Part.MachineFunctions.end();
+       i != ie; i++)
+  {
+    MachineLevel->addFunctionInfo(**i);
+  }
+
+  YDoc.mergePML(Part);
+
+  return true;
+}
+
 void PMLImport::deletePMLIndex() {
   if (BitcodeLevel) delete BitcodeLevel;
   if (MachineLevel) delete MachineLevel;
@@ -100,8 +192,8 @@ void PMLImport::rebuildPMLIndex() {
   deletePMLIndex();
 
   // We could check if we actually have any documents with that level, but meh..
-  BitcodeLevel = new PMLLevelInfo(yaml::level_bitcode);
-  MachineLevel = new PMLLevelInfo(yaml::level_machinecode);
+  BitcodeLevel = new PMLLevelInfo(yaml::level_bitcode, this);
+  MachineLevel = new PMLLevelInfo(yaml::level_machinecode, this);
 
   for (std::vector<yaml::BitcodeFunction*>::iterator
        i = YDoc.BitcodeFunctions.begin(), ie = YDoc.BitcodeFunctions.end();
@@ -115,6 +207,22 @@ void PMLImport::rebuildPMLIndex() {
   {
     MachineLevel->addFunctionInfo(**i);
   }
+
+  // Functions of the indices are loaded on demand, only their labels are
+  // needed to map functions to their IDs.
+  for (std::vector<PMLIndex*>::iterator i = Indices.begin(),
+       ie = Indices.end(); i != ie; i++)
+  {
+    PMLIndex *Index = *i;
+    for (unsigned r = 1, re = Index->getNumRecords(); r < re; r++) {
+      StringRef Label = Index->getLabel(r);
+      if (Label.empty()) continue;
+
+      PMLLevelInfo *Lvl = (Index->getLevel(r) == yaml::level_bitcode) ?
+                          BitcodeLevel : MachineLevel;
+      Lvl->addFunctionLabel(Label, Index->getName(r));
+    }
+  }
 }
 
 PMLBitcodeQuery* PMLImport::createBitcodeQuery(Pass &AnalysisProvider,
@@ -222,6 +330,7 @@ void PMLFunctionInfoT<BlockT,bitcode>::reloadBlockInfos()
   BlockLabels.clear();
   Blocks.clear();
   MemInstrLabels.clear();
+  CallSites.clear();
 
   if (!Function) return;
 
@@ -250,6 +359,10 @@ void PMLFunctionInfoT<BlockT,bitcode>::reloadBlockInfos()
           break;
         default: /*NOP*/;
       }
+      // calls are labeled by their index among the calls of the block
+      if (!I->Callees.empty()) {
+        CallSites[BB->BlockName.getName()].push_back(I);
+      }
     }
   }
 }
@@ -284,6 +397,15 @@ yaml::Name PMLFunctionInfoT<BlockT,bitcode>::getMemInstrLabel(
 
 }
 
+template<typename BlockT, bool bitcode>
+yaml::Instruction *PMLFunctionInfoT<BlockT,bitcode>::getCallSite(
+                                  const yaml::Name &Block, unsigned Label) const
+{
+  CallSiteMap::const_iterator it = CallSites.find(Block.getName());
+  if (it == CallSites.end() || Label >= it->second.size()) return NULL;
+  return it->second[Label];
+}
+
 
 // Ensure all template classes are instantiated.
 template class llvm::PMLFunctionInfoT<yaml::BitcodeBlock,true>;
@@ -316,6 +438,11 @@ void PMLLevelInfo::addFunctionInfo(yaml::MachineFunction &F)
   FunctionInfos.GetOrCreateValue(F.FunctionName.getName(), FI);
 }
 
+void PMLLevelInfo::addFunctionLabel(StringRef Label, StringRef Name)
+{
+  FunctionLabels.GetOrCreateValue(Label, Name);
+}
+
 yaml::Name PMLLevelInfo::getFunctionName(const Function &F) const
 {
   // check if there is a mapping for this function to another name
@@ -354,6 +481,13 @@ PMLFunctionInfo &PMLLevelInfo::getFunctionInfo(const yaml::Name &Name) const
   if (it != FunctionInfos.end()) {
     return *it->second;
   }
+  // Check if the function is available from a PML index.
+  if (Loader && Loader->loadFunction(Level, Name.getName())) {
+    it = FunctionInfos.find(Name.getName());
+    if (it != FunctionInfos.end()) {
+      return *it->second;
+    }
+  }
   if (IsBitcode) {
     return PMLBitcodeFunctionInfo::getEmptyInfo();
   } else {
@@ -586,6 +720,42 @@ getBBMemFacts(ValueFactsMap &MemFacts, const MachineBasicBlock &MBB) const
   return MemFacts[FI.getBlockLabel(MBB)];
 }
 
+double PMLBitcodeQuery::getCriticality(BlockDoubleMap &Criticalities,
+                                       const BasicBlock &BB, double Default)
+{
+  if (!FI.hasBlockMapping(BB)) return Default;
+
+  StringMap<double>::iterator it =
+                         Criticalities.find(FI.getBlockName(BB).getName());
+  return (it != Criticalities.end()) ? it->second : Default;
+}
+
+bool PMLBitcodeQuery::getCallees(const Instruction &I,
+                                 std::vector<StringRef> &Callees)
+{
+  const BasicBlock *BB = I.getParent();
+  if (!FI.hasBlockMapping(*BB)) return false;
+
+  // Match the call by its callsite label rather than by its raw instruction
+  // index, which shifts whenever non-call instructions are added or removed
+  // after the PML was exported.
+  unsigned Label = 0;
+  for (BasicBlock::const_iterator it = BB->begin(); &*it != &I; ++it) {
+    if (isa<CallInst>(it) && !isa<IntrinsicInst>(it)) Label++;
+  }
+
+  yaml::Instruction *Ins = FI.getCallSite(FI.getBlockName(*BB), Label);
+  if (!Ins) return false;
+
+  for (std::vector<yaml::Name>::iterator ci = Ins->Callees.begin(),
+       ce = Ins->Callees.end(); ci != ce; ++ci)
+  {
+    if (ci->getName() == "__any__") return false;
+    Callees.push_back(ci->getName());
+  }
+  return !Callees.empty();
+}
+
 double PMLMCQuery::getCriticality(BlockDoubleMap &Criticalities,
                                   MachineBasicBlock &MBB, double Default)
 {
@@ -0,0 +1,392 @@
+//===-- PMLIndex.cpp ------------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Build and read binary indices of PML documents.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "pml-import"
+
+#include "llvm/CodeGen/PMLIndex.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/YAMLTraits.h"
+
+#include <map>
+
+using namespace llvm;
+
+static const char IndexMagic[8] = { 'P','M','L','I','N','D','E','X' };
+static const uint64_t IndexVersion = 1;
+
+/// Size of the header and of a single record of the index table, in bytes.
+static const unsigned HeaderSize = 3 * 8;
+static const unsigned NumFields = 7;
+static const unsigned RecordSize = NumFields * 8;
+
+static void writeField(raw_ostream &OS, uint64_t Value) {
+  char Buf[8];
+  support::endian::write<uint64_t, support::little, support::unaligned>(Buf,
+                                                                        Value);
+  OS.write(Buf, 8);
+}
+
+static void printErrorMessages(const llvm::SMDiagnostic &Diag, void *) {
+  Diag.print("PMLIndex", errs(), true);
+}
+
+namespace {
+
+  /// A record of an index under construction. The document of the record
+  /// only borrows the entries of the document the index is built from.
+  struct IndexRecord {
+    yaml::ReprLevel Level;
+    StringRef Name;
+    StringRef Label;
+    yaml::PMLDoc *Doc;
+    std::string Data;
+
+    IndexRecord(yaml::ReprLevel lvl, StringRef name, StringRef triple)
+    : Level(lvl), Name(name), Doc(new yaml::PMLDoc(triple)) {}
+  };
+
+  class PMLIndexBuilder {
+  private:
+    StringRef Triple;
+
+    std::vector<IndexRecord> Records;
+
+    /// Map of (level, function) -> record.
+    std::map<std::pair<int, std::string>, unsigned> RecordMap;
+
+  public:
+    PMLIndexBuilder(StringRef triple) : Triple(triple) {
+      // The module record comes first.
+      Records.push_back(IndexRecord(yaml::level_bitcode, "", Triple));
+    }
+
+    ~PMLIndexBuilder() {
+      for (unsigned i = 0; i < Records.size(); i++) {
+        yaml::PMLDoc *Doc = Records[i].Doc;
+        // Only the timings have been created for the index, release the
+        // borrowed entries without deleting them.
+        for (unsigned t = 0; t < Doc->Timings.size(); t++) {
+          Doc->Timings[t]->ScopeRef = 0;
+          Doc->Timings[t]->Profile.clear();
+        }
+        Doc->BitcodeFunctions.clear();
+        Doc->MachineFunctions.clear();
+        Doc->RelationGraphs.clear();
+        Doc->ValueFacts.clear();
+        Doc->FlowFacts.clear();
+        Doc->PreemptionCosts.clear();
+        delete Doc;
+      }
+    }
+
+    /// getRecord - Get the record of a function, or the module record for
+    /// entries without a function.
+    IndexRecord &getRecord(yaml::ReprLevel Level, StringRef Function) {
+      if (Function.empty()) return Records[0];
+
+      std::pair<std::map<std::pair<int, std::string>, unsigned>::iterator,
+                bool> It = RecordMap.insert(std::make_pair(
+                  std::make_pair((int)Level, Function.str()), Records.size()));
+      if (It.second) {
+        Records.push_back(IndexRecord(Level, It.first->first.second, Triple));
+      }
+      return Records[It.first->second];
+    }
+
+    void addDocument(yaml::PMLDoc &YDoc);
+
+    void write(raw_ostream &OS);
+  };
+}
+
+void PMLIndexBuilder::addDocument(yaml::PMLDoc &YDoc)
+{
+  for (std::vector<yaml::BitcodeFunction*>::iterator
+       i = YDoc.BitcodeFunctions.begin(), ie = YDoc.BitcodeFunctions.end();
+       i != ie; i++)
+  {
+    IndexRecord &R = getRecord(yaml::level_bitcode, (*i)->FunctionName.getName());
+    if (R.Label.empty()) R.Label = (*i)->MapsTo.getName();
+    R.Doc->addFunction(*i);
+  }
+  for (std::vector<yaml::MachineFunction*>::iterator
+       i = YDoc.MachineFunctions.begin(), ie = YDoc.MachineFunctions.end();
+       i != ie; i++)
+  {
+    IndexRecord &R = getRecord(yaml::level_machinecode,
+                               (*i)->FunctionName.getName());
+    if (R.Label.empty()) R.Label = (*i)->MapsTo.getName();
+    R.Doc->addMachineFunction(*i);
+  }
+  for (std::vector<yaml::RelationGraph*>::iterator
+       i = YDoc.RelationGraphs.begin(), ie = YDoc.RelationGraphs.end();
+       i != ie; i++)
+  {
+    Records[0].Doc->addRelationGraph(*i);
+  }
+  for (std::vector<yaml::ValueFact*>::iterator i = YDoc.ValueFacts.begin(),
+       ie = YDoc.ValueFacts.end(); i != ie; i++)
+  {
+    yaml::ValueFact *VF = *i;
+    StringRef Function = VF->PP ? VF->PP->Function.getName() : "";
+    getRecord(VF->Level, Function).Doc->addValueFact(VF);
+  }
+  for (std::vector<yaml::FlowFact*>::iterator i = YDoc.FlowFacts.begin(),
+       ie = YDoc.FlowFacts.end(); i != ie; i++)
+  {
+    yaml::FlowFact *FF = *i;
+    StringRef Function = FF->ScopeRef ? FF->ScopeRef->Function.getName() : "";
+    getRecord(FF->Level, Function).Doc->addFlowFact(FF);
+  }
+  for (std::vector<yaml::PreemptionCost*>::iterator
+       i = YDoc.PreemptionCosts.begin(), ie = YDoc.PreemptionCosts.end();
+       i != ie; i++)
+  {
+    yaml::PreemptionCost *PC = *i;
+    StringRef Function = PC->Reference ? PC->Reference->Function.getName() : "";
+    IndexRecord &R = getRecord(yaml::level_machinecode, Function);
+    R.Doc->PreemptionCosts.push_back(PC);
+  }
+
+  // Split the profiles of the timings by function. The module record keeps
+  // a summary of every timing, so that the timings are visible without
+  // loading any functions.
+  for (std::vector<yaml::Timing*>::iterator i = YDoc.Timings.begin(),
+       ie = YDoc.Timings.end(); i != ie; i++)
+  {
+    yaml::Timing *T = *i;
+    std::map<unsigned, yaml::Timing*> Parts;
+
+    // Make sure the module record gets a summary even without a profile.
+    Parts[0] = 0;
+
+    for (std::vector<yaml::ProfileEntry*>::iterator pi = T->Profile.begin(),
+         pie = T->Profile.end(); pi != pie; pi++)
+    {
+      yaml::ProfileEntry *P = *pi;
+      StringRef Function = P->Reference ? P->Reference->Function.getName() : "";
+
+      IndexRecord &R = getRecord(T->Level, Function);
+      unsigned Idx = &R - &Records[0];
+
+      yaml::Timing *&Part = Parts[Idx];
+      if (!Part) {
+        Part = new yaml::Timing(T->Level);
+        Part->Origin = T->Origin;
+        Part->ScopeRef = T->ScopeRef;
+        Part->Cycles = T->Cycles;
+        R.Doc->Timings.push_back(Part);
+      }
+      Part->Profile.push_back(P);
+    }
+
+    if (!Parts[0]) {
+      yaml::Timing *Summary = new yaml::Timing(T->Level);
+      Summary->Origin = T->Origin;
+      Summary->ScopeRef = T->ScopeRef;
+      Summary->Cycles = T->Cycles;
+      Records[0].Doc->Timings.push_back(Summary);
+    }
+  }
+}
+
+void PMLIndexBuilder::write(raw_ostream &OS)
+{
+  // Serialize all records first to get the layout of the file.
+  uint64_t StringSize = 0;
+  for (unsigned i = 0; i < Records.size(); i++) {
+    IndexRecord &R = Records[i];
+
+    raw_string_ostream DataOS(R.Data);
+    yaml::Output Output(DataOS);
+    yaml::PMLDoc *DocPtr = R.Doc;
+    Output << DocPtr;
+    DataOS.flush();
+
+    StringSize += R.Name.size() + R.Label.size();
+  }
+
+  uint64_t StringOffset = HeaderSize + Records.size() * RecordSize;
+  uint64_t DataOffset = StringOffset + StringSize;
+
+  OS.write(IndexMagic, 8);
+  writeField(OS, IndexVersion);
+  writeField(OS, Records.size());
+
+  for (unsigned i = 0; i < Records.size(); i++) {
+    IndexRecord &R = Records[i];
+
+    writeField(OS, R.Level);
+    writeField(OS, StringOffset);
+    writeField(OS, R.Name.size());
+    StringOffset += R.Name.size();
+    writeField(OS, StringOffset);
+    writeField(OS, R.Label.size());
+    StringOffset += R.Label.size();
+    writeField(OS, DataOffset);
+    writeField(OS, R.Data.size());
+    // The YAML parser requires null-terminated input.
+    DataOffset += R.Data.size() + 1;
+  }
+
+  for (unsigned i = 0; i < Records.size(); i++) {
+    OS << Records[i].Name << Records[i].Label;
+  }
+  for (unsigned i = 0; i < Records.size(); i++) {
+    OS << Records[i].Data;
+    OS.write('\0');
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+PMLIndex::~PMLIndex() {}
+
+bool PMLIndex::isPMLIndex(StringRef Magic)
+{
+  return Magic.startswith(StringRef(IndexMagic, 8));
+}
+
+void PMLIndex::write(yaml::PMLDoc &Doc, raw_ostream &OS)
+{
+  PMLIndexBuilder Builder(Doc.TargetTriple);
+  Builder.addDocument(Doc);
+  Builder.write(OS);
+}
+
+uint64_t PMLIndex::getField(unsigned Record, unsigned Field) const
+{
+  assert(Record < NumRecords && Field < NumFields && "Invalid index access");
+  const char *Ptr = Buffer->getBufferStart() + HeaderSize +
+                    Record * RecordSize + Field * 8;
+  return support::endian::read<uint64_t, support::little,
+                               support::unaligned>(Ptr);
+}
+
+StringRef PMLIndex::getName(unsigned Record) const
+{
+  return StringRef(Buffer->getBufferStart() + getField(Record, 1),
+                   getField(Record, 2));
+}
+
+StringRef PMLIndex::getLabel(unsigned Record) const
+{
+  return StringRef(Buffer->getBufferStart() + getField(Record, 3),
+                   getField(Record, 4));
+}
+
+bool PMLIndex::open(MemoryBuffer *Buf, std::string &ErrMsg)
+{
+  Buffer.reset(Buf);
+
+  uint64_t Size = Buf->getBufferSize();
+  const char *Start = Buf->getBufferStart();
+
+  if (Size < HeaderSize || !isPMLIndex(Buf->getBuffer())) {
+    ErrMsg = "not a PML index";
+    return false;
+  }
+  if (support::endian::read<uint64_t, support::little,
+                            support::unaligned>(Start + 8) != IndexVersion) {
+    ErrMsg = "unsupported PML index version";
+    return false;
+  }
+
+  uint64_t Records = support::endian::read<uint64_t, support::little,
+                                           support::unaligned>(Start + 16);
+  if (Records == 0 || Records > (Size - HeaderSize) / RecordSize) {
+    ErrMsg = "invalid number of records";
+    return false;
+  }
+  NumRecords = Records;
+
+  for (unsigned i = 0; i < NumRecords; i++) {
+    // The name, label and data (including the null terminator) must be
+    // within the file. The sizes are read from the file, so compare them
+    // against the remaining space instead of adding them up.
+    for (unsigned f = 1; f < NumFields; f += 2) {
+      uint64_t Offset = getField(i, f);
+      uint64_t Length = getField(i, f + 1);
+      bool HasTerminator = f == 5;
+      if (Offset > Size || Length > Size - Offset ||
+          (HasTerminator && Length == Size - Offset)) {
+        ErrMsg = "record exceeds the file";
+        return false;
+      }
+    }
+    if (Start[getField(i, 5) + getField(i, 6)] != '\0') {
+      ErrMsg = "record data is not terminated";
+      return false;
+    }
+
+    if (i == 0) continue;
+
+    StringMap<unsigned> &Map = getLevel(i) == yaml::level_bitcode ?
+                               BitcodeRecords : MachineRecords;
+    Map.GetOrCreateValue(getName(i), i);
+  }
+
+  Loaded.assign(NumRecords, false);
+
+  return true;
+}
+
+bool PMLIndex::loadRecord(unsigned Record, yaml::PMLDoc &Doc)
+{
+  if (Loaded[Record]) return false;
+  Loaded[Record] = true;
+
+  DEBUG(dbgs() << "PMLIndex: loading record " << Record << " ("
+               << getName(Record) << ")\n");
+
+  StringRef Data(Buffer->getBufferStart() + getField(Record, 5),
+                 getField(Record, 6));
+
+  yaml::Input Input(Data, NULL, printErrorMessages);
+
+  yaml::PMLDocList Docs;
+
+  Input >> Docs.YDocs;
+
+  if (Input.error()) {
+    report_fatal_error("PMLIndex: error parsing record of function " +
+                       getName(Record));
+  }
+
+  Docs.mergeInto(Doc);
+
+  return true;
+}
+
+bool PMLIndex::loadFunction(yaml::ReprLevel Level, StringRef Name,
+                            yaml::PMLDoc &Doc)
+{
+  const StringMap<unsigned> &Map = Level == yaml::level_bitcode ?
+                                   BitcodeRecords : MachineRecords;
+
+  StringMap<unsigned>::const_iterator it = Map.find(Name);
+  if (it == Map.end()) return false;
+
+  return loadRecord(it->second, Doc);
+}
+
+void PMLIndex::loadAll(yaml::PMLDoc &Doc)
+{
+  for (unsigned i = 0; i < NumRecords; i++) {
+    loadRecord(i, Doc);
+  }
+}
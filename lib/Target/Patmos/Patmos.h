@@ -40,6 +40,7 @@ namespace llvm {
   FunctionPass *createPatmosSPBundlingPass(const PatmosTargetMachine &tm);
   FunctionPass *createPatmosSPReducePass(const PatmosTargetMachine &tm);
   FunctionPass *createSPSchedulerPass(const PatmosTargetMachine &tm);
+  ModulePass   *createPatmosSPCycleEstimatorPass(const PatmosTargetMachine &tm);
   FunctionPass *createPatmosDelaySlotFillerPass(const PatmosTargetMachine &tm,
                                                 bool ForceDisable);
   FunctionPass *createPatmosFunctionSplitterPass(PatmosTargetMachine &tm);
@@ -59,6 +60,9 @@ namespace llvm {
   ModulePass *createPatmosCallGraphBuilder();
   ModulePass *createPatmosStackCacheAnalysis(const PatmosTargetMachine &tm);
   ModulePass *createPatmosStackCacheAnalysisInfo(const PatmosTargetMachine &tm);
+  ModulePass *createPatmosStackCachePlacementPass(const PatmosTargetMachine &tm);
+  ModulePass *createPatmosScratchpadAllocationPass(const PatmosTargetMachine &tm);
+  ModulePass *createPatmosMethodCacheLayoutPass(const PatmosTargetMachine &tm);
 
   extern char &PatmosPostRASchedulerID;
 } // end namespace llvm;
@@ -27,6 +27,8 @@
 #include "llvm/MC/MCStreamer.h"
 #include "llvm/MC/MCExpr.h"
 #include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCSectionELF.h"
+#include "llvm/Support/ELF.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/CommandLine.h"
 
@@ -44,6 +46,21 @@ static cl::opt<bool> EnableBasicBlockSymbols(
            "named like the IR basic blocks."),
   cl::Hidden);
 
+/// EnablePreemptionNote - If enabled, the worst-case stack cache costs of a
+/// preemption at the beginning of each basic block and right before each call,
+/// as computed by the stack cache analysis (-mpatmos-sca-preemption), are
+/// emitted to an ELF note section.
+static cl::opt<bool> EnablePreemptionNote(
+  "mpatmos-emit-preemption-note",
+  cl::init(false),
+  cl::desc("Emit the stack cache preemption costs of basic blocks and calls "
+           "to the .note.patmos.preemption section."),
+  cl::Hidden);
+
+/// Note type of the stack cache preemption costs. Each entry of the
+/// descriptor consists of three words: the address of the basic block or call,
+/// the bytes to save, and the bytes to restore.
+static const unsigned NT_PATMOS_PREEMPTION = 1;
 
 
 void PatmosAsmPrinter::EmitFunctionEntryLabel() {
@@ -78,6 +95,23 @@ void PatmosAsmPrinter::EmitBasicBlockBegin(const MachineBasicBlock *MBB) {
     }
     OutStreamer.EmitELFSize(bbsym, MCConstantExpr::Create(bbsize, OutContext));
   }
+
+  // Label the beginning of the block for the preemption note, blocks only
+  // reachable by fall-through have no label of their own.
+  if (EnablePreemptionNote) {
+    PatmosStackCacheAnalysisInfo *SCA =
+      getAnalysisIfAvailable<PatmosStackCacheAnalysisInfo>();
+
+    if (SCA && SCA->isValid()) {
+      PatmosStackCacheAnalysisInfo::PreemptionCosts::const_iterator it =
+        SCA->Preemptions.find(MBB);
+      if (it != SCA->Preemptions.end()) {
+        MCSymbol *Label = OutContext.CreateTempSymbol();
+        OutStreamer.EmitLabel(Label);
+        PreemptionPoints.push_back(PreemptionPoint(Label, it->second));
+      }
+    }
+  }
 }
 
 
@@ -125,6 +159,41 @@ void PatmosAsmPrinter::EmitBasicBlockEnd(const MachineBasicBlock *MBB) {
 void PatmosAsmPrinter::EmitFunctionBodyEnd() {
   // Emit the end symbol of the last cache block
   OutStreamer.EmitLabel(CurrCodeEnd);
+
+  if (!PreemptionPoints.empty()) {
+    EmitPreemptionNote();
+  }
+}
+
+void PatmosAsmPrinter::EmitPreemptionNote() {
+  const MCSectionELF *Section =
+    OutContext.getELFSection(".note.patmos.preemption", ELF::SHT_NOTE, 0,
+                             SectionKind::getMetadata());
+
+  OutStreamer.PushSection();
+  OutStreamer.SwitchSection(Section);
+  OutStreamer.EmitValueToAlignment(4);
+
+  // note header: name size, descriptor size, type, padded name
+  StringRef Name("Patmos");
+  OutStreamer.EmitIntValue(Name.size() + 1, 4);
+  OutStreamer.EmitIntValue(PreemptionPoints.size() * 12, 4);
+  OutStreamer.EmitIntValue(NT_PATMOS_PREEMPTION, 4);
+  OutStreamer.EmitBytes(Name);
+  OutStreamer.EmitIntValue(0, 1);
+  OutStreamer.EmitValueToAlignment(4);
+
+  // descriptor: block or call address, bytes to save, bytes to restore
+  for (std::vector<PreemptionPoint>::iterator i = PreemptionPoints.begin(),
+       ie = PreemptionPoints.end(); i != ie; i++) {
+    OutStreamer.EmitValue(MCSymbolRefExpr::Create(i->first, OutContext), 4);
+    OutStreamer.EmitIntValue(i->second.Saving, 4);
+    OutStreamer.EmitIntValue(i->second.getTotalRestoring(), 4);
+  }
+
+  OutStreamer.PopSection();
+
+  PreemptionPoints.clear();
 }
 
 void PatmosAsmPrinter::EmitDotSize(MCSymbol *SymStart, MCSymbol *SymEnd) {
@@ -199,6 +268,23 @@ void PatmosAsmPrinter::EmitInstruction(const MachineInstr *MI) {
     BundleMIs.push_back(MI);
   }
 
+  // Label calls for the preemption note.
+  if (EnablePreemptionNote) {
+    PatmosStackCacheAnalysisInfo *SCA =
+      getAnalysisIfAvailable<PatmosStackCacheAnalysisInfo>();
+
+    for (unsigned Index = 0; SCA && SCA->isValid() && Index < Size; Index++) {
+      PatmosStackCacheAnalysisInfo::CallPreemptionCosts::const_iterator it =
+        SCA->CallPreemptions.find(BundleMIs[Index]);
+      if (it != SCA->CallPreemptions.end()) {
+        MCSymbol *Label = OutContext.CreateTempSymbol();
+        OutStreamer.EmitLabel(Label);
+        PreemptionPoints.push_back(PreemptionPoint(Label, it->second));
+        break;
+      }
+    }
+  }
+
   // Emit all instructions in the bundle.
   for (unsigned Index = 0; Index < Size; Index++) {
     MCInst MCI;
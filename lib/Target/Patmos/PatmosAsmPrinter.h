@@ -17,6 +17,7 @@
 
 #include "PatmosTargetMachine.h"
 #include "PatmosMCInstLower.h"
+#include "PatmosStackCacheAnalysis.h"
 #include "llvm/CodeGen/AsmPrinter.h"
 #include "llvm/MC/MCContext.h"
 
@@ -33,6 +34,14 @@ namespace llvm {
     // symbol to use for the end of the currently emitted subfunction
     MCSymbol *CurrCodeEnd;
 
+    typedef std::pair<MCSymbol*, PatmosStackCacheAnalysisInfo::PreemptionCost>
+                                                               PreemptionPoint;
+
+    /// PreemptionPoints - Labels and stack cache preemption costs of the
+    /// basic blocks and calls of the current function, for the preemption
+    /// note.
+    std::vector<PreemptionPoint> PreemptionPoints;
+
   public:
     PatmosAsmPrinter(TargetMachine &TM, MCStreamer &Streamer)
       : AsmPrinter(TM, Streamer), MCInstLowering(OutContext, *this), CurrCodeEnd(0)
@@ -88,6 +97,10 @@ namespace llvm {
                        unsigned Alignment = 0);
 
     bool isFStart(const MachineBasicBlock *MBB) const;
+
+    /// EmitPreemptionNote - Emit the stack cache preemption costs of the
+    /// basic blocks and calls of the current function to an ELF note section.
+    void EmitPreemptionNote();
   };
 
 } // end of llvm namespace
@@ -0,0 +1,58 @@
+//===-- PatmosBlockDataFlow.cpp - Block-level data-flow support -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Work lists for data-flow analyses over the basic blocks of a machine
+// function, see PatmosBlockDataFlow.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosBlockDataFlow.h"
+#include "llvm/ADT/PostOrderIterator.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+PatmosBlockWorkList::PatmosBlockWorkList(MachineFunction &MF, Direction Dir) :
+    Position(MF.getNumBlockIDs(), ~0u), Queued(MF.size())
+{
+  Blocks.reserve(MF.size());
+
+  // order the reachable blocks
+  ReversePostOrderTraversal<MachineFunction*> RPOT(&MF);
+  for(ReversePostOrderTraversal<MachineFunction*>::rpo_iterator
+      i(RPOT.begin()), ie(RPOT.end()); i != ie; i++) {
+    Blocks.push_back(*i);
+  }
+
+  if (Dir == Backward)
+    std::reverse(Blocks.begin(), Blocks.end());
+
+  for(unsigned int i = 0, ie = Blocks.size(); i != ie; i++) {
+    Position[Blocks[i]->getNumber()] = i;
+  }
+
+  // append the unreachable blocks in layout order
+  for(MachineFunction::iterator i(MF.begin()), ie(MF.end()); i != ie; i++) {
+    if (Position[i->getNumber()] == ~0u) {
+      Position[i->getNumber()] = Blocks.size();
+      Blocks.push_back(i);
+    }
+  }
+}
+
+void PatmosBlockWorkList::insertAll()
+{
+  for(unsigned int i = 0, ie = Blocks.size(); i != ie; i++) {
+    if (!Queued.test(i)) {
+      Queued.set(i);
+      Queue.push(i);
+    }
+  }
+}
@@ -0,0 +1,167 @@
+//===-- PatmosBlockDataFlow.h - Block-level data-flow support ---*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Work lists and per-block state for data-flow analyses over the basic blocks
+// of a machine function.
+//
+// Blocks are identified by their number, so the state of an analysis is kept
+// in flat vectors instead of maps keyed by pointers. The work list yields
+// blocks in reverse post order of the CFG for forward problems and in post
+// order for backward problems, which reduces the number of iterations and
+// makes the results independent of the memory layout of the blocks. The solve
+// helper drives an analysis over a work list until a fixpoint is reached.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _PATMOS_BLOCKDATAFLOW_H_
+#define _PATMOS_BLOCKDATAFLOW_H_
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/CodeGen/MachineFunction.h"
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace llvm {
+
+  /// PatmosBlockMap - Per-block state of a data-flow analysis, indexed by the
+  /// number of the basic blocks of a machine function. As for a std::map, an
+  /// entry is created with a default value when a block is accessed the first
+  /// time.
+  template<typename T>
+  class PatmosBlockMap {
+  private:
+    /// Values - The value of each block, indexed by block number. This is not
+    /// a std::vector, which does not provide references to bools.
+    SmallVector<T, 32> Values;
+
+    /// Present - Blocks for which an entry has been created.
+    BitVector Present;
+
+  public:
+    /// Construct an empty map for the blocks of the function.
+    explicit PatmosBlockMap(const MachineFunction &MF) :
+        Values(MF.getNumBlockIDs()), Present(MF.getNumBlockIDs())
+    {
+    }
+
+    /// Construct a map with an entry of value Init for every block.
+    PatmosBlockMap(const MachineFunction &MF, const T &Init) :
+        Values(MF.getNumBlockIDs(), Init), Present(MF.getNumBlockIDs(), true)
+    {
+    }
+
+    /// operator[] - Get the value of a block, create an entry if needed.
+    T &operator[](const MachineBasicBlock *MBB)
+    {
+      unsigned int N = MBB->getNumber();
+      Present.set(N);
+      return Values[N];
+    }
+
+    /// lookup - Get the value of a block without creating an entry.
+    T lookup(const MachineBasicBlock *MBB) const
+    {
+      return Values[MBB->getNumber()];
+    }
+
+    /// count - Return 1 if an entry of the block exists, 0 otherwise.
+    unsigned int count(const MachineBasicBlock *MBB) const
+    {
+      return Present.test(MBB->getNumber()) ? 1 : 0;
+    }
+  };
+
+  /// PatmosBlockWorkList - A work list of the basic blocks of a machine
+  /// function. Each block is on the list at most once, blocks are taken from
+  /// the list in reverse post order (forward problems) or post order
+  /// (backward problems). Blocks not reachable from the entry come last.
+  class PatmosBlockWorkList {
+  public:
+    enum Direction { Forward, Backward };
+
+  private:
+    /// Position - The position of each block in the processing order,
+    /// indexed by block number.
+    std::vector<unsigned int> Position;
+
+    /// Blocks - The blocks, indexed by their position.
+    std::vector<MachineBasicBlock*> Blocks;
+
+    /// Queued - Positions of the blocks currently on the work list.
+    BitVector Queued;
+
+    /// Queue - The positions of the queued blocks, smallest first.
+    std::priority_queue<unsigned int, std::vector<unsigned int>,
+                        std::greater<unsigned int> > Queue;
+
+  public:
+    PatmosBlockWorkList(MachineFunction &MF, Direction Dir);
+
+    /// empty - Check whether the work list is empty.
+    bool empty() const { return Queue.empty(); }
+
+    /// insert - Put a block on the work list, unless it is already queued.
+    void insert(MachineBasicBlock *MBB)
+    {
+      unsigned int P = Position[MBB->getNumber()];
+      if (!Queued.test(P)) {
+        Queued.set(P);
+        Queue.push(P);
+      }
+    }
+
+    /// insert - Put a range of blocks on the work list.
+    template<typename IterT>
+    void insert(IterT I, IterT E)
+    {
+      for(; I != E; I++)
+        insert(*I);
+    }
+
+    /// insertAll - Put all blocks of the function on the work list.
+    void insertAll();
+
+    /// pop - Take the next block from the work list.
+    MachineBasicBlock *pop()
+    {
+      unsigned int P = Queue.top();
+      Queue.pop();
+      Queued.reset(P);
+      return Blocks[P];
+    }
+  };
+
+  /// solve - Run a data-flow analysis to its fixpoint. Transfer is called for
+  /// each item taken from the work list WL, until the list becomes empty, and
+  /// puts the items whose input changed back on the list.
+  template<typename WorkListT, typename TransferT>
+  void solve(WorkListT &WL, TransferT Transfer)
+  {
+    while (!WL.empty())
+      Transfer(WL.pop());
+  }
+
+  /// solve - Run an analysis over a plain stack of items, e.g., the nodes of a
+  /// graph that are created on the fly, which are taken from the back.
+  template<typename T, typename TransferT>
+  void solve(std::vector<T> &WL, TransferT Transfer)
+  {
+    while (!WL.empty()) {
+      T Item = WL.back();
+      WL.pop_back();
+      Transfer(Item);
+    }
+  }
+
+} // End llvm namespace
+
+#endif // _PATMOS_BLOCKDATAFLOW_H_
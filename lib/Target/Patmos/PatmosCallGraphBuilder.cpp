@@ -9,14 +9,30 @@
 //
 // Build a module-level call graph at the machine-level.
 //
+// Indirect calls are resolved to concrete call edges if their possible
+// targets are known, either from the callees of imported PML bitcode infos or
+// from a simple field-insensitive points-to analysis of the function pointer
+// on the IR. All other indirect calls are represented by an UNKNOWN node per
+// function type, calling all address-taken functions of that type.
+//
 //===----------------------------------------------------------------------===//
 
 #define DEBUG_TYPE "patmos-call-graph-builder"
 
 #include "PatmosCallGraphBuilder.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/CodeGen/MachineMemOperand.h"
+#include "llvm/ADT/OwningPtr.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -24,7 +40,22 @@
 
 using namespace llvm;
 
-INITIALIZE_PASS(PatmosCallGraphBuilder, "patmos-mcg",
+STATISTIC(ResolvedSites,   "Number of indirect call sites resolved");
+STATISTIC(ResolvedFromPML, "Number of indirect call sites resolved from PML");
+STATISTIC(ResolvedEdges,   "Number of call edges of resolved call sites");
+STATISTIC(UnknownSites,    "Number of call sites with unknown callees");
+
+static cl::opt<bool> DisableCallTargetResolution(
+  "mpatmos-disable-call-target-resolution",
+  cl::init(false),
+  cl::desc("Do not resolve the targets of indirect calls in the machine-level "
+           "call graph."),
+  cl::Hidden);
+
+INITIALIZE_PASS_BEGIN(PatmosCallGraphBuilder, "patmos-mcg",
+                "Patmos Call Graph Builder", false, true)
+INITIALIZE_PASS_DEPENDENCY(PMLImport)
+INITIALIZE_PASS_END(PatmosCallGraphBuilder, "patmos-mcg",
                 "Patmos Call Graph Builder", false, true)
 
 namespace llvm {
@@ -45,6 +76,18 @@ namespace llvm {
     return NULL;
   }
 
+  MCGSites MCGNode::findSites(const MachineInstr *MI) const
+  {
+    MCGSites result;
+    for(MCGSites::const_iterator i(Sites.begin()), ie(Sites.end()); i != ie;
+        i++) {
+      if ((*i)->getMI() == MI)
+        result.push_back(*i);
+    }
+
+    return result;
+  }
+
   std::string MCGNode::getLabel() const
   {
     std::string tmps;
@@ -401,6 +444,214 @@ namespace llvm {
 
   //----------------------------------------------------------------------------
 
+  /// A set of possible call targets, in a deterministic order.
+  typedef SmallSetVector<const Function*, 8> CallTargets;
+
+  typedef SmallPtrSet<const Value*, 16> VisitedValues;
+
+  static bool collectCallTargets(const Value *V, CallTargets &Targets,
+                                 VisitedValues &Visited);
+
+  /// collectConstantTargets - Collect all functions referenced by a constant
+  /// initializer.
+  static void collectConstantTargets(const Constant *C, CallTargets &Targets)
+  {
+    C = cast<Constant>(C->stripPointerCasts());
+
+    if (const Function *F = dyn_cast<Function>(C)) {
+      Targets.insert(F);
+    }
+    else if (isa<ConstantArray>(C) || isa<ConstantStruct>(C) ||
+             isa<ConstantVector>(C)) {
+      for(unsigned i = 0, e = C->getNumOperands(); i != e; i++) {
+        collectConstantTargets(cast<Constant>(C->getOperand(i)), Targets);
+      }
+    }
+  }
+
+  /// collectStoredTargets - Collect all functions stored through the pointer
+  /// Ptr, which is derived from a global variable. Returns false if the
+  /// address escapes.
+  static bool collectStoredTargets(const Value *Ptr, CallTargets &Targets,
+                                   VisitedValues &Visited)
+  {
+    for(Value::const_use_iterator i(Ptr->use_begin()), ie(Ptr->use_end());
+        i != ie; i++) {
+      const User *U = *i;
+
+      if (isa<LoadInst>(U))
+        continue;
+
+      if (const StoreInst *SI = dyn_cast<StoreInst>(U)) {
+        // the address itself is stored somewhere
+        if (SI->getValueOperand() == Ptr)
+          return false;
+        if (!collectCallTargets(SI->getValueOperand(), Targets, Visited))
+          return false;
+        continue;
+      }
+
+      const Operator *Op = dyn_cast<Operator>(U);
+      if (Op && (Op->getOpcode() == Instruction::GetElementPtr ||
+                 Op->getOpcode() == Instruction::BitCast)) {
+        if (!collectStoredTargets(U, Targets, Visited))
+          return false;
+        continue;
+      }
+
+      return false;
+    }
+
+    return true;
+  }
+
+  /// collectLoadedTargets - Collect all functions that might be loaded from
+  /// the object Obj, without distinguishing between fields.
+  static bool collectLoadedTargets(const Value *Obj, CallTargets &Targets,
+                                   VisitedValues &Visited)
+  {
+    const GlobalVariable *GV = dyn_cast<GlobalVariable>(Obj);
+    if (!GV || !GV->hasDefinitiveInitializer())
+      return false;
+
+    if (!Visited.insert(GV))
+      return true;
+
+    collectConstantTargets(GV->getInitializer(), Targets);
+
+    if (GV->isConstant())
+      return true;
+
+    // all stores to the variable must be visible
+    if (!GV->hasLocalLinkage())
+      return false;
+
+    return collectStoredTargets(GV, Targets, Visited);
+  }
+
+  /// collectCallTargets - Collect all functions the function pointer V might
+  /// point to. Returns false if V might point to an unknown function.
+  static bool collectCallTargets(const Value *V, CallTargets &Targets,
+                                 VisitedValues &Visited)
+  {
+    V = V->stripPointerCasts();
+
+    if (!Visited.insert(V))
+      return true;
+
+    if (const Function *F = dyn_cast<Function>(V)) {
+      Targets.insert(F);
+      return true;
+    }
+
+    if (isa<ConstantPointerNull>(V) || isa<UndefValue>(V))
+      return true;
+
+    if (const SelectInst *SI = dyn_cast<SelectInst>(V)) {
+      return collectCallTargets(SI->getTrueValue(), Targets, Visited) &&
+             collectCallTargets(SI->getFalseValue(), Targets, Visited);
+    }
+
+    if (const PHINode *PN = dyn_cast<PHINode>(V)) {
+      for(unsigned i = 0, e = PN->getNumIncomingValues(); i != e; i++) {
+        if (!collectCallTargets(PN->getIncomingValue(i), Targets, Visited))
+          return false;
+      }
+      return true;
+    }
+
+    if (const LoadInst *LI = dyn_cast<LoadInst>(V)) {
+      return collectLoadedTargets(GetUnderlyingObject(LI->getPointerOperand()),
+                                  Targets, Visited);
+    }
+
+    if (const Argument *A = dyn_cast<Argument>(V)) {
+      // the argument is only known if all callers are known
+      const Function *F = A->getParent();
+      if (!F->hasLocalLinkage())
+        return false;
+
+      for(Value::const_use_iterator i(F->use_begin()), ie(F->use_end());
+          i != ie; i++) {
+        ImmutableCallSite CS(*i);
+        if (!CS || !CS.isCallee(i) || A->getArgNo() >= CS.arg_size())
+          return false;
+        if (!collectCallTargets(CS.getArgument(A->getArgNo()), Targets,
+                                Visited))
+          return false;
+      }
+      return true;
+    }
+
+    return false;
+  }
+
+  bool PatmosCallGraphBuilder::resolveCallTargets(const Module &M,
+                                                  MachineFunction *MF,
+                                                  const Value *Callee,
+                                                  MCGNodes &Targets)
+  {
+    MachineModuleInfo &MMI(getAnalysis<MachineModuleInfo>());
+    const Function *Caller = MF->getFunction();
+
+    CallTargets Functions;
+    bool Resolved = false;
+
+    // use the callees of imported PML infos first
+    PMLImport &PI(getAnalysis<PMLImport>());
+    OwningPtr<PMLBitcodeQuery> PQ(PI.createBitcodeQuery(*this, *Caller,
+                                                        yaml::level_bitcode));
+    if (PQ) {
+      for(Value::const_use_iterator i(Callee->use_begin()),
+          ie(Callee->use_end()); i != ie; i++) {
+        ImmutableCallSite CS(*i);
+        if (!CS || !CS.isCallee(i) ||
+            CS.getInstruction()->getParent()->getParent() != Caller)
+          continue;
+
+        // all call instructions using the pointer need to be known
+        std::vector<StringRef> Names;
+        Resolved = PQ->getCallees(*CS.getInstruction(), Names);
+
+        for(std::vector<StringRef>::iterator j(Names.begin()),
+            je(Names.end()); Resolved && j != je; j++) {
+          if (const Function *F = M.getFunction(*j))
+            Functions.insert(F);
+          else
+            Resolved = false;
+        }
+
+        if (!Resolved)
+          break;
+      }
+
+      if (Resolved)
+        ResolvedFromPML++;
+    }
+
+    // otherwise try to find the targets on the IR
+    if (!Resolved) {
+      VisitedValues Visited;
+      Functions.clear();
+      if (!collectCallTargets(Callee, Functions, Visited))
+        return false;
+    }
+
+    if (Functions.empty())
+      return false;
+
+    // all targets need to be available as machine code
+    for(CallTargets::iterator i(Functions.begin()), ie(Functions.end());
+        i != ie; i++) {
+      MachineFunction *TargetMF = MMI.getMachineFunction(*i);
+      if (!TargetMF)
+        return false;
+      Targets.push_back(MCG.makeMCGNode(TargetMF));
+    }
+
+    return true;
+  }
+
   void PatmosCallGraphBuilder::visitCallSites(const Module &M, MachineFunction *MF)
   {
     // get the machine-level module information.
@@ -437,9 +688,28 @@ namespace llvm {
             T = Callee ? Callee->getType() : NULL;
           }
 
+          // try to resolve the targets of indirect calls
+          MCGNodes Targets;
+          if (!F && j->hasOneMemOperand() && !DisableCallTargetResolution) {
+            const Value *Callee = (*j->memoperands_begin())->getValue();
+            if (Callee && resolveCallTargets(M, MF, Callee, Targets)) {
+              // construct a call site for each possible target
+              for(MCGNodes::iterator k(Targets.begin()), ke(Targets.end());
+                  k != ke; k++) {
+                MCG.makeMCGSite(MCGN, j, *k);
+              }
+              ResolvedSites++;
+              ResolvedEdges += Targets.size();
+              continue;
+            }
+          }
+
           // does a MachineFunction exist for F?
           MachineFunction *MF = F ? MMI.getMachineFunction(F) : NULL;
 
+          if (!MF)
+            UnknownSites++;
+
           // construct a new call site
           MCG.makeMCGSite(MCGN, j,
                           MF ? MCG.makeMCGNode(MF) : MCG.getUnknownNode(T));
@@ -24,6 +24,8 @@
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
 #include "llvm/CodeGen/MachineModulePass.h"
+#include "llvm/CodeGen/PMLImport.h"
+#include "llvm/InitializePasses.h"
 #include "llvm/Support/DOTGraphTraits.h"
 #include "llvm/Support/GraphWriter.h"
 
@@ -141,6 +143,10 @@ namespace llvm {
     /// findSite - Find the call site of the given MachineInstr.
     MCGSite *findSite(const MachineInstr *MI) const;
 
+    /// findSites - Find all call sites of the given MachineInstr. Indirect
+    /// calls with resolved targets have one call site per target.
+    MCGSites findSites(const MachineInstr *MI) const;
+
     /// getLabel - get a string representation of the call graph node.
     std::string getLabel() const;
 
@@ -355,11 +361,19 @@ namespace llvm {
 
     /// markLive - Mark the node and all its callees as live.
     void markLive(MCGNode *N);
+
+    /// resolveCallTargets - Find the call graph nodes of all functions
+    /// possibly called through the function pointer Callee in MF, either from
+    /// the callees of imported PML infos or from the IR. Returns false if the
+    /// targets are not known.
+    bool resolveCallTargets(const Module &M, MachineFunction *MF,
+                            const Value *Callee, MCGNodes &Targets);
   public:
     /// Pass ID
     static char ID;
 
     PatmosCallGraphBuilder() : MachineModulePass(ID) {
+      initializePMLImportPass(*PassRegistry::getPassRegistry());
     }
 
     /// getAnalysisUsage - Inform the pass manager that nothing is modified
@@ -367,6 +381,7 @@ namespace llvm {
     virtual void getAnalysisUsage(AnalysisUsage &AU) const {
       AU.setPreservesAll();
       AU.addRequired<MachineModuleInfo>();
+      AU.addRequired<PMLImport>();
 
       ModulePass::getAnalysisUsage(AU);
     }
@@ -424,14 +439,7 @@ namespace llvm {
       const MachineFunction *MF = MI->getParent()->getParent();
       MCGNode *N = getNode(MF);
 
-      MCGSites result;
-      for(MCGSites::const_iterator i(N->getSites().begin()),
-          ie(N->getSites().end()); i != ie; i++) {
-        if ((*i)->getMI() == MI)
-          result.push_back(*i);
-      }
-
-      return result;
+      return N->findSites(MI);
     }
 
     /// runOnModule - Construct a simple machine-level call graph from the given
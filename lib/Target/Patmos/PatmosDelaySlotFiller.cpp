@@ -12,16 +12,26 @@
 // instructions. If no instructions can be moved into the delay slot, then a
 // NOP is inserted.
 //
-// At the current state, only instructions from the local basic are considered
-// (not the targets of branches).
+// Instructions are first taken from the local basic block. Remaining delay
+// slots of direct branches are then filled with the first instructions of the
+// branch successors, starting with the more likely successor according to the
+// edge weights in MachineBranchProbabilityInfo (which reflect the imported
+// profile, if any). Instructions are only moved out of successors that have
+// the branch block as single predecessor. For conditional branches the moved
+// instructions are guarded with the (negated) branch predicate, so that they
+// are only executed on the path they were taken from.
 //
 // As a post-processing step, NOPs are inserted after loads again, where
 // necessary.
 //
-// FIXME: This pass must check for bundles. It may skip moving bundles around,
-//        but it must calculate the latencies correctly and insert NOPs
-//        correctly.
-//        This will become a fall-back pass to fill up any hazards and delay
+// Single-path functions are skipped, their delay slots are already filled and
+// their hazards resolved by the SPScheduler.
+//
+// Bundles are treated as a unit: a bundle is only moved into a delay slot as
+// a whole, and hazards and register dependencies are checked for all
+// instructions of the bundle.
+//
+// FIXME: This will become a fall-back pass to fill up any hazards and delay
 //        slots with NOPs in case scheduling has been disabled. If scheduling
 //        is enabled, it must be assumed that delay slots are already filled,
 //        but the pass should still check and insert NOPs for hazards as
@@ -35,7 +45,9 @@
 #define DEBUG_TYPE "delay-slot-filler"
 #include "Patmos.h"
 #include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
 #include "PatmosTargetMachine.h"
+#include "llvm/CodeGen/MachineBranchProbabilityInfo.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/Target/TargetMachine.h"
@@ -62,6 +74,7 @@ using namespace llvm;
 
 STATISTIC( FilledSlots, "Number of delay slots filled");
 STATISTIC( FilledNOPs,  "Number of delay slots filled with NOPs");
+STATISTIC( RemovedNOPs, "Number of NOPs avoided by filling from successors");
 
 STATISTIC( SkippedLoadNOPs, "Number of loads not requiring a NOP");
 STATISTIC( InsertedLoadNOPs, "Number of NOPs inserted after loads");
@@ -76,6 +89,13 @@ static cl::opt<bool> DisableDelaySlotFiller(
   cl::desc("Disable the Patmos delay slot filler."),
   cl::Hidden);
 
+static cl::opt<bool> DisableSuccessorFill(
+  "mpatmos-disable-delay-filler-succ",
+  cl::init(false),
+  cl::desc("Do not fill delay slots of branches with instructions from the "
+           "branch successors."),
+  cl::Hidden);
+
 namespace {
 
   class DelayHazardInfo;
@@ -92,21 +112,38 @@ namespace {
     const PatmosTargetMachine &TM;
     const PatmosInstrInfo *TII;
     const TargetRegisterInfo *TRI;
+    const MachineBranchProbabilityInfo *MBPI;
 
     PatmosDelaySlotFiller(const PatmosTargetMachine &tm, bool disable)
       : MachineFunctionPass(ID), ForceDisableFiller(disable), TM(tm),
         TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())),
-        TRI(tm.getRegisterInfo()) { }
+        TRI(tm.getRegisterInfo()), MBPI(0) { }
 
     virtual const char *getPassName() const {
       return "Patmos Delay Slot Filler";
     }
 
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<MachineBranchProbabilityInfo>();
+      AU.setPreservesCFG();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
     bool runOnMachineFunction(MachineFunction &F) {
       bool Changed = false;
       DEBUG( dbgs() << "\n[DelaySlotFiller] "
                     << F.getFunction()->getName() << "\n" );
 
+      // SPScheduler places its fillers after the control-flow instructions
+      // of single-path code, inserting NOPs would push them out of the
+      // delay slots.
+      if (F.getInfo<PatmosMachineFunctionInfo>()->isSinglePath()) {
+        DEBUG( dbgs() << "Skipping single-path function\n" );
+        return false;
+      }
+
+      MBPI = &getAnalysis<MachineBranchProbabilityInfo>();
+
       // FIXME: check if Post-RA scheduler is enabled (by option or Subtarget),
       //        skip this loop (delay slot filling) in this case.
       for (MachineFunction::iterator FI = F.begin(), FE = F.end();
@@ -151,6 +188,25 @@ namespace {
                     const MachineBasicBlock::iterator I,
                     SmallSet<MachineInstr*, 16> &FillerInstrs);
 
+    /// fillFromSuccessors - Collect up to NumSlots instructions from the
+    /// successors of the branch I to fill its remaining delay slots.
+    /// \param Prev  The instruction executed right before the first filler.
+    void fillFromSuccessors(MachineBasicBlock &MBB,
+                            const MachineBasicBlock::iterator I,
+                            unsigned NumSlots, MachineInstr *Prev,
+                            SmallVectorImpl<MachineInstr*> &Fillers);
+
+    /// collectSuccFillers - Collect up to NumSlots instructions from the top
+    /// of Succ that can be moved into the delay slots of branch I. If Pred is
+    /// not empty, the instructions are predicated with Pred when moved.
+    /// Returns the last collected instruction, or Prev if none was found.
+    MachineInstr *collectSuccFillers(MachineBasicBlock &MBB,
+                            const MachineBasicBlock::iterator I,
+                            MachineBasicBlock *Succ, unsigned NumSlots,
+                            const SmallVectorImpl<MachineOperand> &Pred,
+                            MachineInstr *Prev,
+                            SmallVectorImpl<MachineInstr*> &Fillers);
+
     /// insertNOPAfter - Insert a nop after an instruction I, or split the
     /// bundle I.
     void insertNOPAfter(MachineBasicBlock &MBB,
@@ -254,6 +310,9 @@ fillSlotForCtrlFlow(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I,
 
   unsigned CFLDelaySlots = TM.getSubtargetImpl()->getDelaySlotCycles(I);
 
+  // only the last branch of a block can take fillers from its successors
+  bool IsLastBranch = I->isBranch() && llvm::next(I) == MBB.end();
+
   if (!DisableDelaySlotFiller && !ForceDisableFiller) {
 
     // initialize sets
@@ -289,9 +348,27 @@ fillSlotForCtrlFlow(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I,
     }
   }
 
+  // fill the remaining slots from the successors of the branch; the fillers
+  // are executed after the candidates from the local block.
+  SmallVector<MachineInstr*, 4> SuccFillers;
+  if (!DisableDelaySlotFiller && !ForceDisableFiller && !DisableSuccessorFill &&
+      IsLastBranch && DI.getNumCandidates() < CFLDelaySlots) {
+    MachineInstr *Prev = DI.getNumCandidates() ? DI.getCandidate(0) : 0;
+    fillFromSuccessors(MBB, I, CFLDelaySlots - DI.getNumCandidates(), Prev,
+                       SuccFillers);
+  }
+  for (unsigned i = SuccFillers.size(); i > 0; i--) {
+    MachineInstr *FillMI = SuccFillers[i-1];
+    MBB.splice(llvm::next(I), FillMI->getParent(), FillMI);
+    FillerInstrs.insert(FillMI);
+    ++FilledSlots;  // update statistics
+    ++RemovedNOPs;
+    DEBUG( dbgs() << " -- filler (succ): " << *FillMI );
+  }
+
   // move instructions / insert NOPs
   MachineBasicBlock::iterator NI = llvm::next(I);
-  for (unsigned i=0; i<CFLDelaySlots; i++) {
+  for (unsigned i=0; i<CFLDelaySlots - SuccFillers.size(); i++) {
     if (i < DI.getNumCandidates()) {
       MachineInstr *FillMI = DI.getCandidate(i);
       MBB.splice(llvm::next(I), &MBB, FillMI);
@@ -309,6 +386,125 @@ fillSlotForCtrlFlow(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I,
 
 }
 
+void PatmosDelaySlotFiller::
+fillFromSuccessors(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I,
+                   unsigned NumSlots, MachineInstr *Prev,
+                   SmallVectorImpl<MachineInstr*> &Fillers) {
+  // only direct branches, fillers must be placed before the branch splitter
+  // creates BRCFs
+  if (I->getOpcode() != Patmos::BR && I->getOpcode() != Patmos::BRu)
+    return;
+
+  MachineBasicBlock *TBB = TII->getBranchTarget(I);
+
+  SmallVector<MachineOperand, 2> Pred;
+  if (!TII->getPredicateOperands(I, Pred)) {
+    // unconditional branch, the fillers are executed unconditionally
+    collectSuccFillers(MBB, I, TBB, NumSlots, Pred, Prev, Fillers);
+    return;
+  }
+
+  // conditional branch, find the fall-through successor
+  MachineFunction::iterator NextMBB = &MBB; ++NextMBB;
+  if (NextMBB == MBB.getParent()->end())
+    return;
+  MachineBasicBlock *FBB = NextMBB;
+  if (FBB == TBB || !MBB.isSuccessor(FBB) || MBB.succ_size() != 2)
+    return;
+
+  SmallVector<MachineOperand, 2> NegPred(Pred.begin(), Pred.end());
+  NegPred[1].setImm(!NegPred[1].getImm());
+
+  // take the fillers from the more likely successor first
+  bool PreferFall = MBPI->getEdgeWeight(&MBB, FBB) >
+                    MBPI->getEdgeWeight(&MBB, TBB);
+  MachineBasicBlock *First  = PreferFall ? FBB : TBB;
+  MachineBasicBlock *Second = PreferFall ? TBB : FBB;
+
+  Prev = collectSuccFillers(MBB, I, First, NumSlots,
+                            PreferFall ? NegPred : Pred, Prev, Fillers);
+  if (Fillers.size() < NumSlots)
+    collectSuccFillers(MBB, I, Second, NumSlots - Fillers.size(),
+                       PreferFall ? Pred : NegPred, Prev, Fillers);
+
+  // the fillers read the branch predicate after the branch, which thus does
+  // not kill it anymore.
+  if (!Fillers.empty()) {
+    for (MachineInstr::mop_iterator MO = I->operands_begin(),
+         ME = I->operands_end(); MO != ME; ++MO) {
+      if (MO->isReg() && MO->isUse() && MO->getReg() == Pred[0].getReg())
+        MO->setIsKill(false);
+    }
+  }
+}
+
+MachineInstr *PatmosDelaySlotFiller::
+collectSuccFillers(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I,
+                   MachineBasicBlock *Succ, unsigned NumSlots,
+                   const SmallVectorImpl<MachineOperand> &Pred,
+                   MachineInstr *Prev,
+                   SmallVectorImpl<MachineInstr*> &Fillers) {
+  // the instructions are moved, not copied, so the branch must be the only
+  // way into the successor
+  if (Succ == &MBB || Succ->pred_size() != 1 || Succ->isLandingPad() ||
+      Succ->hasAddressTaken())
+    return Prev;
+
+  DEBUG_TRACE( dbgs() << " -- inspect successor BB#" << Succ->getNumber()
+                      << "\n" );
+
+  // the successor has not been entered yet when the fillers are executed,
+  // check the fillers as if they were moved out of the local block.
+  DelayHazardInfo DI(*this, *I);
+
+  unsigned Found = 0;
+  for (MachineBasicBlock::iterator J = Succ->begin(), JE = Succ->end();
+       J != JE && Found < NumSlots; ++J) {
+    if (J->isDebugValue()) continue;
+
+    if (J->isBundle() || TII->isPseudo(J) || J->hasDelaySlot() ||
+        J->isTerminator() || J->isCall() || J->isInlineAsm() ||
+        J->isLabel())
+      break;
+
+    // a loaded value must not be used in the next cycle
+    if (Prev && Prev->mayLoad() && hasDefUseDep(Prev, J))
+      break;
+
+    if (DI.hasHazard(*Succ, J))
+      break;
+
+    if (!Pred.empty()) {
+      // the filler is executed speculatively, guard it with the predicate
+      // of the path it has been taken from.
+      if (!J->isPredicable() || TII->isPredicated(J) ||
+          J->modifiesRegister(Pred[0].getReg(), TRI))
+        break;
+    }
+
+    Fillers.push_back(J);
+    DI.appendCandidate(J);
+    Prev = J;
+    Found++;
+  }
+
+  // the fillers are moved by the caller, fix up predicates and live-ins
+  for (unsigned i = Fillers.size() - Found; i < Fillers.size(); i++) {
+    MachineInstr *FillMI = Fillers[i];
+    if (!Pred.empty())
+      TII->PredicateInstruction(FillMI, Pred);
+
+    for (MachineInstr::mop_iterator MO = FillMI->operands_begin(),
+         ME = FillMI->operands_end(); MO != ME; ++MO) {
+      if (MO->isReg() && MO->isDef() && MO->getReg() &&
+          !Succ->isLiveIn(MO->getReg()))
+        Succ->addLiveIn(MO->getReg());
+    }
+  }
+
+  return Prev;
+}
+
 void PatmosDelaySlotFiller::insertNOPAfter(MachineBasicBlock &MBB,
                     const MachineBasicBlock::iterator I)
 {
@@ -437,6 +633,18 @@ insertAfterMul(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I) {
 
 void DelayHazardInfo::insertDefsUses(MachineInstr *MI) {
 
+  // The operands of a bundle header do not contain the explicit operands of
+  // calls and returns inside the bundle, examine the bundled instructions.
+  if (MI->isBundle()) {
+    MachineBasicBlock::instr_iterator II = MI; ++II;
+    MachineBasicBlock::instr_iterator IE = MI->getParent()->instr_end();
+
+    for (; II != IE && II->isInsideBundle(); ++II) {
+      insertDefsUses(II);
+    }
+    return;
+  }
+
   // If MI is a call or return, just examine the explicit non-variadic operands.
   const MCInstrDesc& MCID = MI->getDesc();
   unsigned e = (MI->isCall() || MI->isReturn(MachineInstr::AllInBundle))
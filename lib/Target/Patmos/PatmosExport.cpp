@@ -19,6 +19,7 @@
 #include "PatmosMachineFunctionInfo.h"
 #include "PatmosStackCacheAnalysis.h"
 #include "PatmosTargetMachine.h"
+#include "PatmosThreadPool.h"
 #include "InstPrinter/PatmosInstPrinter.h"
 #include "llvm/IR/Function.h"
 #include "llvm/CodeGen/Analysis.h"
@@ -47,6 +48,15 @@ static cl::opt<bool> LongSerialize (
   cl::desc("Export more detailed descriptions."),
   cl::Hidden);
 
+/// SerializeThreads - Option to write the shards of a sharded PML export
+/// concurrently.
+static cl::opt<unsigned int> SerializeThreads(
+  "mpatmos-serialize-threads",
+  cl::init(1),
+  cl::desc("Number of threads writing the shards of a sharded PML export (0: "
+           "number of hardware threads, default: 1)."),
+  cl::Hidden);
+
 
 namespace llvm {
 
@@ -105,19 +115,21 @@ namespace llvm {
       }
       else if (MCG) {
         MCGNode *node = MCG->makeMCGNode(&Caller);
-        MCGSite *site = node->findSite(Instr);
+        MCGSites sites = node->findSites(Instr);
 
-        if (site && site->getCallee()) {
-          MCGNode *Callee = site->getCallee();
-          MFList Callees;
-          addCallees(Callee, Callees);
-          for (MFList::iterator it = Callees.begin(), ie = Callees.end();
-               it != ie; it++)
-          {
-            const Function *F = (*it)->getFunction();
-            if (!F) continue;
-            CalleeNames.push_back(F->getName());
-          }
+        // resolved indirect calls have one site per callee
+        MFList Callees;
+        for (MCGSites::iterator si = sites.begin(), se = sites.end();
+             si != se; si++)
+        {
+          addCallees((*si)->getCallee(), Callees);
+        }
+        for (MFList::iterator it = Callees.begin(), ie = Callees.end();
+             it != ie; it++)
+        {
+          const Function *F = (*it)->getFunction();
+          if (!F) continue;
+          CalleeNames.push_back(F->getName());
         }
       }
 
@@ -129,9 +141,13 @@ namespace llvm {
     {
       if (MCG) {
         MCGNode *node = MCG->makeMCGNode(&MF);
-        MCGSite *site = node->findSite(Instr);
+        MCGSites sites = node->findSites(Instr);
         MFList Callees;
-        addCallees(site->getCallee(), Callees);
+        for (MCGSites::iterator si = sites.begin(), se = sites.end();
+             si != se; si++)
+        {
+          addCallees((*si)->getCallee(), Callees);
+        }
         return Callees;
       }
       return PMLInstrInfo::getCallees(M, MMI, MF, Instr);
@@ -280,6 +296,18 @@ namespace llvm {
       }
 
 
+    virtual void serialize(MachineFunction &MF);
+
+    /// exportPreemptionCosts - Export the stack cache costs of preemptions
+    /// computed by the stack cache analysis.
+    void exportPreemptionCosts(MachineFunction &MF);
+
+    /// exportPreemptionCost - Add the costs of a preemption at a program
+    /// point, which is owned by the PML document afterwards.
+    void exportPreemptionCost(
+                        const PatmosStackCacheAnalysisInfo::PreemptionCost &Cost,
+                        yaml::ProgramPoint *Reference);
+
     virtual bool doExportInstruction(const MachineInstr *Ins) {
       return true;
     }
@@ -315,6 +343,20 @@ namespace llvm {
   class PatmosModuleExportPass : public PMLModuleExportPass {
     static char ID;
 
+    /// Write a shard of a sharded export.
+    class WriteShardTask : public PatmosParallelTask
+    {
+    private:
+      PatmosModuleExportPass &PEP;
+    public:
+      WriteShardTask(PatmosModuleExportPass &pep) : PEP(pep) {}
+
+      virtual void run(unsigned int Index)
+      {
+        PEP.writeShard(Index);
+      }
+    };
+
   public:
     PatmosModuleExportPass(PatmosTargetMachine &tm, StringRef filename,
                            ArrayRef<std::string> roots, bool SerializeAll)
@@ -345,6 +387,13 @@ namespace llvm {
       getPatmosInstrInfo()->setCallGraph( PCGB.getCallGraph() );
       return PMLModuleExportPass::runOnMachineModule(M);
     }
+
+  protected:
+    virtual void writeShards() {
+      PatmosThreadPool Pool(SerializeThreads);
+      WriteShardTask Task(*this);
+      Pool.run(Task, getNumShards());
+    }
   };
 
   char PatmosModuleExportPass::ID = 0;
@@ -581,6 +630,83 @@ namespace llvm {
     }
 
 
+    void PatmosMachineExport::serialize(MachineFunction &MF)
+    {
+      PMLMachineExport::serialize(MF);
+
+      exportPreemptionCosts(MF);
+
+      // Export the execution time of single-path functions, if it is exact.
+      const PatmosMachineFunctionInfo *PMFI =
+                                        MF.getInfo<PatmosMachineFunctionInfo>();
+      if (!PMFI->isSinglePath() || PMFI->getSinglePathCycles() < 0) return;
+
+      yaml::Timing *T = new yaml::Timing(yaml::level_machinecode);
+      T->Origin = "llvm.sp";
+      T->ScopeRef = new yaml::Scope(yaml::Name(MF.getFunctionNumber()));
+      T->Cycles = PMFI->getSinglePathCycles();
+      getPMLDoc().Timings.push_back(T);
+    }
+
+    void PatmosMachineExport::exportPreemptionCosts(MachineFunction &MF)
+    {
+      PatmosStackCacheAnalysisInfo *SCA =
+       &P.getAnalysis<PatmosStackCacheAnalysisInfo>();
+      if (!SCA->isValid()) return;
+
+      // Export the worst-case stack cache costs of a preemption at the
+      // beginning of each basic block and right before each call (if computed
+      // by the analysis)
+      for (MachineFunction::iterator bb = MF.begin(), be = MF.end(); bb != be;
+           bb++)
+      {
+        PatmosStackCacheAnalysisInfo::PreemptionCosts::iterator it =
+          SCA->Preemptions.find(bb);
+        if (it == SCA->Preemptions.end()) continue;
+
+        exportPreemptionCost(it->second,
+                             yaml::ProgramPoint::CreateBlock(
+                                            yaml::Name(MF.getFunctionNumber()),
+                                            yaml::Name(bb->getNumber())));
+
+        // number the instructions as the machine code export does
+        unsigned Index = 0;
+        for (MachineBasicBlock::instr_iterator Ins = bb->instr_begin(),
+             E = bb->instr_end(); Ins != E; ++Ins)
+        {
+          if (Ins->isBundle() || (Ins->isPseudo() && !Ins->isInlineAsm()))
+            continue;
+
+          PatmosStackCacheAnalysisInfo::CallPreemptionCosts::iterator ci =
+            SCA->CallPreemptions.find(Ins);
+          if (ci != SCA->CallPreemptions.end()) {
+            exportPreemptionCost(ci->second,
+                                 yaml::ProgramPoint::CreateInstruction(
+                                            yaml::Name(MF.getFunctionNumber()),
+                                            yaml::Name(bb->getNumber()),
+                                            yaml::Name(Index)));
+          }
+          Index++;
+        }
+      }
+    }
+
+    void PatmosMachineExport::exportPreemptionCost(
+                        const PatmosStackCacheAnalysisInfo::PreemptionCost &Cost,
+                        yaml::ProgramPoint *Reference)
+    {
+      yaml::PreemptionCost *PC = new yaml::PreemptionCost();
+      PC->setReference(Reference);
+      PC->Origin = "llvm.sca";
+      PC->Saving = Cost.Saving;
+      PC->Restoring = Cost.getTotalRestoring();
+      PC->RestoringExplicit = Cost.Restoring;
+      PC->LocalEnsure = Cost.LocalEnsure;
+      PC->GlobalEnsure = Cost.GlobalEnsure;
+      PC->ReserveGain = Cost.ReserveGain;
+      getPMLDoc().PreemptionCosts.push_back(PC);
+    }
+
     void PatmosMachineExport::exportSubfunctions(MachineFunction &MF,
                                                  yaml::MachineFunction *PMF)
     {
@@ -613,8 +739,8 @@ namespace llvm {
       // TODO this is copied from PatmosSinglePathInfo.cpp
       MachineBasicBlock *Header = Loop->getHeader();
       int LoopBound = -1;
-      for (MachineBasicBlock::iterator MI = Header->begin(), ME = Header->end();
-          MI != ME; ++MI) {
+      for (MachineBasicBlock::instr_iterator MI = Header->instr_begin(),
+          ME = Header->instr_end(); MI != ME; ++MI) {
         if (MI->getOpcode() == Patmos::PSEUDO_LOOPBOUND) {
           // max is the second operand (idx 1)
           LoopBound = MI->getOperand(1).getImm() + 1;
@@ -44,9 +44,16 @@
 //       region at all successors of the header.
 //
 // Jump tables require some special handling, since either all targets of the
-// table either have to be region entries or have to be in the same region as 
+// table either have to be region entries or have to be in the same region as
 // all indirect branches using that table.
-// 
+//
+// With -mpatmos-function-splitter-profile, the WCET profile imported by
+// PatmosPMLProfileImport guides the region formation: ready blocks are visited
+// by decreasing criticality, cold blocks (criticality below
+// -mpatmos-cold-block-criticality or never executed on the worst-case path)
+// start separate regions instead of extending hot ones, and hot blocks may
+// grow a region up to the maximum subfunction size.
+//
 //===----------------------------------------------------------------------===//
 
 #define DEBUG_TYPE "patmos-function-splitter"
@@ -95,6 +102,7 @@
 #include "llvm/Support/Timer.h"
 #include "llvm/Target/TargetLoweringObjectFile.h"
 
+#include <deque>
 #include <map>
 #include <sstream>
 #include <iostream>
@@ -134,6 +142,29 @@ static cl::opt<int> MaxSubfunctionSize(
     cl::desc("Maximum size of subfunctions after function splitting, defaults "
              "to the method cache size if set to 0. (default: 1024)"));
 
+static cl::opt<bool> EnableProfileRegions(
+    "mpatmos-function-splitter-profile",
+    cl::init(false),
+    cl::desc("Form regions guided by the WCET criticalities and frequencies "
+             "imported from PML, keeping hot paths in one subfunction and "
+             "cold blocks in separate subfunctions."),
+    cl::Hidden);
+
+static cl::opt<double> ColdBlockCriticality(
+    "mpatmos-cold-block-criticality",
+    cl::init(0.1),
+    cl::desc("Blocks with a lower WCET criticality are not added to hot "
+             "regions by profile-guided splitting. (default: 0.1)"),
+    cl::Hidden);
+
+static cl::opt<double> HotBlockCriticality(
+    "mpatmos-hot-block-criticality",
+    cl::init(0.9),
+    cl::desc("Blocks with at least this WCET criticality may grow regions "
+             "up to mpatmos-max-subfunction-size by profile-guided "
+             "splitting. (default: 0.9)"),
+    cl::Hidden);
+
 static cl::opt<bool> SplitCallBlocks(
     "mpatmos-split-call-blocks",
     cl::init(true),
@@ -171,6 +202,8 @@ namespace llvm {
   STATISTIC(NOPsInserted, "NOPs inserted by function splitter");
   STATISTIC(PostDomsFound, "Post dominators checked");
   STATISTIC(PostDomsAdded, "Post dominators added by increasing region size");
+  STATISTIC(ColdBlocksSplit, "Cold blocks kept out of hot regions");
+  STATISTIC(HotBlocksAdded, "Hot blocks added by increasing region size");
 
   class ablock;
   class agraph;
@@ -308,24 +341,28 @@ namespace llvm {
     }
   };
 
-  /// aedge - an edge in a transformed copy of the CFG.
+  /// aedge - an edge in a transformed copy of the CFG, blocks are referred to
+  /// by their ID.
   class aedge
   {
   public:
     /// The edge's source.
-    ablock * Src;
+    unsigned Src;
 
     /// The edge's destination.
-    ablock * Dst;
+    unsigned Dst;
+
+    /// Flag indicating whether the edge was removed by transformSCCs.
+    /// \see transformSCCs
+    bool IsBackEdge;
 
     /// Create an edge.
-    aedge(ablock *src, ablock *dst) : Src(src), Dst(dst)
+    aedge(unsigned src, unsigned dst) : Src(src), Dst(dst), IsBackEdge(false)
     {
     }
 
-    bool operator<(const aedge &b) {
-      return Src->ID < b.Src->ID ||
-            (Src->ID == b.Src->ID && Dst->ID < b.Dst->ID);
+    bool operator<(const aedge &b) const {
+      return Src < b.Src || (Src == b.Src && Dst < b.Dst);
     }
   };
 
@@ -336,9 +373,10 @@ namespace llvm {
     }
   };
 
-  typedef std::multimap<ablock*, aedge*, CompareBlock> aedges;
+  typedef std::vector<aedge> aedges;
   typedef std::set<ablock*, CompareBlock> ablock_set;
-  typedef std::vector<aedge*> aedge_vector;
+  /// A list of edges, given by their index in agraph::Edges.
+  typedef std::vector<unsigned> aedge_vector;
 
   typedef struct {
     ablock *block;
@@ -360,14 +398,26 @@ namespace llvm {
   class agraph
   {
   public:
-    /// The graph's blocks
+    /// The graph's blocks, indexed by their ID.
     ablocks Blocks;
 
-    /// The graph's edges.
+    /// Storage of the graph's blocks, blocks are not moved when new ones are
+    /// added.
+    std::deque<ablock> BlockStorage;
+
+    /// The graph's edges, including back edges removed by transformSCCs.
     aedges Edges;
 
-    /// The graph's back edges.
-    aedges BackEdges;
+    /// Indices of the edges leaving/entering each block, and the offsets of
+    /// each block's range of edges in these arrays. Back edges are not
+    /// included.
+    /// Edges added after buildIndices are not indexed, redirected edges
+    /// remain in the range of their old destination.
+    /// \see buildIndices
+    aedge_vector SuccEdges;
+    aedge_vector PredEdges;
+    std::vector<unsigned> SuccOffsets;
+    std::vector<unsigned> PredOffsets;
 
     /// List of jump tables of this function.
     std::vector<ablocks> Jumptables;
@@ -387,28 +437,36 @@ namespace llvm {
     PMLMCQuery *PML;
     PMLQuery::BlockDoubleMap Criticalities;
 
+    /// WCET profile imported by PatmosPMLProfileImport, NULL unless
+    /// profile-guided region formation is enabled.
+    PatmosAnalysisInfo *Profile;
+
+    /// The maximum WCET criticality of the blocks of the region currently
+    /// being formed.
+    double RegionCriticality;
+
     MachinePostDominatorTree &MPDT;
 
     /// Construct a graph from a machine function.
     agraph(MachineFunction *mf, PatmosTargetMachine &tm, PMLMCQuery *pml,
+           PatmosAnalysisInfo *profile,
            MachinePostDominatorTree &mpdt, unsigned int preferredRegionSize,
            unsigned int preferredSCCSize, unsigned int maxRegionSize)
     : MF(mf), PTM(tm), STC(tm.getSubtarget<PatmosSubtarget>()),
       PII(*tm.getInstrInfo()),
       PreferredRegionSize(preferredRegionSize),
       PreferredSCCSize(preferredSCCSize), MaxRegionSize(maxRegionSize),
-      PML(pml), MPDT(mpdt)
+      PML(pml), Profile(profile), RegionCriticality(-1.0), MPDT(mpdt)
     {
       Blocks.reserve(mf->size());
 
       // create blocks
-      unsigned id = 0;
       std::map<const MachineBasicBlock*, ablock*> MBBtoA;
       ablock *pred = 0;
       for(MachineFunction::iterator i(mf->begin()), ie(mf->end());
           i != ie; i++) {
         // make a block
-        ablock *ab = new ablock(PTM, id++, this, i);
+        ablock *ab = createBlock(i);
 
         // Keep track of fallthough edges
         if (pred && mayFallThrough(PTM, pred->MBB)) {
@@ -418,7 +476,6 @@ namespace llvm {
 
         // store block
         MBBtoA[i] = ab;
-        Blocks.push_back(ab);
       }
 
       // create edges
@@ -434,8 +491,7 @@ namespace llvm {
           ablock *d = MBBtoA[*j];
 
           // make and store the edge
-          aedge *e = new aedge(s, d);
-          Edges.insert(std::make_pair(s, e));
+          Edges.push_back(aedge(s->ID, d->ID));
         }
       }
 
@@ -526,6 +582,7 @@ namespace llvm {
 
           // Redirect all edges to the jump-table entries to a new header
           aedge_vector ingoing;
+          buildIndices();
           findIngoingEdges(entries, ingoing);
 
           ablock *header = createHeader(entries, ingoing);
@@ -584,14 +641,80 @@ namespace llvm {
       return false;
     }
 
+    /// createBlock - Create a new block, for an MBB or an artificial header.
+    ablock *createBlock(MachineBasicBlock *MBB = NULL)
+    {
+      BlockStorage.push_back(ablock(PTM, Blocks.size(), this, MBB));
+      Blocks.push_back(&BlockStorage.back());
+      return Blocks.back();
+    }
+
+    /// buildIndices - Index the successor and predecessor edges of all
+    /// blocks.
+    void buildIndices()
+    {
+      unsigned numBlocks = Blocks.size();
+      unsigned numEdges = Edges.size();
+
+      // count the successors and predecessors of each block
+      SuccOffsets.assign(numBlocks + 1, 0);
+      PredOffsets.assign(numBlocks + 1, 0);
+      for(unsigned e = 0; e != numEdges; e++) {
+        if (Edges[e].IsBackEdge) continue;
+        SuccOffsets[Edges[e].Src + 1]++;
+        PredOffsets[Edges[e].Dst + 1]++;
+      }
+
+      for(unsigned b = 0; b != numBlocks; b++) {
+        SuccOffsets[b + 1] += SuccOffsets[b];
+        PredOffsets[b + 1] += PredOffsets[b];
+      }
+
+      // place the edges in the ranges of their blocks, keeping their order
+      std::vector<unsigned> nextSucc(SuccOffsets.begin(), SuccOffsets.end() - 1);
+      std::vector<unsigned> nextPred(PredOffsets.begin(), PredOffsets.end() - 1);
+      SuccEdges.resize(SuccOffsets.back());
+      PredEdges.resize(PredOffsets.back());
+      for(unsigned e = 0; e != numEdges; e++) {
+        if (Edges[e].IsBackEdge) continue;
+        SuccEdges[nextSucc[Edges[e].Src]++] = e;
+        PredEdges[nextPred[Edges[e].Dst]++] = e;
+      }
+    }
+
+    /// succ_begin/succ_end - Iterate over the indices of the (indexed) edges
+    /// leaving a block.
+    aedge_vector::const_iterator succ_begin(const ablock *block) const {
+      return SuccEdges.begin() + SuccOffsets[block->ID];
+    }
+    aedge_vector::const_iterator succ_end(const ablock *block) const {
+      return SuccEdges.begin() + SuccOffsets[block->ID + 1];
+    }
+
+    /// pred_begin/pred_end - Iterate over the indices of the (indexed) edges
+    /// entering a block.
+    aedge_vector::const_iterator pred_begin(const ablock *block) const {
+      return PredEdges.begin() + PredOffsets[block->ID];
+    }
+    aedge_vector::const_iterator pred_end(const ablock *block) const {
+      return PredEdges.begin() + PredOffsets[block->ID + 1];
+    }
+
+    /// getDst - Return the destination block of an edge.
+    ablock *getDst(unsigned e) const {
+      return Blocks[Edges[e].Dst];
+    }
+
     /// findIngoingEdges - Add all ingoing edges of blocks to entering.
     void findIngoingEdges(const ablock_set &blocks, aedge_vector &entering)
     {
-      for(aedges::iterator j(Edges.begin()), je(Edges.end()); j != je;
-          j++) {
-        ablock *dst = j->second->Dst;
-        if (blocks.count(dst)) {
-          entering.push_back(j->second);
+      for(ablock_set::const_iterator i(blocks.begin()), ie(blocks.end());
+          i != ie; i++) {
+        for(aedge_vector::const_iterator j(pred_begin(*i)), je(pred_end(*i));
+            j != je; j++) {
+          // skip edges that were redirected in the meantime
+          if (Edges[*j].Dst == (*i)->ID && !Edges[*j].IsBackEdge)
+            entering.push_back(*j);
         }
       }
     }
@@ -601,20 +724,18 @@ namespace llvm {
     ablock *createHeader(ablock_set &headers, aedge_vector &entering)
     {
       // create header
-      ablock *header = new ablock(PTM, Blocks.size(), this);
-      Blocks.push_back(header);
+      ablock *header = createBlock();
 
       // redirect edges leading to the headers
       for(aedge_vector::iterator j(entering.begin()), je(entering.end());
           j != je; j++) {
-        (*j)->Dst = header;
+        Edges[*j].Dst = header->ID;
       }
 
       // make edges from the new header to the old ones
       for(ablock_set::iterator j(headers.begin()), je(headers.end());
           j != je; j++) {
-        aedge *e = new aedge(header, *j);
-        Edges.insert(std::make_pair(header, e));
+        Edges.push_back(aedge(header->ID, (*j)->ID));
       }
 
       return header;
@@ -631,16 +752,14 @@ namespace llvm {
           j != je; j++)
       {
         if (last) {
-          aedge *e = new aedge(last, *j);
-          Edges.insert(std::make_pair(last, e));
+          Edges.push_back(aedge(last->ID, (*j)->ID));
         }
         last = *j;
       }
 
       // connect the last block to the header
       if (last) {
-        aedge *e = new aedge(last, header);
-        Edges.insert(std::make_pair(last, e));
+        Edges.push_back(aedge(last->ID, header->ID));
       }
     }
 
@@ -650,9 +769,10 @@ namespace llvm {
     {
       int DFS_index;
       int Low_link;
+      bool On_stack;
 
       /// Default initialization of node infos.
-      tarjan_node_info() : DFS_index(-1), Low_link(-1)
+      tarjan_node_info() : DFS_index(-1), Low_link(-1), On_stack(false)
       {
       }
     };
@@ -685,15 +805,16 @@ namespace llvm {
 
       // push the node on the stack
       nodes.push_back(node);
+      node_infos[node_id].On_stack = true;
 
       // visit successor nodes and check whether the current node is the root of
       // an SCC
-      for(aedges::const_iterator i(Edges.lower_bound(node)),
-          ie(Edges.upper_bound(node)); i != ie; i++) {
+      for(aedge_vector::const_iterator i(succ_begin(node)),
+          ie(succ_end(node)); i != ie; i++) {
         // get destination
-        ablock *dst = i->second->Dst;
+        ablock *dst = getDst(*i);
         unsigned dst_id = dst->ID;
-        assert(i->second->Src == node);
+        assert(Edges[*i].Src == node_id);
 
         // has the successor been visited?
         if (node_infos[dst_id].DFS_index == -1)
@@ -704,7 +825,7 @@ namespace llvm {
           node_infos[node_id].Low_link = std::min(node_infos[node_id].Low_link,
                                                   node_infos[dst_id].Low_link);
         }
-        else if (std::find(nodes.begin(), nodes.end(), dst) != nodes.end())
+        else if (node_infos[dst_id].On_stack)
         {
           // i is on the stack --> update low link
           node_infos[node_id].Low_link = std::min(node_infos[node_id].Low_link,
@@ -726,6 +847,7 @@ namespace llvm {
           scc_result.back().push_back(top);
 
           nodes.pop_back();
+          node_infos[top->ID].On_stack = false;
         } while (top != node);
       }
     }
@@ -778,21 +900,31 @@ namespace llvm {
         changed = false;
 
         // compute SCCs
+        buildIndices();
         scc_vector sccs(scc_tarjan());
 
-        for(scc_vector::iterator i(sccs.begin()), ie(sccs.end()); i != ie;
-            i++) {
-          ablocks &scc = *i;
+        // map the blocks to their SCCs, new headers are not part of any SCC
+        std::vector<unsigned> scc_of(Blocks.size());
+        for(unsigned i = 0; i < sccs.size(); i++) {
+          for(ablocks::iterator j(sccs[i].begin()), je(sccs[i].end()); j != je;
+              j++) {
+            scc_of[(*j)->ID] = i;
+          }
+        }
+
+        // Note: the SCCs are disjoint, redirecting the edges entering one SCC
+        // does thus not affect the (indexed) edges of the others.
+        for(unsigned scc_id = 0; scc_id < sccs.size(); scc_id++) {
+          ablocks &scc = sccs[scc_id];
 
           // skip trivial SCCs
           if (scc.size() == 1) {
             // check for self-edges
             ablock *tmp = *scc.begin();
             bool has_selfedge = false;
-            for(aedges::iterator j(Edges.lower_bound(tmp)),
-                je(Edges.upper_bound(tmp)); j != je && !has_selfedge; j++) {
-              has_selfedge |= (j->second->Src == tmp) &&
-                              (j->second->Dst == tmp);
+            for(aedge_vector::const_iterator j(succ_begin(tmp)),
+                je(succ_end(tmp)); j != je && !has_selfedge; j++) {
+              has_selfedge |= Edges[*j].Dst == tmp->ID;
             }
 
             if (!has_selfedge)
@@ -808,14 +940,13 @@ namespace llvm {
 
           ablock_set headers;
           aedge_vector entering;
-          for(aedges::iterator j(Edges.begin()), je(Edges.end()); j != je;
-              j++) {
-            ablock *src = j->second->Src;
-            ablock *dst = j->second->Dst;
-            if (std::find(scc.begin(), scc.end(), src) == scc.end() &&
-                std::find(scc.begin(), scc.end(), dst) != scc.end()) {
-              headers.insert(dst);
-              entering.push_back(j->second);
+          for(ablocks::iterator j(scc.begin()), je(scc.end()); j != je; j++) {
+            for(aedge_vector::const_iterator k(pred_begin(*j)),
+                ke(pred_end(*j)); k != ke; k++) {
+              if (scc_of[Edges[*k].Src] != scc_id) {
+                headers.insert(*j);
+                entering.push_back(*k);
+              }
             }
           }
 
@@ -851,20 +982,13 @@ namespace llvm {
           // remove all back-edges to any header.
           // the headers are thus no longer part of any SCC, since they only
           // have incoming edges from blocks not in SCCs.
-          for(aedges::iterator j(Edges.begin()), je(Edges.end()); j != je;) {
-            ablock *src = j->second->Src;
-            ablock *dst = j->second->Dst;
-            if (std::find(scc.begin(), scc.end(), src) != scc.end() &&
-                std::find(headers.begin(), headers.end(),
-                          dst) != headers.end())
-            {
-              BackEdges.insert(std::make_pair(j->first, j->second));
-              Edges.erase(j);
-              j = Edges.begin();
-              changed = true;
-            }
-            else {
-              j++;
+          for(ablocks::iterator j(scc.begin()), je(scc.end()); j != je; j++) {
+            for(aedge_vector::const_iterator k(succ_begin(*j)),
+                ke(succ_end(*j)); k != ke; k++) {
+              if (headers.count(getDst(*k))) {
+                Edges[*k].IsBackEdge = true;
+                changed = true;
+              }
             }
           }
 
@@ -924,15 +1048,65 @@ namespace llvm {
     {
       for(aedges::const_iterator i(Edges.begin()), ie(Edges.end()); i != ie;
           i++) {
-        i->second->Dst->NumPreds++;
+        if (!i->IsBackEdge)
+          Blocks[i->Dst]->NumPreds++;
       }
     }
 
+    /// getProfileCriticality - Return the WCET criticality of a block from the
+    /// imported profile, blocks not executed on the worst-case path have a
+    /// criticality of 0. Artificial headers take the maximum criticality of
+    /// their SCC. Returns a negative value if no profile is available.
+    double getProfileCriticality(ablock *block)
+    {
+      if (!Profile)
+        return -1.0;
+
+      if (!block->MBB) {
+        double maxCrit = -1.0;
+        for (ablocks::iterator i = block->SCC.begin(), ie = block->SCC.end();
+             i != ie; i++)
+        {
+          if (!(*i)->MBB) continue;
+          maxCrit = std::max(maxCrit, getProfileCriticality(*i));
+        }
+        return maxCrit;
+      }
+
+      if (Profile->getFrequency(block->MBB) == 0)
+        return 0.0;
+
+      return Profile->getCriticality(block->MBB);
+    }
+
+    /// getProfileCriticality - Return the maximum WCET criticality of some
+    /// blocks, or a negative value if no profile is available.
+    double getProfileCriticality(ablocks &blocks)
+    {
+      double maxCrit = -1.0;
+      for (ablocks::iterator i = blocks.begin(), ie = blocks.end(); i != ie;
+           i++)
+      {
+        maxCrit = std::max(maxCrit, getProfileCriticality(*i));
+      }
+      return maxCrit;
+    }
+
+    /// isCold - Check whether a criticality from the profile denotes cold
+    /// code.
+    static bool isCold(double criticality) {
+      return criticality >= 0.0 && criticality < ColdBlockCriticality;
+    }
+
     void makeReady(ready_set &ready, ablock *block) {
       ready_block rb;
       rb.block = block;
 
-      if (PML && block->MBB) {
+      double profileCrit = getProfileCriticality(block);
+
+      if (profileCrit >= 0.0) {
+        rb.criticality = profileCrit;
+      } else if (PML && block->MBB) {
         rb.criticality = PML->getCriticality(Criticalities, *block->MBB);
       } else if (PML) {
         double maxCrit = 0.0;
@@ -1039,10 +1213,10 @@ namespace llvm {
 
       } else {
         // mark all headers of a non-natural loop or a jump-table as new regions
-        for(aedges::const_iterator i(Edges.lower_bound(block)),
-            ie(Edges.upper_bound(block)); i != ie; i++)
+        for(aedge_vector::const_iterator i(succ_begin(block)),
+            ie(succ_end(block)); i != ie; i++)
         {
-          emitRegion(region, i->second->Dst, ready, regions);
+          emitRegion(region, getDst(*i), ready, regions);
         }
       }
     }
@@ -1070,9 +1244,9 @@ namespace llvm {
         order.push_back(*i);
 
         // make successors of this SCC ready
-        for(aedges::iterator j(Edges.lower_bound(*i)),
-            je(Edges.upper_bound(*i)); j != je; j++) {
-          ablock *dst = j->second->Dst;
+        for(aedge_vector::const_iterator j(succ_begin(*i)),
+            je(succ_end(*i)); j != je; j++) {
+          ablock *dst = getDst(*j);
 
           // skip processed blocks and blocks marked as region header
           if (dst->NumPreds == 0) {
@@ -1167,6 +1341,22 @@ namespace llvm {
         PostDomsFound++;
       }
 
+      // With a WCET profile, keep cold blocks out of hot regions (and vice
+      // versa) and let hot paths grow a region up to the maximum size.
+      bool isHot = false;
+      if (Profile) {
+        double crit = getProfileCriticality(scc);
+        if (isCold(crit) != isCold(RegionCriticality)) {
+          ColdBlocksSplit++;
+          return false;
+        }
+
+        if (crit >= HotBlockCriticality) {
+          maxSize = MaxRegionSize;
+          isHot = true;
+        }
+      }
+
       // Check for size only after we checked for headers to allow large
       // basic blocks.
       if (region_size + scc_size > maxSize) {
@@ -1189,9 +1379,13 @@ namespace llvm {
       // should we do this in the caller? Nah, would just duplicate the code..
       region_size += scc_size;
       region->HasCall |= has_call;
+      if (Profile)
+        RegionCriticality = std::max(RegionCriticality,
+                                     getProfileCriticality(scc));
 
       // update statistics
       if (isPostDom && region_size > PreferredRegionSize) PostDomsAdded++;
+      else if (isHot && region_size > preferred_size) HotBlocksAdded++;
 
       return true;
     }
@@ -1336,6 +1530,9 @@ namespace llvm {
       // set of unprocessed regions
       ablock_set regions;
 
+      // index the edges of the final, acyclic graph
+      buildIndices();
+
       // start with the CFG root
       ablock *root = Blocks.front();
       emitRegion(root, root, ready, regions);
@@ -1358,8 +1555,9 @@ namespace llvm {
         // initialize ready list
         makeReady(ready, region);
 
-        // keep track of the region's total size
+        // keep track of the region's total size and criticality
         unsigned region_size = 0;
+        RegionCriticality = getProfileCriticality(region);
 
         // count the number of regions
         num_regions++;
@@ -1625,9 +1823,9 @@ namespace llvm {
       // destination is an artificial loop header, check all edges that lead 
       // to the real headers of the SCC
       if (!dbb) {
-        for(aedges::const_iterator i(Edges.lower_bound(dst)),
-            ie(Edges.upper_bound(dst)); i != ie; i++) {
-          rewriteEdge(src, i->second->Dst);
+        for(aedge_vector::const_iterator i(succ_begin(dst)),
+            ie(succ_end(dst)); i != ie; i++) {
+          rewriteEdge(src, getDst(*i));
         }
       }
       else if (src->Region != dst->Region) {
@@ -1679,16 +1877,10 @@ namespace llvm {
     /// to non-cache variants.
     void rewriteCode()
     {
-      // check regular control-flow edges
+      // check regular control-flow edges and back edges
       for(aedges::iterator i(Edges.begin()), ie(Edges.end()); i != ie;
           i++) {
-        rewriteEdge(i->second->Src, i->second->Dst);
-      }
-
-      // also check back edges
-      for(aedges::iterator i(BackEdges.begin()), ie(BackEdges.end()); i != ie;
-          i++) {
-        rewriteEdge(i->second->Src, i->second->Dst);
+        rewriteEdge(Blocks[i->Src], Blocks[i->Dst]);
       }
     }
 
@@ -1953,7 +2145,10 @@ namespace llvm {
             i->definesRegister(Patmos::RTR) && !i->isBranch()) {
           MachineBasicBlock::instr_iterator k;
           for (k = llvm::next(i); k != ie; ++k) {
-            tmp_live_margin += agraph::getInstrSize(k, PTM);
+            // the size of a bundle is accounted for at its header
+            if (!k->isInsideBundle()) {
+              tmp_live_margin += agraph::getInstrSize(k, PTM);
+            }
             if (k->killsRegister(Patmos::RTR)) {
               break;
             }
@@ -2052,19 +2247,6 @@ namespace llvm {
     /// Free memory.
     ~agraph()
     {
-      for(aedges::iterator i(Edges.begin()), ie(Edges.end()); i != ie; i++) {
-        delete i->second;
-      }
-
-      for(aedges::iterator i(BackEdges.begin()), ie(BackEdges.end()); i != ie;
-          i++) {
-        delete i->second;
-      }
-
-      for(ablocks::iterator i(Blocks.begin()), ie(Blocks.end()); i != ie; i++) {
-        delete *i;
-      }
-
       if (PML) delete PML;
     }
   };
@@ -2234,7 +2416,9 @@ namespace llvm {
 
         // construct a copy of the CFG.
         PMLImport &PI = getAnalysis<PMLImport>();
-        agraph G(&MF, PTM, PI.createMCQuery(*this, MF), MPDT,
+        PatmosAnalysisInfo *Profile = EnableProfileRegions ?
+            &MF.getInfo<PatmosMachineFunctionInfo>()->getAnalysisInfo() : NULL;
+        agraph G(&MF, PTM, PI.createMCQuery(*this, MF), Profile, MPDT,
                  prefer_subfunc_size, prefer_scc_size, max_subfunc_size);
         G.transformSCCs();
 
@@ -2278,38 +2462,44 @@ namespace llvm {
     typedef ablock NodeType;
     class ChildIteratorType
     {
-      aedges::iterator I;
+      const agraph *G;
+      aedge_vector::const_iterator I;
 
     public:
-      typedef aedges::iterator::iterator_category iterator_category;
-      typedef aedges::iterator::difference_type difference_type;
-      typedef aedges::iterator::pointer pointer;
-      typedef aedges::iterator::reference reference;
+      typedef std::forward_iterator_tag iterator_category;
+      typedef ptrdiff_t difference_type;
+      typedef NodeType *pointer;
+      typedef NodeType *reference;
       typedef NodeType value_type;
 
-      ChildIteratorType(aedges::iterator i) : I(i) {
+      ChildIteratorType(const agraph *g, aedge_vector::const_iterator i) :
+        G(g), I(i) {
+      }
+
+      bool operator==(ChildIteratorType a) const {
+        return I == a.I;
       }
 
-      bool operator!=(ChildIteratorType a) {
+      bool operator!=(ChildIteratorType a) const {
         return I != a.I;
       }
 
       ChildIteratorType operator++() {
-        ChildIteratorType tmp(I);
+        ChildIteratorType tmp(*this);
         I++;
         return tmp;
       }
 
-      NodeType *operator*() {
-        return I->second->Dst;
+      NodeType *operator*() const {
+        return G->getDst(*I);
       }
     };
 
     static inline ChildIteratorType child_begin(NodeType *N) {
-      return N->G->Edges.lower_bound(N);
+      return ChildIteratorType(N->G, N->G->succ_begin(N));
     }
     static inline ChildIteratorType child_end(NodeType *N) {
-      return N->G->Edges.upper_bound(N);
+      return ChildIteratorType(N->G, N->G->succ_end(N));
     }
 
     static NodeType *getEntryNode(const agraph &G) {
@@ -2331,7 +2521,7 @@ namespace llvm {
 
   template<>
   struct DOTGraphTraits<agraph> : public DefaultDOTGraphTraits {
-    typedef aedges::iterator EdgeIteratorType;
+    typedef aedge_vector::const_iterator EdgeIteratorType;
 
     DOTGraphTraits (bool isSimple=false) : DefaultDOTGraphTraits(isSimple) {}
 
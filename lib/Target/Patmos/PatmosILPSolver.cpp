@@ -0,0 +1,1278 @@
+//===-- PatmosILPSolver.cpp - Solving ILPs of the stack cache analysis. ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Solver backends for the ILPs of the stack cache analysis: an in-process
+// simplex-based branch-and-bound solver and a wrapper around an external
+// solver script, as well as a cache of solved ILPs shared by both.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "patmos-ilp-solver"
+
+#include "PatmosILPSolver.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/MutexGuard.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/system_error.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+
+using namespace llvm;
+
+/// Solver backends available for the stack cache analysis.
+enum ILPBackend {
+  ILPBuiltin,
+  ILPScript
+};
+
+static cl::opt<ILPBackend> ILPSolverBackend(
+  "mpatmos-ilp-backend",
+  cl::init(ILPBuiltin),
+  cl::desc("Solver used for the ILPs of the stack cache analysis."),
+  cl::values(
+    clEnumValN(ILPBuiltin, "builtin",
+               "In-process simplex-based branch-and-bound solver (default)"),
+    clEnumValN(ILPScript, "script",
+               "External solver script given by -mpatmos-ilp-solver"),
+    clEnumValEnd),
+  cl::Hidden);
+
+/// This is expected to be a program that takes one argument specifying the name
+/// of a LP file to solve and generate a file with the same name and an appended
+/// suffix .sol containing the numeric value of the integer solution of the LP.
+static cl::opt<std::string> Solve_ilp(
+  "mpatmos-ilp-solver",
+  cl::init("solve_ilp.sh"),
+  cl::desc("Path to an ILP solver."),
+  cl::Hidden);
+
+/// ILPNodeLimit - Limit the size of the search tree of the builtin solver.
+static cl::opt<unsigned> ILPNodeLimit(
+  "mpatmos-ilp-node-limit",
+  cl::init(10000),
+  cl::desc("Maximum number of branch-and-bound nodes explored by the builtin "
+           "ILP solver before falling back to the LP relaxation's bound."),
+  cl::Hidden);
+
+/// EnableILPCache - Memoize the results of canonically equivalent ILPs.
+static cl::opt<bool> EnableILPCache(
+  "mpatmos-ilp-cache",
+  cl::init(true),
+  cl::desc("Reuse the results of equivalent ILPs during the stack cache "
+           "analysis (default: enabled)."),
+  cl::Hidden);
+
+/// ILPCacheDir - Directory used to persist solved ILPs across compilations.
+static cl::opt<std::string> ILPCacheDir(
+  "mpatmos-ilp-cache-dir",
+  cl::init(""),
+  cl::desc("Directory to store the results of solved ILPs for subsequent "
+           "compilations."),
+  cl::Hidden);
+
+STATISTIC(ILPNodes,        "Number of branch-and-bound nodes (builtin ILP solver).");
+STATISTIC(ILPPivots,       "Number of simplex pivots (builtin ILP solver).");
+STATISTIC(ILPRelaxedBound, "Number of ILPs bounded by their LP relaxation.");
+STATISTIC(ILPCacheHits,    "Number of ILPs reused from the ILP cache.");
+STATISTIC(ILPDiskCacheHits,"Number of ILPs reused from the on-disk ILP cache.");
+STATISTIC(ILPCacheMisses,  "Number of ILPs missing in the ILP cache.");
+
+//===----------------------------------------------------------------------===//
+// ILPModel
+//===----------------------------------------------------------------------===//
+
+void ILPModel::addTerm(Terms &T, unsigned int Var, double Coefficient)
+{
+  for(Terms::iterator i(T.begin()), ie(T.end()); i != ie; i++) {
+    if (i->first == Var) {
+      i->second += Coefficient;
+      return;
+    }
+  }
+
+  T.push_back(std::make_pair(Var, Coefficient));
+}
+
+unsigned int ILPModel::getVariable(StringRef Name)
+{
+  StringMap<unsigned int>::iterator tmp(Indices.find(Name));
+  if (tmp != Indices.end())
+    return tmp->getValue();
+
+  unsigned int Var = Names.size();
+  Names.push_back(Name.str());
+  IsIntegral.push_back(false);
+  Indices[Name] = Var;
+
+  return Var;
+}
+
+void ILPModel::addConstraint(const Terms &Coefficients, Relation Rel,
+                             double RHS)
+{
+  Constraint C;
+
+  // merge duplicate variables
+  for(Terms::const_iterator i(Coefficients.begin()), ie(Coefficients.end());
+      i != ie; i++) {
+    addTerm(C.Coefficients, i->first, i->second);
+  }
+
+  C.Rel = Rel;
+  C.RHS = RHS;
+  Rows.push_back(C);
+}
+
+namespace {
+  /// Order variables by their names.
+  struct VariableNameOrder {
+    const std::vector<std::string> &Names;
+    VariableNameOrder(const std::vector<std::string> &names) : Names(names) {}
+    bool operator()(unsigned int A, unsigned int B) const {
+      return Names[A] < Names[B];
+    }
+  };
+}
+
+void ILPModel::printCanonicalTerms(raw_ostream &OS, const Terms &T,
+                                   const std::vector<unsigned int> &Rank)
+{
+  Terms Sorted;
+  Sorted.reserve(T.size());
+  for(Terms::const_iterator i(T.begin()), ie(T.end()); i != ie; i++) {
+    Sorted.push_back(std::make_pair(Rank[i->first], i->second));
+  }
+  std::sort(Sorted.begin(), Sorted.end());
+
+  for(Terms::const_iterator i(Sorted.begin()), ie(Sorted.end()); i != ie;
+      i++) {
+    OS << " " << format("%.17g", i->second) << "*" << i->first;
+  }
+}
+
+void ILPModel::printCanonical(raw_ostream &OS) const
+{
+  // number the variables in the order of their names
+  std::vector<unsigned int> Order(Names.size());
+  for(unsigned int v = 0; v < Order.size(); v++)
+    Order[v] = v;
+  std::sort(Order.begin(), Order.end(), VariableNameOrder(Names));
+
+  std::vector<unsigned int> Rank(Names.size());
+  for(unsigned int r = 0; r < Order.size(); r++)
+    Rank[Order[r]] = r;
+
+  OS << (Maximize ? "max" : "min");
+  printCanonicalTerms(OS, Objective, Rank);
+  OS << " " << format("%.17g", ObjectiveConstant) << "\n";
+
+  // print the constraints in sorted order
+  std::vector<std::string> Lines;
+  Lines.reserve(Rows.size());
+  for(Constraints::const_iterator i(Rows.begin()), ie(Rows.end()); i != ie;
+      i++) {
+    std::string Line;
+    raw_string_ostream LOS(Line);
+    printCanonicalTerms(LOS, i->Coefficients, Rank);
+    LOS << " " << (i->Rel == LE ? "<=" : i->Rel == GE ? ">=" : "=") << " "
+        << format("%.17g", i->RHS) << "\n";
+    Lines.push_back(LOS.str());
+  }
+  std::sort(Lines.begin(), Lines.end());
+
+  for(std::vector<std::string>::const_iterator i(Lines.begin()),
+      ie(Lines.end()); i != ie; i++) {
+    OS << *i;
+  }
+
+  OS << "int";
+  for(unsigned int r = 0; r < Order.size(); r++) {
+    if (IsIntegral[Order[r]])
+      OS << " " << r;
+  }
+  OS << "\n";
+}
+
+namespace {
+  /// Token of a problem in LP format.
+  struct LPToken {
+    enum TokenKind {
+      Number,
+      Identifier,
+      Sign,
+      Rel,
+      Colon,
+      End
+    };
+
+    TokenKind Kind;
+    StringRef Text;
+    double Value;
+    ILPModel::Relation Relation;
+  };
+
+  /// Split the text of a single section of an LP file into tokens.
+  class LPLexer {
+    StringRef Buffer;
+    size_t Pos;
+
+    static bool isDelimiter(char c) {
+      return isspace(c) || c == '+' || c == '-' || c == '<' || c == '>' ||
+             c == '=' || c == ':';
+    }
+  public:
+    LPLexer(StringRef buffer) : Buffer(buffer), Pos(0) {}
+
+    /// lex - Read the next token.
+    void lex(LPToken &Tok) {
+      while (Pos < Buffer.size() && isspace(Buffer[Pos]))
+        Pos++;
+
+      size_t Start = Pos;
+      if (Pos == Buffer.size()) {
+        Tok.Kind = LPToken::End;
+        Tok.Text = StringRef();
+        return;
+      }
+
+      char c = Buffer[Pos];
+      if (isdigit(c) || (c == '.' && Pos + 1 < Buffer.size() &&
+                         isdigit(Buffer[Pos + 1]))) {
+        while (Pos < Buffer.size() &&
+               (isdigit(Buffer[Pos]) || Buffer[Pos] == '.'))
+          Pos++;
+
+        // exponent
+        if (Pos < Buffer.size() && (Buffer[Pos] == 'e' || Buffer[Pos] == 'E')){
+          size_t Exp = Pos + 1;
+          if (Exp < Buffer.size() && (Buffer[Exp] == '+' || Buffer[Exp] == '-'))
+            Exp++;
+          if (Exp < Buffer.size() && isdigit(Buffer[Exp])) {
+            Pos = Exp;
+            while (Pos < Buffer.size() && isdigit(Buffer[Pos]))
+              Pos++;
+          }
+        }
+
+        Tok.Kind = LPToken::Number;
+        Tok.Text = Buffer.slice(Start, Pos);
+        Tok.Value = strtod(Tok.Text.str().c_str(), NULL);
+      }
+      else if (c == '+' || c == '-') {
+        Pos++;
+        Tok.Kind = LPToken::Sign;
+        Tok.Text = Buffer.slice(Start, Pos);
+        Tok.Value = (c == '-') ? -1.0 : 1.0;
+      }
+      else if (c == '<' || c == '>' || c == '=') {
+        // accept <, <=, =<, >, >=, =>, and =
+        Pos++;
+        if (Pos < Buffer.size() && (Buffer[Pos] == '<' || Buffer[Pos] == '>' ||
+                                    Buffer[Pos] == '='))
+          Pos++;
+
+        Tok.Kind = LPToken::Rel;
+        Tok.Text = Buffer.slice(Start, Pos);
+        if (Tok.Text.find('<') != StringRef::npos)
+          Tok.Relation = ILPModel::LE;
+        else if (Tok.Text.find('>') != StringRef::npos)
+          Tok.Relation = ILPModel::GE;
+        else
+          Tok.Relation = ILPModel::EQ;
+      }
+      else if (c == ':') {
+        Pos++;
+        Tok.Kind = LPToken::Colon;
+        Tok.Text = Buffer.slice(Start, Pos);
+      }
+      else {
+        while (Pos < Buffer.size() && !isDelimiter(Buffer[Pos]))
+          Pos++;
+        Tok.Kind = LPToken::Identifier;
+        Tok.Text = Buffer.slice(Start, Pos);
+      }
+    }
+
+    /// peek - Return the next token without consuming it.
+    void peek(LPToken &Tok) {
+      size_t Old = Pos;
+      lex(Tok);
+      Pos = Old;
+    }
+  };
+
+  /// Sections of an LP file.
+  enum LPSection {
+    SecNone,
+    SecObjective,
+    SecConstraints,
+    SecBounds,
+    SecGenerals,
+    SecBinaries,
+    SecEnd
+  };
+
+  /// getSectionKeyword - Check whether a line starts a new section, return the
+  /// section and the remainder of the line.
+  LPSection getSectionKeyword(StringRef Line, bool &Maximize,
+                              StringRef &Remainder)
+  {
+    static const struct {
+      const char *Keyword;
+      LPSection Section;
+      bool Maximize;
+    } Keywords[] = {
+      {"maximize",   SecObjective,   true},
+      {"maximise",   SecObjective,   true},
+      {"maximum",    SecObjective,   true},
+      {"max",        SecObjective,   true},
+      {"minimize",   SecObjective,   false},
+      {"minimise",   SecObjective,   false},
+      {"minimum",    SecObjective,   false},
+      {"min",        SecObjective,   false},
+      {"subject to", SecConstraints, false},
+      {"such that",  SecConstraints, false},
+      {"s.t.",       SecConstraints, false},
+      {"st",         SecConstraints, false},
+      {"bounds",     SecBounds,      false},
+      {"bound",      SecBounds,      false},
+      {"generals",   SecGenerals,    false},
+      {"general",    SecGenerals,    false},
+      {"gen",        SecGenerals,    false},
+      {"integers",   SecGenerals,    false},
+      {"binaries",   SecBinaries,    false},
+      {"binary",     SecBinaries,    false},
+      {"bin",        SecBinaries,    false},
+      {"end",        SecEnd,         false}
+    };
+
+    std::string Lower(Line.lower());
+    for(unsigned int i = 0; i < array_lengthof(Keywords); i++) {
+      StringRef K(Keywords[i].Keyword);
+      if (StringRef(Lower).startswith(K) &&
+          (Lower.size() == K.size() || isspace(Lower[K.size()]))) {
+        Maximize = Keywords[i].Maximize;
+        Remainder = Line.substr(K.size());
+        return Keywords[i].Section;
+      }
+    }
+
+    return SecNone;
+  }
+
+  /// Parse the sections of a problem in LP format into an ILPModel.
+  class LPParser {
+    ILPModel &Model;
+    std::string &ErrMsg;
+
+    bool error(const Twine &Msg) {
+      ErrMsg = Msg.str();
+      return false;
+    }
+
+    /// parseExpression - Parse a linear expression, stop at the first token
+    /// that is not part of the expression. The stop token is not consumed.
+    bool parseExpression(LPLexer &L, ILPModel::Terms &T, double &Constant,
+                         LPToken &Stop)
+    {
+      double Sign = 1.0;
+      double Coefficient = 0.0;
+      bool HasCoefficient = false;
+      bool HasSign = false;
+      bool HasTerm = false;
+      Constant = 0.0;
+
+      while (true) {
+        LPToken Tok;
+        L.peek(Tok);
+
+        switch (Tok.Kind) {
+          case LPToken::Sign:
+            L.lex(Tok);
+            if (HasCoefficient) {
+              Constant += Sign * Coefficient;
+              HasCoefficient = false;
+              Sign = 1.0;
+            }
+            Sign *= Tok.Value;
+            HasSign = true;
+            break;
+          case LPToken::Number:
+            if (HasCoefficient)
+              return error("unexpected number '" + Tok.Text + "'");
+            L.lex(Tok);
+            Coefficient = Tok.Value;
+            HasCoefficient = true;
+            break;
+          case LPToken::Identifier: {
+            // a variable without a sign or coefficient starts a new statement
+            if (HasTerm && !HasSign && !HasCoefficient) {
+              Stop = Tok;
+              return true;
+            }
+
+            L.lex(Tok);
+
+            LPToken Next;
+            L.peek(Next);
+            if (Next.Kind == LPToken::Colon) {
+              // a label, only valid at the beginning of the expression
+              if (HasTerm || HasCoefficient || HasSign)
+                return error("unexpected label '" + Tok.Text + "'");
+              L.lex(Next);
+              break;
+            }
+
+            T.push_back(std::make_pair(Model.getVariable(Tok.Text),
+                                       Sign * (HasCoefficient ? Coefficient :
+                                                                1.0)));
+            HasCoefficient = false;
+            HasSign = false;
+            HasTerm = true;
+            Sign = 1.0;
+            break;
+          }
+          default:
+            if (HasCoefficient)
+              Constant += Sign * Coefficient;
+            Stop = Tok;
+            return true;
+        }
+      }
+    }
+
+    /// parseNumber - Parse a (signed) number.
+    bool parseNumber(LPLexer &L, double &Value)
+    {
+      double Sign = 1.0;
+      LPToken Tok;
+      L.lex(Tok);
+      while (Tok.Kind == LPToken::Sign) {
+        Sign *= Tok.Value;
+        L.lex(Tok);
+      }
+
+      if (Tok.Kind != LPToken::Number)
+        return error("expected number, found '" + Tok.Text + "'");
+
+      Value = Sign * Tok.Value;
+      return true;
+    }
+
+    bool parseObjective(StringRef Text)
+    {
+      LPLexer L(Text);
+      ILPModel::Terms T;
+      double Constant;
+      LPToken Stop;
+
+      if (!parseExpression(L, T, Constant, Stop))
+        return false;
+      if (Stop.Kind != LPToken::End)
+        return error("unexpected '" + Stop.Text + "' in objective function");
+
+      for(ILPModel::Terms::iterator i(T.begin()), ie(T.end()); i != ie; i++)
+        Model.addObjective(i->first, i->second);
+      Model.addObjectiveConstant(Constant);
+
+      return true;
+    }
+
+    bool parseConstraints(StringRef Text)
+    {
+      LPLexer L(Text);
+
+      while (true) {
+        ILPModel::Terms T;
+        double Constant, RHS;
+        LPToken Stop;
+
+        if (!parseExpression(L, T, Constant, Stop))
+          return false;
+
+        if (Stop.Kind == LPToken::End && T.empty())
+          return true;
+        else if (Stop.Kind != LPToken::Rel)
+          return error("expected relation, found '" + Stop.Text + "'");
+
+        L.lex(Stop);
+        if (!parseNumber(L, RHS))
+          return false;
+
+        Model.addConstraint(T, Stop.Relation, RHS - Constant);
+      }
+    }
+
+    bool parseBounds(StringRef Text)
+    {
+      LPLexer L(Text);
+
+      while (true) {
+        ILPModel::Terms T;
+        double Constant, Value;
+        LPToken Stop;
+
+        if (!parseExpression(L, T, Constant, Stop))
+          return false;
+
+        if (Stop.Kind == LPToken::End && T.empty())
+          return true;
+        else if (Stop.Kind != LPToken::Rel)
+          return error("expected relation, found '" + Stop.Text + "'");
+
+        L.lex(Stop);
+        if (T.empty()) {
+          // lower <= x [<= upper]
+          ILPModel::Relation Rel = Stop.Relation == ILPModel::LE ? ILPModel::GE :
+                                   Stop.Relation == ILPModel::GE ? ILPModel::LE :
+                                                                   ILPModel::EQ;
+          if (!parseExpression(L, T, Value, Stop))
+            return false;
+          if (T.size() != 1 || T[0].second != 1.0)
+            return error("invalid bound");
+          if (!addBound(T, Rel, Constant))
+            return false;
+
+          if (Stop.Kind != LPToken::Rel)
+            continue;
+          L.lex(Stop);
+        }
+        else if (T.size() != 1 || T[0].second != 1.0)
+          return error("invalid bound");
+
+        if (!parseNumber(L, Value) || !addBound(T, Stop.Relation, Value))
+          return false;
+      }
+    }
+
+    bool addBound(const ILPModel::Terms &T, ILPModel::Relation Rel,
+                  double Value)
+    {
+      // variables are non-negative, negative lower bounds can't be modeled.
+      if (Value < 0 && Rel != ILPModel::LE)
+        return error("negative lower bound for '" +
+                     Model.getName(T[0].first) + "'");
+
+      Model.addConstraint(T, Rel, Value);
+      return true;
+    }
+
+    bool parseIntegrals(StringRef Text, bool Binary)
+    {
+      LPLexer L(Text);
+
+      while (true) {
+        LPToken Tok;
+        L.lex(Tok);
+
+        if (Tok.Kind == LPToken::End)
+          return true;
+        else if (Tok.Kind != LPToken::Identifier)
+          return error("expected variable, found '" + Tok.Text + "'");
+
+        unsigned int Var = Model.getVariable(Tok.Text);
+        Model.setIntegral(Var);
+
+        if (Binary) {
+          ILPModel::Terms T(1, std::make_pair(Var, 1.0));
+          Model.addConstraint(T, ILPModel::LE, 1.0);
+        }
+      }
+    }
+  public:
+    LPParser(ILPModel &model, std::string &errmsg) :
+        Model(model), ErrMsg(errmsg)
+    {
+    }
+
+    bool parseSection(LPSection Section, StringRef Text)
+    {
+      switch (Section) {
+        case SecObjective:   return parseObjective(Text);
+        case SecConstraints: return parseConstraints(Text);
+        case SecBounds:      return parseBounds(Text);
+        case SecGenerals:    return parseIntegrals(Text, false);
+        case SecBinaries:    return parseIntegrals(Text, true);
+        case SecNone:
+          return StringRef(Text).trim().empty() ||
+                 error("text outside of any section");
+        case SecEnd:
+          return true;
+      }
+      llvm_unreachable("unknown LP section");
+    }
+  };
+}
+
+bool ILPModel::parseLP(StringRef LP, std::string &ErrMsg)
+{
+  LPParser Parser(*this, ErrMsg);
+  LPSection Section = SecNone;
+  std::string Text;
+
+  while (!LP.empty()) {
+    std::pair<StringRef, StringRef> tmp(LP.split('\n'));
+    LP = tmp.second;
+
+    // strip comments
+    StringRef Line(tmp.first.substr(0, tmp.first.find('\\')).trim());
+
+    bool maximize;
+    StringRef Remainder;
+    LPSection Next = getSectionKeyword(Line, maximize, Remainder);
+    if (Next == SecNone) {
+      Text += Line.str();
+      Text += '\n';
+      continue;
+    }
+
+    // a new section starts, parse the previous section
+    if (!Parser.parseSection(Section, Text))
+      return false;
+
+    if (Next == SecObjective)
+      setMaximize(maximize);
+
+    Section = Next;
+    Text = Remainder.str();
+    Text += '\n';
+  }
+
+  return Parser.parseSection(Section, Text);
+}
+
+//===----------------------------------------------------------------------===//
+// Simplex-based branch-and-bound
+//===----------------------------------------------------------------------===//
+
+namespace {
+  /// Tolerance for numerical comparisons.
+  const double Epsilon = 1e-9;
+
+  /// Tolerance to decide whether a value is integral.
+  const double IntegralityEpsilon = 1e-6;
+
+  /// Maximum number of pivots per LP, protects against cycling due to
+  /// numerical problems.
+  const unsigned int PivotLimit = 100000;
+
+  /// Additional bound on a variable imposed by branching.
+  struct BranchBound {
+    unsigned int Var;
+    ILPModel::Relation Rel;
+    double Value;
+  };
+
+  typedef std::vector<BranchBound> BranchBounds;
+
+  /// Dense two-phase simplex over a tableau. All variables are non-negative,
+  /// the objective function is maximized. Bland's rule is used to select
+  /// pivots to avoid cycling on the highly degenerate flow problems of the
+  /// stack cache analysis.
+  class SimplexTableau {
+    /// Number of structural variables.
+    unsigned int NumVars;
+
+    /// Number of slack and surplus variables.
+    unsigned int NumSlacks;
+
+    /// Number of rows (constraints) and columns (excluding the RHS).
+    unsigned int NumRows, NumCols;
+
+    /// The tableau, the last row holds the objective function.
+    std::vector<double> T;
+
+    /// The basic variable of each row.
+    std::vector<unsigned int> Basis;
+
+    double &at(unsigned int r, unsigned int c) {
+      return T[r * (NumCols + 1) + c];
+    }
+
+    /// pivot - Make column c basic in row r.
+    void pivot(unsigned int r, unsigned int c) {
+      double p = at(r, c);
+      for(unsigned int j = 0; j <= NumCols; j++)
+        at(r, j) /= p;
+
+      for(unsigned int i = 0; i <= NumRows; i++) {
+        double f = at(i, c);
+        if (i == r || f == 0.0)
+          continue;
+
+        for(unsigned int j = 0; j <= NumCols; j++)
+          at(i, j) -= f * at(r, j);
+      }
+
+      Basis[r] = c;
+      ILPPivots++;
+    }
+
+    /// optimize - Run the simplex iterations, considering only the first
+    /// Limit columns as entering columns.
+    PatmosILPSolver::Status optimize(unsigned int Limit) {
+      for(unsigned int iterations = 0; iterations < PivotLimit; iterations++) {
+        // find the entering column (smallest index with negative cost)
+        unsigned int c = Limit;
+        for(unsigned int j = 0; j < Limit; j++) {
+          if (at(NumRows, j) < -Epsilon) {
+            c = j;
+            break;
+          }
+        }
+
+        if (c == Limit)
+          return PatmosILPSolver::Optimal;
+
+        // find the leaving row using the minimum ratio test
+        unsigned int r = NumRows;
+        double ratio = 0;
+        for(unsigned int i = 0; i < NumRows; i++) {
+          double a = at(i, c);
+          if (a <= Epsilon)
+            continue;
+
+          double tmp = at(i, NumCols) / a;
+          if (r == NumRows || tmp < ratio - Epsilon ||
+              (tmp <= ratio + Epsilon && Basis[i] < Basis[r])) {
+            r = i;
+            ratio = tmp;
+          }
+        }
+
+        if (r == NumRows)
+          return PatmosILPSolver::Unbounded;
+
+        pivot(r, c);
+      }
+
+      return PatmosILPSolver::Failed;
+    }
+  public:
+    /// Construct the tableau of the model's LP relaxation including the
+    /// additional bounds.
+    SimplexTableau(const ILPModel &Model, const BranchBounds &Bounds) :
+        NumVars(Model.getNumVariables()), NumSlacks(0)
+    {
+      // collect all rows, normalized to a non-negative right-hand side
+      ILPModel::Constraints Rows(Model.getConstraints());
+      for(BranchBounds::const_iterator i(Bounds.begin()), ie(Bounds.end());
+          i != ie; i++) {
+        ILPModel::Constraint C;
+        C.Coefficients.push_back(std::make_pair(i->Var, 1.0));
+        C.Rel = i->Rel;
+        C.RHS = i->Value;
+        Rows.push_back(C);
+      }
+
+      unsigned int NumArtificials = 0;
+      for(ILPModel::Constraints::iterator i(Rows.begin()), ie(Rows.end());
+          i != ie; i++) {
+        if (i->RHS < 0) {
+          for(ILPModel::Terms::iterator j(i->Coefficients.begin()),
+              je(i->Coefficients.end()); j != je; j++)
+            j->second = -j->second;
+          i->RHS = -i->RHS;
+          if (i->Rel != ILPModel::EQ)
+            i->Rel = i->Rel == ILPModel::LE ? ILPModel::GE : ILPModel::LE;
+        }
+
+        if (i->Rel != ILPModel::EQ)
+          NumSlacks++;
+        if (i->Rel != ILPModel::LE)
+          NumArtificials++;
+      }
+
+      NumRows = Rows.size();
+      NumCols = NumVars + NumSlacks + NumArtificials;
+      T.assign((NumRows + 1) * (NumCols + 1), 0.0);
+      Basis.resize(NumRows);
+
+      // fill the tableau, phase one minimizes the sum of artificials
+      unsigned int slack = NumVars, artificial = NumVars + NumSlacks;
+      for(unsigned int r = 0; r < NumRows; r++) {
+        const ILPModel::Constraint &C(Rows[r]);
+        for(ILPModel::Terms::const_iterator j(C.Coefficients.begin()),
+            je(C.Coefficients.end()); j != je; j++)
+          at(r, j->first) = j->second;
+        at(r, NumCols) = C.RHS;
+
+        if (C.Rel == ILPModel::LE) {
+          at(r, slack) = 1.0;
+          Basis[r] = slack++;
+        }
+        else {
+          if (C.Rel == ILPModel::GE)
+            at(r, slack++) = -1.0;
+
+          at(r, artificial) = 1.0;
+          Basis[r] = artificial++;
+
+          for(unsigned int j = 0; j <= NumCols; j++)
+            if (j < NumVars + NumSlacks || j == NumCols)
+              at(NumRows, j) -= at(r, j);
+        }
+      }
+    }
+
+    /// solve - Solve the LP relaxation, returns the optimal value of the
+    /// (maximized) objective function and the variables' values.
+    PatmosILPSolver::Status solve(const ILPModel &Model, double &Objective,
+                                  std::vector<double> &Values)
+    {
+      unsigned int NumStructural = NumVars + NumSlacks;
+
+      // phase one: find a feasible basis
+      PatmosILPSolver::Status S = optimize(NumCols);
+      if (S == PatmosILPSolver::Failed)
+        return S;
+      if (at(NumRows, NumCols) < -IntegralityEpsilon)
+        return PatmosILPSolver::Infeasible;
+
+      // drive remaining (zero) artificials out of the basis, rows where this
+      // fails are redundant.
+      for(unsigned int r = 0; r < NumRows; r++) {
+        if (Basis[r] < NumStructural)
+          continue;
+
+        for(unsigned int c = 0; c < NumStructural; c++) {
+          if (std::fabs(at(r, c)) > Epsilon) {
+            pivot(r, c);
+            break;
+          }
+        }
+      }
+
+      // phase two: set up the actual objective function
+      for(unsigned int j = 0; j <= NumCols; j++)
+        at(NumRows, j) = 0.0;
+
+      double Sign = Model.isMaximize() ? 1.0 : -1.0;
+      const ILPModel::Terms &Obj(Model.getObjective());
+      for(ILPModel::Terms::const_iterator i(Obj.begin()), ie(Obj.end());
+          i != ie; i++)
+        at(NumRows, i->first) = -Sign * i->second;
+
+      for(unsigned int r = 0; r < NumRows; r++) {
+        double f = at(NumRows, Basis[r]);
+        if (f == 0.0)
+          continue;
+
+        for(unsigned int j = 0; j <= NumCols; j++)
+          at(NumRows, j) -= f * at(r, j);
+      }
+
+      S = optimize(NumStructural);
+      if (S != PatmosILPSolver::Optimal)
+        return S;
+
+      Objective = at(NumRows, NumCols);
+      Values.assign(NumVars, 0.0);
+      for(unsigned int r = 0; r < NumRows; r++)
+        if (Basis[r] < NumVars)
+          Values[Basis[r]] = at(r, NumCols);
+
+      return PatmosILPSolver::Optimal;
+    }
+  };
+
+  /// Depth-first branch-and-bound search over the LP relaxations.
+  class BranchAndBound {
+    const ILPModel &Model;
+
+    unsigned int NodeLimit;
+    unsigned int Nodes;
+
+    /// The best integral solution found so far (maximized).
+    bool HasIncumbent;
+    double Incumbent;
+
+    BranchBounds Bounds;
+  public:
+    bool LimitExceeded;
+
+    BranchAndBound(const ILPModel &model, unsigned int nodelimit) :
+        Model(model), NodeLimit(nodelimit), Nodes(0), HasIncumbent(false),
+        Incumbent(0), LimitExceeded(false)
+    {
+    }
+
+    /// getIncumbent - Return the best integral solution, if any.
+    bool getIncumbent(double &Result) const {
+      Result = Incumbent;
+      return HasIncumbent;
+    }
+
+    /// search - Solve the LP relaxation under the current bounds and branch on
+    /// the first fractional integral variable. Returns the status of the
+    /// relaxation, its bound is returned in Bound. The root relaxation is
+    /// always solved, its bound is needed when the node limit is exceeded.
+    PatmosILPSolver::Status search(double &Bound)
+    {
+      if (Nodes++ >= NodeLimit && !Bounds.empty()) {
+        LimitExceeded = true;
+        return PatmosILPSolver::Optimal;
+      }
+      ILPNodes++;
+
+      std::vector<double> Values;
+      SimplexTableau Tableau(Model, Bounds);
+      PatmosILPSolver::Status S = Tableau.solve(Model, Bound, Values);
+      if (S != PatmosILPSolver::Optimal)
+        return S;
+
+      // no improvement possible in this subtree
+      if (HasIncumbent && Bound <= Incumbent + IntegralityEpsilon)
+        return S;
+
+      // find a variable to branch on
+      for(unsigned int v = 0; v < Values.size(); v++) {
+        if (!Model.isIntegral(v))
+          continue;
+
+        double Down = std::floor(Values[v] + IntegralityEpsilon);
+        if (Values[v] - Down <= IntegralityEpsilon)
+          continue;
+
+        BranchBound B = {v, ILPModel::LE, Down};
+        double tmp;
+
+        Bounds.push_back(B);
+        S = search(tmp);
+        Bounds.back().Rel = ILPModel::GE;
+        Bounds.back().Value = Down + 1.0;
+        if (S != PatmosILPSolver::Failed)
+          S = search(tmp);
+        Bounds.pop_back();
+
+        return S == PatmosILPSolver::Failed ? S : PatmosILPSolver::Optimal;
+      }
+
+      // the solution is integral
+      Incumbent = Bound;
+      HasIncumbent = true;
+      return S;
+    }
+  };
+}
+
+PatmosILPSolver::Status llvm::solveILP(const ILPModel &Model,
+                                       unsigned int NodeLimit, double &Result)
+{
+  BranchAndBound BB(Model, NodeLimit);
+  double RootBound;
+
+  PatmosILPSolver::Status S = BB.search(RootBound);
+  if (S != PatmosILPSolver::Optimal)
+    return S;
+
+  double Best;
+  if (BB.LimitExceeded) {
+    // the relaxation bounds the optimum of the ILP
+    DEBUG(dbgs() << "ILP: node limit exceeded, using LP relaxation\n");
+    ILPRelaxedBound++;
+    Best = RootBound;
+  }
+  else if (!BB.getIncumbent(Best)) {
+    return PatmosILPSolver::Infeasible;
+  }
+
+  Result = (Model.isMaximize() ? Best : -Best) + Model.getObjectiveConstant();
+  return PatmosILPSolver::Optimal;
+}
+
+//===----------------------------------------------------------------------===//
+// Solver backends
+//===----------------------------------------------------------------------===//
+
+PatmosILPSolver::~PatmosILPSolver()
+{
+}
+
+PatmosILPSolver::Status PatmosILPSolver::solveModel(StringRef LP,
+                                                    const ILPModel &Model,
+                                                    double &Result)
+{
+  return solve(LP, Result);
+}
+
+namespace {
+  /// Solve ILPs in-process, the problem is never written to disk.
+  class BuiltinILPSolver : public PatmosILPSolver {
+  public:
+    virtual Status solve(StringRef LP, double &Result)
+    {
+      ILPModel Model;
+      std::string ErrMsg;
+      if (!Model.parseLP(LP, ErrMsg)) {
+        errs() << "Error: Failed to parse ILP: " << ErrMsg << "\n";
+        return Failed;
+      }
+
+      return solveILP(Model, ILPNodeLimit, Result);
+    }
+
+    virtual Status solveModel(StringRef LP, const ILPModel &Model,
+                              double &Result)
+    {
+      return solveILP(Model, ILPNodeLimit, Result);
+    }
+
+    virtual const char *getName() const {
+      return "builtin";
+    }
+  };
+
+  /// Solve ILPs by writing an LP file and calling an external solver script.
+  class ScriptILPSolver : public PatmosILPSolver {
+  public:
+    virtual Status solve(StringRef LP, double &Result)
+    {
+      // open LP file.
+      SmallString<1024> LPdir;
+      error_code err = sys::fs::createUniqueDirectory("stack", LPdir);
+      if (err) {
+        errs() << "Error creating temp .lp file: " << err.message() << "\n";
+        return Failed;
+      }
+
+      SmallString<1024> LPname(LPdir);
+      sys::path::append(LPname, "scc.lp");
+
+      {
+        std::string ErrMsg;
+        raw_fd_ostream OS(LPname.c_str(), ErrMsg);
+        if (!ErrMsg.empty()) {
+          errs() << "Error: Failed to open file '" << LPname.str()
+                 << "' for writing!\n";
+          return Failed;
+        }
+
+        OS << LP;
+      }
+
+      std::vector<const char*> args;
+      args.push_back(Solve_ilp.c_str());
+      args.push_back(LPname.c_str());
+      args.push_back(0);
+
+      std::string ErrMsg;
+      if (sys::ExecuteAndWait(sys::FindProgramByName(Solve_ilp),
+                                       &args[0],0,0,0,0,&ErrMsg)) {
+        report_fatal_error("calling ILP solver (" + Solve_ilp + "): " + ErrMsg);
+      }
+
+      // read solution
+      // construct name of solution
+      std::string SOLname(LPname.str());
+      SOLname += ".sol";
+
+      if (!sys::fs::exists(SOLname))
+        report_fatal_error("Failed to read ILP solution");
+
+      Status S = Optimal;
+      {
+        std::ifstream IS(SOLname.c_str());
+        assert(IS.good());
+
+        // read the result value, the script reports -1 when solving failed
+        IS >> Result;
+        if (Result == -1.)
+          S = Infeasible;
+      }
+
+      sys::fs::remove(SOLname);
+      sys::fs::remove(LPname.str());
+      sys::fs::remove(LPdir.str());
+
+      return S;
+    }
+
+    virtual const char *getName() const {
+      return Solve_ilp.c_str();
+    }
+  };
+}
+
+namespace {
+  /// Memoize the results of a solver backend, keyed by the canonical form of
+  /// the ILPs. Results are optionally kept on disk, one file per ILP, named
+  /// after the MD5 hash of the canonical form. The cache may be shared by
+  /// concurrent callers, the backend itself is invoked outside of the lock.
+  class CachingILPSolver : public PatmosILPSolver {
+    typedef std::pair<Status, double> CachedResult;
+    typedef std::map<std::string, CachedResult> ResultCache;
+
+    /// The solver actually solving ILPs.
+    OwningPtr<PatmosILPSolver> Backend;
+
+    /// Results of ILPs solved so far.
+    ResultCache Cache;
+
+    /// Guard the in-memory cache against concurrent updates.
+    sys::Mutex CacheLock;
+
+    /// Directory of the on-disk cache, or empty.
+    std::string CacheDir;
+
+    /// getCacheFile - Return the name of the cache file for an ILP.
+    void getCacheFile(StringRef Key, SmallString<1024> &Filename) const
+    {
+      MD5 Hash;
+      MD5::MD5Result Digest;
+      SmallString<32> HashString;
+
+      Hash.update(Key);
+      Hash.final(Digest);
+      MD5::stringifyResult(Digest, HashString);
+
+      Filename = CacheDir;
+      sys::path::append(Filename, HashString.str() + ".ilp");
+    }
+
+    /// readCacheFile - Read the result of an ILP from the on-disk cache. The
+    /// first line holds the result, the remainder the canonical ILP.
+    bool readCacheFile(StringRef Key, CachedResult &R) const
+    {
+      SmallString<1024> Filename;
+      getCacheFile(Key, Filename);
+
+      OwningPtr<MemoryBuffer> Buffer;
+      if (MemoryBuffer::getFile(Filename.str(), Buffer))
+        return false;
+
+      std::pair<StringRef, StringRef> tmp(Buffer->getBuffer().split('\n'));
+      if (tmp.second != Key)
+        return false;
+
+      std::pair<StringRef, StringRef> res(tmp.first.split(' '));
+      unsigned int S;
+      if (res.first.getAsInteger(10, S) || S > (unsigned int)Unbounded)
+        return false;
+
+      R.first = (Status)S;
+      R.second = strtod(res.second.str().c_str(), NULL);
+      return true;
+    }
+
+    /// writeCacheFile - Store the result of an ILP in the on-disk cache. The
+    /// file is written under a temporary name and then renamed, such that
+    /// concurrent compilations never see partial files.
+    void writeCacheFile(StringRef Key, const CachedResult &R) const
+    {
+      if (sys::fs::create_directories(CacheDir))
+        return;
+
+      SmallString<1024> Filename, TmpName;
+      getCacheFile(Key, Filename);
+
+      int FD;
+      if (sys::fs::createUniqueFile(Filename.str() + "-%%%%%%", FD, TmpName))
+        return;
+
+      {
+        raw_fd_ostream OS(FD, true);
+        OS << (unsigned int)R.first << " " << format("%.17g", R.second) << "\n"
+           << Key;
+      }
+
+      if (sys::fs::rename(TmpName.str(), Filename.str()))
+        sys::fs::remove(TmpName.str());
+    }
+  public:
+    CachingILPSolver(PatmosILPSolver *backend, StringRef cachedir) :
+        Backend(backend), CacheDir(cachedir)
+    {
+    }
+
+    virtual Status solve(StringRef LP, double &Result)
+    {
+      // ILPs that can't be parsed are left to the backend
+      ILPModel Model;
+      std::string ErrMsg;
+      if (!Model.parseLP(LP, ErrMsg))
+        return Backend->solve(LP, Result);
+
+      std::string Key;
+      raw_string_ostream OS(Key);
+      Model.printCanonical(OS);
+      OS.flush();
+
+      {
+        MutexGuard Guard(CacheLock);
+        ResultCache::iterator tmp(Cache.find(Key));
+        if (tmp != Cache.end()) {
+          ILPCacheHits++;
+          Result = tmp->second.second;
+          return tmp->second.first;
+        }
+      }
+
+      CachedResult R;
+      if (!CacheDir.empty() && readCacheFile(Key, R)) {
+        ILPDiskCacheHits++;
+      }
+      else {
+        ILPCacheMisses++;
+        R.first = Backend->solveModel(LP, Model, R.second);
+
+        // do not remember failures, the next attempt might succeed
+        if (R.first == Failed)
+          return Failed;
+
+        if (!CacheDir.empty())
+          writeCacheFile(Key, R);
+      }
+
+      {
+        MutexGuard Guard(CacheLock);
+        Cache[Key] = R;
+      }
+      Result = R.second;
+      return R.first;
+    }
+
+    virtual const char *getName() const {
+      return Backend->getName();
+    }
+  };
+}
+
+PatmosILPSolver *llvm::createPatmosILPSolver()
+{
+  PatmosILPSolver *Solver = NULL;
+  switch (ILPSolverBackend) {
+    case ILPBuiltin: Solver = new BuiltinILPSolver(); break;
+    case ILPScript:  Solver = new ScriptILPSolver();  break;
+  }
+
+  if (EnableILPCache)
+    Solver = new CachingILPSolver(Solver, ILPCacheDir);
+
+  return Solver;
+}
@@ -0,0 +1,179 @@
+//===-- PatmosILPSolver.h - Solving ILPs of the stack cache analysis. -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Pluggable interface to solve the integer linear programs constructed by the
+// stack cache analysis.
+//
+// Problems are handed to the solvers in (a subset of) the CPLEX LP format,
+// which is what the external solver scripts expect and what users provide in
+// the bounds file (-mpatmos-stack-cache-analysis-bounds). The builtin solver
+// parses the text into an in-memory model and solves it using a simplex-based
+// branch-and-bound search, the script solver forks -mpatmos-ilp-solver. Both
+// can be wrapped by a cache of solved ILPs.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOSILPSOLVER_H_
+#define _LLVM_TARGET_PATMOSILPSOLVER_H_
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class raw_ostream;
+
+  /// An integer linear program, i.e., a linear objective function over
+  /// non-negative variables subject to linear constraints.
+  class ILPModel
+  {
+  public:
+    /// Relations of a constraint's left-hand side to its right-hand side.
+    enum Relation {
+      LE,
+      GE,
+      EQ
+    };
+
+    /// Linear term, i.e., a list of (variable index, coefficient) pairs.
+    typedef std::vector<std::pair<unsigned int, double> > Terms;
+
+    /// A linear constraint: Coefficients Rel RHS.
+    struct Constraint {
+      Terms Coefficients;
+      Relation Rel;
+      double RHS;
+    };
+
+    typedef std::vector<Constraint> Constraints;
+  private:
+    /// Names of the model's variables.
+    std::vector<std::string> Names;
+
+    /// Map variable names to variable indices.
+    StringMap<unsigned int> Indices;
+
+    /// Flags indicating whether a variable has to take an integral value.
+    std::vector<bool> IsIntegral;
+
+    /// Flag indicating whether the objective function is maximized.
+    bool Maximize;
+
+    /// The objective function and a constant offset.
+    Terms Objective;
+    double ObjectiveConstant;
+
+    /// The model's constraints.
+    Constraints Rows;
+
+    /// addTerm - Add coefficient * variable to a term, merging duplicates.
+    static void addTerm(Terms &T, unsigned int Var, double Coefficient);
+
+    /// printCanonicalTerms - Print a term with its variables renumbered
+    /// according to Rank, sorted by the new numbers.
+    static void printCanonicalTerms(raw_ostream &OS, const Terms &T,
+                                    const std::vector<unsigned int> &Rank);
+  public:
+    ILPModel() : Maximize(true), ObjectiveConstant(0) {}
+
+    /// getVariable - Return the index of a variable, the variable is created
+    /// when it does not yet exist.
+    unsigned int getVariable(StringRef Name);
+
+    /// getNumVariables - Return the number of variables of the model.
+    unsigned int getNumVariables() const { return Names.size(); }
+
+    /// getName - Return the name of a variable.
+    const std::string &getName(unsigned int Var) const { return Names[Var]; }
+
+    /// setIntegral - Require the variable to take an integral value.
+    void setIntegral(unsigned int Var) { IsIntegral[Var] = true; }
+
+    /// isIntegral - Return whether the variable has to be integral.
+    bool isIntegral(unsigned int Var) const { return IsIntegral[Var]; }
+
+    /// setMaximize - Set the direction of the optimization.
+    void setMaximize(bool maximize) { Maximize = maximize; }
+
+    /// isMaximize - Return whether the objective function is maximized.
+    bool isMaximize() const { return Maximize; }
+
+    /// addObjective - Add coefficient * variable to the objective function.
+    void addObjective(unsigned int Var, double Coefficient) {
+      addTerm(Objective, Var, Coefficient);
+    }
+
+    /// addObjectiveConstant - Add a constant to the objective function.
+    void addObjectiveConstant(double C) { ObjectiveConstant += C; }
+
+    const Terms &getObjective() const { return Objective; }
+    double getObjectiveConstant() const { return ObjectiveConstant; }
+
+    /// addConstraint - Add a new constraint to the model.
+    void addConstraint(const Terms &Coefficients, Relation Rel, double RHS);
+
+    const Constraints &getConstraints() const { return Rows; }
+
+    /// parseLP - Read the model from a problem in LP format. Returns false and
+    /// sets ErrMsg if the problem could not be parsed.
+    bool parseLP(StringRef LP, std::string &ErrMsg);
+
+    /// printCanonical - Print the model with variables referred to by their
+    /// rank in the sorted list of variable names. Terms and constraints are
+    /// printed in sorted order, such that the output does not depend on the
+    /// order in which the problem was written.
+    void printCanonical(raw_ostream &OS) const;
+  };
+
+  /// Interface of solvers for the stack cache analysis' ILPs.
+  class PatmosILPSolver
+  {
+  public:
+    /// Outcome of solving an ILP.
+    enum Status {
+      Optimal,
+      Infeasible,
+      Unbounded,
+      Failed
+    };
+
+    virtual ~PatmosILPSolver();
+
+    /// solve - Solve the ILP given in LP format. On success, the optimal value
+    /// of the objective function is returned in Result. Solvers may be called
+    /// concurrently from several threads.
+    virtual Status solve(StringRef LP, double &Result) = 0;
+
+    /// solveModel - Solve an ILP given in LP format that has already been
+    /// parsed into Model. By default the model is ignored and the LP is
+    /// solved.
+    virtual Status solveModel(StringRef LP, const ILPModel &Model,
+                              double &Result);
+
+    /// getName - Return a name describing the solver backend.
+    virtual const char *getName() const = 0;
+  };
+
+  /// solveILP - Solve an in-memory ILP model using a simplex-based
+  /// branch-and-bound search. At most NodeLimit nodes of the search tree are
+  /// explored, the bound of the LP relaxation is returned when the limit is
+  /// exceeded, which is a safe approximation of the objective's optimum.
+  PatmosILPSolver::Status solveILP(const ILPModel &Model, unsigned int NodeLimit,
+                                   double &Result);
+
+  /// createPatmosILPSolver - Create the solver selected using the command-line
+  /// option -mpatmos-ilp-backend. Unless disabled using -mpatmos-ilp-cache, the
+  /// solver memoizes results of canonically equivalent ILPs, optionally
+  /// persisting them in the directory given by -mpatmos-ilp-cache-dir.
+  PatmosILPSolver *createPatmosILPSolver();
+} // End llvm namespace
+
+#endif // _LLVM_TARGET_PATMOSILPSOLVER_H_
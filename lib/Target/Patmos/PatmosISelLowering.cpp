@@ -775,6 +775,163 @@ PatmosTargetLowering::LowerVASTART(SDValue Op, SelectionDAG &DAG) const {
 }
 
 
+//===----------------------------------------------------------------------===//
+//                      Custom Inserters
+//===----------------------------------------------------------------------===//
+
+static unsigned getWordLoadOpcode(PatmosII::MemType Type) {
+  switch (Type) {
+  case PatmosII::MEM_L: return Patmos::LWL;
+  case PatmosII::MEM_M: return Patmos::LWM;
+  case PatmosII::MEM_C: return Patmos::LWC;
+  default:
+    llvm_unreachable("Unexpected memory type of a memcpy");
+  }
+}
+
+static unsigned getWordStoreOpcode(PatmosII::MemType Type) {
+  switch (Type) {
+  case PatmosII::MEM_L: return Patmos::SWL;
+  case PatmosII::MEM_M: return Patmos::SWM;
+  case PatmosII::MEM_C: return Patmos::SWC;
+  default:
+    llvm_unreachable("Unexpected memory type of a memcpy or memset");
+  }
+}
+
+MachineBasicBlock *
+PatmosTargetLowering::EmitInstrWithCustomInserter(MachineInstr *MI,
+                                                  MachineBasicBlock *MBB) const
+{
+  switch (MI->getOpcode()) {
+  case Patmos::PSEUDO_MEMCPY_LOOP:
+  case Patmos::PSEUDO_MEMSET_LOOP:
+    return EmitMemOpLoop(MI, MBB);
+  default:
+    llvm_unreachable("Unexpected instruction with custom inserter");
+  }
+}
+
+MachineBasicBlock *
+PatmosTargetLowering::EmitMemOpLoop(MachineInstr *MI,
+                                    MachineBasicBlock *MBB) const
+{
+  // The loop copies (or sets) Unroll words per iteration:
+  //
+  //   MBB:    li    cnt0 = Iterations
+  //   Loop:   dst = phi(Dst, dst'), src = phi(Src, src'), cnt = phi(cnt0, cnt')
+  //           loopbound [Iterations-1, Iterations-1]
+  //           lw    v_i = [src + i]        (memcpy only)
+  //           sw    [dst + i] = v_i
+  //           add   dst' = dst, Unroll*4
+  //           add   src' = src, Unroll*4   (memcpy only)
+  //           sub   cnt' = cnt, 1
+  //           cmpneq p = cnt', 0
+  //     (p)   br    Loop
+  //   Exit:   ...
+  const TargetInstrInfo &TII = *getTargetMachine().getInstrInfo();
+  MachineFunction *MF = MBB->getParent();
+  MachineRegisterInfo &MRI = MF->getRegInfo();
+  DebugLoc DL = MI->getDebugLoc();
+
+  bool IsMemcpy = MI->getOpcode() == Patmos::PSEUDO_MEMCPY_LOOP;
+  unsigned DstReg = MI->getOperand(0).getReg();
+  unsigned SrcReg = MI->getOperand(1).getReg();
+  unsigned Iterations = MI->getOperand(2).getImm();
+  unsigned Unroll = MI->getOperand(3).getImm();
+  unsigned StoreOpc = getWordStoreOpcode(
+                        (PatmosII::MemType)MI->getOperand(4).getImm());
+  unsigned LoadOpc = IsMemcpy ? getWordLoadOpcode(
+                        (PatmosII::MemType)MI->getOperand(5).getImm()) : 0;
+
+  assert(Iterations > 1 && Unroll > 0 && isInt<7>(Unroll - 1) &&
+         "Invalid memcpy or memset loop");
+
+  const TargetRegisterClass *RC = &Patmos::RRegsRegClass;
+
+  // Split the block after MI and insert the loop block in between.
+  const BasicBlock *LLVM_BB = MBB->getBasicBlock();
+  MachineFunction::iterator It = MBB;
+  ++It;
+
+  MachineBasicBlock *LoopMBB = MF->CreateMachineBasicBlock(LLVM_BB);
+  MachineBasicBlock *ExitMBB = MF->CreateMachineBasicBlock(LLVM_BB);
+  MF->insert(It, LoopMBB);
+  MF->insert(It, ExitMBB);
+
+  ExitMBB->splice(ExitMBB->begin(), MBB,
+                  llvm::next(MachineBasicBlock::iterator(MI)), MBB->end());
+  ExitMBB->transferSuccessorsAndUpdatePHIs(MBB);
+
+  MBB->addSuccessor(LoopMBB);
+  LoopMBB->addSuccessor(LoopMBB);
+  LoopMBB->addSuccessor(ExitMBB);
+
+  // Initialize the counter.
+  unsigned CntInit = MRI.createVirtualRegister(RC);
+  AddDefaultPred(BuildMI(*MBB, MI, DL,
+                         TII.get(isUInt<12>(Iterations) ? Patmos::LIi
+                                                        : Patmos::LIl),
+                         CntInit))
+    .addImm(Iterations);
+
+  // Loop header
+  unsigned Dst = MRI.createVirtualRegister(RC);
+  unsigned DstNext = MRI.createVirtualRegister(RC);
+  unsigned Src = IsMemcpy ? MRI.createVirtualRegister(RC) : 0;
+  unsigned SrcNext = IsMemcpy ? MRI.createVirtualRegister(RC) : 0;
+  unsigned Cnt = MRI.createVirtualRegister(RC);
+  unsigned CntNext = MRI.createVirtualRegister(RC);
+  unsigned Pred = MRI.createVirtualRegister(&Patmos::PRegsRegClass);
+
+  BuildMI(LoopMBB, DL, TII.get(Patmos::PHI), Dst)
+    .addReg(DstReg).addMBB(MBB).addReg(DstNext).addMBB(LoopMBB);
+  if (IsMemcpy) {
+    BuildMI(LoopMBB, DL, TII.get(Patmos::PHI), Src)
+      .addReg(SrcReg).addMBB(MBB).addReg(SrcNext).addMBB(LoopMBB);
+  }
+  BuildMI(LoopMBB, DL, TII.get(Patmos::PHI), Cnt)
+    .addReg(CntInit).addMBB(MBB).addReg(CntNext).addMBB(LoopMBB);
+
+  // The header executes exactly Iterations times.
+  BuildMI(LoopMBB, DL, TII.get(Patmos::PSEUDO_LOOPBOUND))
+    .addImm(Iterations - 1).addImm(Iterations - 1);
+
+  // Loop body, the offsets of the loads and stores are given in words.
+  SmallVector<unsigned, 8> Values;
+  for (unsigned i = 0; i < Unroll; i++) {
+    if (IsMemcpy) {
+      unsigned Value = MRI.createVirtualRegister(RC);
+      AddDefaultPred(BuildMI(LoopMBB, DL, TII.get(LoadOpc), Value))
+        .addReg(Src).addImm(i);
+      Values.push_back(Value);
+    } else {
+      Values.push_back(SrcReg);
+    }
+  }
+  for (unsigned i = 0; i < Unroll; i++) {
+    AddDefaultPred(BuildMI(LoopMBB, DL, TII.get(StoreOpc)))
+      .addReg(Dst).addImm(i).addReg(Values[i]);
+  }
+
+  AddDefaultPred(BuildMI(LoopMBB, DL, TII.get(Patmos::ADDi), DstNext))
+    .addReg(Dst).addImm(Unroll * 4);
+  if (IsMemcpy) {
+    AddDefaultPred(BuildMI(LoopMBB, DL, TII.get(Patmos::ADDi), SrcNext))
+      .addReg(Src).addImm(Unroll * 4);
+  }
+  AddDefaultPred(BuildMI(LoopMBB, DL, TII.get(Patmos::SUBi), CntNext))
+    .addReg(Cnt).addImm(1);
+  AddDefaultPred(BuildMI(LoopMBB, DL, TII.get(Patmos::CMPINEQ), Pred))
+    .addReg(CntNext).addImm(0);
+  BuildMI(LoopMBB, DL, TII.get(Patmos::BR))
+    .addReg(Pred).addImm(0).addMBB(LoopMBB);
+
+  MI->eraseFromParent();
+
+  return ExitMBB;
+}
+
 const char *PatmosTargetLowering::getTargetNodeName(unsigned Opcode) const {
   switch (Opcode) {
   default: return NULL;
@@ -782,5 +939,7 @@ const char *PatmosTargetLowering::getTargetNodeName(unsigned Opcode) const {
   case PatmosISD::CALL:               return "PatmosISD::CALL";
   case PatmosISD::MUL:                return "PatmosISD::MUL";
   case PatmosISD::MULU:               return "PatmosISD::MULU";
+  case PatmosISD::MEMCPY_LOOP:        return "PatmosISD::MEMCPY_LOOP";
+  case PatmosISD::MEMSET_LOOP:        return "PatmosISD::MEMSET_LOOP";
   }
 }
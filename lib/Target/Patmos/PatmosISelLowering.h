@@ -32,6 +32,18 @@ namespace llvm {
       /// multiplication
       MUL, MULU,
 
+      /// MEMCPY_LOOP - Copy loop of a memcpy. Operands are the chain, the
+      /// destination and source addresses, the number of iterations, the
+      /// number of words per iteration and the memory types of the
+      /// destination and the source.
+      MEMCPY_LOOP,
+
+      /// MEMSET_LOOP - Store loop of a memset. Operands are the chain, the
+      /// destination address, the word to store, the number of iterations,
+      /// the number of words per iteration and the memory type of the
+      /// destination.
+      MEMSET_LOOP,
+
       /// CALL - These operations represent an abstract call
       /// instruction, which includes a bunch of information.
       CALL = ISD::FIRST_TARGET_MEMORY_OPCODE
@@ -62,6 +74,12 @@ namespace llvm {
 
     virtual EVT getSetCCResultType(LLVMContext &Context, EVT VT) const;
 
+    /// EmitInstrWithCustomInserter - Expand the memcpy and memset loop
+    /// pseudos into loops.
+    virtual MachineBasicBlock *
+    EmitInstrWithCustomInserter(MachineInstr *MI,
+                                MachineBasicBlock *MBB) const;
+
     virtual unsigned getByValTypeAlignment(Type *Ty) const LLVM_OVERRIDE {
       // Align any type passed by value on the stack to words
       return 4;
@@ -178,6 +196,11 @@ namespace llvm {
 
     /// LowerLOAD - Promote i1 load operations to i8.
     SDValue LowerLOAD(SDValue Op, SelectionDAG &DAG) const;
+
+    /// EmitMemOpLoop - Emit the loop of a PSEUDO_MEMCPY_LOOP or a
+    /// PSEUDO_MEMSET_LOOP.
+    MachineBasicBlock *EmitMemOpLoop(MachineInstr *MI,
+                                     MachineBasicBlock *MBB) const;
   };
 
 
@@ -810,7 +810,7 @@ bool PatmosInstrInfo::canRemoveFromSchedule(MachineBasicBlock &MBB,
 
   // Check for MULs
   // TODO how far do we have to look back for MULs, i.e., what is the delay?
-  if (I->getOpcode() == Patmos::MUL || I->getOpcode() == Patmos::MULU)
+  if (hasOpcode(I, Patmos::MUL) || hasOpcode(I, Patmos::MULU))
     return false;
 
   return true;
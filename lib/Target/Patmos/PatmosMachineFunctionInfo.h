@@ -107,6 +107,10 @@ class PatmosMachineFunctionInfo : public MachineFunctionInfo {
   // Index to the SinglePathFIs where the call spill slots start (R9)
   unsigned SPCallSpillOffset;
 
+  /// Exact execution time in cycles of a single-path function, or -1 if no
+  /// exact estimate is available.
+  int64_t SinglePathCycles;
+
   /// Set of entry blocks to code regions that are potentially cached by the
   /// method cache.
   std::set<const MachineBasicBlock*> MethodCacheRegionEntries;
@@ -121,7 +125,7 @@ public:
     StackCacheReservedBytes(0), StackReservedBytes(0), VarArgsFI(0),
     RegScavengingFI(0), S0SpillReg(0),
     SinglePathConvert(false), SPS0SpillOffset(0), SPExcessSpillOffset(0),
-    SPCallSpillOffset(0)
+    SPCallSpillOffset(0), SinglePathCycles(-1)
     {}
 
   /// getStackCacheReservedBytes - Get the number of bytes reserved on the
@@ -208,6 +212,18 @@ public:
     return SinglePathConvert;
   }
 
+  /// setSinglePathCycles - Set the exact execution time of the single-path
+  /// function in cycles, -1 if unknown.
+  void setSinglePathCycles(int64_t cycles) {
+    SinglePathCycles = cycles;
+  }
+
+  /// getSinglePathCycles - Get the exact execution time of the single-path
+  /// function in cycles, or -1 if it is not known.
+  int64_t getSinglePathCycles() const {
+    return SinglePathCycles;
+  }
+
   void addSinglePathFI(int fi) {
     SinglePathFIs.push_back(fi);
   }
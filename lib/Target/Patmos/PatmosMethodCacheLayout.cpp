@@ -0,0 +1,394 @@
+//===-- PatmosMethodCacheLayout.cpp - Module-level code layout. -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Order the functions of a module, and thus their subfunctions, for Patmos'
+// method cache and estimate method cache conflicts statically.
+//
+// The function splitter decides on the subfunctions of one function at a time,
+// the order of the functions in the binary is otherwise the order in which
+// they are emitted. This pass uses the machine-level call graph to co-locate
+// callers and callees: functions are merged into chains greedily along the
+// heaviest call edges (similar to Pettis and Hansen), where calls from within
+// loops or recursion weigh more than others. The chains are then emitted one
+// after another.
+//
+// In addition, the working set of each call site within a loop is estimated
+// as the size of the calling subfunction plus the code size of all functions
+// reachable from the callee. When the working set exceeds the method cache
+// size (-mpatmos-method-cache-size), the calling subfunction is likely evicted
+// and reloaded on each iteration, which is reported as a conflict.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "patmos-method-cache-layout"
+
+#include "Patmos.h"
+#include "PatmosCallGraphBuilder.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/CodeGen/MachineModulePass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <list>
+#include <vector>
+
+using namespace llvm;
+
+/// LoopCallWeight - Weight of calls from within loops or recursion relative to
+/// other calls when merging call chains.
+static cl::opt<unsigned int> LoopCallWeight(
+  "mpatmos-method-cache-layout-loop-weight",
+  cl::init(10),
+  cl::desc("Weight of calls within loops when co-locating functions for the "
+           "method cache (default: 10)."),
+  cl::Hidden);
+
+namespace llvm {
+  STATISTIC(LayoutChains, "Number of call chains formed by the code layout.");
+  STATISTIC(LayoutAdjacentCalls,
+            "Call edges with adjacent caller and callee after the layout.");
+  STATISTIC(MethodCacheConflicts,
+            "Call sites in loops likely conflicting in the method cache.");
+}
+
+namespace {
+  /// Pass to order the functions of a module for the method cache.
+  class PatmosMethodCacheLayout : public MachineModulePass {
+  private:
+    /// A chain of functions to be emitted consecutively.
+    typedef std::list<MCGNode*> Chain;
+
+    /// A weighted call edge between two call graph nodes.
+    struct CallEdge {
+      MCGNode *A, *B;
+      unsigned int Weight;
+
+      /// Position of the first call to order edges of equal weight.
+      unsigned int Order;
+
+      bool operator<(const CallEdge &e) const {
+        return Weight > e.Weight || (Weight == e.Weight && Order < e.Order);
+      }
+    };
+
+    /// Map call graph nodes to values.
+    typedef DenseMap<MCGNode*, unsigned int> MCGNodeUInt;
+
+    const PatmosSubtarget &STC;
+    const PatmosInstrInfo &PII;
+
+    /// Size of the subfunction containing each call instruction.
+    DenseMap<const MachineInstr*, unsigned int> CallRegionSize;
+
+    /// Code size of each function.
+    MCGNodeUInt FunctionSize;
+
+    /// Code size of each function and all functions reachable from it.
+    MCGNodeUInt Footprint;
+
+    /// computeSizes - Compute the code size of a function and the size of the
+    /// subfunction containing each of its instructions.
+    void computeSizes(MCGNode *N)
+    {
+      MachineFunction *MF = N->getMF();
+      const PatmosMachineFunctionInfo *PMFI =
+                                       MF->getInfo<PatmosMachineFunctionInfo>();
+
+      // instructions of the current subfunction, waiting for its size
+      std::vector<const MachineInstr*> calls;
+      unsigned int total = 0, region = 0;
+
+      for(MachineFunction::iterator i(MF->begin()), ie(MF->end()); i != ie;
+          i++) {
+        if (i != MF->begin() && PMFI->isMethodCacheRegionEntry(i)) {
+          for(unsigned int c = 0; c < calls.size(); c++)
+            CallRegionSize[calls[c]] = region;
+          calls.clear();
+          total += region;
+          region = 0;
+        }
+
+        for(MachineBasicBlock::instr_iterator j(i->instr_begin()),
+            je(i->instr_end()); j != je; j++) {
+          if (j->isBundle()) continue;
+          region += PII.getInstrSize(&*j);
+
+          if (j->isCall())
+            calls.push_back(&*j);
+        }
+      }
+
+      for(unsigned int c = 0; c < calls.size(); c++)
+        CallRegionSize[calls[c]] = region;
+      total += region;
+
+      FunctionSize[N] = total;
+    }
+
+    /// computeFootprint - Compute the code size of a function and all
+    /// functions reachable from it.
+    unsigned int computeFootprint(MCGNode *N)
+    {
+      MCGNodeUInt::iterator it(Footprint.find(N));
+      if (it != Footprint.end())
+        return it->second;
+
+      // collect all reachable functions, counting each of them once
+      std::vector<MCGNode*> WL;
+      DenseMap<MCGNode*, bool> visited;
+      unsigned int size = 0;
+      WL.push_back(N);
+      visited[N] = true;
+      while (!WL.empty()) {
+        MCGNode *M = WL.back();
+        WL.pop_back();
+        size += FunctionSize.lookup(M);
+
+        for(MCGSites::const_iterator i(M->getSites().begin()),
+            ie(M->getSites().end()); i != ie; i++) {
+          MCGNode *callee = (*i)->getCallee();
+          if (!visited[callee]) {
+            visited[callee] = true;
+            WL.push_back(callee);
+          }
+        }
+      }
+
+      Footprint[N] = size;
+      return size;
+    }
+
+    /// estimateConflicts - Count call sites within loops whose working set
+    /// exceeds the method cache.
+    void estimateConflicts(const MCallGraph &G)
+    {
+      unsigned int size = STC.getMethodCacheSize();
+
+      for(MCGSites::const_iterator i(G.getSites().begin()),
+          ie(G.getSites().end()); i != ie; i++) {
+        MCGSite *site = *i;
+        MCGNode *caller = site->getCaller();
+        if (!site->isInSCC() || caller->isUnknown() || caller->isDead() ||
+            site->getCallee()->isUnknown())
+          continue;
+
+        // fall back to the whole caller in case the call is unknown
+        unsigned int region = FunctionSize.lookup(caller);
+        DenseMap<const MachineInstr*, unsigned int>::iterator it(
+                                          CallRegionSize.find(site->getMI()));
+        if (it != CallRegionSize.end())
+          region = it->second;
+
+        unsigned int workingset = region + computeFootprint(site->getCallee());
+        if (workingset > size) {
+          MethodCacheConflicts++;
+
+          DEBUG(dbgs() << "Method cache conflict: " << caller->getLabel()
+                       << " -> " << site->getCallee()->getLabel()
+                       << ": working set " << workingset << " > " << size
+                       << "\n");
+        }
+      }
+    }
+
+    /// collectEdges - Collect the weighted call edges between live functions,
+    /// given their positions in the module.
+    void collectEdges(const MCallGraph &G, MCGNodeUInt &Position,
+                      std::vector<CallEdge> &Edges)
+    {
+      DenseMap<std::pair<MCGNode*, MCGNode*>, unsigned int> Index;
+
+      for(MCGSites::const_iterator i(G.getSites().begin()),
+          ie(G.getSites().end()); i != ie; i++) {
+        MCGNode *a = (*i)->getCaller();
+        MCGNode *b = (*i)->getCallee();
+        if (a == b || !Position.count(a) || !Position.count(b))
+          continue;
+
+        // edges are undirected
+        if (Position[a] > Position[b])
+          std::swap(a, b);
+
+        std::pair<DenseMap<std::pair<MCGNode*, MCGNode*>,
+                           unsigned int>::iterator, bool> tmp(
+            Index.insert(std::make_pair(std::make_pair(a, b), Edges.size())));
+        if (tmp.second) {
+          CallEdge e = {a, b, 0, (unsigned int)Edges.size()};
+          Edges.push_back(e);
+        }
+
+        Edges[tmp.first->second].Weight += (*i)->isInSCC() ? LoopCallWeight
+                                                           : 1;
+      }
+
+      std::sort(Edges.begin(), Edges.end());
+    }
+
+    /// formChains - Merge functions into chains along the heaviest call edges.
+    /// Chains are only concatenated, such that callers and callees at the ends
+    /// of their chains become neighbors when possible.
+    void formChains(const std::vector<CallEdge> &Edges,
+                    std::vector<Chain> &Chains, MCGNodeUInt &ChainOf)
+    {
+      for(std::vector<CallEdge>::const_iterator i(Edges.begin()),
+          ie(Edges.end()); i != ie; i++) {
+        unsigned int ca = ChainOf[i->A], cb = ChainOf[i->B];
+        if (ca == cb)
+          continue;
+
+        Chain &A(Chains[ca]), &B(Chains[cb]);
+
+        // orient the chains such that the nodes end up close to each other
+        if (A.front() == i->A && B.back() == i->B) {
+          B.splice(B.end(), A);
+          std::swap(A, B);
+        }
+        else if (A.front() == i->A && B.front() == i->B) {
+          A.reverse();
+          A.splice(A.end(), B);
+        }
+        else if (A.back() == i->A && B.back() == i->B) {
+          B.reverse();
+          A.splice(A.end(), B);
+        }
+        else {
+          A.splice(A.end(), B);
+        }
+
+        for(Chain::iterator j(A.begin()), je(A.end()); j != je; j++)
+          ChainOf[*j] = ca;
+      }
+    }
+  public:
+    /// Pass ID
+    static char ID;
+
+    PatmosMethodCacheLayout(const PatmosTargetMachine &tm) :
+        MachineModulePass(ID), STC(tm.getSubtarget<PatmosSubtarget>()), PII(*tm.getInstrInfo())
+    {
+    }
+
+    /// getPassName - Return the pass' name.
+    virtual const char *getPassName() const
+    {
+      return "Patmos Method Cache Layout";
+    }
+
+    /// getAnalysisUsage - Inform the pass manager that only the order of the
+    /// functions is modified, the machine functions and the call graph are
+    /// kept.
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const
+    {
+      AU.addRequired<PatmosCallGraphBuilder>();
+      AU.addPreserved<PatmosCallGraphBuilder>();
+      AU.addRequired<MachineModuleInfo>();
+
+      MachineModulePass::getAnalysisUsage(AU);
+    }
+
+    virtual bool runOnMachineModule(const Module &M)
+    {
+      PatmosCallGraphBuilder &PCGB(getAnalysis<PatmosCallGraphBuilder>());
+      const MCallGraph &G(*PCGB.getCallGraph());
+      MachineModuleInfo &MMI(getAnalysis<MachineModuleInfo>());
+
+      DenseMap<const MachineFunction*, MCGNode*> Nodes;
+      for(MCGNodes::const_iterator i(G.getNodes().begin()),
+          ie(G.getNodes().end()); i != ie; i++) {
+        if (!(*i)->isUnknown())
+          Nodes[(*i)->getMF()] = *i;
+      }
+
+      // one chain per live function, in module order
+      std::vector<Chain> Chains;
+      MCGNodeUInt ChainOf;
+      for(Module::const_iterator i(M.begin()), ie(M.end()); i != ie; i++) {
+        MCGNode *N = Nodes.lookup(MMI.getMachineFunction(i));
+        if (!N || N->isDead())
+          continue;
+
+        computeSizes(N);
+
+        ChainOf[N] = Chains.size();
+        Chains.push_back(Chain(1, N));
+      }
+
+      estimateConflicts(G);
+
+      // merge chains along call edges
+      std::vector<CallEdge> Edges;
+      collectEdges(G, ChainOf, Edges);
+      formChains(Edges, Chains, ChainOf);
+
+      // emit the chains in the order of their first function in the module,
+      // functions that are not part of any chain stay behind them.
+      Module::FunctionListType &Functions(
+                               const_cast<Module&>(M).getFunctionList());
+      Module::iterator pos(Functions.begin());
+      for(unsigned int c = 0; c < Chains.size(); c++) {
+        if (Chains[c].empty())
+          continue;
+
+        LayoutChains++;
+
+        for(Chain::iterator i(Chains[c].begin()), ie(Chains[c].end());
+            i != ie; i++) {
+          Function *F = const_cast<Function*>((*i)->getMF()->getFunction());
+          if (pos != Functions.end() && &*pos == F)
+            pos++;
+          else
+            Functions.splice(pos, Functions, Module::iterator(F));
+        }
+      }
+
+      // count the call edges between neighbors
+      DenseMap<const Function*, const Function*> Next;
+      for(Module::const_iterator i(M.begin()), ie(M.end()); i != ie; ) {
+        const Function *F = i;
+        if (++i != ie)
+          Next[F] = i;
+      }
+      for(std::vector<CallEdge>::const_iterator i(Edges.begin()),
+          ie(Edges.end()); i != ie; i++) {
+        const Function *A = i->A->getMF()->getFunction();
+        const Function *B = i->B->getMF()->getFunction();
+        if (Next.lookup(A) == B || Next.lookup(B) == A)
+          LayoutAdjacentCalls++;
+      }
+
+      DEBUG(
+        dbgs() << "Method cache layout:";
+        for(Module::const_iterator i(M.begin()), ie(M.end()); i != ie; i++) {
+          if (!i->isDeclaration())
+            dbgs() << " " << i->getName();
+        }
+        dbgs() << "\n";
+      );
+
+      return true;
+    }
+  };
+
+  char PatmosMethodCacheLayout::ID = 0;
+}
+
+/// createPatmosMethodCacheLayoutPass - Returns a new PatmosMethodCacheLayout.
+ModulePass *llvm::createPatmosMethodCacheLayoutPass(
+                                               const PatmosTargetMachine &tm) {
+  return new PatmosMethodCacheLayout(tm);
+}
@@ -32,6 +32,7 @@
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/CodeGen/AggressiveAntiDepBreaker.h"
 #include "llvm/CodeGen/AntiDepBreaker.h"
+#include "llvm/CodeGen/MachineBranchProbabilityInfo.h"
 #include "llvm/CodeGen/CriticalAntiDepBreaker.h"
 #include "llvm/CodeGen/LatencyPriorityQueue.h"
 #include "llvm/CodeGen/MachineDominators.h"
@@ -63,6 +64,8 @@ STATISTIC(NumFixedAnti, "Number of fixed anti-dependencies");
 STATISTIC(NumBundled, "Number of bundles with size > 1");
 STATISTIC(NumNotBundled, "Number of instructions not bundled");
 STATISTIC(NumRescheduled, "Number of rescheduled instructions");
+STATISTIC(NumHoisted,     "Number of instructions hoisted across branches");
+STATISTIC(NumTraceEdges,  "Number of branches extended into their successor");
 
 static cl::opt<bool> ViewPostRASchedDAGs("view-postra-sched-dags", cl::Hidden,
   cl::desc("Pop up a window to show PostRASched dags after they are processed"));
@@ -74,6 +77,17 @@ EnableAntiDepBreaking("mpatmos-break-anti-dependencies",
                                "\"critical\", \"all\", or \"none\""),
                       cl::Hidden);
 
+static cl::opt<bool> EnableSuperblockSched("mpatmos-superblock-sched",
+  cl::init(false), cl::Hidden,
+  cl::desc("Hoist instructions of the critical successor of a conditional "
+           "branch into the branching block, guarded by the branch "
+           "condition, before post-RA scheduling."));
+
+static cl::opt<unsigned> SuperblockHoistLimit("mpatmos-superblock-hoist-limit",
+  cl::init(0), cl::Hidden,
+  cl::desc("Maximum number of instructions to hoist across a branch "
+           "(default: the number of delay slots of the branch)."));
+
 
 // DAG subtrees must have at least this many nodes.
 static const unsigned MinSubtreeSize = 8;
@@ -98,11 +112,34 @@ namespace {
       AU.addPreserved<MachineDominatorTree>();
       AU.addRequired<MachineLoopInfo>();
       AU.addPreserved<MachineLoopInfo>();
+      AU.addRequired<MachineBranchProbabilityInfo>();
+      AU.addPreserved<MachineBranchProbabilityInfo>();
       MachineFunctionPass::getAnalysisUsage(AU);
     }
 
     bool runOnMachineFunction(MachineFunction &Fn);
 
+  private:
+    /// getTraceSuccessor - Get the successor of a conditional branch that
+    /// continues the critical trace, based on the criticalities of the
+    /// blocks or, if not available, on the branch probabilities. Returns
+    /// null if no successor is preferred.
+    MachineBasicBlock *getTraceSuccessor(MachineBasicBlock *MBB,
+                                         MachineBasicBlock *TBB,
+                                         MachineBasicBlock *FBB);
+
+    /// canHoistIntoTrace - Check if MI can be moved in front of the given
+    /// terminator registers and guarded by the branch condition.
+    bool canHoistIntoTrace(const PatmosInstrInfo &PII, MachineInstr *MI,
+                           const SmallVectorImpl<unsigned> &TermRegs) const;
+
+    /// formSuperblocks - Move instructions from the head of the trace
+    /// successor of every conditional branch into the branching block, so
+    /// that they can be scheduled into the delay slots of the branch. The
+    /// instructions are guarded by the branch condition, thus the other
+    /// successor does not need any compensation code.
+    bool formSuperblocks(MachineFunction &MF);
+
   };
   char PatmosPostRAScheduler::ID = 0;
 
@@ -173,6 +210,10 @@ bool PatmosPostRAScheduler::runOnMachineFunction(MachineFunction &mf) {
          : TargetSubtargetInfo::ANTIDEP_NONE);
   }
 
+  if (EnableSuperblockSched) {
+    formSuperblocks(mf);
+  }
+
   // TODO this should be created by some factory..
   const PatmosTargetMachine *PTM =
                       static_cast<const PatmosTargetMachine*>(&mf.getTarget());
@@ -266,6 +307,154 @@ bool PatmosPostRAScheduler::runOnMachineFunction(MachineFunction &mf) {
   return true;
 }
 
+MachineBasicBlock *
+PatmosPostRAScheduler::getTraceSuccessor(MachineBasicBlock *MBB,
+                                         MachineBasicBlock *TBB,
+                                         MachineBasicBlock *FBB)
+{
+  PatmosAnalysisInfo &PAI =
+                   MF->getInfo<PatmosMachineFunctionInfo>()->getAnalysisInfo();
+
+  double TCrit = PAI.getCriticality(TBB);
+  double FCrit = PAI.getCriticality(FBB);
+  if (TCrit >= 0.0 || FCrit >= 0.0) {
+    if (TCrit == FCrit) return 0;
+    return TCrit > FCrit ? TBB : FBB;
+  }
+
+  const MachineBranchProbabilityInfo &MBPI =
+                                   getAnalysis<MachineBranchProbabilityInfo>();
+  if (MBPI.isEdgeHot(MBB, TBB)) return TBB;
+  if (MBPI.isEdgeHot(MBB, FBB)) return FBB;
+  return 0;
+}
+
+bool PatmosPostRAScheduler::canHoistIntoTrace(const PatmosInstrInfo &PII,
+                          MachineInstr *MI,
+                          const SmallVectorImpl<unsigned> &TermRegs) const
+{
+  if (MI->isBundle() || MI->isInlineAsm() || PII.isPseudo(MI) ||
+      MI->isCall() || MI->isReturn() || MI->isBranch() || MI->isTerminator() ||
+      MI->hasUnmodeledSideEffects() || PII.isStackControl(MI))
+    return false;
+
+  // The instruction must not be guarded already, and we do not predicate
+  // instructions that may stall, as the cache analyses do not handle them
+  // properly (same as the if-converter).
+  if (!MI->isPredicable() || PII.isPredicated(MI) || PII.mayStall(MI))
+    return false;
+
+  const TargetRegisterInfo *TRI = MF->getTarget().getRegisterInfo();
+  for (MachineInstr::const_mop_iterator MO = MI->operands_begin(),
+       MOE = MI->operands_end(); MO != MOE; ++MO)
+  {
+    if (MO->isRegMask()) return false;
+    if (!MO->isReg() || !MO->isDef()) continue;
+
+    for (unsigned i = 0; i < TermRegs.size(); i++) {
+      if (TRI->regsOverlap(MO->getReg(), TermRegs[i])) return false;
+    }
+  }
+  return true;
+}
+
+bool PatmosPostRAScheduler::formSuperblocks(MachineFunction &MF)
+{
+  const PatmosTargetMachine &PTM =
+                     static_cast<const PatmosTargetMachine&>(MF.getTarget());
+  const PatmosInstrInfo &PII = *PTM.getInstrInfo();
+  const PatmosSubtarget &PST = *PTM.getSubtargetImpl();
+
+  bool Changed = false;
+
+  for (MachineFunction::iterator MBB = MF.begin(), MBBEnd = MF.end();
+       MBB != MBBEnd; ++MBB)
+  {
+    MachineBasicBlock *TBB = 0, *FBB = 0;
+    SmallVector<MachineOperand, 2> Cond;
+    if (PII.AnalyzeBranch(*MBB, TBB, FBB, Cond) || Cond.empty()) continue;
+    if (MBB->succ_size() != 2) continue;
+
+    // Get the fall-through successor
+    if (!FBB) {
+      for (MachineBasicBlock::succ_iterator SI = MBB->succ_begin(),
+           SE = MBB->succ_end(); SI != SE; ++SI)
+      {
+        if (*SI != TBB) FBB = *SI;
+      }
+    }
+    if (!FBB || TBB == FBB) continue;
+
+    MachineBasicBlock *Succ = getTraceSuccessor(MBB, TBB, FBB);
+    if (!Succ) continue;
+
+    // Only merge the head of successors that are executed exclusively after
+    // this branch.
+    if (Succ->pred_size() != 1 || Succ == MBB || Succ->isLandingPad() ||
+        Succ->hasAddressTaken())
+      continue;
+
+    if (Succ == FBB) PII.ReverseBranchCondition(Cond);
+
+    MachineBasicBlock::iterator InsertPt = MBB->getFirstTerminator();
+    assert(InsertPt != MBB->end() && InsertPt->isConditionalBranch() &&
+           "Conditional branch expected");
+
+    unsigned Limit = SuperblockHoistLimit ? (unsigned)SuperblockHoistLimit :
+                                            PST.getDelaySlotCycles(InsertPt);
+    if (!Limit) continue;
+
+    // Hoisted instructions must not change any register read by the branches
+    SmallVector<unsigned, 4> TermRegs;
+    for (MachineBasicBlock::iterator TI = InsertPt, TE = MBB->end();
+         TI != TE; ++TI)
+    {
+      for (MachineInstr::const_mop_iterator MO = TI->operands_begin(),
+           MOE = TI->operands_end(); MO != MOE; ++MO)
+      {
+        if (MO->isReg() && MO->isUse() && MO->getReg()) {
+          TermRegs.push_back(MO->getReg());
+        }
+      }
+    }
+
+    unsigned Hoisted = 0;
+    MachineBasicBlock::iterator I = Succ->begin();
+    while (I != Succ->end() && Hoisted < Limit) {
+      MachineInstr *MI = I++;
+
+      if (MI->isDebugValue()) continue;
+
+      if (!canHoistIntoTrace(PII, MI, TermRegs)) break;
+
+      DEBUG(dbgs() << "Superblock: hoisting from BB#" << Succ->getNumber()
+                   << " into BB#" << MBB->getNumber() << ": " << *MI);
+
+      MBB->splice(InsertPt, Succ, MI);
+      PII.PredicateInstruction(MI, Cond);
+
+      // The defined registers are now live across the edge.
+      for (MachineInstr::const_mop_iterator MO = MI->operands_begin(),
+           MOE = MI->operands_end(); MO != MOE; ++MO)
+      {
+        if (MO->isReg() && MO->isDef() && !Succ->isLiveIn(MO->getReg())) {
+          Succ->addLiveIn(MO->getReg());
+        }
+      }
+
+      Hoisted++;
+    }
+
+    if (Hoisted) {
+      NumHoisted += Hoisted;
+      NumTraceEdges++;
+      Changed = true;
+    }
+  }
+
+  return Changed;
+}
+
 
 PostRASchedContext::PostRASchedContext():
     MF(0), MLI(0), MDT(0), PassConfig(0), AA(0),
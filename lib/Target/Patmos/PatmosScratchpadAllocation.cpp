@@ -0,0 +1,682 @@
+//===-- PatmosScratchpadAllocation.cpp - Allocate data to the scratchpad. -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Allocate frequently accessed globals and stack objects statically to the
+// local scratchpad memory (SPM), such that their loads and stores are selected
+// to the local memory variants (LWL, SWL, ...) instead of going through the
+// data cache.
+//
+// Candidates are internal globals and fixed-size allocas whose addresses do
+// not escape, i.e., that are only accessed by loads and stores, possibly
+// through GEPs and bitcasts. Allocas are only considered in functions that
+// can neither be re-entered through recursion nor through calls to unknown
+// code. Their SPM space is overlaid with the space of all functions that can
+// not be active at the same time, based on the call graph.
+//
+// The accesses of each candidate are weighted by the block frequencies of the
+// accessing blocks and an estimate of the number of calls of the accessing
+// function. If WCET criticalities are available from imported PML files, the
+// weights are scaled by the criticality of the accessing blocks. Candidates
+// are then selected greedily by their weight per byte until the SPM is full.
+//
+// Selected objects are addressed by constant addresses in address space 1.
+// The initial values of selected globals are copied to the SPM in a prologue
+// at the entry of main, before any of their accesses.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "patmos-spm-alloc"
+
+#include "Patmos.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/CodeGen/PMLImport.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+#include "llvm/PML.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace llvm;
+
+/// SPMAllocSize - Size of the scratchpad available to the allocation.
+static cl::opt<unsigned> SPMAllocSize(
+  "mpatmos-spm-alloc-size",
+  cl::init(0),
+  cl::desc("Allocate hot globals and stack objects to the given number of "
+           "bytes of the local scratchpad (default: 0, disabled)."),
+  cl::Hidden);
+
+/// SPMAllocBase - Local address of the scratchpad space used for the
+/// allocation.
+static cl::opt<unsigned> SPMAllocBase(
+  "mpatmos-spm-alloc-base",
+  cl::init(0),
+  cl::desc("Local address of the scratchpad space used for the allocation "
+           "(default: 0)."),
+  cl::Hidden);
+
+/// SPMAllocMinObject - Minimum size of stack objects allocated to the
+/// scratchpad.
+static cl::opt<unsigned> SPMAllocMinObject(
+  "mpatmos-spm-alloc-min-object",
+  cl::init(16),
+  cl::desc("Minimum size of stack objects allocated to the local scratchpad "
+           "in bytes (default: 16)."),
+  cl::Hidden);
+
+STATISTIC(SPMGlobals,      "Number of globals allocated to the scratchpad.");
+STATISTIC(SPMStackObjects, "Number of stack objects allocated to the "
+                           "scratchpad.");
+STATISTIC(SPMBytes,        "Bytes of the scratchpad used by the allocation.");
+STATISTIC(SPMAccesses,     "Loads and stores rewritten to the scratchpad.");
+
+namespace {
+  class PatmosScratchpadAllocation : public ModulePass {
+  private:
+    /// A global or alloca that can be allocated to the scratchpad.
+    struct Candidate {
+      Value *Object;
+
+      /// The function containing the alloca, NULL for globals.
+      Function *F;
+
+      unsigned Size;
+      double Weight;
+
+      Candidate(Value *object, Function *f, unsigned size, double weight)
+        : Object(object), F(f), Size(size), Weight(weight) {}
+
+      /// Order candidates by decreasing weight per byte.
+      bool operator<(const Candidate &C) const {
+        return Weight * C.Size > C.Weight * Size;
+      }
+    };
+
+    typedef DenseMap<const Function*, double> FunctionDouble;
+    typedef DenseMap<const Function*, unsigned> FunctionUInt;
+    typedef DenseMap<const Function*, std::vector<Function*> > FunctionCalls;
+
+    const PatmosTargetMachine &TM;
+    const DataLayout *DL;
+
+    /// Callees and callers of all defined functions.
+    FunctionCalls Callees, Callers;
+
+    /// Functions calling unknown code, e.g., indirect calls.
+    DenseMap<const Function*, bool> CallsUnknown;
+
+    /// Functions that are (transitively) re-entrant, and thus cannot keep
+    /// their stack objects in the scratchpad.
+    DenseMap<const Function*, bool> Reentrant;
+
+    /// Estimated number of calls of each function reachable from main.
+    FunctionDouble Calls;
+
+    /// Space of each non-re-entrant function in the scratchpad.
+    FunctionUInt FrameSize;
+
+    /// Relative frequency of each basic block in its function, scaled by the
+    /// WCET criticality of the block if available.
+    DenseMap<const BasicBlock*, double> BlockWeight;
+
+    /// buildCallGraph - Collect the calls of all defined functions.
+    void buildCallGraph(Module &M)
+    {
+      for(Module::iterator F(M.begin()), FE(M.end()); F != FE; F++) {
+        if (F->isDeclaration())
+          continue;
+
+        for(Function::iterator BB(F->begin()), BE(F->end()); BB != BE; BB++) {
+          for(BasicBlock::iterator I(BB->begin()), IE(BB->end()); I != IE;
+              I++) {
+            CallSite CS(I);
+            if (!CS || isa<IntrinsicInst>(I))
+              continue;
+
+            Function *Callee = dyn_cast<Function>(
+                                   CS.getCalledValue()->stripPointerCasts());
+            if (!Callee || Callee->isDeclaration()) {
+              CallsUnknown[F] = true;
+              continue;
+            }
+
+            Callees[F].push_back(Callee);
+            Callers[Callee].push_back(F);
+          }
+        }
+      }
+    }
+
+    /// isReentrant - Check whether a function may be called again while it
+    /// is active, i.e., whether it is part of a cycle in the call graph or
+    /// calls unknown code.
+    bool isReentrant(const Function *F)
+    {
+      DenseMap<const Function*, bool>::iterator known(Reentrant.find(F));
+      if (known != Reentrant.end())
+        return known->second;
+
+      // reaching the function again while it is visited means recursion
+      Reentrant[F] = true;
+
+      bool result = CallsUnknown.lookup(F);
+      const std::vector<Function*> callees(Callees.lookup(F));
+      for(unsigned i = 0, e = callees.size(); i != e; i++) {
+        if (isReentrant(callees[i]))
+          result = true;
+      }
+
+      return Reentrant[F] = result;
+    }
+
+    /// computeCalls - Estimate the number of calls of all functions reachable
+    /// from the entry function. Calls within recursion are counted once.
+    void computeCalls(Function *Entry)
+    {
+      // order the functions topologically, ignoring recursive calls
+      std::vector<Function*> order;
+      DenseMap<const Function*, bool> visited;
+      std::vector<std::pair<Function*, unsigned> > stack;
+
+      stack.push_back(std::make_pair(Entry, 0u));
+      visited[Entry] = true;
+      while (!stack.empty()) {
+        Function *F = stack.back().first;
+        unsigned &next = stack.back().second;
+        const std::vector<Function*> &callees(Callees[F]);
+
+        if (next < callees.size()) {
+          Function *Callee = callees[next++];
+          if (!visited.lookup(Callee)) {
+            visited[Callee] = true;
+            stack.push_back(std::make_pair(Callee, 0u));
+          }
+        }
+        else {
+          order.push_back(F);
+          stack.pop_back();
+        }
+      }
+
+      Calls[Entry] = 1.0;
+      for(std::vector<Function*>::reverse_iterator i(order.rbegin()),
+          ie(order.rend()); i != ie; i++) {
+        Function *F = *i;
+        double calls = Calls[F];
+
+        for(Function::iterator BB(F->begin()), BE(F->end()); BB != BE; BB++) {
+          for(BasicBlock::iterator I(BB->begin()), IE(BB->end()); I != IE;
+              I++) {
+            CallSite CS(I);
+            if (!CS || isa<IntrinsicInst>(I))
+              continue;
+
+            Function *Callee = dyn_cast<Function>(
+                                   CS.getCalledValue()->stripPointerCasts());
+            if (Callee && Callee != F && !Callee->isDeclaration())
+              Calls[Callee] += calls * BlockWeight[BB];
+          }
+        }
+      }
+    }
+
+    /// computeBlockWeights - Compute the relative frequencies of the basic
+    /// blocks of a function, scaled by their WCET criticality.
+    void computeBlockWeights(Function &F)
+    {
+      BlockFrequencyInfo &BFI(getAnalysis<BlockFrequencyInfo>(F));
+      double entry = BlockFrequency::getEntryFrequency();
+
+      PMLImport &PI(getAnalysis<PMLImport>());
+      OwningPtr<PMLBitcodeQuery> PQ(PI.createBitcodeQuery(*this, F,
+                                                         yaml::level_bitcode));
+      PMLQuery::BlockDoubleMap Criticalities;
+      bool hasCriticalities = PQ && PQ->getBlockCriticalityMap(Criticalities);
+
+      for(Function::iterator BB(F.begin()), BE(F.end()); BB != BE; BB++) {
+        double weight = BFI.getBlockFreq(BB).getFrequency() / entry;
+
+        if (hasCriticalities)
+          weight *= PQ->getCriticality(Criticalities, *BB, 0.0);
+
+        BlockWeight[BB] = weight;
+      }
+    }
+
+    /// collectAccesses - Check that a pointer is only used to access memory
+    /// and sum up the weights of its accesses. Returns false if the pointer
+    /// escapes, or is used by functions not reachable from the entry.
+    bool collectAccesses(Value *Ptr, double &Weight, unsigned &Accesses)
+    {
+      for(Value::use_iterator U(Ptr->use_begin()), UE(Ptr->use_end());
+          U != UE; U++) {
+        User *user = *U;
+
+        if (ConstantExpr *CE = dyn_cast<ConstantExpr>(user)) {
+          if (CE->getOpcode() != Instruction::GetElementPtr &&
+              CE->getOpcode() != Instruction::BitCast)
+            return false;
+          if (!collectAccesses(CE, Weight, Accesses))
+            return false;
+          continue;
+        }
+
+        Instruction *I = dyn_cast<Instruction>(user);
+        if (!I)
+          return false;
+
+        const Function *F = I->getParent()->getParent();
+        if (!Calls.count(F))
+          return false;
+
+        if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+          if (LI->isAtomic())
+            return false;
+        }
+        else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+          if (SI->isAtomic() || SI->getValueOperand() == Ptr)
+            return false;
+        }
+        else if (isa<GetElementPtrInst>(I) || isa<BitCastInst>(I)) {
+          if (!collectAccesses(I, Weight, Accesses))
+            return false;
+          continue;
+        }
+        else if (const IntrinsicInst *II = dyn_cast<IntrinsicInst>(I)) {
+          // lifetime markers are dropped for allocated stack objects
+          if (II->getIntrinsicID() != Intrinsic::lifetime_start &&
+              II->getIntrinsicID() != Intrinsic::lifetime_end)
+            return false;
+          continue;
+        }
+        else
+          return false;
+
+        Weight += Calls[F] * BlockWeight[I->getParent()];
+        Accesses++;
+      }
+      return true;
+    }
+
+    /// collectCandidates - Find the globals and allocas that can be allocated
+    /// to the scratchpad.
+    void collectCandidates(Module &M, std::vector<Candidate> &Candidates)
+    {
+      for(Module::global_iterator GV(M.global_begin()), GE(M.global_end());
+          GV != GE; GV++) {
+        if (!GV->hasLocalLinkage() || GV->isThreadLocal() ||
+            !GV->hasInitializer() ||
+            GV->getType()->getAddressSpace() != 0 ||
+            GV->getAlignment() > 4 || GV->hasSection())
+          continue;
+
+        unsigned size = DL->getTypeAllocSize(GV->getType()->getElementType());
+        double weight = 0;
+        unsigned accesses = 0;
+        if (size == 0 || size > SPMAllocSize ||
+            !collectAccesses(GV, weight, accesses) || !accesses)
+          continue;
+
+        Candidates.push_back(Candidate(GV, NULL, size, weight));
+      }
+
+      for(Module::iterator F(M.begin()), FE(M.end()); F != FE; F++) {
+        if (!Calls.count(F) || isReentrant(F))
+          continue;
+
+        BasicBlock &Entry(F->getEntryBlock());
+        for(BasicBlock::iterator I(Entry.begin()), IE(Entry.end()); I != IE;
+            I++) {
+          AllocaInst *AI = dyn_cast<AllocaInst>(I);
+          if (!AI || !AI->isStaticAlloca() || AI->getAlignment() > 4)
+            continue;
+
+          unsigned size = DL->getTypeAllocSize(AI->getAllocatedType()) *
+                     cast<ConstantInt>(AI->getArraySize())->getZExtValue();
+          double weight = 0;
+          unsigned accesses = 0;
+          if (size < SPMAllocMinObject || size > SPMAllocSize ||
+              !collectAccesses(AI, weight, accesses) || !accesses)
+            continue;
+
+          Candidates.push_back(Candidate(AI, F, size, weight));
+        }
+      }
+    }
+
+    /// getMaxChain - Compute the maximum scratchpad space used by a function
+    /// and its callees.
+    unsigned getMaxChain(const Function *F, FunctionUInt &Chains)
+    {
+      FunctionUInt::iterator known(Chains.find(F));
+      if (known != Chains.end())
+        return known->second;
+
+      unsigned chain = 0;
+      const std::vector<Function*> callees(Callees.lookup(F));
+      for(unsigned i = 0, e = callees.size(); i != e; i++)
+        chain = std::max(chain, getMaxChain(callees[i], Chains));
+
+      return Chains[F] = chain + FrameSize.lookup(F);
+    }
+
+    /// getStackSpace - Compute the scratchpad space needed by the stack
+    /// objects of all non-re-entrant functions.
+    unsigned getStackSpace()
+    {
+      FunctionUInt chains;
+      unsigned space = 0;
+      for(FunctionUInt::iterator i(FrameSize.begin()), ie(FrameSize.end());
+          i != ie; i++) {
+        space = std::max(space, getMaxChain(i->first, chains));
+      }
+      return space;
+    }
+
+    /// getFrameOffset - Compute the offset of a function's stack objects in
+    /// the scratchpad, behind the space of all its callers.
+    unsigned getFrameOffset(const Function *F, FunctionUInt &Offsets)
+    {
+      FunctionUInt::iterator known(Offsets.find(F));
+      if (known != Offsets.end())
+        return known->second;
+
+      unsigned offset = 0;
+      const std::vector<Function*> callers(Callers.lookup(F));
+      for(unsigned i = 0, e = callers.size(); i != e; i++) {
+        // re-entrant callers do not have any stack objects in the scratchpad
+        if (!isReentrant(callers[i])) {
+          offset = std::max(offset, getFrameOffset(callers[i], Offsets) +
+                                    FrameSize.lookup(callers[i]));
+        }
+      }
+
+      return Offsets[F] = offset;
+    }
+
+    /// rewriteUses - Rewrite all uses of a pointer to use the scratchpad
+    /// address instead.
+    void rewriteUses(Value *Old, Value *New)
+    {
+      SmallVector<User*, 16> users(Old->use_begin(), Old->use_end());
+
+      for(unsigned i = 0, e = users.size(); i != e; i++) {
+        User *user = users[i];
+
+        if (ConstantExpr *CE = dyn_cast<ConstantExpr>(user)) {
+          Constant *NewC = cast<Constant>(New);
+          Constant *Replacement;
+          if (CE->getOpcode() == Instruction::BitCast) {
+            Replacement = ConstantExpr::getBitCast(NewC,
+                                 getSPMPointerType(CE->getType()));
+          }
+          else {
+            SmallVector<Constant*, 4> indices;
+            for(unsigned j = 1, je = CE->getNumOperands(); j != je; j++)
+              indices.push_back(CE->getOperand(j));
+            Replacement = ConstantExpr::getGetElementPtr(NewC, indices,
+                              cast<GEPOperator>(CE)->isInBounds());
+          }
+          rewriteUses(CE, Replacement);
+          if (CE->use_empty())
+            CE->destroyConstant();
+          continue;
+        }
+
+        Instruction *I = cast<Instruction>(user);
+        if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+          LoadInst *NewLI = new LoadInst(New, "", LI->isVolatile(),
+                                         LI->getAlignment(), LI);
+          NewLI->takeName(LI);
+          LI->replaceAllUsesWith(NewLI);
+          SPMAccesses++;
+        }
+        else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+          new StoreInst(SI->getValueOperand(), New, SI->isVolatile(),
+                        SI->getAlignment(), SI);
+          SPMAccesses++;
+        }
+        else if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(I)) {
+          SmallVector<Value*, 4> indices(GEP->idx_begin(), GEP->idx_end());
+          GetElementPtrInst *NewGEP = GetElementPtrInst::Create(New, indices,
+                                                                "", GEP);
+          NewGEP->setIsInBounds(GEP->isInBounds());
+          NewGEP->takeName(GEP);
+          rewriteUses(GEP, NewGEP);
+        }
+        else if (BitCastInst *BC = dyn_cast<BitCastInst>(I)) {
+          BitCastInst *NewBC = new BitCastInst(New,
+                                 getSPMPointerType(BC->getType()), "", BC);
+          NewBC->takeName(BC);
+          rewriteUses(BC, NewBC);
+        }
+        else {
+          assert(isa<IntrinsicInst>(I) && "Unexpected use of SPM object.");
+        }
+
+        I->eraseFromParent();
+      }
+    }
+
+    /// getSPMPointerType - Get the scratchpad pointer type corresponding to a
+    /// pointer type.
+    static PointerType *getSPMPointerType(Type *T)
+    {
+      return PointerType::get(cast<PointerType>(T)->getElementType(), 1);
+    }
+
+    /// emitCopy - Copy the initial value of a global to the scratchpad in
+    /// front of the given instruction, in words and trailing bytes.
+    void emitCopy(GlobalVariable *GV, Constant *SPMAddress, unsigned Size,
+                  Instruction *InsertBefore)
+    {
+      LLVMContext &Ctx(GV->getContext());
+      Type *I32 = Type::getInt32Ty(Ctx);
+      Type *I8 = Type::getInt8Ty(Ctx);
+
+      GV->setAlignment(std::max(4u, GV->getAlignment()));
+
+      unsigned words = Size / 4;
+      if (words) {
+        Constant *Src = ConstantExpr::getBitCast(GV, I32->getPointerTo(0));
+        Constant *Dst = ConstantExpr::getBitCast(SPMAddress,
+                                                 I32->getPointerTo(1));
+
+        // copy in a loop in front of the instruction
+        BasicBlock *Head = InsertBefore->getParent();
+        BasicBlock *Tail = Head->splitBasicBlock(InsertBefore,
+                                                 GV->getName() + ".spm.tail");
+        BasicBlock *Loop = BasicBlock::Create(Ctx, GV->getName() + ".spm.copy",
+                                              Head->getParent(), Tail);
+        Head->getTerminator()->setSuccessor(0, Loop);
+
+        PHINode *Idx = PHINode::Create(I32, 2, "", Loop);
+        Value *Bound = ConstantInt::get(I32, words - 1);
+        Value *BoundArgs[] = { Bound, Bound };
+        CallInst::Create(Intrinsic::getDeclaration(GV->getParent(),
+                                                   Intrinsic::loopbound),
+                         BoundArgs, "", Loop);
+        Value *SrcPtr = GetElementPtrInst::CreateInBounds(Src, Idx, "", Loop);
+        Value *DstPtr = GetElementPtrInst::CreateInBounds(Dst, Idx, "", Loop);
+        Value *Word = new LoadInst(SrcPtr, "", false, 4, Loop);
+        new StoreInst(Word, DstPtr, false, 4, Loop);
+        Value *Next = BinaryOperator::CreateAdd(Idx, ConstantInt::get(I32, 1),
+                                                "", Loop);
+        Value *Cond = new ICmpInst(*Loop, ICmpInst::ICMP_ULT, Next,
+                                   ConstantInt::get(I32, words));
+        BranchInst::Create(Loop, Tail, Cond, Loop);
+        Idx->addIncoming(ConstantInt::get(I32, 0), Head);
+        Idx->addIncoming(Next, Loop);
+      }
+
+      for(unsigned i = words * 4; i < Size; i++) {
+        Constant *Src = ConstantExpr::getGetElementPtr(
+                          ConstantExpr::getBitCast(GV, I8->getPointerTo(0)),
+                          ConstantInt::get(I32, i));
+        Constant *Dst = ConstantExpr::getGetElementPtr(
+                          ConstantExpr::getBitCast(SPMAddress,
+                                                   I8->getPointerTo(1)),
+                          ConstantInt::get(I32, i));
+        Value *Byte = new LoadInst(Src, "", InsertBefore);
+        new StoreInst(Byte, Dst, InsertBefore);
+      }
+    }
+
+  public:
+    static char ID;
+
+    PatmosScratchpadAllocation(const PatmosTargetMachine &tm)
+      : ModulePass(ID), TM(tm), DL(tm.getDataLayout())
+    {
+      PassRegistry &Registry = *PassRegistry::getPassRegistry();
+      initializeBlockFrequencyInfoPass(Registry);
+      initializePMLImportPass(Registry);
+    }
+
+    virtual const char *getPassName() const
+    {
+      return "Patmos Scratchpad Allocation";
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const
+    {
+      AU.addRequired<BlockFrequencyInfo>();
+      AU.addRequired<PMLImport>();
+    }
+
+    virtual bool runOnModule(Module &M)
+    {
+      Function *Main = M.getFunction("main");
+      if (!SPMAllocSize || !Main || Main->isDeclaration())
+        return false;
+
+      buildCallGraph(M);
+
+      for(Module::iterator F(M.begin()), FE(M.end()); F != FE; F++) {
+        if (!F->isDeclaration())
+          computeBlockWeights(*F);
+      }
+
+      computeCalls(Main);
+
+      std::vector<Candidate> Candidates;
+      collectCandidates(M, Candidates);
+      std::stable_sort(Candidates.begin(), Candidates.end());
+
+      // select candidates greedily, globals are placed in front of the
+      // overlaid stack objects.
+      std::vector<Candidate> Selected;
+      unsigned globalSpace = 0;
+      for(unsigned i = 0, e = Candidates.size(); i != e; i++) {
+        const Candidate &C(Candidates[i]);
+        unsigned size = RoundUpToAlignment(C.Size, 4);
+
+        if (C.Weight <= 0)
+          break;
+
+        if (!C.F) {
+          if (globalSpace + size + getStackSpace() > SPMAllocSize)
+            continue;
+          globalSpace += size;
+        }
+        else {
+          FrameSize[C.F] += size;
+          if (globalSpace + getStackSpace() > SPMAllocSize) {
+            FrameSize[C.F] -= size;
+            continue;
+          }
+        }
+
+        DEBUG(dbgs() << "SPM: allocating " << C.Object->getName() << " ("
+                     << C.Size << " bytes, weight " << C.Weight << ")\n");
+        Selected.push_back(C);
+      }
+
+      if (Selected.empty())
+        return false;
+
+      SPMBytes += globalSpace + getStackSpace();
+
+      // split the entry block of main behind its allocas before any access
+      // is rewritten. The copies of the initial values are emitted in front
+      // of the new branch, which is never touched by the rewriting, such
+      // that they precede all (rewritten) accesses of main.
+      BasicBlock &MainEntry(Main->getEntryBlock());
+      BasicBlock::iterator FirstAccess(MainEntry.getFirstNonPHI());
+      while (isa<AllocaInst>(FirstAccess))
+        FirstAccess++;
+      MainEntry.splitBasicBlock(FirstAccess, "spm.entry");
+      Instruction *InsertBefore = MainEntry.getTerminator();
+
+      // assign addresses and rewrite the accesses
+      Type *I32 = Type::getInt32Ty(M.getContext());
+      FunctionUInt frameOffsets, objectOffsets;
+      unsigned globalOffset = 0;
+      for(unsigned i = 0, e = Selected.size(); i != e; i++) {
+        const Candidate &C(Selected[i]);
+        unsigned size = RoundUpToAlignment(C.Size, 4);
+
+        unsigned address = SPMAllocBase;
+        if (!C.F) {
+          address += globalOffset;
+          globalOffset += size;
+        }
+        else {
+          address += globalSpace + getFrameOffset(C.F, frameOffsets) +
+                     objectOffsets[C.F];
+          objectOffsets[C.F] += size;
+        }
+
+        Constant *SPMAddress = ConstantExpr::getIntToPtr(
+                                 ConstantInt::get(I32, address),
+                                 getSPMPointerType(C.Object->getType()));
+
+        rewriteUses(C.Object, SPMAddress);
+
+        if (GlobalVariable *GV = dyn_cast<GlobalVariable>(C.Object)) {
+          emitCopy(GV, SPMAddress, C.Size, InsertBefore);
+          SPMGlobals++;
+        }
+        else {
+          cast<Instruction>(C.Object)->eraseFromParent();
+          SPMStackObjects++;
+        }
+      }
+
+      return true;
+    }
+  };
+
+  char PatmosScratchpadAllocation::ID = 0;
+}
+
+/// createPatmosScratchpadAllocationPass - Returns a new
+/// PatmosScratchpadAllocation.
+ModulePass *llvm::createPatmosScratchpadAllocationPass(
+                                               const PatmosTargetMachine &tm) {
+  return new PatmosScratchpadAllocation(tm);
+}
@@ -9,15 +9,263 @@
 //
 // This file implements the PatmosSelectionDAGInfo class.
 //
+// Small memcpys and memsets are already expanded by the generic lowering up to
+// MaxStoresPerMemcpy/MaxStoresPerMemset stores. Larger word-aligned operations
+// of constant size are handled here, to avoid the method cache miss, the call
+// overhead and the stack cache spills of a library call: medium sizes are
+// expanded into unrolled word loads and stores, large sizes into a copy loop
+// with a constant iteration count, which carries a loop bound for the WCET
+// analysis.
+//
+// The loads and stores use the memory type selected by the address space of
+// the pointers, i.e., the data cache, the local scratchpad or the main memory.
+//
 //===----------------------------------------------------------------------===//
 
 #define DEBUG_TYPE "patmos-selectiondag-info"
 #include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/SelectionDAG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/CommandLine.h"
 using namespace llvm;
 
+STATISTIC(NumMemcpyUnrolled, "Number of memcpys expanded to loads and stores");
+STATISTIC(NumMemcpyLoops,    "Number of memcpys expanded to copy loops");
+STATISTIC(NumMemsetUnrolled, "Number of memsets expanded to stores");
+STATISTIC(NumMemsetLoops,    "Number of memsets expanded to loops");
+
+static cl::opt<unsigned> MemOpInlineWords("mpatmos-memop-inline-words",
+  cl::init(32), cl::Hidden,
+  cl::desc("Maximum number of words of a memcpy or memset that are expanded "
+           "into unrolled loads and stores (default: 32)."));
+
+static cl::opt<unsigned> MemOpLoopUnroll("mpatmos-memop-loop-unroll",
+  cl::init(4), cl::Hidden,
+  cl::desc("Number of words copied per iteration of memcpy and memset "
+           "loops (default: 4)."));
+
+/// getMemType - Get the memory type the load and store patterns select for
+/// accesses through a pointer.
+static PatmosII::MemType getMemType(const MachinePointerInfo &PtrInfo) {
+  switch (PtrInfo.getAddrSpace()) {
+  case 1:  return PatmosII::MEM_L;
+  case 3:  return PatmosII::MEM_M;
+  default: return PatmosII::MEM_C;
+  }
+}
+
+/// getLoopUnroll - Get the number of words per loop iteration. The offsets of
+/// the loads and stores in the loop must fit into their immediates.
+static uint64_t getLoopUnroll() {
+  return std::min(std::max((unsigned)MemOpLoopUnroll, 1U), 64U);
+}
+
+/// isOptForSize - Check if the function of the DAG is optimized for size.
+static bool isOptForSize(SelectionDAG &DAG) {
+  return DAG.getMachineFunction().getFunction()->getAttributes().
+           hasAttribute(AttributeSet::FunctionIndex, Attribute::OptimizeForSize);
+}
+
+static SDValue getAddress(SelectionDAG &DAG, SDLoc dl, SDValue Base,
+                          uint64_t Offset) {
+  if (Offset == 0) return Base;
+  return DAG.getNode(ISD::ADD, dl, MVT::i32, Base,
+                     DAG.getConstant(Offset, MVT::i32));
+}
+
+/// getAccessType - Get the widest type to access at Offset with at most
+/// Bytes remaining.
+static EVT getAccessType(uint64_t Bytes) {
+  if (Bytes >= 4) return MVT::i32;
+  if (Bytes >= 2) return MVT::i16;
+  return MVT::i8;
+}
+
+/// emitUnrolledCopy - Copy the bytes from Offset to End with word loads and
+/// stores, and a halfword and a byte access for the remainder.
+static SDValue emitUnrolledCopy(SelectionDAG &DAG, SDLoc dl, SDValue Chain,
+                                SDValue Dst, SDValue Src,
+                                uint64_t Offset, uint64_t End,
+                                unsigned Align, bool isVolatile,
+                                MachinePointerInfo DstPtrInfo,
+                                MachinePointerInfo SrcPtrInfo)
+{
+  SmallVector<SDValue, 16> Values;
+  SmallVector<SDValue, 16> Chains;
+
+  // Issue all loads first to give the scheduler the freedom to hide the load
+  // latencies.
+  for (uint64_t Off = Offset; Off < End; ) {
+    EVT VT = getAccessType(End - Off);
+    unsigned Bytes = VT.getSizeInBits() / 8;
+
+    SDValue Value = DAG.getExtLoad(ISD::EXTLOAD, dl, MVT::i32, Chain,
+                                   getAddress(DAG, dl, Src, Off),
+                                   SrcPtrInfo.getWithOffset(Off), VT,
+                                   isVolatile, false, MinAlign(Align, Off));
+    Values.push_back(Value);
+    Chains.push_back(Value.getValue(1));
+    Off += Bytes;
+  }
+
+  Chain = DAG.getNode(ISD::TokenFactor, dl, MVT::Other,
+                      &Chains[0], Chains.size());
+  Chains.clear();
+
+  unsigned i = 0;
+  for (uint64_t Off = Offset; Off < End; i++) {
+    EVT VT = getAccessType(End - Off);
+    unsigned Bytes = VT.getSizeInBits() / 8;
+
+    Chains.push_back(DAG.getTruncStore(Chain, dl, Values[i],
+                                       getAddress(DAG, dl, Dst, Off),
+                                       DstPtrInfo.getWithOffset(Off), VT,
+                                       false, isVolatile,
+                                       MinAlign(Align, Off)));
+    Off += Bytes;
+  }
+
+  return DAG.getNode(ISD::TokenFactor, dl, MVT::Other,
+                     &Chains[0], Chains.size());
+}
+
+/// emitUnrolledSet - Store Value from Offset to End with word stores, and a
+/// halfword and a byte store for the remainder.
+static SDValue emitUnrolledSet(SelectionDAG &DAG, SDLoc dl, SDValue Chain,
+                               SDValue Dst, SDValue Value,
+                               uint64_t Offset, uint64_t End,
+                               unsigned Align, bool isVolatile,
+                               MachinePointerInfo DstPtrInfo)
+{
+  SmallVector<SDValue, 16> Chains;
+
+  for (uint64_t Off = Offset; Off < End; ) {
+    EVT VT = getAccessType(End - Off);
+    unsigned Bytes = VT.getSizeInBits() / 8;
+
+    Chains.push_back(DAG.getTruncStore(Chain, dl, Value,
+                                       getAddress(DAG, dl, Dst, Off),
+                                       DstPtrInfo.getWithOffset(Off), VT,
+                                       false, isVolatile,
+                                       MinAlign(Align, Off)));
+    Off += Bytes;
+  }
+
+  return DAG.getNode(ISD::TokenFactor, dl, MVT::Other,
+                     &Chains[0], Chains.size());
+}
+
 PatmosSelectionDAGInfo::PatmosSelectionDAGInfo(const PatmosTargetMachine &TM)
   : TargetSelectionDAGInfo(TM) {
 }
 
 PatmosSelectionDAGInfo::~PatmosSelectionDAGInfo() {
 }
+
+SDValue
+PatmosSelectionDAGInfo::EmitTargetCodeForMemcpy(SelectionDAG &DAG, SDLoc dl,
+                                                SDValue Chain,
+                                                SDValue Dst, SDValue Src,
+                                                SDValue Size, unsigned Align,
+                                                bool isVolatile,
+                                                bool AlwaysInline,
+                                                MachinePointerInfo DstPtrInfo,
+                                                MachinePointerInfo SrcPtrInfo)
+                                                const
+{
+  // Unaligned and variable-sized copies are left to the library.
+  ConstantSDNode *ConstantSize = dyn_cast<ConstantSDNode>(Size);
+  if (!ConstantSize || (Align & 3) != 0)
+    return SDValue();
+
+  uint64_t SizeVal = ConstantSize->getZExtValue();
+  if (SizeVal > UINT32_MAX)
+    return SDValue();
+
+  bool OptSize = isOptForSize(DAG);
+  uint64_t Words = SizeVal / 4;
+  uint64_t Unroll = OptSize ? 1 : getLoopUnroll();
+  uint64_t Iterations = Words / Unroll;
+
+  if ((!OptSize && Words <= MemOpInlineWords) || Iterations < 2) {
+    NumMemcpyUnrolled++;
+    return emitUnrolledCopy(DAG, dl, Chain, Dst, Src, 0, SizeVal, Align,
+                            isVolatile, DstPtrInfo, SrcPtrInfo);
+  }
+
+  SDValue Ops[] = { Chain, Dst, Src,
+                    DAG.getTargetConstant(Iterations, MVT::i32),
+                    DAG.getTargetConstant(Unroll, MVT::i32),
+                    DAG.getTargetConstant(getMemType(DstPtrInfo), MVT::i32),
+                    DAG.getTargetConstant(getMemType(SrcPtrInfo), MVT::i32) };
+  Chain = DAG.getNode(PatmosISD::MEMCPY_LOOP, dl, MVT::Other, Ops,
+                      array_lengthof(Ops));
+  NumMemcpyLoops++;
+
+  // Copy the remaining words and bytes after the loop.
+  uint64_t Offset = Iterations * Unroll * 4;
+  if (Offset == SizeVal)
+    return Chain;
+
+  return emitUnrolledCopy(DAG, dl, Chain, Dst, Src, Offset, SizeVal, Align,
+                          isVolatile, DstPtrInfo, SrcPtrInfo);
+}
+
+SDValue
+PatmosSelectionDAGInfo::EmitTargetCodeForMemset(SelectionDAG &DAG, SDLoc dl,
+                                                SDValue Chain,
+                                                SDValue Dst, SDValue Src,
+                                                SDValue Size, unsigned Align,
+                                                bool isVolatile,
+                                                MachinePointerInfo DstPtrInfo)
+                                                const
+{
+  ConstantSDNode *ConstantSize = dyn_cast<ConstantSDNode>(Size);
+  if (!ConstantSize || (Align & 3) != 0)
+    return SDValue();
+
+  uint64_t SizeVal = ConstantSize->getZExtValue();
+  if (SizeVal > UINT32_MAX)
+    return SDValue();
+
+  // Replicate the byte into a word.
+  SDValue Value;
+  if (ConstantSDNode *C = dyn_cast<ConstantSDNode>(Src)) {
+    uint32_t Byte = C->getZExtValue() & 0xFF;
+    Value = DAG.getConstant(Byte * 0x01010101U, MVT::i32);
+  } else {
+    Value = DAG.getZExtOrTrunc(Src, dl, MVT::i32);
+    Value = DAG.getNode(ISD::AND, dl, MVT::i32, Value,
+                        DAG.getConstant(0xFF, MVT::i32));
+    Value = DAG.getNode(ISD::MUL, dl, MVT::i32, Value,
+                        DAG.getConstant(0x01010101U, MVT::i32));
+  }
+
+  bool OptSize = isOptForSize(DAG);
+  uint64_t Words = SizeVal / 4;
+  uint64_t Unroll = OptSize ? 1 : getLoopUnroll();
+  uint64_t Iterations = Words / Unroll;
+
+  if ((!OptSize && Words <= MemOpInlineWords) || Iterations < 2) {
+    NumMemsetUnrolled++;
+    return emitUnrolledSet(DAG, dl, Chain, Dst, Value, 0, SizeVal, Align,
+                           isVolatile, DstPtrInfo);
+  }
+
+  SDValue Ops[] = { Chain, Dst, Value,
+                    DAG.getTargetConstant(Iterations, MVT::i32),
+                    DAG.getTargetConstant(Unroll, MVT::i32),
+                    DAG.getTargetConstant(getMemType(DstPtrInfo), MVT::i32) };
+  Chain = DAG.getNode(PatmosISD::MEMSET_LOOP, dl, MVT::Other, Ops,
+                      array_lengthof(Ops));
+  NumMemsetLoops++;
+
+  // Set the remaining words and bytes after the loop.
+  uint64_t Offset = Iterations * Unroll * 4;
+  if (Offset == SizeVal)
+    return Chain;
+
+  return emitUnrolledSet(DAG, dl, Chain, Dst, Value, Offset, SizeVal, Align,
+                         isVolatile, DstPtrInfo);
+}
@@ -24,6 +24,27 @@ class PatmosSelectionDAGInfo : public TargetSelectionDAGInfo {
 public:
   explicit PatmosSelectionDAGInfo(const PatmosTargetMachine &TM);
   ~PatmosSelectionDAGInfo();
+
+  /// EmitTargetCodeForMemcpy - Expand word-aligned memcpys of constant size
+  /// into unrolled word loads and stores, or into a copy loop with a known
+  /// iteration count for large sizes.
+  virtual SDValue
+  EmitTargetCodeForMemcpy(SelectionDAG &DAG, SDLoc dl,
+                          SDValue Chain,
+                          SDValue Dst, SDValue Src,
+                          SDValue Size, unsigned Align, bool isVolatile,
+                          bool AlwaysInline,
+                          MachinePointerInfo DstPtrInfo,
+                          MachinePointerInfo SrcPtrInfo) const;
+
+  /// EmitTargetCodeForMemset - Expand word-aligned memsets of constant size
+  /// like memcpys.
+  virtual SDValue
+  EmitTargetCodeForMemset(SelectionDAG &DAG, SDLoc dl,
+                          SDValue Chain,
+                          SDValue Dst, SDValue Src,
+                          SDValue Size, unsigned Align, bool isVolatile,
+                          MachinePointerInfo DstPtrInfo) const;
 };
 
 }
@@ -28,34 +28,34 @@
 #undef PATMOS_TRACE_DETAILED_RESULTS
 
 #include "Patmos.h"
+#include "PatmosBlockDataFlow.h"
 #include "PatmosCallGraphBuilder.h"
+#include "PatmosILPSolver.h"
 #include "PatmosMachineFunctionInfo.h"
 #include "PatmosStackCacheAnalysis.h"
 #include "PatmosSubtarget.h"
 #include "PatmosTargetMachine.h"
+#include "PatmosThreadPool.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/OwningPtr.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
 #include "llvm/CodeGen/MachineModulePass.h"
 #include "llvm/CodeGen/PMLExport.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
-#include "llvm/Support/Program.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <cmath>
 #include <map>
 #include <set>
 #include <fstream>
-
-/// Utility for deleting owned members of an object
-#define DELETE_MEMBERS(vec) \
-    while(! vec.empty()) { \
-      delete vec.back(); \
-      vec.pop_back(); \
-    } \
-
-#define YAML_MEMBER(type, name) \
-  yaml::type y ## name
+#include <vector>
 
 using namespace llvm;
 
@@ -69,15 +69,6 @@ ModulePass *createPatmosStackCacheAnalysisInfo(const PatmosTargetMachine &tm) {
 }
 }
 
-/// This is expected to be a program that takes one argument specifying the name
-/// of a LP file to solve and generate a file with the same name and an appended
-/// suffix .sol containing the numeric value of the integer solution of the LP.
-static cl::opt<std::string> Solve_ilp(
-  "mpatmos-ilp-solver",
-  cl::init("solve_ilp.sh"),
-  cl::desc("Path to an ILP solver."),
-  cl::Hidden);
-
 /// Option to specify a file containing user-supplied bounds when solving ILP
 /// problems (for regions of the call graph with recursion).
 static cl::opt<std::string> BoundsFile(
@@ -136,6 +127,70 @@ static cl::opt<bool> RootOccupied(
   cl::desc("Stack Cache Analysis assumes fully occupied root node."),
   cl::ReallyHidden);
 
+/// SCAThreads - Option to evaluate independent functions and SCCs of the call
+/// graph concurrently.
+static cl::opt<unsigned int> SCAThreads(
+  "mpatmos-sca-threads",
+  cl::init(1),
+  cl::desc("Number of threads used by the stack cache analysis (0: number of "
+           "hardware threads, default: 1)."),
+  cl::Hidden);
+
+/// Strategies to merge calling contexts while constructing the SCA graph.
+enum SCAContextMerging {
+  /// Keep all calling contexts apart.
+  SCAMergeNone,
+  /// Round occupancies up to multiples of a granule.
+  SCAMergeInterval,
+  /// Keep a bounded number of contexts per function.
+  SCAMergeKLimit
+};
+
+/// SCAMerging - Option to bound the size of the SCA graph by merging calling
+/// contexts, trading precision of the spill costs for analysis time.
+static cl::opt<SCAContextMerging> SCAMerging(
+  "mpatmos-sca-context-merging",
+  cl::init(SCAMergeNone),
+  cl::desc("Merge calling contexts of the stack cache analysis."),
+  cl::values(
+    clEnumValN(SCAMergeNone, "none", "Keep all calling contexts (default)"),
+    clEnumValN(SCAMergeInterval, "interval",
+               "Round occupancies up to -mpatmos-sca-occupancy-granule bytes"),
+    clEnumValN(SCAMergeKLimit, "klimit",
+               "Keep at most -mpatmos-sca-max-contexts contexts per function"),
+    clEnumValEnd),
+  cl::Hidden);
+
+/// getContextMergingName - Return the option name of a context merging
+/// strategy.
+static const char *getContextMergingName(SCAContextMerging M)
+{
+  switch (M) {
+    case SCAMergeNone:     return "none";
+    case SCAMergeInterval: return "interval";
+    case SCAMergeKLimit:   return "klimit";
+  }
+  llvm_unreachable("Unknown context merging strategy.");
+}
+
+/// SCAOccupancyGranule - Size of the occupancy intervals merged into a single
+/// calling context.
+static cl::opt<unsigned int> SCAOccupancyGranule(
+  "mpatmos-sca-occupancy-granule",
+  cl::init(0),
+  cl::desc("Granule of occupancy intervals merged by the stack cache analysis "
+           "in bytes (default: 4 stack cache blocks)."),
+  cl::Hidden);
+
+/// SCAMaxContexts - Maximum number of calling contexts per function kept
+/// apart when merging k-limited contexts.
+static cl::opt<unsigned int> SCAMaxContexts(
+  "mpatmos-sca-max-contexts",
+  cl::init(8),
+  cl::desc("Maximum number of calling contexts per function of the stack "
+           "cache analysis (default: 8)."),
+  cl::Hidden);
+
 static cl::opt<std::string> SCAPMLExport("mpatmos-sca-serialize",
    cl::desc("Export PML specification of generated machine code to FILE"),
    cl::init(""));
@@ -170,6 +225,13 @@ namespace llvm {
   /// Count the total number of nodes in the pruned SCA graph.
   STATISTIC(PrunedSCAGraphSize, "Pruned SCA graph size.");
 
+  /// Count the number of calling contexts merged with others.
+  STATISTIC(MergedSCAContexts, "Calling contexts merged in the SCA graph.");
+
+  /// Count the spill costs (in bytes) overestimated by merging contexts.
+  STATISTIC(MergedSCASpillCosts,
+            "Spill costs overestimated by merging contexts (bytes).");
+
   /// Count the total number of ILPs solved.
   STATISTIC(ILPs, "Number of ILPs solved.");
 
@@ -229,47 +291,34 @@ namespace llvm {
   bool operator <(const SCAEdge &a, const SCAEdge &b);
   llvm::raw_ostream &operator <<(llvm::raw_ostream &O, ilp_prefix Prefix);
 
-  namespace yaml {
-    template <>
-      struct MappingTraits< SCANode >;
-  }
-
-  /// Set of SCANodes.
-  typedef std::set<SCANode*> SCANodeSet;
-
-  /// Set of SCAEdges.
-  typedef std::set<SCAEdge> SCAEdgeSet;
-
-  /// Map call graph nodes to spill cost information.
-  typedef std::map<std::pair<MCGNode*, CostPair>, SCANode*> MCGSCANodeMap;
-
   /// Link context-sensitive information on the spill costs at a call graph
-  /// nodes to calling contexts.
+  /// nodes to calling contexts. Nodes are referred to by their index in the
+  /// SCA graph.
   class SCAEdge
   {
   private:
     /// The calling context's node.
-    SCANode *Caller;
+    unsigned int Caller;
 
     /// The called context's node.
-    SCANode *Callee;
+    unsigned int Callee;
 
     /// The corresponding call site.
     MCGSite *Site;
   public:
-    SCAEdge(SCANode *caller, SCANode *callee, MCGSite *site) :
+    SCAEdge(unsigned int caller, unsigned int callee, MCGSite *site) :
         Caller(caller), Callee(callee), Site(site)
     {
     }
 
     /// Return the calling context's node.
-    SCANode *getCaller() const
+    unsigned int getCaller() const
     {
       return Caller;
     }
 
     /// Return the called context's node.
-    SCANode *getCallee() const
+    unsigned int getCallee() const
     {
       return Callee;
     }
@@ -279,15 +328,24 @@ namespace llvm {
     {
       return Site;
     }
+
+    bool operator==(const SCAEdge &e) const
+    {
+      return Caller == e.Caller && Callee == e.Callee && Site == e.Site;
+    }
   };
 
   /// Context-sensitive information on the spill costs at a call graph node.
   class SCANode
   {
+    friend class SpillCostAnalysisGraph;
   private:
     /// Call graph node associated with spill costs.
     MCGNode *Node;
 
+    /// The graph containing the node.
+    const SpillCostAnalysisGraph *Graph;
+
     /// Number of bytes occupied in the stack cache before entering the
     /// function.
     CostPair Occupancy;
@@ -303,16 +361,13 @@ namespace llvm {
     /// Cost associated with spilling at this node.
     CostPair SpillCost;
 
+    /// Identifier of the node in PML exports.
+    unsigned int Id;
+
     /// Flag indicating whether the CFG of the corresponding function contains
     /// a path without calls.
     bool HasCallFreePath;
 
-    /// The parent calling contexts of this node.
-    SCAEdgeSet Parents;
-
-    /// The calling contexts originating from this node.
-    SCAEdgeSet Children;
-
     /// Flag indicating whether this node should be visualized in DOT dumps.
     bool IsVisible;
 
@@ -321,29 +376,27 @@ namespace llvm {
     /// maximum displacement (which is not limited by the stack cache size).
     bool IsValid;
   public:
-    SCANode(MCGNode *node, const CostPair &occupancy,
-            unsigned int maxdisplacment, const CostPair &spillcost,
-            bool hascallfreepath) :
-        Node(node), Occupancy(occupancy), MaxDisplacement(maxdisplacment),
-        RemainingOccupancy(0), SpillCost(spillcost),
-        HasCallFreePath(hascallfreepath), IsVisible(false), IsValid(false)
+    SCANode(MCGNode *node, const SpillCostAnalysisGraph *graph,
+            const CostPair &occupancy, unsigned int maxdisplacment,
+            const CostPair &spillcost, unsigned int id, bool hascallfreepath) :
+        Node(node), Graph(graph), Occupancy(occupancy),
+        MaxDisplacement(maxdisplacment), RemainingOccupancy(0),
+        SpillCost(spillcost), Id(id), HasCallFreePath(hascallfreepath),
+        IsVisible(false), IsValid(false)
     {}
 
-    void initYAML(const PatmosSubtarget &STC)
-    {
-      if (Node->getMF())
-        yFunction = Node->getMF()->getName();
-      else
-        yFunction = "none";
-      ySpillBlocks = SpillCost.first; // export in bytes
-    }
-
     /// Returns the associated call graph node.
     MCGNode *getMCGNode() const
     {
       return Node;
     }
 
+    /// Returns the graph containing the node.
+    const SpillCostAnalysisGraph *getGraph() const
+    {
+      return Graph;
+    }
+
     /// Return the stack cache occupancy associated with the node.
     const CostPair &getOccupancyCosts() const
     {
@@ -388,6 +441,12 @@ namespace llvm {
       return MaxDisplacement;
     }
 
+    /// Return the identifier of the node in PML exports.
+    unsigned int getId() const
+    {
+      return Id;
+    }
+
     /// Used for trace output
     CostPair getSpillCostPair() const { return SpillCost; }
     CostPair getOccupancyPair() const { return Occupancy; }
@@ -398,21 +457,6 @@ namespace llvm {
       return HasCallFreePath;
     }
 
-    /// Set the node's visible flag to and propagate it to all its parents.
-    /// Nodes that are not valid are automatically marked not to be visible.
-    void setVisible()
-    {
-      if (!IsVisible && IsValid) {
-        IsVisible = true;
-
-        /// propagate to parents
-        for(SCAEdgeSet::const_iterator i(Parents.begin()), ie(Parents.end());
-            i != ie; i++) {
-          i->getCaller()->setVisible();
-        }
-      }
-    }
-
     /// Return whether this node should be visualized in DOT graph dumps.
     bool isVisible() const
     {
@@ -431,167 +475,312 @@ namespace llvm {
     {
       return IsValid;
     }
-
-    /// addParent - Create a link between this node and its parent.
-    void addParent(SCANode *parent, MCGSite *site)
-    {
-      SCAEdge newEdge(parent, this, site);
-
-      parent->Children.insert(newEdge);
-      Parents.insert(newEdge);
-    }
-
-    /// Return the parents of this node.
-    SCAEdgeSet &getParents()
-    {
-      return Parents;
-    }
-
-    /// Return the parents of this node.
-    const SCAEdgeSet &getParents() const
-    {
-      return Parents;
-    }
-
-    /// Return the children of this node.
-    SCAEdgeSet &getChildren()
-    {
-      return Children;
-    }
-
-    /// Return the children of this node.
-    const SCAEdgeSet &getChildren() const
-    {
-      return Children;
-    }
-
-    YAML_MEMBER(Name, Id);
-    YAML_MEMBER(Name, Function);
-    YAML_MEMBER(Name, SpillBlocks);
-    friend struct yaml::MappingTraits<SCANode*>;
   };
 
   /// A graph representing context-sensitive information on the spill costs at
   /// call graph nodes -- aka SCA graph or SC-SCA graph.
+  ///
+  /// Nodes are kept in a single array and referred to by their index. During
+  /// construction edges are only appended to a list, finalize then sorts them
+  /// by their calling node (the children of a node thus are a contiguous range
+  /// of the edge array) and indexes them by their called node.
   class SpillCostAnalysisGraph
   {
   private:
+    /// Map call graph nodes and calling contexts to node indices.
+    typedef DenseMap<std::pair<MCGNode*, CostPair>, unsigned int> NodeIndexMap;
+
+    /// The nodes of the graph.
+    std::vector<SCANode> Nodes;
+
+    /// The edges of the graph, sorted by their caller after finalize.
+    std::vector<SCAEdge> Edges;
+
+    /// Offsets of the first child edge of each node in Edges.
+    std::vector<unsigned int> ChildOffsets;
+
+    /// Indices of the edges in Edges, sorted by their callee.
+    std::vector<unsigned int> ParentEdges;
+
+    /// Offsets of the first parent edge of each node in ParentEdges.
+    std::vector<unsigned int> ParentOffsets;
+
     /// Spill cost information available for individual call graph nodes and
-    /// calling contexts.
-    MCGSCANodeMap Nodes;
+    /// calling contexts, only needed during construction.
+    NodeIndexMap Index;
+
+    /// The calling contexts of each call graph node, only tracked during
+    /// construction when k-limited contexts are merged.
+    DenseMap<MCGNode*, std::vector<unsigned int> > Contexts;
 
     /// The root node of the spill cost graph.
-    SCANode *Root;
+    unsigned int Root;
 
     /// Subtarget information (stack cache sizes)
     const PatmosSubtarget &STC;
 
     unsigned yamlId;
+
+    /// buildIndices - Sort, unique, and index the edge list.
+    void buildIndices()
+    {
+      std::sort(Edges.begin(), Edges.end());
+      Edges.erase(std::unique(Edges.begin(), Edges.end()), Edges.end());
+
+      unsigned int numNodes = Nodes.size();
+      unsigned int numEdges = Edges.size();
+
+      // count children and parents of each node
+      ChildOffsets.assign(numNodes + 1, 0);
+      ParentOffsets.assign(numNodes + 1, 0);
+      for(unsigned int i = 0; i != numEdges; i++) {
+        ChildOffsets[Edges[i].getCaller() + 1]++;
+        ParentOffsets[Edges[i].getCallee() + 1]++;
+      }
+
+      for(unsigned int i = 0; i != numNodes; i++) {
+        ChildOffsets[i + 1] += ChildOffsets[i];
+        ParentOffsets[i + 1] += ParentOffsets[i];
+      }
+
+      // place the edges in the parent lists
+      std::vector<unsigned int> next(ParentOffsets.begin(),
+                                     ParentOffsets.end() - 1);
+      ParentEdges.resize(numEdges);
+      for(unsigned int i = 0; i != numEdges; i++) {
+        ParentEdges[next[Edges[i].getCallee()]++] = i;
+      }
+    }
   public:
-    SpillCostAnalysisGraph(const PatmosSubtarget &s) : STC(s), yamlId(100) {}
+    /// Iterate over the children of a node.
+    typedef std::vector<SCAEdge>::const_iterator child_iterator;
+
+    SpillCostAnalysisGraph(const PatmosSubtarget &s) : Root(0), STC(s),
+        yamlId(100) {}
 
     /// makeRoot - Construct the root node of the SCA graph.
-    SCANode *makeRoot(MCGNode *node, unsigned int maxdisplacment,
-                      bool hascallfreepath)
+    unsigned int makeRoot(MCGNode *node, unsigned int maxdisplacment,
+                          bool hascallfreepath)
     {
       assert(Nodes.empty());
       unsigned rootoccupancy = RootOccupied ? STC.getStackCacheSize() : 0;
       CostPair occupancyCosts(rootoccupancy, rootoccupancy);
       CostPair spillCosts(0, 0);
 
-      // create the root node.
-      Root = new SCANode(node, occupancyCosts, maxdisplacment, spillCosts,
-                         hascallfreepath);
-
-      Root->yId = yamlId++;
-
-      // store the root node.
-      Nodes[std::make_pair(node, occupancyCosts)] = Root;
+      // create and store the root node.
+      Root = Nodes.size();
+      Nodes.push_back(SCANode(node, this, occupancyCosts, maxdisplacment,
+                              spillCosts, yamlId++, hascallfreepath));
+      Index[std::make_pair(node, occupancyCosts)] = Root;
+      if (SCAMerging == SCAMergeKLimit)
+        Contexts[node].push_back(Root);
 
       return Root;
     }
 
     /// makeNode - Construct a new SCA node or return an already existing one.
-    /// Returns true when the node was newly created, false otherwise. The node
-    /// itself is returned using the argument result.
+    /// Returns true when the node was newly created, false otherwise. The
+    /// node's index is returned using the argument result.
     bool makeNode(MCGNode *node, const CostPair &occupancy,
                   const CostPair &spillcost, unsigned int maxdisplacment,
-                  bool hascallfreepath, SCANode *&result)
+                  bool hascallfreepath, unsigned int &result)
     {
-      MCGSCANodeMap::iterator tmp(Nodes.find(
-          std::make_pair(node, occupancy)));
+      std::pair<NodeIndexMap::iterator, bool> tmp(Index.insert(
+          std::make_pair(std::make_pair(node, occupancy), Nodes.size())));
 
-      result = NULL;
-      if (tmp == Nodes.end()) {
+      result = tmp.first->second;
+      if (tmp.second) {
 
 #ifdef PATMOS_TRACE_DETAILED_RESULTS
         DEBUG(
           dbgs() << "makeNode[" << yamlId << "]: " << *node
-            << " spill=" << spillcost.get() << " occ=" << occupancy.get() << "\n";
+            << " spill=" << spillcost.first << " occ=" << occupancy.first
+            << "\n";
         );
 #endif // PATMOS_TRACE_DETAILED_RESULTS
 
         // create a new node
-        result = new SCANode(node, occupancy, maxdisplacment, spillcost,
-                             hascallfreepath);
-        result->yId = yaml::Name(yamlId++);
+        Nodes.push_back(SCANode(node, this, occupancy, maxdisplacment,
+                                spillcost, yamlId++, hascallfreepath));
+        if (SCAMerging == SCAMergeKLimit)
+          Contexts[node].push_back(result);
+      }
 
-        // store the newly created node
-        Nodes[std::make_pair(node, occupancy)] = result;
+      return tmp.second;
+    }
 
-        return true;
-      }
-      else {
-        // use the existing node
-        result = tmp->second;
+    /// hasNode - Check whether a node for the call graph node and calling
+    /// context exists (before finalize).
+    bool hasNode(MCGNode *node, const CostPair &occupancy) const
+    {
+      return Index.count(std::make_pair(node, occupancy));
+    }
 
-        return false;
-      }
+    /// getContexts - Return the nodes of the calling contexts of a call graph
+    /// node (before finalize, only tracked when k-limited contexts are
+    /// merged).
+    const std::vector<unsigned int> &getContexts(MCGNode *node)
+    {
+      return Contexts[node];
     }
 
-    /// deleteNode - Free the node and remove it from the node list as well as
-    /// parent/children lists.
-    void deleteNode(SCANode *N)
+    /// addEdge - Create a link between a node and its parent.
+    void addEdge(unsigned int parent, unsigned int child, MCGSite *site)
     {
-      // remove the node from the node list
-      Nodes.erase(std::make_pair(N->getMCGNode(), N->getOccupancyCosts()));
+      Edges.push_back(SCAEdge(parent, child, site));
+    }
 
-      // remove all edges leading to the node in its parent's children lists
-      for(SCAEdgeSet::const_iterator i(N->getParents().begin()),
-          ie(N->getParents().end()); i != ie; i++) {
-        i->getCaller()->getChildren().erase(*i);
+    /// finalize - Complete the construction of the graph. Nodes of UNKNOWN
+    /// functions are removed, linking their parents to their children
+    /// directly, and the edges are indexed.
+    void finalize()
+    {
+      // the lookups are not needed anymore
+      NodeIndexMap().swap(Index);
+      Contexts.shrink_and_clear();
+
+      buildIndices();
+
+      unsigned int numNodes = Nodes.size();
+      unsigned int numUnknown = 0;
+      for(unsigned int n = 0; n != numNodes; n++) {
+        if (Nodes[n].getMCGNode()->isUnknown())
+          numUnknown++;
+      }
+
+      if (numUnknown == 0)
+        return;
+
+      // redirect edges over UNKNOWN nodes
+      for(unsigned int n = 0; n != numNodes; n++) {
+        if (!Nodes[n].getMCGNode()->isUnknown())
+          continue;
+
+        for(unsigned int c = ChildOffsets[n]; c != ChildOffsets[n + 1]; c++) {
+          for(unsigned int p = ParentOffsets[n]; p != ParentOffsets[n + 1];
+              p++) {
+            SCAEdge parent(Edges[ParentEdges[p]]);
+            Edges.push_back(SCAEdge(parent.getCaller(), Edges[c].getCallee(),
+                                    parent.getSite()));
+          }
+        }
       }
 
-      // remove all edges originating from the node in its children's parents
-      // lists
-      for(SCAEdgeSet::const_iterator i(N->getChildren().begin()),
-          ie(N->getChildren().end()); i != ie; i++) {
-        i->getCallee()->getParents().erase(*i);
+      // compact the node array in place, keeping the order of the nodes
+      std::vector<unsigned int> newIndex(numNodes);
+      unsigned int numKept = 0;
+      for(unsigned int n = 0; n != numNodes; n++) {
+        if (Nodes[n].getMCGNode()->isUnknown())
+          newIndex[n] = numNodes;
+        else {
+          newIndex[n] = numKept;
+          Nodes[numKept++] = Nodes[n];
+        }
       }
+      Nodes.resize(numKept, Nodes.front());
+      std::vector<SCANode>(Nodes).swap(Nodes);
+      Root = newIndex[Root];
+
+      // drop edges of the removed nodes and renumber the others
+      unsigned int numEdges = 0;
+      for(unsigned int e = 0, ee = Edges.size(); e != ee; e++) {
+        unsigned int caller = newIndex[Edges[e].getCaller()];
+        unsigned int callee = newIndex[Edges[e].getCallee()];
+        if (caller != numNodes && callee != numNodes)
+          Edges[numEdges++] = SCAEdge(caller, callee, Edges[e].getSite());
+      }
+      Edges.resize(numEdges, SCAEdge(0, 0, NULL));
+      std::vector<SCAEdge>(Edges).swap(Edges);
 
-      delete N;
+      buildIndices();
+    }
+
+    /// setVisible - Mark the nodes and all their ancestors visible. Nodes that
+    /// are not valid are not marked visible and hide their ancestors.
+    void setVisible(std::vector<unsigned int> &WL)
+    {
+      while (!WL.empty()) {
+        unsigned int n = WL.back();
+        SCANode &N(Nodes[n]);
+        WL.pop_back();
+
+        if (N.IsVisible || !N.IsValid)
+          continue;
+
+        N.IsVisible = true;
+
+        /// propagate to parents
+        for(unsigned int p = ParentOffsets[n]; p != ParentOffsets[n + 1]; p++) {
+          WL.push_back(Edges[ParentEdges[p]].getCaller());
+        }
+      }
     }
 
     /// Return the graph's root node.
-    SCANode *getRoot() const
+    unsigned int getRoot() const
     {
       return Root;
     }
 
-    /// getNodes - Return the nodes of the SCA graph.
-    /// @return The nodes of the SCA graph.
-    const MCGSCANodeMap &getNodes() const
+    /// Return the number of nodes of the SCA graph.
+    unsigned int getNumNodes() const
     {
-      return Nodes;
+      return Nodes.size();
     }
 
-    /// Free all SCA nodes associated with this graph.
-    ~SpillCostAnalysisGraph()
+    /// Return a node of the SCA graph.
+    SCANode &getNode(unsigned int n)
     {
-      for(MCGSCANodeMap::iterator i(Nodes.begin()), ie(Nodes.end()); i != ie;
-          i++) {
-        delete i->second;
-      }
+      return Nodes[n];
+    }
+
+    /// Return a node of the SCA graph.
+    const SCANode &getNode(unsigned int n) const
+    {
+      return Nodes[n];
+    }
+
+    /// Return the index of a node of the SCA graph.
+    unsigned int getIndex(const SCANode *N) const
+    {
+      assert(N >= &Nodes.front() && N <= &Nodes.back());
+      return N - &Nodes.front();
+    }
+
+    /// Return the number of edges of the SCA graph.
+    unsigned int getNumEdges() const
+    {
+      return Edges.size();
+    }
+
+    /// Return an edge of the SCA graph, after finalize edges are sorted by
+    /// their calling node.
+    const SCAEdge &getEdge(unsigned int e) const
+    {
+      return Edges[e];
+    }
+
+    /// Iterate over the edges to children of a node (after finalize).
+    child_iterator child_begin(unsigned int n) const
+    {
+      return Edges.begin() + ChildOffsets[n];
+    }
+
+    child_iterator child_end(unsigned int n) const
+    {
+      return Edges.begin() + ChildOffsets[n + 1];
+    }
+
+    /// Return the number of parent edges of a node (after finalize).
+    unsigned int getNumParents(unsigned int n) const
+    {
+      return ParentOffsets[n + 1] - ParentOffsets[n];
+    }
+
+    /// Return the i-th parent edge of a node (after finalize).
+    const SCAEdge &getParent(unsigned int n, unsigned int i) const
+    {
+      return Edges[ParentEdges[ParentOffsets[n] + i]];
     }
   };
 
@@ -754,17 +943,25 @@ namespace llvm {
     }
   };
 
+  /// Map call instructions to their basic block and their index among the
+  /// calls of the block.
+  typedef std::map<const MachineInstr*, std::pair<MachineBasicBlock*,
+                                                  unsigned> > MInstrIndex;
+
   namespace yaml {
+    struct SCANode {
+      Name Id;
+      Name Function;
+      Name SpillBlocks;
+    };
     template <>
-      struct MappingTraits<SCANode*> {
-        static void mapping(IO &io, SCANode *&n) {
-          assert(n);
-          io.mapRequired("id", n->yId);
-          io.mapRequired("function", n->yFunction);
-          io.mapRequired("spillsize", n->ySpillBlocks);
+      struct MappingTraits<SCANode> {
+        static void mapping(IO &io, SCANode &n) {
+          io.mapRequired("id", n.Id);
+          io.mapRequired("function", n.Function);
+          io.mapRequired("spillsize", n.SpillBlocks);
         }
       };
-    YAML_IS_PTR_SEQUENCE_VECTOR(SCANode)
 
     struct SCAEdge {
       Name Src;
@@ -772,34 +969,72 @@ namespace llvm {
       Name CallBlock;
       Name CallIndex;
       Name CallBlocki;
-      SCAEdge(Name src, Name dst, Name bb, unsigned idx, unsigned i)
-        : Src(src), Dst(dst), CallBlock(bb), CallIndex(idx), CallBlocki(i) {}
     };
     template <>
-      struct MappingTraits<SCAEdge*> {
-        static void mapping(IO &io, SCAEdge *&e) {
-          assert(e);
-          io.mapRequired("src", e->Src);
-          io.mapRequired("dst", e->Dst);
-          io.mapRequired("callblock", e->CallBlock);
-          io.mapRequired("callblocki", e->CallBlocki);
-          io.mapRequired("callindex", e->CallIndex);
+      struct MappingTraits<SCAEdge> {
+        static void mapping(IO &io, SCAEdge &e) {
+          io.mapRequired("src", e.Src);
+          io.mapRequired("dst", e.Dst);
+          io.mapRequired("callblock", e.CallBlock);
+          io.mapRequired("callblocki", e.CallBlocki);
+          io.mapRequired("callindex", e.CallIndex);
+        }
+      };
+
+    /// The nodes of an SCA graph. The YAML representation of a node is only
+    /// constructed when the node is written out.
+    struct SCANodes {
+      const SpillCostAnalysisGraph &G;
+      SCANode Current;
+      SCANodes(const SpillCostAnalysisGraph &g) : G(g) {}
+    };
+    template <>
+      struct SequenceTraits<SCANodes> {
+        static size_t size(IO &io, SCANodes &seq) {
+          return seq.G.getNumNodes();
+        }
+        static SCANode &element(IO &io, SCANodes &seq, size_t index) {
+          const llvm::SCANode &n(seq.G.getNode(index));
+          llvm::MachineFunction *MF = n.getMCGNode()->getMF();
+          seq.Current.Id = Name(n.getId());
+          seq.Current.Function = MF ? MF->getName() : StringRef("none");
+          seq.Current.SpillBlocks = Name(n.getSpillCost()); // export in bytes
+          return seq.Current;
+        }
+      };
+
+    /// The edges of an SCA graph, constructed when written out (see SCANodes).
+    struct SCAEdges {
+      const SpillCostAnalysisGraph &G;
+      const MInstrIndex &MiMap;
+      SCAEdge Current;
+      SCAEdges(const SpillCostAnalysisGraph &g, const MInstrIndex &mimap) :
+          G(g), MiMap(mimap) {}
+    };
+    template <>
+      struct SequenceTraits<SCAEdges> {
+        static size_t size(IO &io, SCAEdges &seq) {
+          return seq.G.getNumEdges();
+        }
+        static SCAEdge &element(IO &io, SCAEdges &seq, size_t index) {
+          const llvm::SCAEdge &e(seq.G.getEdge(index));
+          MInstrIndex::const_iterator it(seq.MiMap.find(e.getSite()->getMI()));
+          assert(it != seq.MiMap.end());
+          MachineBasicBlock *MBB = it->second.first;
+          seq.Current.Src = Name(seq.G.getNode(e.getCaller()).getId());
+          seq.Current.Dst = Name(seq.G.getNode(e.getCallee()).getId());
+          seq.Current.CallBlock = MBB->getName();
+          seq.Current.CallIndex = Name(it->second.second);
+          seq.Current.CallBlocki = Name(MBB->getNumber());
+          return seq.Current;
         }
       };
-    YAML_IS_PTR_SEQUENCE_VECTOR(SCAEdge)
 
     struct SCAGraph {
-      std::vector<SCANode*> N;
-      std::vector<SCAEdge*> E;
-      SCAGraph() {}
-      ~SCAGraph() {
-        DELETE_MEMBERS(E);
-      }
-      void addEdge(SCANode *src, SCANode *dst,
-          const MachineBasicBlock *MBB, unsigned index) {
-        E.push_back(new SCAEdge(src->yId, dst->yId,
-                                MBB->getName(), index, MBB->getNumber()));
-      }
+      SCANodes N;
+      SCAEdges E;
+      SCAGraph(const SpillCostAnalysisGraph &g, const MInstrIndex &mimap) :
+          N(g), E(g, mimap) {}
     };
 
     template <>
@@ -812,6 +1047,8 @@ namespace llvm {
 
     struct SCADoc {
       SCAGraph SCAG;
+      SCADoc(const SpillCostAnalysisGraph &g, const MInstrIndex &mimap) :
+          SCAG(g, mimap) {}
     };
     template <>
     struct MappingTraits< SCADoc > {
@@ -825,7 +1062,7 @@ namespace llvm {
   class PatmosStackCacheAnalysis : public MachineModulePass {
   private:
     /// Work list of basic blocks.
-    typedef std::set<MachineBasicBlock*> MBBs;
+    typedef PatmosBlockWorkList MBBWorkList;
 
     /// Set of call graph nodes.
     typedef std::set<MCGNode*> MCGNodeSet;
@@ -840,8 +1077,11 @@ namespace llvm {
     /// Map basic blocks to an unsigned integer.
     typedef std::map<MachineBasicBlock*, unsigned int> MBBUInt;
 
-    /// Map basic blocks to a boolean.
-    typedef std::map<MachineBasicBlock*, bool> MBBBool;
+    /// Data-flow state of the basic blocks of a function.
+    typedef PatmosBlockMap<unsigned int> MBBUIntState;
+
+    /// Boolean data-flow state of the basic blocks of a function.
+    typedef PatmosBlockMap<bool> MBBBoolState;
 
     /// Map call graph nodes to booleans.
     typedef std::map<MCGNode*, bool> MCGNodeBool;
@@ -852,6 +1092,56 @@ namespace llvm {
     /// Map call graph nodes to an unsigned integer.
     typedef std::map<MCGNode*, unsigned int> MCGNodeUInt;
 
+    /// Call graph nodes grouped by the level of their SCC in the condensed
+    /// call graph.
+    typedef std::vector<MCGNodes> MCGLevels;
+
+    /// A phase of the analysis that processes a single function.
+    typedef void (PatmosStackCacheAnalysis::*FunctionPhase)(MCGNode *Node);
+
+    /// Run a phase of the analysis for a list of functions.
+    class FunctionPhaseTask : public PatmosParallelTask
+    {
+    private:
+      PatmosStackCacheAnalysis &SCA;
+      FunctionPhase Phase;
+      const MCGNodes &Nodes;
+    public:
+      FunctionPhaseTask(PatmosStackCacheAnalysis &sca, FunctionPhase phase,
+                        const MCGNodes &nodes) :
+          SCA(sca), Phase(phase), Nodes(nodes)
+      {
+      }
+
+      virtual void run(unsigned int Index)
+      {
+        (SCA.*Phase)(Nodes[Index]);
+      }
+    };
+
+    /// Solve a list of independent ILPs, empty problems are skipped.
+    class SolveILPTask : public PatmosParallelTask
+    {
+    private:
+      PatmosILPSolver &Solver;
+      const std::vector<std::string> &LPs;
+    public:
+      std::vector<PatmosILPSolver::Status> Status;
+      std::vector<double> Results;
+
+      SolveILPTask(PatmosILPSolver &solver, const std::vector<std::string> &lps):
+          Solver(solver), LPs(lps), Status(lps.size(), PatmosILPSolver::Failed),
+          Results(lps.size(), 0)
+      {
+      }
+
+      virtual void run(unsigned int Index)
+      {
+        if (!LPs[Index].empty())
+          Status[Index] = Solver.solve(LPs[Index], Results[Index]);
+      }
+    };
+
     struct MCGSiteCompare {
       bool operator()(const MCGSite *lhs, const MCGSite *rhs) const {
         if (lhs->getCaller() < rhs->getCaller())
@@ -876,9 +1166,6 @@ namespace llvm {
     /// List of ensures and their effective sizes.
     typedef std::map<MachineInstr*, unsigned int> SIZEs;
 
-    typedef std::map<const MachineInstr*, std::pair<MachineBasicBlock*,
-                                                    unsigned> > MInstrIndex;
-
     /// Track for each call graph node the maximum stack displacement.
     MCGNodeUInt MaxDisplacement;
 
@@ -967,13 +1254,20 @@ namespace llvm {
     const BoundsInformation BI;
 
     MInstrIndex MiMap;
+
+    /// Solver backend for the ILPs constructed during the analysis.
+    OwningPtr<PatmosILPSolver> Solver;
+
+    /// Worker threads processing independent functions and SCCs.
+    PatmosThreadPool Pool;
   public:
     /// Pass ID
     static char ID;
 
     PatmosStackCacheAnalysis(const PatmosTargetMachine &tm) :
         MachineModulePass(ID), STC(tm.getSubtarget<PatmosSubtarget>()),
-        TII(*tm.getInstrInfo()), SCAGraph(STC), BI(BoundsFile)
+        TII(*tm.getInstrInfo()), SCAGraph(STC), BI(BoundsFile),
+        Solver(createPatmosILPSolver()), Pool(SCAThreads)
     {
       initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
     }
@@ -1027,8 +1321,10 @@ namespace llvm {
     }
 
     // updateMinMaxOccupancy - Update the minimum/maximum occupancy known for a
-    // given call graph node.
+    // given call graph node. The maximum occupancy may stem from a merged
+    // calling context, the minimum occupancy has to stem from an unmerged one.
     void updateMinMaxOccupancy(MCGNode *node, unsigned int occupancy,
+                               unsigned int min_occupancy,
                                unsigned int effective_occupancy)
     {
       // update maximum occupancy
@@ -1039,9 +1335,9 @@ namespace llvm {
 
       // attention default value is 0 here
       if (nodeOccupancy == MinOccupancy.end())
-        MinOccupancy[node] = occupancy;
+        MinOccupancy[node] = min_occupancy;
       else
-        MinOccupancy[node] = std::min(MinOccupancy[node], occupancy);
+        MinOccupancy[node] = std::min(MinOccupancy[node], min_occupancy);
 
       // update maximum effective occupancy
       MaxEffectiveOccupancy[node] = std::max(MaxEffectiveOccupancy[node],
@@ -1082,6 +1378,32 @@ namespace llvm {
                       getMinMaxDisplacement(Node, true));
     }
 
+    /// getMinDisplacement - Find the minimum stack displacement over the
+    /// possible callees of a call, given by its call sites.
+    unsigned int getMinDisplacement(const MCGSites &Sites) const
+    {
+      assert(!Sites.empty());
+      unsigned int result = std::numeric_limits<unsigned int>::max();
+      for(MCGSites::const_iterator i(Sites.begin()), ie(Sites.end()); i != ie;
+          i++) {
+        result = std::min(result, getMinDisplacement((*i)->getCallee()));
+      }
+      return result;
+    }
+
+    /// getMaxDisplacement - Find the maximum stack displacement over the
+    /// possible callees of a call, given by its call sites.
+    unsigned int getMaxDisplacement(const MCGSites &Sites) const
+    {
+      assert(!Sites.empty());
+      unsigned int result = 0;
+      for(MCGSites::const_iterator i(Sites.begin()), ie(Sites.end()); i != ie;
+          i++) {
+        result = std::max(result, getMaxDisplacement((*i)->getCallee()));
+      }
+      return result;
+    }
+
     /// getBytesReserved - Get the number of bytes reserved at the entry of a
     /// call graph node. Returns 0 for UNKNOWN nodes.
     unsigned int getBytesReserved(const MCGNode *Node) const
@@ -1136,10 +1458,9 @@ namespace llvm {
 
     /// computeMinMaxDisplacement - Visit a call graph node and determine its
     /// minimum/maximum displacement, including all its children in the call
-    /// graph.
+    /// graph. For nodes in SCCs, ILPResult holds the bound found by the ILP.
     void computeMinMaxDisplacement(MCGNodeSCC &SCCMap, MCGNode *Node,
-                                   MCGNodeUInt &succCount, MCGNodes &WL,
-                                   bool Maximize)
+                                   unsigned int ILPResult, bool Maximize)
     {
       // keep track of the total displacement of the node and its children
       unsigned int totalDisplacment;
@@ -1154,11 +1475,10 @@ namespace llvm {
         return;
       }
       else if (SCCMap[Node]->second) {
-        // the node is in an SCC! -> make an ILP
+        // the node is in an SCC! -> the ILP has been solved already
         // note: we know here that all successors of the entire SCC have been
         // handled
-        totalDisplacment = computeMinMaxDisplacementILP(SCCMap[Node]->first,
-                                                        Node, Maximize);
+        totalDisplacment = ILPResult;
         assert(totalDisplacment >= nodeDisplacement);
       }
       else {
@@ -1196,50 +1516,18 @@ namespace llvm {
         MaxDisplacement[Node] = totalDisplacment;
       else
         MinDisplacement[Node] = totalDisplacment;
-
-      // get unique predecessors in the call graph, excluding dead functions and
-      // predecessors within the same SCC
-      MCGNodeSet preds;
-      const MCGSites &callingSites(Node->getCallingSites());
-      for(MCGSites::const_iterator i(callingSites.begin()),
-          ie(callingSites.end()); i != ie; i++) {
-        MCGNode *caller = (*i)->getCaller();
-        assert(caller->isDead() || SCCMap.count(caller));
-        // do not consider dead functions and functions in the same SCC here
-        if (!caller->isDead() && SCCMap[caller] != SCCMap[Node]) {
-          const MCGNodes &predSCC(SCCMap[caller]->first);
-          preds.insert(predSCC.begin(), predSCC.end());
-        }
-      }
-
-      // update the work list by checking the predecessor list
-      for(MCGNodeSet::const_iterator i(preds.begin()), ie(preds.end()); i != ie;
-          i++) {
-        assert(succCount[*i] > 0);
-        if (--succCount[*i] == 0)
-          WL.push_back(*i);
-      }
     }
 
-    /// computeMinMaxDisplacement - Visit all nodes of the call graph and
-    /// compute the minimum/maximum displacement for each of them (including
-    /// their respective children in the call graph).
-    ///
-    /// The algorithm uses a simple work list (and successor counters) to
-    /// traverse the call graph in some topological order. During the traversal
-    /// the minimum/maximum displacement is propagated from children upwards to
-    /// the root(s) of the call graph.
-    ///
-    /// Note that SCCs are considered as if they were collapsed into a single
-    /// node. Within SCCs an ILP formulation is used to bound the displacement.
+    /// computeSCCLevels - Find the SCCs of the call graph and group their
+    /// nodes into levels, such that SCCs only depend on SCCs of preceding
+    /// levels, i.e., their callees when BottomUp is set, their callers
+    /// otherwise. Nodes of the same level can thus be processed independently.
     ///
-    /// \see computeMinMaxDisplacementILP
-    void computeMinMaxDisplacement(const MCallGraph &G, bool Maximize)
+    /// The nodes of a level are ordered by the order in which the SCCs are
+    /// found, which does not depend on the level-wise processing.
+    void computeSCCLevels(const MCallGraph &G, bool BottomUp, MCGNSCCs &SCCs,
+                          MCGNodeSCC &SCCMap, MCGLevels &Levels)
     {
-      // list of SCCs in the call graph and mapping to/from call graph nodes
-      MCGNSCCs SCCs;
-      MCGNodeSCC SCCMap;
-
       // get all call graph nodes
       const MCGNodes &nodes(G.getNodes());
 
@@ -1263,48 +1551,97 @@ namespace llvm {
           dbgs() << "missing: " << **i << "\n";
       }
 
-      // initialize the work list and successor counters
-      MCGNodeUInt succCount;
-      MCGNodes WL;
-      for(MCGNSCCs::const_iterator i(SCCs.begin()), ie(SCCs.end()); i != ie;
-          i++) {
-        // get info of the current SCC
-        const MCGNodes *SCC = &i->first;
-
-        // get the number of successors of the SCC that are not in that SCC.
-        MCGNodeSet succs;
-        for(MCGNodes::const_iterator j(SCC->begin()), je(SCC->end()); j != je;
+      // SCCs are found in reverse topological order, i.e., callees before
+      // their callers. Assign each SCC a level one above the highest level of
+      // the SCCs it depends on.
+      std::vector<unsigned int> SCCLevel(SCCs.size(), 0);
+      unsigned int numLevels = 0;
+      for(unsigned int k = 0, ke = SCCs.size(); k != ke; k++) {
+        unsigned int i = BottomUp ? k : ke - k - 1;
+        const MCGNodes &SCC(SCCs[i].first);
+
+        unsigned int level = 0;
+        for(MCGNodes::const_iterator j(SCC.begin()), je(SCC.end()); j != je;
             j++) {
-          for(MCGSites::const_iterator k((*j)->getSites().begin()),
-              ke((*j)->getSites().end()); k != ke; k++) {
-            // check if the two are in the same SCC
-            if (&SCCMap[(*k)->getCallee()]->first != SCC) {
-              succs.insert((*k)->getCallee());
+          const MCGSites &sites(BottomUp ? (*j)->getSites() :
+                                           (*j)->getCallingSites());
+          for(MCGSites::const_iterator cs(sites.begin()), cse(sites.end());
+              cs != cse; cs++) {
+            MCGNode *dep = BottomUp ? (*cs)->getCallee() : (*cs)->getCaller();
+
+            // do not consider dead functions and functions in the same SCC
+            MCGNodeSCC::const_iterator depSCC(SCCMap.find(dep));
+            if (!dep->isDead() && depSCC != SCCMap.end() &&
+                depSCC->second != &SCCs[i]) {
+              level = std::max(level, SCCLevel[depSCC->second - &SCCs[0]] + 1);
             }
           }
         }
 
-        // be sure to keep all nodes within an SCC off the WL for now
-        for(MCGNodes::const_iterator j(SCC->begin()), je(SCC->end()); j != je;
-            j++) {
-          if (succs.size() == 0)
-            WL.push_back(*j);
-          else
-            succCount[*j] = succs.size();
-        }
+        SCCLevel[i] = level;
+        numLevels = std::max(numLevels, level + 1);
+      }
+
+      // collect the nodes of each level
+      Levels.resize(numLevels);
+      for(unsigned int i = 0, ie = SCCs.size(); i != ie; i++) {
+        MCGNodes &level(Levels[SCCLevel[i]]);
+        level.insert(level.end(), SCCs[i].first.begin(), SCCs[i].first.end());
       }
+    }
+
+    /// computeMinMaxDisplacement - Visit all nodes of the call graph and
+    /// compute the minimum/maximum displacement for each of them (including
+    /// their respective children in the call graph).
+    ///
+    /// The call graph is traversed level by level in topological order (see
+    /// computeSCCLevels). During the traversal the minimum/maximum
+    /// displacement is propagated from children upwards to the root(s) of the
+    /// call graph.
+    ///
+    /// Note that SCCs are considered as if they were collapsed into a single
+    /// node. Within SCCs an ILP formulation is used to bound the displacement.
+    /// The ILPs of a level are independent and solved concurrently.
+    ///
+    /// \see makeMinMaxDisplacementILP
+    void computeMinMaxDisplacement(const MCallGraph &G, bool Maximize)
+    {
+      // list of SCCs in the call graph and mapping to/from call graph nodes
+      MCGNSCCs SCCs;
+      MCGNodeSCC SCCMap;
+      MCGLevels Levels;
+
+      computeSCCLevels(G, true, SCCs, SCCMap, Levels);
 
       // process nodes in topological order
-      while(!WL.empty()) {
-        // pop some node from the work list
-        MCGNode *tmp = WL.back();
-        WL.pop_back();
+      for(MCGLevels::const_iterator l(Levels.begin()), le(Levels.end());
+          l != le; l++) {
+        const MCGNodes &level(*l);
+
+        // construct the ILPs of nodes within SCCs
+        std::vector<std::string> LPs(level.size());
+        for(unsigned int i = 0, ie = level.size(); i != ie; i++) {
+          if (!level[i]->isDead() && SCCMap[level[i]]->second)
+            LPs[i] = makeMinMaxDisplacementILP(SCCMap[level[i]]->first,
+                                               level[i], Maximize);
+        }
+
+        std::vector<unsigned int> ILPResults;
+        solve_ilps(LPs, Maximize, ILPResults);
+
+        // compute the displacement of the level's nodes
+        for(unsigned int i = 0, ie = level.size(); i != ie; i++) {
+#ifdef PATMOS_TRACE_CG_DISPLACMENT_ILP
+          if (!LPs[i].empty())
+            dbgs() << "ILP: " << *level[i] << ": " << ILPResults[i] << "\n";
+#endif // PATMOS_TRACE_CG_DISPLACMENT_ILP
 
-        // compute its displacement
-        computeMinMaxDisplacement(SCCMap, tmp, succCount, WL, Maximize);
+          computeMinMaxDisplacement(SCCMap, level[i], ILPResults[i], Maximize);
+        }
       }
 
 #ifdef PATMOS_TRACE_CG_DISPLACMENT
+      const MCGNodes &nodes(G.getNodes());
       DEBUG(dbgs() << (Maximize ? ">>>>>>>>>>>>>>> MAX >>>>>>>>>>>>>>>>\n" :
                                   "<<<<<<<<<<<<<<< MIN <<<<<<<<<<<<<<<<\n"););
       DEBUG(
@@ -1319,6 +1656,52 @@ namespace llvm {
 #endif // PATMOS_TRACE_CG_DISPLACMENT
     }
 
+    /// forEachFunction - Run a phase of the analysis for all live functions of
+    /// the call graph. The functions are processed concurrently, the phase may
+    /// thus only update information of the function's own basic blocks and
+    /// instructions (see initBlockInfo).
+    void forEachFunction(const MCallGraph &G, FunctionPhase Phase)
+    {
+      const MCGNodes &nodes(G.getNodes());
+
+      MCGNodes functions;
+      for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
+          i++) {
+        if (!(*i)->isUnknown() && !(*i)->isDead())
+          functions.push_back(*i);
+      }
+
+      FunctionPhaseTask Task(*this, Phase, functions);
+      Pool.run(Task, functions.size());
+    }
+
+    /// initBlockInfo - Create the entries of all basic blocks of live
+    /// functions in the per-block maps, such that the maps are not modified
+    /// structurally when functions are processed concurrently.
+    void initBlockInfo(const MCallGraph &G)
+    {
+      const MCGNodes &nodes(G.getNodes());
+
+      for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
+          i++) {
+        if ((*i)->isUnknown() || (*i)->isDead())
+          continue;
+
+        MachineFunction *MF = (*i)->getMF();
+        for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
+            j++) {
+          WorstCaseBlockDP[j];
+          WorstCaseBlockRP[j];
+          WorstCaseBlockLP[j];
+          WorstCaseLocalEnsureFilling[j];
+          ReserveGain[j];
+          WorstCaseBlockOccupancy[j];
+          WorstCaseBlockSaving[j];
+          WorstCaseBlockRestoring[j];
+        }
+      }
+    }
+
     /// getLiveAreaSize - Bound the address accessed by the instruction wrt.
     /// the stack cache, i.e., get the size of the area within the stack cache
     /// that contains live data.
@@ -1363,7 +1746,7 @@ namespace llvm {
     /// to ensure instructions. This information can be used to downsize or
     /// remove ensures.
     // TODO: check for STCr
-    void propagateLiveArea(MBBs &WL, MBBUInt &INs, MCGNode *Node,
+    void propagateLiveArea(MBBWorkList &WL, MBBUIntState &INs, MCGNode *Node,
                            SIZEs &ENSs, MachineBasicBlock *MBB)
     {
       // get the size of the live stack area from the CFG successors
@@ -1415,71 +1798,60 @@ namespace llvm {
     }
 
     /// propagateLiveArea - Propagate information on the live data within the
-    /// stack cache, e.g., accessed by loads and stores, upwards trough the CFG
-    /// to ensure instructions. This information can be used to downsize or
-    /// remove ensures.
-    void propagateLiveArea(const MCallGraph &G)
+    /// stack cache of a function upwards trough its CFG to ensure
+    /// instructions.
+    void propagateLiveArea(MCGNode *Node)
     {
-      const MCGNodes &nodes(G.getNodes());
-
-      // visit all functions
-      for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
-          i++) {
-        if (!(*i)->isUnknown() && !(*i)->isDead()) {
-          MBBs WL;
-          SIZEs ENSs;
-          MBBUInt INs;
-          MachineFunction *MF = (*i)->getMF();
-
-          MCGNodes::const_iterator j = i;
-
-          // initialize work list (yeah, reverse-reverse post order would be
-          // optimal, but this works too).
-          for(MachineFunction::iterator i(MF->begin()), ie(MF->end()); i != ie;
-              i++) {
-            WL.insert(i);
-          }
+      MachineFunction *MF = Node->getMF();
+      MBBWorkList WL(*MF, MBBWorkList::Backward);
+      SIZEs ENSs;
+      MBBUIntState INs(*MF);
 
-          // process until the work list becomes empty
-          while (!WL.empty()) {
-            // get some basic block
-            MachineBasicBlock *MBB = *WL.begin();
-            WL.erase(WL.begin());
+      // initialize work list, blocks are processed in post order.
+      WL.insertAll();
 
-            // update the basic block's information, potentially putting any of
-            // its predecessors on the work list.
-            propagateLiveArea(WL, INs, *j, ENSs, MBB);
-          }
+      // update the basic blocks' information, potentially putting any of
+      // their predecessors on the work list.
+      solve(WL, [&](MachineBasicBlock *MBB) {
+        propagateLiveArea(WL, INs, Node, ENSs, MBB);
+      });
 
 
-          // actually update the sizes of the ensure instructions.
-          if (EnableEnsureDwn) {
-            for(SIZEs::const_iterator i(ENSs.begin()), ie(ENSs.end()); i != ie;
-                i++) {
-              i->first->getOperand(2).setImm(i->second);
-            }
-          }
+      // actually update the sizes of the ensure instructions.
+      if (EnableEnsureDwn) {
+        for(SIZEs::const_iterator i(ENSs.begin()), ie(ENSs.end()); i != ie;
+            i++) {
+          i->first->getOperand(2).setImm(i->second);
+        }
+      }
 
 #ifdef PATMOS_TRACE_BB_LIVEAREA
-          DEBUG(
-            dbgs() << "*************************** "
-                   << MF->getFunction()->getName() << "\n";
-            for(MBBUInt::const_iterator i(INs.begin()), ie(INs.end()); i != ie;
-                i++) {
-              dbgs() << "  " << i->first->getName()
-                    << "(" << i->first->getNumber() << ")"
-                    << ": " << i->second << "\n";
-            }
-          );
-#endif // PATMOS_TRACE_BB_LIVEAREA
+      DEBUG(
+        dbgs() << "*************************** "
+               << MF->getFunction()->getName() << "\n";
+        for(MachineFunction::iterator i(MF->begin()), ie(MF->end()); i != ie;
+            i++) {
+          dbgs() << "  " << i->getName()
+                << "(" << i->getNumber() << ")"
+                << ": " << INs.lookup(i) << "\n";
         }
-      }
+      );
+#endif // PATMOS_TRACE_BB_LIVEAREA
+    }
+
+    /// propagateLiveArea - Propagate information on the live data within the
+    /// stack cache, e.g., accessed by loads and stores, upwards trough the CFG
+    /// to ensure instructions. This information can be used to downsize or
+    /// remove ensures.
+    void propagateLiveArea(const MCallGraph &G)
+    {
+      forEachFunction(G, &PatmosStackCacheAnalysis::propagateLiveArea);
     }
 
     /// propagateReserveGain - Propagate the minimum reduction in spilling at
     /// the reserve instructions of subsequent call sites upwards through the
     /// CFG.
-    void propagateReserveGain(MBBs &WL, MBBUInt &INs,
+    void propagateReserveGain(MBBWorkList &WL, MBBUIntState &INs,
                               MCGNode *Node, MachineBasicBlock *MBB)
     {
       // get the reserve gain from the CFG successors
@@ -1492,8 +1864,7 @@ namespace llvm {
 
        // check for ensures
         if (i->isCall()) {
-          MCGSite *site = Node->findSite(&*i);
-          unsigned int minDisp = getMinDisplacement(site->getCallee());
+          unsigned int minDisp = getMinDisplacement(Node->findSites(&*i));
           unsigned int minOccupancy = std::min(WorstCaseBlockOccupancy[MBB],
                                                getMinOccupancy(Node));
 
@@ -1519,7 +1890,7 @@ namespace llvm {
         /// check if the new gain is less than what was known previously for
         /// this predecessor. Also, insert predecessors that have not been
         /// already visited.
-        if ((INs.find(*i) == INs.end()) || (INs[*i] > siteGain)) {
+        if (!INs.count(*i) || (INs[*i] > siteGain)) {
           // update the predecessor's gain and put it on the work list
           INs[*i] = siteGain;
           WL.insert(*i);
@@ -1527,47 +1898,38 @@ namespace llvm {
       }
     }
 
+    /// propagateReserveGain - Propagate the minimum reduction in spilling at
+    /// the reserve instructions of subsequent call sites upwards through the
+    /// CFG of a function.
+    void propagateReserveGain(MCGNode *Node)
+    {
+      MachineFunction *MF = Node->getMF();
+      MBBWorkList WL(*MF, MBBWorkList::Backward);
+      MBBUIntState INs(*MF);
+
+      // initialize work list, blocks are processed in post order.
+      WL.insertAll();
+
+      // update the basic blocks' information, potentially putting any of
+      // their predecessors on the work list.
+      solve(WL, [&](MachineBasicBlock *MBB) {
+        propagateReserveGain(WL, INs, Node, MBB);
+      });
+    }
+
     /// propagateReserveGain - Propagate the minimum reduction in spilling at
     /// the reserve instructions of subsequent call sites upwards through the
     /// CFG.
     void propagateReserveGain(const MCallGraph &G)
     {
-      const MCGNodes &nodes(G.getNodes());
-
-      // visit all functions
-      for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
-          i++) {
-        if (!(*i)->isUnknown() && !(*i)->isDead()) {
-          MBBs WL;
-          MBBUInt INs;
-          MachineFunction *MF = (*i)->getMF();
-
-          // initialize work list (yeah, reverse-reverse post order would be
-          // optimal, but this works too).
-          for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
-              j++) {
-            WL.insert(j);
-          }
-
-          // process until the work list becomes empty
-          while (!WL.empty()) {
-            // get some basic block
-            MachineBasicBlock *MBB = *WL.begin();
-            WL.erase(WL.begin());
-
-            // update the basic block's information, potentially putting any of
-            // its predecessors on the work list.
-            propagateReserveGain(WL, INs, *i, MBB);
-          }
-        }
-      }
+      forEachFunction(G, &PatmosStackCacheAnalysis::propagateReserveGain);
     }
 
     /// propagateLocalEnsureFilling - Propagate the maximum number of blocks
     /// that are filled by the next ensure instruction after a preemption
     /// upwards through the CFG. Also associate call sites with worst-case
     /// filling.
-    void propagateLocalEnsureFilling(MBBs &WL, MBBUInt &INs,
+    void propagateLocalEnsureFilling(MBBWorkList &WL, MBBUIntState &INs,
                                      MCGNode *Node, MachineBasicBlock *MBB)
     {
       // get the number of filled blocks from the CFG successors
@@ -1586,8 +1948,11 @@ namespace llvm {
         }
         // check for calls
         else if (i->isCall()) {
-          MCGSite *site = Node->findSite(&*i);
-          WorstCaseSiteEnsureBound[site] = ensureBound;
+          MCGSites sites(Node->findSites(&*i));
+          for(MCGSites::iterator j(sites.begin()), je(sites.end()); j != je;
+              j++) {
+            WorstCaseSiteEnsureBound[*j] = ensureBound;
+          }
         }
       }
 
@@ -1602,7 +1967,7 @@ namespace llvm {
           ie(MBB->pred_end()); i != ie; i++) {
         // check if the new filling size is less than what was known
         // previously for this predecessor
-        if ((INs.find(*i) == INs.end()) || (INs[*i] > ensureBound)) {
+        if (!INs.count(*i) || (INs[*i] > ensureBound)) {
           // update the predecessor's filling size and put it on the work list
           INs[*i] = ensureBound;
           WL.insert(*i);
@@ -1622,37 +1987,36 @@ namespace llvm {
       for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
           i++) {
         if (!(*i)->isUnknown() && !(*i)->isDead()) {
-          MBBs WL;
-          MBBUInt INs;
           MachineFunction *MF = (*i)->getMF();
+          MBBWorkList WL(*MF, MBBWorkList::Backward);
+          MBBUIntState INs(*MF, getBytesReserved(*i));
 
-          // initialize work list (yeah, reverse-reverse post order would be
-          // optimal, but this works too).
-          for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
-              j++) {
-            WL.insert(j);
-            INs[j] = getBytesReserved(*i);
-          }
-
-          // process until the work list becomes empty
-          while (!WL.empty()) {
-            // get some basic block
-            MachineBasicBlock *MBB = *WL.begin();
-            WL.erase(WL.begin());
+          // initialize work list, blocks are processed in post order.
+          WL.insertAll();
 
-            // update the basic block's information, potentially putting any of
-            // its predecessors on the work list.
+          // update the basic blocks' information, potentially putting any of
+          // their predecessors on the work list.
+          solve(WL, [&](MachineBasicBlock *MBB) {
             propagateLocalEnsureFilling(WL, INs, *i, MBB);
-          }
+          });
         }
       }
     }
 
+    /// needsGlobalEnsureFillingILP - Check whether the global ensure filling
+    /// of a call graph node has to be bounded using an ILP.
+    bool needsGlobalEnsureFillingILP(MCGNodeSCC &SCCMap, MCGNode *Node) const
+    {
+      return !Node->isDead() && SCCMap[Node]->second &&
+             getMinDisplacement(Node) < STC.getStackCacheSize();
+    }
+
     /// propagateGlobalEnsureFilling - Propagate the worst-case filling caused
     /// at the ensure instruction of all the callers of a call graph node
-    /// downwards through the call graph.
+    /// downwards through the call graph. For nodes in SCCs, ILPResult holds
+    /// the bound found by the ILP.
     void propagateGlobalEnsureFilling(MCGNodeSCC &SCCMap, MCGNode *Node,
-                                      MCGNodeUInt &succCount, MCGNodes &WL)
+                                      unsigned int ILPResult)
     {
       // keep track of the total ensure cost of the node and its parent
       unsigned int totalCost = 0;
@@ -1669,11 +2033,10 @@ namespace llvm {
           GlobalEnsureFillingILPFree++;
         }
         else {
-          // the node is in an SCC! -> make an ILP
+          // the node is in an SCC! -> the ILP has been solved already
           // note: we know here that all predecessors of the entire SCC have been
           // handled
-          totalCost = propagateGlobalEnsureFillingILP(SCCMap[Node]->first,
-                                                      Node);
+          totalCost = ILPResult;
           GlobalEnsureFillingILP++;
         }
       }
@@ -1705,60 +2068,21 @@ namespace llvm {
       /// Since the analysis goes upward, the result is set at the output of
       /// the analyzed basic block.
       WorstCaseGlobalEnsureFilling[Node] = totalCost;
-
-      // get unique successors in the call graph, excluding dead functions and
-      // nodes within the same SCC
-      MCGNodeSet succs;
-
-      const MCGSites &sites(Node->getSites());
-
-      for(MCGSites::const_iterator i(sites.begin()),
-          ie(sites.end()); i != ie; i++) {
-        MCGNode *callee = (*i)->getCallee();
-        assert(callee->isDead() || SCCMap.count(callee));
-        // do not consider dead functions and functions in the same SCC here
-        if (!callee->isDead() && SCCMap[callee] != SCCMap[Node]) {
-          const MCGNodes &succSCC(SCCMap[callee]->first);
-          succs.insert(succSCC.begin(), succSCC.end());
-        }
-      }
-
-      // update the work list by checking the successor list
-      for(MCGNodeSet::const_iterator i(succs.begin()), ie(succs.end()); i != ie;
-          i++) {
-          if (--succCount[*i] == 0)
-            WL.push_back(*i);
-      }
     }
 
-    /// propagateGlobalEnsureFillingILP - Propagate the worst-case filling
-    /// caused at the ensure instruction of all the callers of a call graph node
-    /// downwards through the call graph.
-    unsigned int propagateGlobalEnsureFillingILP(const MCGNodes &SCC,
-                                                 MCGNode *N)
+    /// makeGlobalEnsureFillingILP - Construct an ILP modeling the worst-case
+    /// filling caused at the ensure instruction of all the callers of a call
+    /// graph node within an SCC and return it in LP format.
+    std::string makeGlobalEnsureFillingILP(const MCGNodes &SCC, MCGNode *N)
     {
       assert(std::find(SCC.begin(), SCC.end(), N) != SCC.end());
 
       // get user-supplied bounds to solve the ILP.
       const SCCInfo &BInfo(BI.getInfo(SCC));
 
-      // open LP file.
-      SmallString<1024> LPname;
-      error_code err = sys::fs::createUniqueDirectory("stack", LPname);
-      if (err) {
-        errs() << "Error creating temp .lp file: " << err.message() << "\n";
-        return std::numeric_limits<unsigned int>::max();
-      }
-
-      sys::path::append(LPname, "scc.lp");
-
-      std::string ErrMsg;
-      raw_fd_ostream OS(LPname.c_str(), ErrMsg);
-      if (!ErrMsg.empty()) {
-        errs() << "Error: Failed to open file '" << LPname.str()
-               << "' for writing!\n";
-        return std::numeric_limits<unsigned int>::max();
-      }
+      // build the LP in memory.
+      std::string LP;
+      raw_string_ostream OS(LP);
 
       // find entry and exit call sites
       typedef std::set<MCGSite*> MCGSiteSet;
@@ -1998,91 +2322,54 @@ namespace llvm {
 
       OS << "End\n";
 
-      OS.close();
-
-      // solve the ILP
-      unsigned int result = solve_ilp(LPname.c_str(), true);
-
-#ifdef PATMOS_TRACE_CG_ENS_COST_ILP
-      dbgs() << "ILP: " << *N << ": " << result << "\n";
-#endif // PATMOS_TRACE_CG_ENS_COST_ILP
-
-      // remove LP file
-      // TODO do we need to remove the temp dir??
-      sys::fs::remove(LPname.str());
-
-      return result;
+      return OS.str();
     }
 
     /// propagateGlobalEnsureFilling - Propagate the worst-case filling caused
     /// at the ensure instruction of all the callers of a call graph node
     /// downwards through the call graph.
+    ///
+    /// The call graph is traversed level by level from the root(s) downwards
+    /// (see computeSCCLevels), the ILPs of a level are solved concurrently.
     void propagateGlobalEnsureFilling(const MCallGraph &G)
     {
       // list of SCCs in the call graph and mapping to/from call graph nodes
       MCGNSCCs SCCs;
       MCGNodeSCC SCCMap;
+      MCGLevels Levels;
 
-      // get all call graph nodes
-      const MCGNodes &nodes(G.getNodes());
-
-      // make sure we have enough space for all SCCs without re-allocation
-      SCCs.reserve(nodes.size());
+      computeSCCLevels(G, false, SCCs, SCCMap, Levels);
 
-      // get SCCs
-      typedef scc_iterator<MCallGraph> PCGSCC_iterator;
-      for(PCGSCC_iterator s(scc_begin(G)); !s.isAtEnd(); s++) {
+      for(MCGLevels::const_iterator l(Levels.begin()), le(Levels.end());
+          l != le; l++) {
+        const MCGNodes &level(*l);
 
-        // keep track of call graph nodes and their SCCs.
-        SCCs.push_back(std::make_pair(*s, s.hasLoop()));
-        for(MCGNodes::iterator n((*s).begin()), ne((*s).end()); n != ne; n++) {
-          SCCMap[*n] = &SCCs.back();
+        // construct the ILPs of nodes within SCCs
+        std::vector<std::string> LPs(level.size());
+        for(unsigned int i = 0, ie = level.size(); i != ie; i++) {
+          if (needsGlobalEnsureFillingILP(SCCMap, level[i]))
+            LPs[i] = makeGlobalEnsureFillingILP(SCCMap[level[i]]->first,
+                                                level[i]);
         }
-      }
 
-      // initialize the work list and predecessor counters
-      MCGNodeUInt predCount;
-      MCGNodes WL;
-      for(MCGNSCCs::const_iterator i(SCCs.begin()), ie(SCCs.end()); i != ie;
-          i++) {
-        // get info of the current SCC
-        const MCGNodes *SCC = &i->first;
+        std::vector<unsigned int> ILPResults;
+        solve_ilps(LPs, true, ILPResults);
 
-        // get the number of predecessors of the SCC that are not in that SCC.
-        MCGNodeSet preds;
-        for(MCGNodes::const_iterator j(SCC->begin()), je(SCC->end()); j != je;
-            j++) {
-          for(MCGSites::const_iterator k((*j)->getCallingSites().begin()),
-              ke((*j)->getCallingSites().end()); k != ke; k++) {
-            // check if the two are in the same SCC
-            if (&SCCMap[(*k)->getCaller()]->first != SCC) {
-              preds.insert((*k)->getCaller());
-            }
-          }
-        }
+        for(unsigned int i = 0, ie = level.size(); i != ie; i++) {
+#ifdef PATMOS_TRACE_CG_ENS_COST_ILP
+          if (!LPs[i].empty())
+            dbgs() << "ILP: " << *level[i] << ": " << ILPResults[i] << "\n";
+#endif // PATMOS_TRACE_CG_ENS_COST_ILP
 
-        // be sure to keep all nodes within an SCC off the WL for now
-        for(MCGNodes::const_iterator j(SCC->begin()), je(SCC->end()); j != je;
-            j++) {
-          if (preds.size() == 0)
-            WL.push_back(*j);
-          else
-            predCount[*j] = preds.size();
+          propagateGlobalEnsureFilling(SCCMap, level[i], ILPResults[i]);
         }
       }
-
-      while(!WL.empty()) {
-          MCGNode *tmp = WL.back();
-          WL.pop_back();
-
-          propagateGlobalEnsureFilling(SCCMap, tmp, predCount, WL);
-      }
     }
 
     /// propagateDeadArea - Propagate information on the dead data within the
     /// stack cache, e.g., accessed by loads and stores, upwards trough the CFG.
     // TODO: check for STCr
-    void propagateDeadArea(MBBs &WL, MBBUInt &INs,
+    void propagateDeadArea(MBBWorkList &WL, MBBUIntState &INs,
                            MCGNode *Node, MachineBasicBlock *MBB)
     {
       // get the size of the dead stack area from the CFG successors
@@ -2163,70 +2450,60 @@ namespace llvm {
     }
 
     /// propagateDeadArea - Propagate information on the dead data within the
-    /// stack cache, e.g., accessed by loads and stores, upwards trough the CFG.
-    void propagateDeadArea(const MCallGraph &G)
+    /// stack cache of a function upwards trough its CFG.
+    void propagateDeadArea(MCGNode *Node)
     {
-      const MCGNodes &nodes(G.getNodes());
-
-      // visit all functions
-      for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
-          i++) {
-        if (!(*i)->isUnknown() && !(*i)->isDead()) {
-          MBBs WL;
-          MBBUInt INs;
-          MachineFunction *MF = (*i)->getMF();
-
-          // initialize work list (yeah, reverse-reverse post order would be
-          // optimal, but this works too).
-          for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
-              j++) {
-            WL.insert(j);
-            INs[j] = getBytesReserved(*i);
-          }
-
-          // process until the work list becomes empty
-          while (!WL.empty()) {
-            // get some basic block
-            MachineBasicBlock *MBB = *WL.begin();
-            WL.erase(WL.begin());
-
-            // update the basic block's information, potentially putting any of
-            // its predecessors on the work list.
-            propagateDeadArea(WL, INs, *i, MBB);
-          }
+      MachineFunction *MF = Node->getMF();
+      MBBWorkList WL(*MF, MBBWorkList::Backward);
+      MBBUIntState INs(*MF, getBytesReserved(Node));
+
+      // initialize work list, blocks are processed in post order.
+      WL.insertAll();
+
+      // update the basic blocks' information, potentially putting any of
+      // their predecessors on the work list.
+      solve(WL, [&](MachineBasicBlock *MBB) {
+        propagateDeadArea(WL, INs, Node, MBB);
+      });
 #ifdef PATMOS_TRACE_BB_DEADAREA
-          DEBUG(
-            dbgs() << "*************************** "
-                   << MF->getFunction()->getName() << "\n";);
+      DEBUG(
+        dbgs() << "*************************** "
+               << MF->getFunction()->getName() << "\n";);
 #endif // PATMOS_TRACE_BB_DEADAREA
 
-          for(MBBUInt::const_iterator j(INs.begin()), je(INs.end()); j != je;
-              j++) {
+      for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
+          j++) {
+        unsigned int deadAreaSize = INs.lookup(j);
 #ifdef PATMOS_TRACE_BB_DEADAREA
-            DEBUG(
-              dbgs() << "  " << j->first->getName()
-                    << "(" << j->first->getNumber() << ")"
-                    << ": " << j->second << "\n";);
+        DEBUG(
+          dbgs() << "  " << j->getName()
+                << "(" << j->getNumber() << ")"
+                << ": " << deadAreaSize << "\n";);
 #endif // PATMOS_TRACE_BB_DEADAREA
 
-            TotalBlocks++;
-            if (j->second == getBytesReserved(*i))
-              TotallyDeadBlocks++;
-            else if ((j->second != 0) && (j->second != std::numeric_limits<unsigned int>::max())) {
-              PartiallyDeadBlocks++;
-            }
-          }
+        TotalBlocks++;
+        if (deadAreaSize == getBytesReserved(Node))
+          TotallyDeadBlocks++;
+        else if ((deadAreaSize != 0) && (deadAreaSize != std::numeric_limits<unsigned int>::max())) {
+          PartiallyDeadBlocks++;
         }
       }
     }
 
+    /// propagateDeadArea - Propagate information on the dead data within the
+    /// stack cache, e.g., accessed by loads and stores, upwards trough the CFG.
+    void propagateDeadArea(const MCallGraph &G)
+    {
+      forEachFunction(G, &PatmosStackCacheAnalysis::propagateDeadArea);
+    }
+
     /// analyzeEnsures - Does what it says. SENS instructions can be removed if
     /// the preceding calls plus the current frame on the stack cache fit into
     /// the stack cache.
     // TODO: take care of predication, i.e., predicated SENS/CALL instructions
     // might be mangled and they might not match one to one.
     // TODO: check for STCr
-    void analyzeEnsures(MBBs &WL, MBBUInt &INs, SIZEs &ENSs, MCGNode *Node,
+    void analyzeEnsures(MBBWorkList &WL, MBBUIntState &INs, SIZEs &ENSs, MCGNode *Node,
                         MachineBasicBlock *MBB)
     {
       // track maximum displacement of children in the call graph -- initialize
@@ -2237,12 +2514,12 @@ namespace llvm {
       for(MachineBasicBlock::instr_iterator i(MBB->instr_begin()),
           ie(MBB->instr_end()); i != ie; i++) {
         if (i->isCall()) {
-          // find call site
-          MCGSite *site = Node->findSite(i);
-          assert(site);
+          // find call sites, one per possible callee
+          MCGSites sites(Node->findSites(i));
+          assert(!sites.empty());
 
           childDisplacement = std::max(childDisplacement,
-                                       getMaxDisplacement(site->getCallee()));
+                                       getMaxDisplacement(sites));
         }
         else if (i->getOpcode() == Patmos::SENSi) {
           unsigned int ensure = i->getOperand(2).getImm() * 4;
@@ -2300,28 +2577,19 @@ namespace llvm {
       for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
           i++) {
         if (!(*i)->isUnknown() && !(*i)->isDead()) {
-          MBBs WL;
-          SIZEs ENSs;
-          MBBUInt INs;
           MachineFunction *MF = (*i)->getMF();
+          MBBWorkList WL(*MF, MBBWorkList::Forward);
+          SIZEs ENSs;
+          MBBUIntState INs(*MF);
 
-          // initialize work list (yeah, reverse post order would be optimal,
-          // but this works too).
-          for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
-              j++) {
-            WL.insert(j);
-          }
-
-          // process until the work list becomes empty
-          while (!WL.empty()) {
-            // get some basic block
-            MachineBasicBlock *MBB = *WL.begin();
-            WL.erase(WL.begin());
+          // initialize work list, blocks are processed in reverse post order.
+          WL.insertAll();
 
-            // update the basic block's information, potentially putting any of
-            // its successors on the work list.
+          // update the basic blocks' information, potentially putting any of
+          // their successors on the work list.
+          solve(WL, [&](MachineBasicBlock *MBB) {
             analyzeEnsures(WL, INs, ENSs, *i, MBB);
-          }
+          });
 
           // actually remove ensure instructions (if requested)
           for(SIZEs::const_iterator i(ENSs.begin()), ie(ENSs.end()); i != ie;
@@ -2361,11 +2629,11 @@ namespace llvm {
           DEBUG(
             dbgs() << "########################### "
                    << MF->getFunction()->getName() << "\n";
-            for(MBBUInt::const_iterator i(INs.begin()), ie(INs.end()); i != ie;
-                i++) {
-              dbgs() << "  " << i->first->getName()
-                    << "(" << i->first->getNumber() << ")"
-                    << ": " << i->second << "\n";
+            for(MachineFunction::iterator i(MF->begin()), ie(MF->end());
+                i != ie; i++) {
+              dbgs() << "  " << i->getName()
+                    << "(" << i->getNumber() << ")"
+                    << ": " << INs.lookup(i) << "\n";
             }
           );
 #endif // PATMOS_TRACE_SENS_REMOVAL
@@ -2373,105 +2641,95 @@ namespace llvm {
       }
     }
 
-    /// ilp_name - make a name for a node suitable for the LP file.
+    /// ilp_name - make a name for a node suitable for the LP file. Names do
+    /// not depend on addresses, such that the ILPs can be cached across
+    /// compilations. UNKNOWN nodes are named after the hash of their type.
     static std::string ilp_name(ilp_prefix Prefix, const MCGNode *N)
     {
       std::string tmps;
       raw_string_ostream tmp(tmps);
       tmp << Prefix;
       if (N->isUnknown()) {
-        tmp << "U" << (void*)N;
+        std::string types;
+        raw_string_ostream type(types);
+        type << *N->getType();
+
+        MD5 Hash;
+        MD5::MD5Result Digest;
+        SmallString<32> HashString;
+        Hash.update(type.str());
+        Hash.final(Digest);
+        MD5::stringifyResult(Digest, HashString);
+
+        tmp << "U" << HashString;
       }
       else
         tmp << "X" << N->getMF()->getFunction()->getName();
       return tmp.str();
     }
 
-    /// ilp_name - make a name for a call site suitable for the LP file.
+    /// ilp_name - make a name for a call site suitable for the LP file, from
+    /// the name of the calling function and the site's index in it.
     static std::string ilp_name(ilp_prefix Prefix, const MCGSite *S)
     {
+      const MCGSites &sites(S->getCaller()->getSites());
+      unsigned int index = std::find(sites.begin(), sites.end(), S) -
+                           sites.begin();
+      assert(index != sites.size());
+
       std::string tmps;
       raw_string_ostream tmp(tmps);
-      tmp << Prefix << "S" << (void*)S;
+      tmp << Prefix << "S" << S->getCaller()->getMF()->getFunction()->getName()
+          << "_" << index;
       return tmp.str();
     }
 
-    /// solve_ilp - solve the ILP problem.
-    static unsigned int solve_ilp(const char *LPname, bool Maximize)
+    /// solve_ilps - solve a list of independent ILP problems concurrently
+    /// using the selected solver backend. Empty problems are skipped.
+    void solve_ilps(const std::vector<std::string> &LPs, bool Maximize,
+                    std::vector<unsigned int> &Results)
     {
-      unsigned int result = Maximize ? std::numeric_limits<unsigned int>::max():
-                                       std::numeric_limits<unsigned int>::min();
-
-      std::vector<const char*> args;
-      args.push_back(Solve_ilp.c_str());
-      args.push_back(LPname);
-      args.push_back(0);
-
-      std::string ErrMsg;
-      if (sys::ExecuteAndWait(sys::FindProgramByName(Solve_ilp),
-                                       &args[0],0,0,0,0,&ErrMsg)) {
-        report_fatal_error("calling ILP solver (" + Solve_ilp + "): " + ErrMsg);
-      }
-      else {
-        // read solution
-        // construct name of solution
-        std::string SOLname(LPname);
-        SOLname += ".sol";
-
-        //SmallString<1024> SOLname(LPname);
-        //sys::path::replace_extension(SOLname, ".sol");
+      SolveILPTask Task(*Solver, LPs);
+      Pool.run(Task, LPs.size());
 
-        if (!sys::fs::exists(SOLname))
-          report_fatal_error("Failed to read ILP solution");
-
-        std::ifstream IS(SOLname.c_str());
-        assert(IS.good());
+      // check the results in order, independent of the order of solving
+      Results.assign(LPs.size(), 0);
+      for(unsigned int i = 0, ie = LPs.size(); i != ie; i++) {
+        if (LPs[i].empty())
+          continue;
 
-        // read the result value
-        double tmp;
-        IS >> tmp;
-        result = tmp;
+        PatmosILPSolver::Status S = Task.Status[i];
+        double tmp = Task.Results[i];
 
         // don't go ahead when solving has failed
-        if (tmp == -1.)
+        if (S == PatmosILPSolver::Failed)
+          report_fatal_error(Twine("calling ILP solver (") + Solver->getName() +
+                             ") failed");
+        else if (S != PatmosILPSolver::Optimal)
           assert(0 && "unbounded/infeasible ILP");
+        else {
+          // the objective is integral, round safely towards the bound
+          Results[i] = Maximize ? (unsigned int)std::ceil(tmp - 1e-6) :
+                                  (unsigned int)std::floor(tmp + 1e-6);
+        }
 
-        sys::fs::remove(SOLname);
+        ILPs++;
       }
-
-      ILPs++;
-
-      return result;
     }
 
-    /// computeMinMaxDisplacementILP - Construct an ILP modeling the
-    /// displacement of an SCC within the call graph, write it to an LP file,
-    /// and solve it.
-    unsigned int computeMinMaxDisplacementILP(const MCGNodes &SCC,
-                                              const MCGNode *N, bool Maximize)
+    /// makeMinMaxDisplacementILP - Construct an ILP modeling the
+    /// displacement of an SCC within the call graph and return it in LP format.
+    std::string makeMinMaxDisplacementILP(const MCGNodes &SCC,
+                                          const MCGNode *N, bool Maximize)
     {
       assert(std::find(SCC.begin(), SCC.end(), N) != SCC.end());
 
       // get user-supplied bounds to solve the ILP.
       const SCCInfo &BInfo(BI.getInfo(SCC));
 
-      // open LP file.
-      SmallString<1024> LPname;
-      error_code err = sys::fs::createUniqueDirectory("stack", LPname);
-      if (err) {
-        errs() << "Error creating temp .lp file: " << err.message() << "\n";
-        return std::numeric_limits<unsigned int>::max();
-      }
-
-      sys::path::append(LPname, "scc.lp");
-
-      std::string ErrMsg;
-      raw_fd_ostream OS(LPname.c_str(), ErrMsg);
-      if (!ErrMsg.empty()) {
-        errs() << "Error: Failed to open file '" << LPname.str()
-               << "' for writing!\n";
-        return std::numeric_limits<unsigned int>::max();
-      }
+      // build the LP in memory.
+      std::string LP;
+      raw_string_ostream OS(LP);
 
       // find entry and exit call sites
       typedef std::set<MCGSite*> MCGSiteSet;
@@ -2690,25 +2948,12 @@ namespace llvm {
 
       OS << "End\n";
 
-      OS.close();
-
-      // solve the ILP
-      unsigned int result = solve_ilp(LPname.c_str(), Maximize);
-
-#ifdef PATMOS_TRACE_CG_DISPLACMENT_ILP
-      dbgs() << "ILP: " << *N << ": " << result << "\n";
-#endif // PATMOS_TRACE_CG_DISPLACMENT_ILP
-
-      // remove LP file
-      // TODO do we need to remove the temp dir??
-      sys::fs::remove(LPname.str());
-
-      return result;
+      return OS.str();
     }
 
     /// checkCallFreePaths - Check whether functions have call free paths.
     /// see below.
-    void checkCallFreePaths(MBBs &WL, MBBBool &OUTs, MachineBasicBlock *MBB)
+    void checkCallFreePaths(MBBWorkList &WL, MBBBoolState &OUTs, MachineBasicBlock *MBB)
     {
       // see if a successor contains a call-free path to a sink
       bool is_call_free = OUTs[MBB];
@@ -2749,30 +2994,21 @@ namespace llvm {
 
         // ignore unknown functions here
         if (!(*i)->isUnknown() && !(*i)->isDead()) {
-          MBBs WL;
-          MBBBool OUTs;
           MachineFunction *MF = (*i)->getMF();
+          MBBWorkList WL(*MF, MBBWorkList::Backward);
 
-          // initialize work list -- initially we assume
-          for(MachineFunction::iterator i(MF->begin()), ie(MF->end()); i != ie;
-              i++) {
-            WL.insert(i);
-
-            // initially assume the basic block does not contain a call and a
-            // path to a sink exists without any calls.
-            OUTs[i] = true;
-          }
+          // initially assume the basic block does not contain a call and a
+          // path to a sink exists without any calls.
+          MBBBoolState OUTs(*MF, true);
 
-          // process until the work list becomes empty
-          while (!WL.empty()) {
-            // get some basic block
-            MachineBasicBlock *MBB = *WL.begin();
-            WL.erase(WL.begin());
+          // initialize work list, blocks are processed in post order.
+          WL.insertAll();
 
-            // update the basic block's information, potentially putting any of
-            // its predecessors on the work list.
+          // update the basic blocks' information, potentially putting any of
+          // their predecessors on the work list.
+          solve(WL, [&](MachineBasicBlock *MBB) {
             checkCallFreePaths(WL, OUTs, MBB);
-          }
+          });
 
           // see if the entry node contains a call-free path
           is_call_free = OUTs[MF->begin()];
@@ -2789,7 +3025,7 @@ namespace llvm {
     /// propagate the worst-case occupancy at call sites through the function.
     /// We use the minimum displacement caused by the functions called along
     /// a path to get the worst-case occupancy.
-    void propagateWorstCaseOccupancyAtSite(MBBs &WL, MBBUInt &INs,
+    void propagateWorstCaseOccupancyAtSite(MBBWorkList &WL, MBBUIntState &INs,
                                            MCGNode *Node,
                                            MachineBasicBlock *MBB)
     {
@@ -2805,18 +3041,21 @@ namespace llvm {
       for(MachineBasicBlock::instr_iterator i(MBB->instr_begin()),
           ie(MBB->instr_end()); i != ie; i++) {
         if (i->isCall()) {
-          // find call site
-          MCGSite *site = Node->findSite(i);
-          assert(site);
+          // find call sites, one per possible callee
+          MCGSites sites(Node->findSites(i));
+          assert(!sites.empty());
 
           // store the worst-case occupancy before the call site, i.e., for the
           // functions potentially entered through calls from this site
-          WorstCaseSiteOccupancy[site] = worstOccupancy;
+          for(MCGSites::iterator j(sites.begin()), je(sites.end()); j != je;
+              j++) {
+            WorstCaseSiteOccupancy[*j] = worstOccupancy;
+          }
 
           if (!TII.isPredicated(i)) {
             // get the worst-case occupancy after the call
             unsigned int worstCallOccupancy =
-                STC.getStackCacheSize() - getMinDisplacement(site->getCallee());
+                STC.getStackCacheSize() - getMinDisplacement(sites);
 
             // update the worst-case occupancy
             worstOccupancy = std::min(worstOccupancy, worstCallOccupancy);
@@ -2840,7 +3079,7 @@ namespace llvm {
       }
     }
 
-    void propagateLPSaving(MBBs &WL, MBBUInt &INs,
+    void propagateLPSaving(MBBWorkList &WL, MBBUIntState &INs,
                            MCGNode *Node,
                            MachineBasicBlock *MBB)
     {
@@ -2858,16 +3097,19 @@ namespace llvm {
       for(MachineBasicBlock::instr_iterator i(MBB->instr_begin()),
           ie(MBB->instr_end()); i != ie; i++) {
         if (i->isCall()) {
-          // find call site
-          MCGSite *site = Node->findSite(i);
-          assert(site);
+          // find call sites, one per possible callee
+          MCGSites sites(Node->findSites(i));
+          assert(!sites.empty());
 
           // store the worst-case occupancy before the call site, i.e., for the
           // functions potentially entered through calls from this site
-          WorstCaseSpillDirty[site] = worstSpillDirty;
+          for(MCGSites::iterator j(sites.begin()), je(sites.end()); j != je;
+              j++) {
+            WorstCaseSpillDirty[*j] = worstSpillDirty;
+          }
 
           if (!TII.isPredicated(i)) {
-            unsigned int minDisplacement= getMinDisplacement(site->getCallee());
+            unsigned int minDisplacement = getMinDisplacement(sites);
 
             // update the LP's position
             worstSpillDirty = std::min(worstSpillDirty, SCSize -
@@ -2875,7 +3117,7 @@ namespace llvm {
 
 #ifdef PATMOS_TRACE_WORST_SITE_OCCUPANCY
             if (minDisplacement)
-              dbgs() << "LP-disp[" << *site->getCallee() << "](" << minDisplacement
+              dbgs() << "LP-disp[" << *sites.front()->getCallee() << "](" << minDisplacement
                 << "), new dirty: " << worstSpillDirty << "\n";
 #endif
           }
@@ -2917,7 +3159,7 @@ namespace llvm {
       for(MachineBasicBlock::succ_iterator i(MBB->succ_begin()),
           ie(MBB->succ_end()); i != ie; i++) {
         // propagate worst-case value and put successors on the work list
-        if (INs.find(*i) == INs.end()) {
+        if (!INs.count(*i)) {
           INs[*i] = worstSpillDirty;
           WL.insert(*i);
         } else if (INs[*i] < worstSpillDirty) {
@@ -2969,26 +3211,27 @@ namespace llvm {
 
     /// computeWorstCaseSavingOccupancy - Compute the worst-case amount of stack
     /// cache blocks that would need to be saved upon a task preemption at the
-    /// beginning of each basic block.
-    void computeWorstCaseSavingOccupancy(const MCallGraph &G)
+    /// beginning of each basic block of a function.
+    void computeWorstCaseSavingOccupancy(MCGNode *Node)
     {
-      const MCGNodes &nodes(G.getNodes());
-
-      // visit all functions
-      for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
-          i++) {
-        if (!(*i)->isDead() && !(*i)->isUnknown()) {
-          MachineFunction *MF = (*i)->getMF();
+      MachineFunction *MF = Node->getMF();
 
-          // visit all basic blocks
-          for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
-              j++) {
-            computeWorstCaseSavingOccupancy(*i, j);
-          }
-        }
+      // visit all basic blocks
+      for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
+          j++) {
+        computeWorstCaseSavingOccupancy(Node, j);
       }
     }
 
+    /// computeWorstCaseSavingOccupancy - Compute the worst-case amount of stack
+    /// cache blocks that would need to be saved upon a task preemption at the
+    /// beginning of each basic block of all functions.
+    void computeWorstCaseSavingOccupancy(const MCallGraph &G)
+    {
+      forEachFunction(G,
+                      &PatmosStackCacheAnalysis::computeWorstCaseSavingOccupancy);
+    }
+
     /// computeWorstCaseRestoringOccupancy - Compute the worst-case amount of
     /// stack cache blocks that would need to be restored upon a task preemption
     /// at the beginning of each basic block.
@@ -3043,25 +3286,25 @@ namespace llvm {
 
     /// computeWorstCaseRestoringOccupancy - Compute the worst-case amount of
     /// stack cache blocks that would need to be restored upon a task preemption
-    /// at the beginning of each basic block.
-    void computeWorstCaseRestoringOccupancy(const MCallGraph &G)
+    /// at the beginning of each basic block of a function.
+    void computeWorstCaseRestoringOccupancy(MCGNode *Node)
     {
+      MachineFunction *MF = Node->getMF();
 
-      const MCGNodes &nodes(G.getNodes());
-
-      // visit all functions
-      for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
-          i++) {
-        if (!(*i)->isDead() && !(*i)->isUnknown()) {
-          MachineFunction *MF = (*i)->getMF();
-
-          // visit all basic blocks
-          for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
-              j++) {
-            computeWorstCaseRestoringOccupancy(*i, j);
-          }
-        }
+      // visit all basic blocks
+      for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
+          j++) {
+        computeWorstCaseRestoringOccupancy(Node, j);
       }
+    }
+
+    /// computeWorstCaseRestoringOccupancy - Compute the worst-case amount of
+    /// stack cache blocks that would need to be restored upon a task preemption
+    /// at the beginning of each basic block of all functions.
+    void computeWorstCaseRestoringOccupancy(const MCallGraph &G)
+    {
+      forEachFunction(G,
+                   &PatmosStackCacheAnalysis::computeWorstCaseRestoringOccupancy);
 
 #ifdef PATMOS_TRACE_WORST_RESTORING_REGION
       DEBUG(
@@ -3073,6 +3316,74 @@ namespace llvm {
 #endif // PATMOS_TRACE_WORST_RESTORING_REGION
     }
 
+    /// storePreemptionCosts - Store the worst-case costs of preemptions at the
+    /// beginning of the basic blocks of all functions in the analysis info
+    /// pseudo pass.
+    void storePreemptionCosts(const MCallGraph &G)
+    {
+      PatmosStackCacheAnalysisInfo *info =
+       &getAnalysis<PatmosStackCacheAnalysisInfo>();
+
+      const MCGNodes &nodes(G.getNodes());
+      for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
+          i++) {
+        if ((*i)->isUnknown() || (*i)->isDead())
+          continue;
+
+        MachineFunction *MF = (*i)->getMF();
+        for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
+            j++) {
+          PatmosStackCacheAnalysisInfo::PreemptionCost &Cost =
+                                                         info->Preemptions[j];
+
+          Cost.Saving = WorstCaseBlockSaving[j];
+          Cost.Restoring = WorstCaseBlockRestoring[j];
+          Cost.LocalEnsure = safeUIntDiff(WorstCaseLocalEnsureFilling[j],
+                                          WorstCaseBlockRP[j]);
+          Cost.GlobalEnsure = getGlobalEnsureFilling(*i);
+          Cost.ReserveGain = ReserveGain[j];
+
+          storeCallPreemptionCosts(info, *i, j);
+        }
+      }
+    }
+
+    /// storeCallPreemptionCosts - Store the worst-case costs of preemptions
+    /// right before the call instructions of a basic block.
+    ///
+    /// The dead area is not known within a basic block and assumed to be
+    /// empty. Nothing of the caller's frame is accessed until the ensure
+    /// following the call, i.e., the ensure fills all that was evicted by the
+    /// preemption. The reserve gain of the callee is ignored.
+    void storeCallPreemptionCosts(PatmosStackCacheAnalysisInfo *info,
+                                  MCGNode *Node, MachineBasicBlock *MBB)
+    {
+      unsigned int reserved = getBytesReserved(Node);
+      unsigned int maxOccupancy = getMaxEffectiveOccupancy(Node);
+
+      for(MachineBasicBlock::instr_iterator i(MBB->instr_begin()),
+          ie(MBB->instr_end()); i != ie; i++) {
+        if (!i->isCall())
+          continue;
+
+        PatmosStackCacheAnalysisInfo::PreemptionCost &Cost =
+                                                   info->CallPreemptions[i];
+
+        // all sites of a call share the same occupancy and ensure bound
+        MCGSites sites(Node->findSites(i));
+        for(MCGSites::iterator j(sites.begin()), je(sites.end()); j != je;
+            j++) {
+          Cost.Saving = std::max(Cost.Saving,
+                                 std::min(WorstCaseSpillDirty[*j],
+                                          maxOccupancy));
+          Cost.LocalEnsure = std::max(Cost.LocalEnsure,
+                                      safeUIntDiff(reserved,
+                                               WorstCaseSiteEnsureBound[*j]));
+        }
+        Cost.GlobalEnsure = getGlobalEnsureFilling(Node);
+      }
+    }
+
 
     /// propagateWorstCaseOccupancyAtSite - Propagate, locally within a
     /// function, the worst-case stack occupancy at call sites.
@@ -3098,24 +3409,19 @@ namespace llvm {
           }
         }
         else if (!(*i)->isDead()) {
-          MBBs WL;
-          MBBUInt INs;
           MachineFunction *MF = (*i)->getMF();
+          MBBWorkList WL(*MF, MBBWorkList::Forward);
+          MBBUIntState INs(*MF);
 
           // initialize work list.
           INs[MF->begin()] = STC.getStackCacheSize();
           WL.insert(MF->begin());
 
-          // process until the work list becomes empty
-          while (!WL.empty()) {
-            // get some basic block
-            MachineBasicBlock *MBB = *WL.begin();
-            WL.erase(WL.begin());
-
-            // update the basic block's information, potentially putting any of
-            // its successors on the work list.
+          // update the basic blocks' information, potentially putting any of
+          // their successors on the work list.
+          solve(WL, [&](MachineBasicBlock *MBB) {
             propagateWorstCaseOccupancyAtSite(WL, INs, *i, MBB);
-          }
+          });
 
 #ifdef PATMOS_TRACE_WORST_SITE_OCCUPANCY
           DEBUG(
@@ -3138,9 +3444,9 @@ namespace llvm {
         if ((*i)->isDead() || (*i)->isUnknown())
           continue;
 
-        MBBs WL;
-        MBBUInt INs;
         MachineFunction *MF = (*i)->getMF();
+        MBBWorkList WL(*MF, MBBWorkList::Forward);
+        MBBUIntState INs(*MF);
 
         // initialize work list.
         INs[MF->begin()] = STC.getStackCacheSize();
@@ -3153,16 +3459,11 @@ namespace llvm {
 #endif // PATMOS_TRACE_WORST_SITE_OCCUPANCY
 
 
-        // process until the work list becomes empty
-        while (!WL.empty()) {
-          // get some basic block
-          MachineBasicBlock *MBB = *WL.begin();
-          WL.erase(WL.begin());
-
-          // update the basic block's information, potentially putting any of
-          // its successors on the work list.
+        // update the basic blocks' information, potentially putting any of
+        // their successors on the work list.
+        solve(WL, [&](MachineBasicBlock *MBB) {
           propagateLPSaving(WL, INs, *i, MBB);
-        }
+        });
       }
 
 #ifdef PATMOS_DUMP_WORST_SITE_OCCUPANCY
@@ -3204,21 +3505,34 @@ namespace llvm {
     /// is reachable from the root node such that it remains in the maximum
     /// displacement computed before.
     /// \see computeMinMaxDisplacement
-    void pruneNodes(SCANode *N, unsigned int parentOccupancy)
+    void pruneNodes(unsigned int Root, unsigned int rootOccupancy)
     {
+      // work list of nodes and the occupancy remaining from their parent,
+      // children are pushed in reverse order to visit them in order.
+      std::vector<std::pair<unsigned int, unsigned int> > WL;
+      WL.push_back(std::make_pair(Root, rootOccupancy));
+
+      while (!WL.empty()) {
+        unsigned int n = WL.back().first;
+        unsigned int parentOccupancy = WL.back().second;
+        WL.pop_back();
 
-      // This node is already valid, so skip it.
-      if (!N->isValid()) {
-        unsigned int nodeReserved = getBytesReserved(N->getMCGNode());
+        SCANode &N(SCAGraph.getNode(n));
+
+        // This node is already valid, so skip it.
+        if (N.isValid())
+          continue;
+
+        unsigned int nodeReserved = getBytesReserved(N.getMCGNode());
         bool isValid = (parentOccupancy >= nodeReserved);
 
         if (isValid) {
           // mark the node as valid.
-          N->setValid();
-          N->setRemainingOccupancy(parentOccupancy);
+          N.setValid();
+          N.setRemainingOccupancy(parentOccupancy);
 
           // compute unbounded(!) displacement for children
-          unsigned int maxDisplacment = getMinMaxDisplacement(N->getMCGNode(),
+          unsigned int maxDisplacment = getMinMaxDisplacement(N.getMCGNode(),
                                                               true);
 
           // compute the stack occupancy remaining for the children
@@ -3227,9 +3541,10 @@ namespace llvm {
                                                  maxDisplacment);
 
           // visit the children in the graph
-          for(SCAEdgeSet::iterator i(N->getChildren().begin()),
-              ie(N->getChildren().end()); i != ie; i++) {
-            pruneNodes(i->getCallee(), remainingOccupancy);
+          for(SpillCostAnalysisGraph::child_iterator i(SCAGraph.child_end(n)),
+              ie(SCAGraph.child_begin(n)); i != ie;) {
+            --i;
+            WL.push_back(std::make_pair(i->getCallee(), remainingOccupancy));
           }
         }
       }
@@ -3240,58 +3555,100 @@ namespace llvm {
     /// spills, or that do not lead to a valid stack cache state, can be pruned.
     void markSCAGraphVisible()
     {
-      const MCGSCANodeMap &nodes(SCAGraph.getNodes());
-
       // keep statistics of the initial SCA graph size.
-      TotalSCAGraphSize += nodes.size();
-
-      // eliminate UNKNOWN nodes from the graph
-      SCANodeSet cleanup;
-      for(MCGSCANodeMap::const_iterator i(nodes.begin()), ie(nodes.end());
-          i != ie; i++) {
-        MCGNode *mcgNode = i->second->getMCGNode();
-        if (mcgNode->isUnknown()) {
-          cleanup.insert(i->second);
-          // remove the node and redirect its parent/child relations
-          for(SCAEdgeSet::iterator j(i->second->getChildren().begin()),
-              je(i->second->getChildren().end()); j != je; j++) {
-
-            SCANode *calleeNode = j->getCallee();
-
-            for(SCAEdgeSet::const_iterator k(i->second->getParents().begin()),
-                ke(i->second->getParents().end()); k != ke; k++) {
-
-              SCANode *callerNode = k->getCaller();
+      TotalSCAGraphSize += SCAGraph.getNumNodes();
 
-              SCAEdge newEdge(callerNode, calleeNode, k->getSite());
-              calleeNode->getParents().insert(newEdge);
-              callerNode->getChildren().insert(newEdge);
-            }
-          }
-        }
-      }
+      // eliminate UNKNOWN nodes from the graph and index the edges
+      SCAGraph.finalize();
 
-      // remove the UNKNOWN nodes from the graph and free them
-      std::for_each(cleanup.begin(), cleanup.end(),
-                 std::bind1st(std::mem_fun(&SpillCostAnalysisGraph::deleteNode),
-                             &SCAGraph));
+      unsigned int root = SCAGraph.getRoot();
 
       // get unbounded (!) displacement of root node
       unsigned int maxDisplacment = getMinMaxDisplacement(
-                                        SCAGraph.getRoot()->getMCGNode(), true);
+                                     SCAGraph.getNode(root).getMCGNode(), true);
 
       // eliminate nodes whose shortest path to a leaf is longer than the
       // previously analyzed maximum displacement
-      pruneNodes(SCAGraph.getRoot(), maxDisplacment);
+      pruneNodes(root, maxDisplacment);
 
       // mark only those nodes visible that have non-zero spill costs or have a
       // descendent with non-zero spill costs.
-      for(MCGSCANodeMap::const_iterator i(nodes.begin()), ie(nodes.end());
-          i != ie; i++) {
-        if (i->second->getSpillCost()) {
-          i->second->setVisible();
+      std::vector<unsigned int> WL;
+      for(unsigned int i = 0, ie = SCAGraph.getNumNodes(); i != ie; i++) {
+        if (SCAGraph.getNode(i).getSpillCost()) {
+          WL.push_back(i);
+        }
+      }
+      SCAGraph.setVisible(WL);
+    }
+
+    /// getSpillCost - Return the spill cost caused by the reserve of a call
+    /// graph node when entered with the given stack cache occupancy.
+    unsigned int getSpillCost(MCGNode *Node, unsigned int Occupancy)
+    {
+      unsigned int childOccupancy = getBytesReserved(Node) + Occupancy;
+      return childOccupancy <= STC.getStackCacheSize() ? 0 :
+                                  childOccupancy - STC.getStackCacheSize();
+    }
+
+    /// mergeContext - Merge a calling context of a call graph node with others
+    /// according to -mpatmos-sca-context-merging. Merging only ever increases
+    /// the context's occupancy, which overestimates its spill costs and the
+    /// maximum occupancy of the function. It must not be used to derive the
+    /// minimum occupancy, see propagateMinOccupancy. The spill costs of the
+    /// context are updated and the overestimation is recorded.
+    void mergeContext(MCGNode *Node, CostPair &OccP, CostPair &SCP)
+    {
+      unsigned int size = STC.getStackCacheSize();
+      CostPair merged(OccP);
+
+      switch (SCAMerging) {
+        case SCAMergeNone:
+          return;
+        case SCAMergeInterval:
+        {
+          unsigned int granule = SCAOccupancyGranule ? SCAOccupancyGranule :
+                                           4 * STC.getStackCacheBlockSize();
+          merged.first = std::min<unsigned int>(size,
+                                     RoundUpToAlignment(OccP.first, granule));
+          merged.second = std::min<unsigned int>(size,
+                                    RoundUpToAlignment(OccP.second, granule));
+          break;
+        }
+        case SCAMergeKLimit:
+        {
+          const std::vector<unsigned int> &contexts(
+                                                SCAGraph.getContexts(Node));
+          if (contexts.size() < SCAMaxContexts ||
+              SCAGraph.hasNode(Node, OccP))
+            return;
+
+          // find the smallest existing context covering the new one, or fall
+          // back to a fully occupied stack cache.
+          merged = CostPair(size, size);
+          for(std::vector<unsigned int>::const_iterator i(contexts.begin()),
+              ie(contexts.end()); i != ie; i++) {
+            const CostPair &occ(SCAGraph.getNode(*i).getOccupancyCosts());
+            if (occ.first >= OccP.first && occ.second >= OccP.second &&
+                occ < merged)
+              merged = occ;
+          }
+          break;
         }
       }
+
+      if (merged == OccP)
+        return;
+
+      CostPair mergedSCP(getSpillCost(Node, merged.first),
+                         getSpillCost(Node, merged.second));
+      assert(mergedSCP.first >= SCP.first && mergedSCP.second >= SCP.second);
+
+      MergedSCAContexts++;
+      MergedSCASpillCosts += mergedSCP.first - SCP.first;
+
+      OccP = merged;
+      SCP = mergedSCP;
     }
 
     /// propagateMaxOccupancy - propagate the maximum stack occupancy on the
@@ -3311,22 +3668,21 @@ namespace llvm {
     /// We only need to propagate the minimum of the two.
     ///
     /// \see propagateWorstCaseOccupancyAtSite
-    void propagateMaxOccupancy(SCANode *Node, SCANodeSet &WL)
+    void propagateMaxOccupancy(unsigned int Node, std::vector<unsigned int> &WL)
     {
       // get the call graph node and occupancy
-      MCGNode *mcgNode = Node->getMCGNode();
+      // note: nodes are not referenced across makeNode, which may reallocate
+      // the graph's nodes.
+      const SCANode &N(SCAGraph.getNode(Node));
+      MCGNode *mcgNode = N.getMCGNode();
 
       // get the stack occupancy of the current calling context and add the
       // space allocated by the current function to it.
       unsigned int nodeOccupancy = std::min(STC.getStackCacheSize(),
-                              Node->getOccupancy() + getBytesReserved(mcgNode));
+                              N.getOccupancy() + getBytesReserved(mcgNode));
 
       unsigned int lpNodeOccupancy = std::min(STC.getStackCacheSize(),
-                     Node->getEffectiveOccupancy() + getBytesReserved(mcgNode));
-
-      // keep track of the node's minimum/maximum occupancy after the
-      // function's sres
-      updateMinMaxOccupancy(Node->getMCGNode(), nodeOccupancy, lpNodeOccupancy);
+                     N.getEffectiveOccupancy() + getBytesReserved(mcgNode));
 
       // propagate to call sites
       for(MCGSites::const_iterator j(mcgNode->getSites().begin()),
@@ -3376,20 +3732,70 @@ namespace llvm {
         assert(lpChildOccupancy <= childOccupancy);
         assert(lpSpillCost <= spillCost);
 
+        // merge the calling context with others, if requested
+        mergeContext(callee, OccP, SCP);
+
         // the occupancy before child's reserve (and spill cost) is propagated
-        SCANode *calleeSCANode;
+        unsigned int calleeSCANode;
         bool isNewNode = SCAGraph.makeNode(callee, OccP, SCP,
                                            getMaxDisplacement(callee),
                                            IsCallFree[callee], calleeSCANode);
 
         // make a link to the parent context
-        calleeSCANode->addParent(Node, site);
+        SCAGraph.addEdge(Node, calleeSCANode, site);
 
         // if the node did not exist before, append it to the work list
         if (isNewNode) {
-          WL.insert(calleeSCANode);
+          WL.push_back(calleeSCANode);
+        }
+      }
+    }
+
+    /// propagateMinOccupancy - Record the minimum/maximum occupancy after the
+    /// sres of each function in the SCA graph.
+    ///
+    /// The occupancy of a node may have been widened by merging calling
+    /// contexts, which is only safe for the maximum occupancy. The minimum
+    /// occupancy is computed from the unmerged occupancies propagated along
+    /// the edges of the graph, repeated until a fixpoint is reached.
+    void propagateMinOccupancy()
+    {
+      unsigned int size = STC.getStackCacheSize();
+      unsigned int numNodes = SCAGraph.getNumNodes();
+      unsigned int root = SCAGraph.getRoot();
+
+      // the minimum unmerged occupancy before the sres of each node
+      std::vector<unsigned int> Unmerged(numNodes, size);
+      Unmerged[root] = SCAGraph.getNode(root).getOccupancy();
+
+      bool changed = true;
+      while (changed) {
+        changed = false;
+        for(unsigned int e = 0, ee = SCAGraph.getNumEdges(); e != ee; e++) {
+          const SCAEdge &E(SCAGraph.getEdge(e));
+          MCGNode *caller = SCAGraph.getNode(E.getCaller()).getMCGNode();
+          unsigned int siteOccupancy = std::min(size,
+                            Unmerged[E.getCaller()] + getBytesReserved(caller));
+          if (siteOccupancy < Unmerged[E.getCallee()]) {
+            Unmerged[E.getCallee()] = siteOccupancy;
+            changed = true;
+          }
         }
       }
+
+      for(unsigned int i = 0; i != numNodes; i++) {
+        const SCANode &N(SCAGraph.getNode(i));
+        MCGNode *mcgNode = N.getMCGNode();
+        if (mcgNode->isDead())
+          continue;
+
+        unsigned int reserved = getBytesReserved(mcgNode);
+        updateMinMaxOccupancy(mcgNode,
+                              std::min(size, N.getOccupancy() + reserved),
+                              std::min(size, Unmerged[i] + reserved),
+                              std::min(size,
+                                       N.getEffectiveOccupancy() + reserved));
+      }
     }
 
     /// propagateMaxOccupancy - propagate the maximum stack occupancy on the
@@ -3412,43 +3818,49 @@ namespace llvm {
     void propagateMaxOccupancy(const MCallGraph &G, MCGNode *main)
     {
       // initialize the work list and calling context information
-      SCANodeSet WL;
-      WL.insert(SCAGraph.makeRoot(main, getMaxDisplacement(main),
-                                  IsCallFree[main]));
-
-      while (!WL.empty()) {
-        // pop current call graph node
-        SCANode *Node =  *WL.begin();
-        WL.erase(Node);
-
-        // propagate to callees through call sites
-        if (!Node->getMCGNode()->isDead()) {
+      std::vector<unsigned int> WL;
+      WL.push_back(SCAGraph.makeRoot(main, getMaxDisplacement(main),
+                                     IsCallFree[main]));
+
+      // propagate to callees through call sites, new calling contexts are
+      // put on the work list.
+      solve(WL, [&](unsigned int Node) {
+        if (!SCAGraph.getNode(Node).getMCGNode()->isDead()) {
           propagateMaxOccupancy(Node, WL);
         }
-      }
+      });
+
+      DEBUG(
+        dbgs() << "SCA graph (context merging: "
+               << getContextMergingName(SCAMerging) << "): "
+               << SCAGraph.getNumNodes() << " nodes\n";
+      );
+
+      // keep track of the nodes' minimum/maximum occupancy after the
+      // functions' sres
+      propagateMinOccupancy();
 
       // mark cost-relevant nodes; nodes not relevant for analysis remain hidden
       markSCAGraphVisible();
 
-      const MCGSCANodeMap &nodes(SCAGraph.getNodes());
 #ifdef PATMOS_TRACE_DETAILED_RESULTS
-      for(MCGSCANodeMap::const_iterator i(nodes.begin()), ie(nodes.end());
-          i != ie; i++) {
-        if (i->second->isVisible()) {
-          MCGNode *N = i->first.first;
+      for(unsigned int i = 0, ie = SCAGraph.getNumNodes(); i != ie; i++) {
+        const SCANode &n(SCAGraph.getNode(i));
+        if (n.isVisible()) {
+          MCGNode *N = n.getMCGNode();
           dbgs() << "CTXT: " << N->getMF()->getFunction()->getName()
                 << ": k=" << getBytesReserved(N)
-                << ", s=" << i->second->getSpillCostPair().Cost // without lp
-                << ", slp=" << i->second->getSpillCostPair().OptCost //with lp
-                << ", o=" << i->first.second << "; ";
+                << ", s=" << n.getSpillCostPair().first // without lp
+                << ", slp=" << n.getSpillCostPair().second //with lp
+                << ", o=" << n.getOccupancy() << "; ";
           dbgs() << "sca-ctxt:"
             << N->getMF()->getFunction()->getName() << ","
-            << i->second->getSpillCost();
-          SCAEdgeSet P = i->second->getParents();
-          for(SCAEdgeSet::const_iterator j(P.begin()), je(P.end());
-              j != je; j++) {
-            dbgs() << "," <<
-              j->getCaller()->getMCGNode()->getMF()->getFunction()->getName();
+            << n.getSpillCost();
+          for(unsigned int j = 0, je = SCAGraph.getNumParents(i); j != je;
+              j++) {
+            const SCANode &p(SCAGraph.getNode(
+                                        SCAGraph.getParent(i, j).getCaller()));
+            dbgs() << "," << p.getMCGNode()->getMF()->getFunction()->getName();
           }
           dbgs() << "\n";
         }
@@ -3457,14 +3869,22 @@ namespace llvm {
 
       // keep statistics of the pruned SCA graph size.
       MCGNodeUInt Spilling;
-      for(MCGSCANodeMap::const_iterator i(nodes.begin()), ie(nodes.end());
-          i != ie; i++) {
-        if (i->second->isVisible()) {
-          PrunedSCAGraphSize++;
-          Spilling[i->first.first] = std::max(Spilling[i->first.first],
-                                              i->second->getSpillCost());
+      unsigned int numVisible = 0;
+      for(unsigned int i = 0, ie = SCAGraph.getNumNodes(); i != ie; i++) {
+        const SCANode &n(SCAGraph.getNode(i));
+        if (n.isVisible()) {
+          numVisible++;
+          Spilling[n.getMCGNode()] = std::max(Spilling[n.getMCGNode()],
+                                              n.getSpillCost());
         }
       }
+      PrunedSCAGraphSize += numVisible;
+
+      DEBUG(
+        dbgs() << "SCA graph (pruned): " << numVisible
+               << " visible, " << MergedSCAContexts << " merged contexts, "
+               << MergedSCASpillCosts << " bytes of overestimated spill costs\n";
+      );
 
       PatmosStackCacheAnalysisInfo *info =
        &getAnalysis<PatmosStackCacheAnalysisInfo>();
@@ -3512,6 +3932,9 @@ namespace llvm {
       const MCallGraph &G(*PCGB.getCallGraph());
       MCGNode *main = G.getEntryNode();
 
+      // prepare the per-block information for concurrent updates
+      initBlockInfo(G);
+
       // find out whether a call free path exists in each function
       checkCallFreePaths(G);
 
@@ -3552,6 +3975,9 @@ namespace llvm {
         computeWorstCaseSavingOccupancy(G);
         // compute the total cost of context restoring
         computeWorstCaseRestoringOccupancy(G);
+
+        // make the costs available for the PML export and the asm printer
+        storePreemptionCosts(G);
       }
 
       if (!SCAPMLExport.empty())
@@ -3583,33 +4009,19 @@ namespace llvm {
     }
 
     void exportPML(const MCallGraph &G, const SpillCostAnalysisGraph &scag) {
-      yaml::SCADoc YDoc;
-
+      // index the call sites of all functions in the graph
       std::set<MachineFunction*> Seen;
-      for (MCGSCANodeMap::const_iterator I = scag.getNodes().begin(),
-          E = scag.getNodes().end(); I != E; ++I) {
-        SCANode *n = I->second;
-        n->initYAML(STC);
-        YDoc.SCAG.N.push_back(n);
-
-        MachineFunction *mf = n->getMCGNode()->getMF();
+      for (unsigned int i = 0, ie = scag.getNumNodes(); i != ie; i++) {
+        MachineFunction *mf = scag.getNode(i).getMCGNode()->getMF();
         if (!Seen.count(mf)) {
           mapIndices(*mf);
           Seen.insert(mf);
         }
-
-        SCAEdgeSet &e = n->getChildren();
-        for (SCAEdgeSet::iterator I = e.begin(), E = e.end(); I != E; ++I) {
-          MInstrIndex::iterator it = MiMap.find(I->getSite()->getMI());
-          int cidx = -1;
-          if (it != MiMap.end())
-            cidx = it->second.second;
-          YDoc.SCAG.addEdge(I->getCaller(), I->getCallee(),
-              it->second.first, cidx);
-        }
-
       }
 
+      // nodes and edges are converted while they are written out
+      yaml::SCADoc YDoc(scag, MiMap);
+
       yaml::Output *Output;
       assert(!SCAPMLExport.empty());
       StringRef OutFileName(SCAPMLExport);
@@ -3677,16 +4089,18 @@ namespace llvm {
     typedef SCANode NodeType;
     class ChildIteratorType
     {
-      SCAEdgeSet::const_iterator I;
+      const SpillCostAnalysisGraph *G;
+      SpillCostAnalysisGraph::child_iterator I;
 
     public:
-      typedef SCAEdgeSet::const_iterator::iterator_category iterator_category;
-      typedef SCAEdgeSet::const_iterator::difference_type difference_type;
-      typedef SCAEdgeSet::const_iterator::pointer pointer;
-      typedef SCAEdgeSet::const_iterator::reference reference;
+      typedef std::forward_iterator_tag iterator_category;
+      typedef ptrdiff_t difference_type;
+      typedef NodeType *pointer;
+      typedef NodeType *reference;
       typedef NodeType value_type;
 
-      ChildIteratorType(SCAEdgeSet::const_iterator i) : I(i)
+      ChildIteratorType(const SpillCostAnalysisGraph *g,
+                        SpillCostAnalysisGraph::child_iterator i) : G(g), I(i)
       {
       }
 
@@ -3697,14 +4111,14 @@ namespace llvm {
 
       ChildIteratorType operator++()
       {
-        ChildIteratorType tmp(I);
+        ChildIteratorType tmp(G, I);
         I++;
         return tmp;
       }
 
       NodeType *operator*()
       {
-        return I->getCallee();
+        return const_cast<NodeType*>(&G->getNode(I->getCallee()));
       }
 
       MachineInstr *getMI()
@@ -3715,30 +4129,34 @@ namespace llvm {
 
     static inline ChildIteratorType child_begin(NodeType *N)
     {
-      return N->getChildren().begin();
+      const SpillCostAnalysisGraph *G = N->getGraph();
+      return ChildIteratorType(G, G->child_begin(G->getIndex(N)));
     }
 
     static inline ChildIteratorType child_end(NodeType *N)
     {
-      return N->getChildren().end();
+      const SpillCostAnalysisGraph *G = N->getGraph();
+      return ChildIteratorType(G, G->child_end(G->getIndex(N)));
     }
 
     static NodeType *getEntryNode(const SpillCostAnalysisGraph &G)
     {
-      return G.getRoot();
+      return const_cast<NodeType*>(&G.getNode(G.getRoot()));
     }
 
     class nodes_iterator
     {
-      MCGSCANodeMap::const_iterator I;
+      const SpillCostAnalysisGraph *G;
+      unsigned int I;
 
     public:
-      typedef MCGSCANodeMap::const_iterator::iterator_category iterator_category;
-      typedef MCGSCANodeMap::const_iterator::difference_type difference_type;
-      typedef MCGSCANodeMap::const_iterator::pointer pointer;
-      typedef MCGSCANodeMap::const_iterator::reference reference;
+      typedef std::forward_iterator_tag iterator_category;
+      typedef ptrdiff_t difference_type;
+      typedef NodeType *pointer;
+      typedef NodeType *reference;
 
-      nodes_iterator(MCGSCANodeMap::const_iterator i) : I(i)
+      nodes_iterator(const SpillCostAnalysisGraph *g, unsigned int i) : G(g),
+          I(i)
       {
       }
 
@@ -3749,28 +4167,28 @@ namespace llvm {
 
       nodes_iterator operator++()
       {
-        nodes_iterator tmp(I);
+        nodes_iterator tmp(G, I);
         I++;
         return tmp;
       }
 
       NodeType *operator*()
       {
-        return I->second;
+        return const_cast<NodeType*>(&G->getNode(I));
       }
     };
 
     static nodes_iterator nodes_begin(const SpillCostAnalysisGraph &G)
     {
-      return G.getNodes().begin();
+      return nodes_iterator(&G, 0);
     }
     static nodes_iterator nodes_end (const SpillCostAnalysisGraph &G)
     {
-      return G.getNodes().end();
+      return nodes_iterator(&G, G.getNumNodes());
     }
     static unsigned size (const SpillCostAnalysisGraph &G)
     {
-      return G.getNodes().size();
+      return G.getNumNodes();
     }
   };
 
@@ -43,14 +43,56 @@ public:
   void setValid() { Valid = true; }
   bool isValid() const { return Valid; }
 
+  /// PreemptionCost - Worst-case stack cache costs of a task preemption at
+  /// the beginning of a basic block, in bytes.
+  struct PreemptionCost {
+    /// Saving - Dirty, live data to be written back when the task is
+    /// preempted.
+    unsigned int Saving;
+
+    /// Restoring - Data to be restored explicitly when the task resumes.
+    unsigned int Restoring;
+
+    /// LocalEnsure - Data filled additionally by the next ensure of the
+    /// function itself.
+    unsigned int LocalEnsure;
+
+    /// GlobalEnsure - Data filled additionally by ensures of the callers.
+    unsigned int GlobalEnsure;
+
+    /// ReserveGain - Reduction of the spilling at subsequent reserves.
+    unsigned int ReserveGain;
+
+    PreemptionCost() : Saving(0), Restoring(0), LocalEnsure(0),
+                       GlobalEnsure(0), ReserveGain(0) {}
+
+    /// getTotalRestoring - The worst-case amount of data transferred to the
+    /// stack cache due to the preemption when the task resumes.
+    unsigned int getTotalRestoring() const {
+      unsigned int Filling = Restoring + LocalEnsure + GlobalEnsure;
+      return Filling > ReserveGain ? Filling - ReserveGain : 0;
+    }
+  };
+
   typedef std::map<const MachineInstr*, unsigned int> FillSpillCounts;
   typedef std::map<const MachineInstr*, int> CallMap;
+  typedef std::map<const MachineBasicBlock*, PreemptionCost> PreemptionCosts;
+  typedef std::map<const MachineInstr*, PreemptionCost> CallPreemptionCosts;
 
   FillSpillCounts Reserves;
   FillSpillCounts Ensures;
 
   CallMap CallIDs;
 
+  /// Preemptions - Preemption costs of the basic blocks, only available when
+  /// the analysis of preemption costs is enabled. Blocks created after the
+  /// analysis have no entry.
+  PreemptionCosts Preemptions;
+
+  /// CallPreemptions - Preemption costs right before call instructions, only
+  /// available when the analysis of preemption costs is enabled.
+  CallPreemptionCosts CallPreemptions;
+
   static char ID; // Pass identification, replacement for typeid
 };
 
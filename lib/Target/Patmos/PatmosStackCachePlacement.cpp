@@ -0,0 +1,455 @@
+//===-- PatmosStackCachePlacement.cpp - Place stack cache ensures. --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Re-place the stack cache ensure instructions (SENS) emitted by the frame
+// lowering after every call site, based on the machine-level call graph.
+//
+// An ensure only has to provide the part of the stack frame that is accessed
+// before the next ensure or the end of the function, i.e., the live area of
+// the frame. The live area is propagated upwards through the CFG, similar to
+// the live-area analysis of the stack cache analysis, and every ensure is
+// shrunk to it, or removed if nothing of the frame is accessed.
+//
+// In addition, the maximum displacement of each function, i.e., the amount of
+// stack cache space reserved by the function and all functions reachable from
+// it in the call graph, is computed. When the displacement of a callee plus
+// the live area after the call fits into the stack cache, the callee cannot
+// evict any live data of the caller, and the ensure following the call is
+// removed. The live area then is provided by an earlier ensure or reserve.
+//
+// Finally, ensures that are only needed on some of the outgoing edges of a
+// block, e.g., ensures after calls within loops that are only needed on the
+// loop exit, are sunk into the successors that need them.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "patmos-stack-cache-placement"
+
+#include "Patmos.h"
+#include "PatmosBlockDataFlow.h"
+#include "PatmosCallGraphBuilder.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "SinglePath/PatmosSinglePathInfo.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/CodeGen/MachineModulePass.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <limits>
+
+using namespace llvm;
+
+namespace llvm {
+  STATISTIC(PlacementRemovedSENS,  "SENS instructions removed (dead).");
+  STATISTIC(PlacementCalleeSENS,
+            "SENS instructions removed (callee fits into the stack cache).");
+  STATISTIC(PlacementShrunkSENS,   "SENS instructions shrunk to the live area.");
+  STATISTIC(PlacementSunkSENS,     "SENS instructions sunk into successors.");
+  STATISTIC(PlacementEnsuredBytes, "Bytes ensured before the placement.");
+  STATISTIC(PlacementRemainingBytes, "Bytes ensured after the placement.");
+}
+
+namespace {
+  /// Pass to place stack cache ensure instructions.
+  class PatmosStackCachePlacement : public MachineModulePass {
+  private:
+    /// Map call graph nodes to values.
+    typedef DenseMap<MCGNode*, unsigned int> MCGNodeUInt;
+
+    /// Map basic blocks to values.
+    typedef PatmosBlockMap<unsigned int> MBBUInt;
+
+    /// Work list of basic blocks.
+    typedef PatmosBlockWorkList MBBWorkList;
+
+    const PatmosSubtarget &STC;
+    const PatmosInstrInfo &TII;
+
+    /// Maximum displacement of each call graph node, including all nodes
+    /// reachable from it. Unbounded for recursion and unknown callees.
+    MCGNodeUInt MaxDisplacement;
+
+    /// getMaxDisplacement - Compute the maximum amount of stack cache space
+    /// reserved by a call graph node and its children in the call graph.
+    unsigned int getMaxDisplacement(MCGNode *Node)
+    {
+      const unsigned int unbounded = std::numeric_limits<unsigned int>::max();
+
+      MCGNodeUInt::const_iterator known(MaxDisplacement.find(Node));
+      if (known != MaxDisplacement.end())
+        return known->second;
+
+      // UNKNOWN nodes may call anything, including functions outside of the
+      // module
+      if (Node->isUnknown())
+        return MaxDisplacement[Node] = unbounded;
+
+      // reaching the node again while it is visited means recursion, the
+      // nodes of the cycle are thus unbounded.
+      MaxDisplacement[Node] = unbounded;
+
+      unsigned int childDisplacement = 0;
+      const MCGSites &sites(Node->getSites());
+      for(MCGSites::const_iterator i(sites.begin()), ie(sites.end()); i != ie;
+          i++) {
+        childDisplacement = std::max(childDisplacement,
+                                     getMaxDisplacement((*i)->getCallee()));
+      }
+
+      PatmosMachineFunctionInfo *PMFI =
+                           Node->getMF()->getInfo<PatmosMachineFunctionInfo>();
+      unsigned int reserved =
+             STC.getAlignedStackFrameSize(PMFI->getStackCacheReservedBytes());
+
+      unsigned int total = unbounded;
+      if (childDisplacement <= unbounded - reserved)
+        total = childDisplacement + reserved;
+
+      return MaxDisplacement[Node] = total;
+    }
+
+    /// getLiveAreaSize - Return the size of the stack frame area accessed by
+    /// an instruction, in bytes from the top of the stack.
+    unsigned int getLiveAreaSize(const MachineInstr *MI) const
+    {
+      unsigned int scale = 1;
+      switch (MI->getOpcode()) {
+        case Patmos::SWS:
+          scale = 2;
+        case Patmos::SHS:
+          scale <<= 1;
+        case Patmos::SBS:
+        {
+          if (MI->getOperand(3).isImm() &&
+              MI->getOperand(2).getReg() == Patmos::R0) {
+            return scale * (MI->getOperand(3).getImm() + 1);
+          }
+          return STC.getStackCacheSize();
+        }
+        case Patmos::LWS:
+          scale = 2;
+        case Patmos::LHS:
+        case Patmos::LHUS:
+          scale <<= 1;
+        case Patmos::LBS:
+        case Patmos::LBUS:
+        {
+          if (MI->getOperand(4).isImm() &&
+              MI->getOperand(3).getReg() == Patmos::R0) {
+            return scale * (MI->getOperand(4).getImm() + 1);
+          }
+          return STC.getStackCacheSize();
+        }
+        default:
+          return 0;
+      }
+    }
+
+    /// isHandled - Check whether the ensures of a function can be placed by
+    /// this pass. Single-path code and code manipulating the stack cache
+    /// otherwise is left alone.
+    bool isHandled(MachineFunction &MF) const
+    {
+      if (PatmosSinglePathInfo::isEnabled(MF))
+        return false;
+
+      for(MachineFunction::iterator i(MF.begin()), ie(MF.end()); i != ie;
+          i++) {
+        for(MachineBasicBlock::instr_iterator j(i->instr_begin()),
+            je(i->instr_end()); j != je; j++) {
+          switch (j->getOpcode()) {
+            case Patmos::SENSr:
+            case Patmos::SSPILLi:
+            case Patmos::SSPILLr:
+              return false;
+            default:
+              if (j->isInlineAsm() || j->isBundle())
+                return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    /// getCallDisplacement - Get the maximum displacement of the call
+    /// immediately preceding an ensure, or an unbounded displacement if the
+    /// ensure does not directly follow a call.
+    unsigned int getCallDisplacement(MCGNode *Node, MachineInstr *SENS)
+    {
+      MachineBasicBlock::instr_iterator i(SENS);
+      MachineBasicBlock *MBB = SENS->getParent();
+
+      while (i != MBB->instr_begin()) {
+        --i;
+        if (i->isCall()) {
+          // one call site per possible callee
+          MCGSites sites(Node->findSites(i));
+          if (sites.empty() || TII.isPredicated(i))
+            break;
+
+          unsigned int displacement = 0;
+          for(MCGSites::iterator j(sites.begin()), je(sites.end()); j != je;
+              j++) {
+            displacement = std::max(displacement,
+                                    getMaxDisplacement((*j)->getCallee()));
+          }
+          return displacement;
+        }
+        else if (getLiveAreaSize(i) || i->getOpcode() == Patmos::SENSi ||
+                 i->getOpcode() == Patmos::SRESi ||
+                 i->getOpcode() == Patmos::SFREEi)
+          break;
+      }
+
+      return std::numeric_limits<unsigned int>::max();
+    }
+
+    /// isRemovable - Check whether an ensure can be dropped because its call
+    /// cannot evict the live area following it.
+    bool isRemovable(unsigned int Displacement, unsigned int LiveArea) const
+    {
+      unsigned int size = STC.getStackCacheSize();
+      return Displacement <= size && LiveArea <= size - Displacement;
+    }
+
+    /// propagateLiveArea - Propagate the live area of the stack frame upwards
+    /// through a basic block. Ensures that are removable pass the live area
+    /// on, others provide it.
+    unsigned int propagateLiveArea(MachineBasicBlock *MBB, unsigned int Live,
+                                   DenseMap<MachineInstr*, unsigned int> &Disp,
+                                   DenseMap<MachineInstr*, unsigned int> &ENSs)
+    {
+      for(MachineBasicBlock::reverse_instr_iterator i(MBB->instr_rbegin()),
+          ie(MBB->instr_rend()); i != ie; i++) {
+        if (i->getOpcode() == Patmos::SENSi) {
+          ENSs[&*i] = Live;
+
+          // predicated ensures are kept, they may not be executed though.
+          if (TII.isPredicated(&*i))
+            continue;
+
+          if (!isRemovable(Disp[&*i], Live))
+            Live = 0;
+        }
+        else if (i->getOpcode() == Patmos::SFREEi) {
+          // the frame is dead after the free
+          Live = 0;
+        }
+        else {
+          Live = std::max(Live, getLiveAreaSize(&*i));
+        }
+      }
+      return Live;
+    }
+
+    /// placeEnsures - Shrink, remove, and sink the ensures of a function.
+    bool placeEnsures(MCGNode *Node)
+    {
+      MachineFunction *MF = Node->getMF();
+
+      if (!isHandled(*MF))
+        return false;
+
+      // find the ensures and the displacement of their calls
+      DenseMap<MachineInstr*, unsigned int> Disp;
+      for(MachineFunction::iterator i(MF->begin()), ie(MF->end()); i != ie;
+          i++) {
+        for(MachineBasicBlock::instr_iterator j(i->instr_begin()),
+            je(i->instr_end()); j != je; j++) {
+          if (j->getOpcode() == Patmos::SENSi)
+            Disp[j] = getCallDisplacement(Node, j);
+        }
+      }
+
+      if (Disp.empty())
+        return false;
+
+      // propagate the live area upwards until a fixpoint is reached. The live
+      // area at block exits only grows, which keeps the result safe even when
+      // an ensure turns from removable to not removable during the iteration.
+      MBBWorkList WL(*MF, MBBWorkList::Backward);
+      MBBUInt OUTs(*MF), INs(*MF);
+      DenseMap<MachineInstr*, unsigned int> ENSs;
+      WL.insertAll();
+
+      solve(WL, [&](MachineBasicBlock *MBB) {
+        unsigned int live = propagateLiveArea(MBB, OUTs[MBB], Disp, ENSs);
+        INs[MBB] = live;
+
+        for(MachineBasicBlock::pred_iterator i(MBB->pred_begin()),
+            ie(MBB->pred_end()); i != ie; i++) {
+          if (OUTs[*i] < live) {
+            OUTs[*i] = live;
+            WL.insert(*i);
+          }
+        }
+      });
+
+      // rewrite the ensures
+      bool changed = false;
+      for(DenseMap<MachineInstr*, unsigned int>::iterator i(Disp.begin()),
+          ie(Disp.end()); i != ie; i++) {
+        MachineInstr *SENS = i->first;
+        unsigned int live = ENSs[SENS];
+        unsigned int ensure = SENS->getOperand(2).getImm();
+
+        PlacementEnsuredBytes += ensure * 4;
+
+        if (TII.isPredicated(SENS)) {
+          PlacementRemainingBytes += ensure * 4;
+          continue;
+        }
+
+        if (live == 0 || isRemovable(i->second, live)) {
+          DEBUG(dbgs() << "Removing " << *SENS);
+          if (live == 0)
+            PlacementRemovedSENS++;
+          else
+            PlacementCalleeSENS++;
+
+          SENS->eraseFromParent();
+          changed = true;
+          continue;
+        }
+
+        unsigned int words = std::min(ensure,
+                                      STC.getAlignedStackFrameSize(live) / 4);
+
+        if (sinkEnsure(SENS, words, INs)) {
+          changed = true;
+          continue;
+        }
+
+        if (words < ensure) {
+          DEBUG(dbgs() << "Shrinking to " << words << " words: " << *SENS);
+          SENS->getOperand(2).setImm(words);
+          PlacementShrunkSENS++;
+          changed = true;
+        }
+
+        PlacementRemainingBytes += words * 4;
+      }
+
+      return changed;
+    }
+
+    /// sinkEnsure - Move an ensure at the end of its block into those
+    /// successors whose live area is not empty, if any successor does not
+    /// need the ensure.
+    bool sinkEnsure(MachineInstr *SENS, unsigned int Words,
+                    const MBBUInt &INs)
+    {
+      MachineBasicBlock *MBB = SENS->getParent();
+
+      if (MBB->succ_size() < 2)
+        return false;
+
+      // nothing following the ensure in the block may access the frame
+      for(MachineBasicBlock::instr_iterator i(llvm::next(
+          MachineBasicBlock::instr_iterator(SENS))), ie(MBB->instr_end());
+          i != ie; i++) {
+        if (i->isCall() || getLiveAreaSize(i) ||
+            i->getOpcode() == Patmos::SENSi || i->getOpcode() == Patmos::SFREEi)
+          return false;
+      }
+
+      // check that the ensure can be placed in all successors needing it
+      bool unneeded = false;
+      for(MachineBasicBlock::succ_iterator i(MBB->succ_begin()),
+          ie(MBB->succ_end()); i != ie; i++) {
+        if (INs.lookup(*i) == 0)
+          unneeded = true;
+        else if (*i == MBB || (*i)->pred_size() != 1 || (*i)->isLandingPad())
+          return false;
+      }
+
+      if (!unneeded)
+        return false;
+
+      for(MachineBasicBlock::succ_iterator i(MBB->succ_begin()),
+          ie(MBB->succ_end()); i != ie; i++) {
+        unsigned int live = INs.lookup(*i);
+        if (live == 0)
+          continue;
+
+        unsigned int words = std::min(Words,
+                                      STC.getAlignedStackFrameSize(live) / 4);
+        MachineBasicBlock::iterator pos((*i)->begin());
+        AddDefaultPred(BuildMI(**i, pos, SENS->getDebugLoc(),
+                               TII.get(Patmos::SENSi))).addImm(words);
+
+        PlacementRemainingBytes += words * 4;
+      }
+
+      DEBUG(dbgs() << "Sinking " << *SENS);
+      SENS->eraseFromParent();
+      PlacementSunkSENS++;
+      return true;
+    }
+
+  public:
+    /// Pass ID
+    static char ID;
+
+    PatmosStackCachePlacement(const PatmosTargetMachine &tm) :
+        MachineModulePass(ID), STC(tm.getSubtarget<PatmosSubtarget>()),
+        TII(*tm.getInstrInfo())
+    {
+      initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
+    }
+
+    /// getPassName - Return the pass' name.
+    virtual const char *getPassName() const
+    {
+      return "Patmos Stack Cache Placement";
+    }
+
+    /// getAnalysisUsage - Inform the pass manager that the call graph is
+    /// preserved, only ensure instructions are modified.
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const
+    {
+      AU.setPreservesAll();
+      AU.addRequired<PatmosCallGraphBuilder>();
+
+      ModulePass::getAnalysisUsage(AU);
+    }
+
+    virtual bool runOnMachineModule(const Module &M)
+    {
+      PatmosCallGraphBuilder &PCGB(getAnalysis<PatmosCallGraphBuilder>());
+      const MCallGraph &G(*PCGB.getCallGraph());
+
+      MaxDisplacement.clear();
+
+      bool changed = false;
+      for(MCGNodes::const_iterator i(G.getNodes().begin()),
+          ie(G.getNodes().end()); i != ie; i++) {
+        if (!(*i)->isUnknown())
+          changed |= placeEnsures(*i);
+      }
+
+      return changed;
+    }
+  };
+
+  char PatmosStackCachePlacement::ID = 0;
+}
+
+/// createPatmosStackCachePlacementPass - Returns a new
+/// PatmosStackCachePlacement.
+ModulePass *llvm::createPatmosStackCachePlacementPass(
+                                               const PatmosTargetMachine &tm) {
+  return new PatmosStackCachePlacement(tm);
+}
@@ -58,6 +58,22 @@ namespace {
     cl::init(false),
     cl::desc("Enable the Patmos stack cache analysis."),
     cl::Hidden);
+  /// EnableStackCachePlacement - Option to shrink, remove, and sink the stack
+  /// cache ensures emitted after every call site.
+  static cl::opt<bool> EnableStackCachePlacement(
+    "mpatmos-enable-stack-cache-placement",
+    cl::init(false),
+    cl::desc("Enable the placement of stack cache ensures based on the call "
+             "graph."),
+    cl::Hidden);
+  /// EnableMethodCacheLayout - Option to order functions for Patmos' method
+  /// cache.
+  static cl::opt<bool> EnableMethodCacheLayout(
+    "mpatmos-enable-method-cache-layout",
+    cl::init(false),
+    cl::desc("Co-locate callers and callees for the Patmos method cache and "
+             "estimate method cache conflicts."),
+    cl::Hidden);
   static cl::opt<bool> DisableIfConverter(
       "mpatmos-disable-ifcvt",
       cl::init(false),
@@ -105,6 +121,9 @@ namespace {
     /// addPreISelPasses - This method should add any "last minute" LLVM->LLVM
     /// passes (which are run just before instruction selector).
     virtual bool addPreISel() {
+      // allocate hot data to the scratchpad, if requested
+      addPass(createPatmosScratchpadAllocationPass(getPatmosTargetMachine()));
+
       if (PatmosSinglePathInfo::isEnabled()) {
         // Single-path transformation requires a single exit node
         addPass(createUnifyFunctionExitNodesPass());
@@ -170,6 +189,11 @@ namespace {
         }
       }
 
+      // shrink, remove, and sink the ensures emitted after call sites
+      if (getOptLevel() != CodeGenOpt::None && EnableStackCachePlacement) {
+        addPass(createPatmosStackCachePlacementPass(getPatmosTargetMachine()));
+      }
+
       // this is pseudo pass that may hold results from SC analysis
       // (currently for PML export)
       addPass(createPatmosStackCacheAnalysisInfo(getPatmosTargetMachine()));
@@ -207,6 +231,10 @@ namespace {
 
       if (getPatmosSubtarget().hasMethodCache()) {
         addPass(createPatmosFunctionSplitterPass(getPatmosTargetMachine()));
+
+        if (EnableMethodCacheLayout) {
+          addPass(createPatmosMethodCacheLayoutPass(getPatmosTargetMachine()));
+        }
       }
 
       addPass(createPatmosDelaySlotKillerPass(getPatmosTargetMachine()));
@@ -217,6 +245,11 @@ namespace {
       // the control structure nor the size of basic blocks.
       addPass(createPatmosBypassFromPMLPass(getPatmosTargetMachine()));
 
+      // compute the execution time of the final single-path code
+      if (PatmosSinglePathInfo::isEnabled()) {
+        addPass(createPatmosSPCycleEstimatorPass(getPatmosTargetMachine()));
+      }
+
       return true;
     }
 
@@ -0,0 +1,84 @@
+//===-- PatmosThreadPool.cpp - Run independent tasks on worker threads. ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Implementation of the worker threads of parallel loops.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosThreadPool.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Threading.h"
+
+#include <algorithm>
+
+#if LLVM_ENABLE_THREADS
+#include <atomic>
+#include <thread>
+#include <vector>
+#endif
+
+using namespace llvm;
+
+PatmosParallelTask::~PatmosParallelTask()
+{
+}
+
+PatmosThreadPool::PatmosThreadPool(unsigned int numthreads) :
+    NumThreads(numthreads)
+{
+#if LLVM_ENABLE_THREADS
+  if (NumThreads == 0)
+    NumThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  // make statistics and other global state of LLVM thread-safe
+  if (NumThreads > 1 && !llvm_start_multithreaded())
+    NumThreads = 1;
+#else
+  NumThreads = 1;
+#endif
+}
+
+#if LLVM_ENABLE_THREADS
+/// runTasks - Repeatedly grab the next unprocessed index and run the task on
+/// it, until all indices are taken.
+static void runTasks(PatmosParallelTask *Task, std::atomic<unsigned int> *Next,
+                     unsigned int NumTasks)
+{
+  for(unsigned int i = (*Next)++; i < NumTasks; i = (*Next)++) {
+    Task->run(i);
+  }
+}
+#endif
+
+void PatmosThreadPool::run(PatmosParallelTask &Task, unsigned int NumTasks)
+{
+#if LLVM_ENABLE_THREADS
+  if (NumThreads > 1 && NumTasks > 1) {
+    std::atomic<unsigned int> Next(0);
+
+    // spawn workers, the calling thread is one of them
+    std::vector<std::thread> Workers;
+    unsigned int NumWorkers = std::min(NumThreads, NumTasks) - 1;
+    for(unsigned int i = 0; i < NumWorkers; i++) {
+      Workers.push_back(std::thread(runTasks, &Task, &Next, NumTasks));
+    }
+
+    runTasks(&Task, &Next, NumTasks);
+
+    for(unsigned int i = 0; i < NumWorkers; i++) {
+      Workers[i].join();
+    }
+    return;
+  }
+#endif
+
+  for(unsigned int i = 0; i < NumTasks; i++) {
+    Task.run(i);
+  }
+}
@@ -0,0 +1,66 @@
+//===-- PatmosThreadPool.h - Run independent tasks on worker threads. -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A minimal pool of worker threads executing parallel loops, used by the
+// module-level analyses of the Patmos backend to process independent
+// functions or call graph SCCs concurrently.
+//
+// Tasks are handed out to the workers dynamically, the order in which they
+// are executed is thus unspecified. Clients obtain deterministic results by
+// letting each task write only to data private to its index and merging the
+// results afterwards in index order.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOSTHREADPOOL_H_
+#define _LLVM_TARGET_PATMOSTHREADPOOL_H_
+
+namespace llvm {
+  /// The body of a parallel loop.
+  class PatmosParallelTask
+  {
+  public:
+    virtual ~PatmosParallelTask();
+
+    /// run - Execute the loop body for the given index.
+    virtual void run(unsigned int Index) = 0;
+  };
+
+  /// A pool of worker threads executing parallel loops.
+  class PatmosThreadPool
+  {
+  private:
+    /// The number of threads executing a loop, including the caller.
+    unsigned int NumThreads;
+
+  public:
+    /// Construct a pool using the given number of threads, 0 selects the
+    /// number of hardware threads. Without thread support in LLVM all loops
+    /// are executed serially.
+    explicit PatmosThreadPool(unsigned int numthreads);
+
+    /// getNumThreads - Return the number of threads executing a loop.
+    unsigned int getNumThreads() const
+    {
+      return NumThreads;
+    }
+
+    /// isParallel - Return whether loops are executed concurrently.
+    bool isParallel() const
+    {
+      return NumThreads > 1;
+    }
+
+    /// run - Execute the task for all indices in [0, NumTasks) and wait for
+    /// all of them to complete. The calling thread participates in the work.
+    void run(PatmosParallelTask &Task, unsigned int NumTasks);
+  };
+} // End llvm namespace
+
+#endif // _LLVM_TARGET_PATMOSTHREADPOOL_H_
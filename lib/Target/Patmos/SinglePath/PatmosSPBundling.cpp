@@ -8,12 +8,20 @@
 //===----------------------------------------------------------------------===//
 //
 // This pass makes the single-pat code utilitize Patmos' dual issue pipeline.
-// TODO: more description
+// Sibling blocks of a branch, i.e., blocks on disjoint paths, are merged into
+// one block. The instructions of the two blocks are interleaved by a list
+// schedule that respects the latencies within each block, and bundled where
+// the two instructions can be issued together.
 //
 //===----------------------------------------------------------------------===//
 
 #include "PatmosSPBundling.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/MC/MCRegisterInfo.h"
+
+#include <climits>
+#include <map>
+#include <set>
 
 using namespace llvm;
 
@@ -60,69 +68,136 @@ std::pair<PredicatedBlock*, PredicatedBlock*> findBranch(SPScope* root){
   return std::make_pair((PredicatedBlock*)NULL, (PredicatedBlock*)NULL);
 }
 
-int numberOfInstructions(MachineBasicBlock* mbb){
-  auto count = 0;
-  for(auto begin = mbb->begin(), end = mbb->getFirstTerminator();
-      begin != end ; begin++){
-    count++;
+void PatmosSPBundling::buildMergeDAG(MachineBasicBlock *mbb,
+                                     std::vector<MergeNode> &nodes) const {
+  auto itins = TM.getInstrItineraryData();
+  auto tri = TM.getRegisterInfo();
+
+  // The last definition of each register unit: node, instruction and operand
+  std::map<unsigned, std::pair<unsigned, std::pair<MachineInstr*, unsigned>>> defs;
+
+  for(auto iter = mbb->begin(), end = mbb->getFirstTerminator();
+      iter != end; iter++)
+  {
+    unsigned idx = nodes.size();
+    nodes.push_back(MergeNode(iter));
+    auto &node = nodes.back();
+
+    auto instr = iter.getInstrIterator();
+    do {
+      for(unsigned i = 0; i < instr->getNumOperands(); i++){
+        auto &mo = instr->getOperand(i);
+        if(!mo.isReg() || !mo.getReg() || !mo.isUse()) continue;
+
+        for(MCRegUnitIterator unit(mo.getReg(), tri); unit.isValid(); ++unit){
+          auto def = defs.find(*unit);
+          if(def == defs.end() || def->second.first == idx) continue;
+
+          int latency = TII->getOperandLatency(itins,
+                                               def->second.second.first,
+                                               def->second.second.second,
+                                               &(*instr), i);
+          node.Preds.push_back(std::make_pair(def->second.first,
+                                              (unsigned) std::max(latency, 1)));
+        }
+      }
+      for(unsigned i = 0; i < instr->getNumOperands(); i++){
+        auto &mo = instr->getOperand(i);
+        if(!mo.isReg() || !mo.getReg() || !mo.isDef()) continue;
+
+        for(MCRegUnitIterator unit(mo.getReg(), tri); unit.isValid(); ++unit){
+          defs[*unit] = std::make_pair(idx, std::make_pair(&(*instr), i));
+        }
+      }
+    } while(++instr != mbb->instr_end() && instr->isBundledWithPred());
+  }
+
+  // The instructions of a block keep their order, so every instruction is
+  // also on a path with its successor in the block.
+  for(unsigned i = nodes.size(); i-- > 0; ){
+    if(i + 1 < nodes.size()){
+      nodes[i].Height = std::max(nodes[i].Height, nodes[i+1].Height + 1);
+    }
+    for(auto pred: nodes[i].Preds){
+      nodes[pred.first].Height = std::max(nodes[pred.first].Height,
+                                          nodes[i].Height + pred.second);
+    }
+  }
+}
+
+unsigned PatmosSPBundling::getMergeReadyCycle(
+    const std::vector<MergeNode> &nodes, unsigned idx) const {
+  unsigned ready = idx > 0 ? nodes[idx-1].Cycle + 1 : 0;
+  for(auto pred: nodes[idx].Preds){
+    ready = std::max(ready, nodes[pred.first].Cycle + pred.second);
   }
-  return count;
+  return ready;
 }
 
 void PatmosSPBundling::mergeMBBs(MachineBasicBlock *mbb1, MachineBasicBlock *mbb2){
+  std::vector<MergeNode> nodes1, nodes2;
+  buildMergeDAG(mbb1, nodes1);
+  buildMergeDAG(mbb2, nodes2);
 
-  auto moveInstruction = [&](auto bundleWith){
-    InstPairsTried++;
-    auto inst = &(*mbb2->instr_begin());
-    mbb2->remove(inst);
-#define DO_BUNDLE // for easily turning off bundling of instructions
-#ifdef DO_BUNDLE
-    if(TII->canIssueInSlot(inst, 1)){
-      InstPairsSuccess++;
-      mbb1->insertAfter(bundleWith, inst);
-      inst->bundleWithPred();
-    }else if (TII->canIssueInSlot(&(*bundleWith), 1)){
-      InstPairsSwitched++;
-      mbb1->insert(bundleWith, inst);
-      inst->bundleWithSucc();
-    }else{
-#endif
-      mbb1->insertAfter(bundleWith, inst);
-#ifdef DO_BUNDLE
-    }
-#endif
+  // The merged instructions are placed before the terminators of mbb1
+  auto insertPos = mbb1->getFirstTerminator();
+
+  auto issue = [&](MachineBasicBlock *from, MergeNode &node, unsigned cycle){
+    mbb1->splice(insertPos, from, MachineBasicBlock::iterator(node.MI));
+    node.Cycle = cycle;
   };
 
-  auto moveNextInstruction = [&](unsigned movedInstructions){
-    auto mbb1next = mbb1->instr_begin();
-    for(int i = 0; i<movedInstructions; i++){
-      // We advance by 2, because we have already inserted some instructions from mbb2
-      mbb1next++;
-      mbb1next++;
-    }
-    moveInstruction(mbb1next);
+  auto canBundle = [&](MachineInstr *first, MachineInstr *second){
+    return !first->isBundled() && !second->isBundled() &&
+           TII->getIssueWidth(first) == 1 && TII->getIssueWidth(second) == 1 &&
+           TII->canIssueInSlot(first, 0) && TII->canIssueInSlot(second, 1);
   };
-  int nrMbb1Instrs = numberOfInstructions(mbb1);
-  if (nrMbb1Instrs > numberOfInstructions(mbb2)) {
-    for(auto movedInstructions = 0;
-        mbb2->instr_begin() != mbb2->getFirstInstrTerminator();
-        movedInstructions++)
-    {
-      moveNextInstruction(movedInstructions);
-    }
-  }else{
-    for(auto movedInstructions = 0;
-        movedInstructions < nrMbb1Instrs;
-        movedInstructions++)
-    {
-      moveNextInstruction(movedInstructions);
+
+  unsigned idx1 = 0, idx2 = 0, cycle = 0;
+  while(idx1 < nodes1.size() || idx2 < nodes2.size()){
+    unsigned ready1 = idx1 < nodes1.size() ?
+                      getMergeReadyCycle(nodes1, idx1) : UINT_MAX;
+    unsigned ready2 = idx2 < nodes2.size() ?
+                      getMergeReadyCycle(nodes2, idx2) : UINT_MAX;
+
+    // If neither block has a ready instruction, the block ready first stalls
+    cycle = std::max(cycle, std::min(ready1, ready2));
+    bool issue1 = ready1 <= cycle, issue2 = ready2 <= cycle;
+
+    if(issue1 && issue2){
+      InstPairsTried++;
+      auto &node1 = nodes1[idx1], &node2 = nodes2[idx2];
+
+      if(canBundle(node1.MI, node2.MI)){
+        InstPairsSuccess++;
+        issue(mbb1, node1, cycle);
+        issue(mbb2, node2, cycle);
+        node2.MI->bundleWithPred();
+        idx1++; idx2++; cycle++;
+        continue;
+      }else if(canBundle(node2.MI, node1.MI)){
+        InstPairsSwitched++;
+        issue(mbb2, node2, cycle);
+        issue(mbb1, node1, cycle);
+        node1.MI->bundleWithPred();
+        idx1++; idx2++; cycle++;
+        continue;
+      }
+
+      // Cannot bundle, issue the instruction on the longer critical path
+      if(node1.Height >= node2.Height){
+        issue2 = false;
+      }else{
+        issue1 = false;
+      }
     }
 
-    while(mbb2->instr_begin() != mbb2->getFirstInstrTerminator()){
-      auto inst = &(*mbb2->instr_begin());
-      mbb2->remove(inst);
-      mbb1->insert(mbb1->getFirstInstrTerminator(), inst);
+    if(issue1){
+      issue(mbb1, nodes1[idx1++], cycle);
+    }else{
+      issue(mbb2, nodes2[idx2++], cycle);
     }
+    cycle++;
   }
 
   // Only terminators left
@@ -133,7 +208,13 @@ void PatmosSPBundling::mergeMBBs(MachineBasicBlock *mbb1, MachineBasicBlock *mbb
   }
 }
 
-std::pair<bool, std::pair<PredicatedBlock*,PredicatedBlock*>> PatmosSPBundling::findMergePair(const SPScope* scope){
+std::vector<std::pair<PredicatedBlock*,PredicatedBlock*>>
+PatmosSPBundling::findMergePairs(const SPScope* scope){
+  std::vector<std::pair<PredicatedBlock*,PredicatedBlock*>> pairs;
+
+  // Blocks whose successors or predecessors are changed by a found pair
+  std::set<const PredicatedBlock*> used;
+
   for(auto block: scope->getScopeBlocks()){
     DEBUG(dbgs() << "Looking for merge pair at: #" << block->getMBB()->getNumber() << "\n");
     auto succs = block->getSuccessors();
@@ -152,53 +233,63 @@ std::pair<bool, std::pair<PredicatedBlock*,PredicatedBlock*>> PatmosSPBundling::
           continue;
         }
 
+        if(used.count(block) || used.count(b1) || used.count(b2)){
+          continue;
+        }
+
         if(!(scope->isSubheader(b1) || scope->isSubheader(b2) || b1->getSuccessors().size() == 0 || b2->getSuccessors().size() == 0 ||
           b1->bundledMBBs().size()>0 || b2->bundledMBBs().size()>0)){
 
+          used.insert(block);
+          used.insert(b1);
+          used.insert(b2);
+
           auto farMBB = TII->getBranchTarget(mbb->getFirstInstrTerminator());
           if(TII->mayFallthrough(*mbb) && farMBB == b1->getMBB()){
             assert(++mbb->getFirstInstrTerminator() == mbb->end());
             assert(farMBB == b1->getMBB() || farMBB == b2->getMBB());
-            return std::make_pair(true, std::make_pair(b2, b1));
+            pairs.push_back(std::make_pair(b2, b1));
           }else{
-            return std::make_pair(true, std::make_pair(b1, b2));
+            pairs.push_back(std::make_pair(b1, b2));
           }
         }
 	  }
     }
   }
-  return std::make_pair(false, std::make_pair((PredicatedBlock*)NULL, (PredicatedBlock*)NULL));
+  return pairs;
 }
 
 void PatmosSPBundling::bundleScope(SPScope* root){
-  std::pair<bool, std::pair<PredicatedBlock*,PredicatedBlock*>> mergePair;
-  while( (mergePair = findMergePair(root)).first ){
-    PairsSuccess++;
+  std::vector<std::pair<PredicatedBlock*,PredicatedBlock*>> mergePairs;
+  while( !(mergePairs = findMergePairs(root)).empty() ){
+    for(auto mergePair: mergePairs){
+      PairsSuccess++;
 
-    auto destination = mergePair.second.first;
-    auto source = mergePair.second.second;
+      auto destination = mergePair.first;
+      auto source = mergePair.second;
 
-    DEBUG(dbgs() << "Merge pair: (#" << destination->getMBB()->getNumber() << ", #" << source->getMBB()->getNumber() << ")\n");
+      DEBUG(dbgs() << "Merge pair: (#" << destination->getMBB()->getNumber() << ", #" << source->getMBB()->getNumber() << ")\n");
 
-    mergeMBBs(destination->getMBB(), source->getMBB());
+      mergeMBBs(destination->getMBB(), source->getMBB());
 
-    auto mbb1 = destination->getMBB(), mbb2 = source->getMBB();
-    auto func = mbb2->getParent();
+      auto mbb1 = destination->getMBB(), mbb2 = source->getMBB();
+      auto func = mbb2->getParent();
 
-    // Replace the use of the discarded MBB with the other
-    for(auto iter = func->begin(), end = func->end(); iter != end; iter++){
-      if(iter->isSuccessor(mbb2)){
-        iter->ReplaceUsesOfBlockWith(mbb2, mbb1);
+      // Replace the use of the discarded MBB with the other
+      for(auto iter = func->begin(), end = func->end(); iter != end; iter++){
+        if(iter->isSuccessor(mbb2)){
+          iter->ReplaceUsesOfBlockWith(mbb2, mbb1);
+        }
+      }
+      while(mbb2->succ_begin() != mbb2->succ_end()){
+        mbb2->removeSuccessor(mbb2->succ_begin());
       }
-    }
-    while(mbb2->succ_begin() != mbb2->succ_end()){
-      mbb2->removeSuccessor(mbb2->succ_begin());
-    }
 
-    func->erase(source->getMBB());
+      func->erase(source->getMBB());
 
-    // Merge the two PredicatedBlocks into one
-    root->merge(destination, source);
+      // Merge the two PredicatedBlocks into one
+      root->merge(destination, source);
+    }
   }
 
   std::for_each(root->child_begin(), root->child_end(), [&](auto subscope){
@@ -40,6 +40,32 @@ private:
 
   MachinePostDominatorTree *PostDom;
 
+  /// MergeNode - An instruction (or bundle) of a block that is merged.
+  struct MergeNode {
+    MachineInstr *MI;
+
+    /// Data dependences on earlier instructions of the block and their latency.
+    std::vector<std::pair<unsigned, unsigned>> Preds;
+
+    /// Length of the longest latency path to the end of the block.
+    unsigned Height;
+
+    /// The cycle of the merged schedule the node is issued in.
+    unsigned Cycle;
+
+    MergeNode(MachineInstr *mi) : MI(mi), Height(1), Cycle(0) {}
+  };
+
+  /// buildMergeDAG - Collect the non-terminators of the block and the data
+  /// dependences between them.
+  void buildMergeDAG(MachineBasicBlock *mbb,
+                     std::vector<MergeNode> &nodes) const;
+
+  /// getMergeReadyCycle - Get the earliest cycle the node can be issued in,
+  /// given that the predecessors of the node have been issued.
+  unsigned getMergeReadyCycle(const std::vector<MergeNode> &nodes,
+                              unsigned idx) const;
+
   /// doBundlingFunction - Bundle a given MachineFunction
   void doBundlingFunction(SPScope* root);
 
@@ -80,13 +106,23 @@ public:
     return PSPI->getRootScope();
   }
 
-  /// Tries to find a pair of blocks to merge.
+  /// Finds pairs of sibling blocks to merge.
   ///
-  /// If a pair is found, true is returned with the pair of blocks found.
-  /// If no pair is found, false is returned with a pair of NULLs.
-  std::pair<bool, std::pair<PredicatedBlock*,PredicatedBlock*>>
-  findMergePair(const SPScope*);
-
+  /// The pairs are disjoint, i.e., each block is part of at most one pair and
+  /// none of the pairs' blocks branches to the blocks of another pair, so all
+  /// pairs can be merged before searching for new pairs.
+  /// If no pair is found, an empty list is returned.
+  std::vector<std::pair<PredicatedBlock*,PredicatedBlock*>>
+  findMergePairs(const SPScope*);
+
+  /// Merges the non-terminator instructions of mbb2 into mbb1, bundling
+  /// instructions of the two blocks where possible.
+  ///
+  /// The instructions of each block keep their order. The blocks are
+  /// interleaved using a list schedule on the blocks' dependence graphs, such
+  /// that the latencies inside one block are filled with instructions of the
+  /// other block and instructions on the longer critical path are issued
+  /// first. Terminators of mbb2 are appended to mbb1.
   void mergeMBBs(MachineBasicBlock *mbb1, MachineBasicBlock *mbb2);
 
   void bundleScope(SPScope* root);
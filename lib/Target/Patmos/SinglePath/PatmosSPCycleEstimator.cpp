@@ -0,0 +1,364 @@
+//===-- PatmosSPCycleEstimator.cpp - Single-path execution time -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass computes the execution time of single-path functions in cycles.
+//
+// Single-path code executes the same instruction sequence regardless of its
+// inputs: every basic block of a loop is executed exactly as often as the
+// loop bound given by the user, as the loop counter inserted by PatmosSPReduce
+// runs to the bound. Hence the execution time of a function is the sum over
+// all basic blocks of the block's cycles times the product of the bounds of
+// the enclosing loops, plus the execution time of the called functions.
+//
+// The estimate runs on the final code, after delay slots have been filled
+// and bundles have been formed. The scopes of PatmosSinglePathInfo are merged
+// into linear code by PatmosSPReduce; their structure is retained by the
+// loops of the final code, which still hold the PSEUDO_LOOPBOUND of the
+// scope's header.
+//
+// Each non-pseudo instruction or bundle takes one cycle. Non-delayed control
+// flow instructions stall for the cycles of their delay slots. Instruction
+// latencies are covered by the explicit NOPs inserted by the scheduler.
+// Stalls of the method cache, the stack cache and the data cache are not
+// included.
+//
+// The result is exact only if all loops are bounded and all callees are
+// single-path functions, otherwise no estimate is stored.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "patmos-singlepath"
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/CodeGen/MachineModulePass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <set>
+
+using namespace llvm;
+
+STATISTIC(NumSPEstimated, "Number of single-path functions with exact cycles");
+STATISTIC(NumSPInexact,   "Number of single-path functions without estimate");
+
+static cl::opt<bool> ReportSPCycles(
+  "mpatmos-sp-report-cycles",
+  cl::init(false),
+  cl::desc("Report the execution time of single-path functions in cycles."),
+  cl::Hidden);
+
+
+namespace {
+
+class PatmosSPCycleEstimator : public MachineModulePass {
+private:
+  /// FunctionCycles - Cycles of a single function, excluding its callees.
+  struct FunctionCycles {
+    /// Exact - false if a loop is unbounded or a callee is unknown.
+    bool Exact;
+
+    /// Local - Cycles of the instructions of the function itself.
+    int64_t Local;
+
+    /// Calls - Called functions and how often they are called.
+    std::map<const MachineFunction*, int64_t> Calls;
+
+    FunctionCycles() : Exact(true), Local(0) {}
+  };
+
+  typedef std::map<const MachineFunction*, FunctionCycles> FunctionCyclesMap;
+
+  const PatmosTargetMachine &TM;
+  const PatmosSubtarget &STI;
+  const PatmosInstrInfo *TII;
+  MachineModuleInfo *MMI;
+
+  /// Local cycles of all single-path functions.
+  FunctionCyclesMap LocalCycles;
+
+  /// Total cycles of the single-path functions, -1 if not exact.
+  std::map<const MachineFunction*, int64_t> TotalCycles;
+
+  /**
+   * Get the machine function called by a given MachineInstr, or NULL if
+   * the callee is unknown.
+   */
+  const MachineFunction *getCallTargetMF(const MachineInstr *MI) const;
+
+  /**
+   * Get the number of cycles the given instruction or bundle stalls for
+   * non-delayed control flow.
+   */
+  unsigned getStallCycles(const MachineInstr *MI) const;
+
+  /**
+   * Get how often the blocks of the given loop are executed per execution of
+   * the function, or -1 if a loop has no bound.
+   */
+  int64_t getExecutionCount(const MachineLoop *Loop) const;
+
+  /**
+   * Compute the cycles of the instructions of a single function and collect
+   * the called functions.
+   */
+  void computeLocalCycles(MachineFunction &MF, FunctionCycles &FC);
+
+  /**
+   * Compute the total cycles of a single-path function including all
+   * callees, -1 if it is not exact.
+   */
+  int64_t computeTotalCycles(const MachineFunction *MF);
+
+public:
+  static char ID; // Pass identification, replacement for typeid
+
+  PatmosSPCycleEstimator(const PatmosTargetMachine &tm)
+    : MachineModulePass(ID), TM(tm),
+      STI(*tm.getSubtargetImpl()), TII(tm.getInstrInfo()) {}
+
+  /// getPassName - Return the pass' name.
+  virtual const char *getPassName() const {
+    return "Patmos Single-Path Cycle Estimator";
+  }
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.addRequired<MachineModuleInfo>();
+    AU.addRequired<MachineLoopInfo>();
+    AU.setPreservesAll();
+    MachineModulePass::getAnalysisUsage(AU);
+  }
+
+  virtual bool runOnMachineModule(const Module &M);
+};
+
+} // end anonymous namespace
+
+char PatmosSPCycleEstimator::ID = 0;
+
+ModulePass *
+llvm::createPatmosSPCycleEstimatorPass(const PatmosTargetMachine &tm) {
+  return new PatmosSPCycleEstimator(tm);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+
+bool PatmosSPCycleEstimator::runOnMachineModule(const Module &M) {
+  DEBUG( dbgs() << "[Single-Path] Estimate execution time\n");
+
+  MMI = &getAnalysis<MachineModuleInfo>();
+  assert(MMI);
+
+  LocalCycles.clear();
+  TotalCycles.clear();
+
+  // The loop info of a function is only valid until the loop info of the
+  // next function is requested, so collect the local cycles of all functions
+  // first and combine them afterwards.
+  for (Module::const_iterator F(M.begin()), FE(M.end()); F != FE; ++F) {
+    MachineFunction *MF = MMI->getMachineFunction(F);
+    if (!MF || !MF->getInfo<PatmosMachineFunctionInfo>()->isSinglePath())
+      continue;
+
+    computeLocalCycles(*MF, LocalCycles[MF]);
+  }
+
+  for (FunctionCyclesMap::iterator i = LocalCycles.begin(),
+       ie = LocalCycles.end(); i != ie; ++i)
+  {
+    const MachineFunction *MF = i->first;
+    int64_t Cycles = computeTotalCycles(MF);
+
+    PatmosMachineFunctionInfo *PMFI =
+      const_cast<MachineFunction*>(MF)->getInfo<PatmosMachineFunctionInfo>();
+    PMFI->setSinglePathCycles(Cycles);
+
+    if (Cycles >= 0) {
+      NumSPEstimated++; // bump STATISTIC
+    } else {
+      NumSPInexact++; // bump STATISTIC
+    }
+
+    if (ReportSPCycles) {
+      errs() << "[Single-Path] " << MF->getName() << ": ";
+      if (Cycles >= 0)
+        errs() << Cycles << " cycles\n";
+      else
+        errs() << "unknown cycles\n";
+    }
+  }
+
+  // only analysis results are stored, the code is not modified.
+  return false;
+}
+
+
+const MachineFunction *
+PatmosSPCycleEstimator::getCallTargetMF(const MachineInstr *MI) const {
+  const MachineOperand &MO = MI->getOperand(2);
+  const Function *Target = NULL;
+  if (MO.isGlobal()) {
+    Target = dyn_cast<Function>(MO.getGlobal());
+  } else if (MO.isSymbol()) {
+    const char *TargetName = MO.getSymbolName();
+    const Module *M = MI->getParent()->getParent()->getFunction()->getParent();
+    Target = M->getFunction(TargetName);
+  }
+  return Target ? MMI->getMachineFunction(Target) : NULL;
+}
+
+
+unsigned PatmosSPCycleEstimator::getStallCycles(const MachineInstr *MI) const {
+  if (MI->isBundle()) {
+    const MachineBasicBlock *MBB = MI->getParent();
+    MachineBasicBlock::const_instr_iterator I = MI, E = MBB->instr_end();
+    unsigned stall = 0;
+    while ((++I != E) && I->isInsideBundle()) {
+      stall = std::max(stall, getStallCycles(I));
+    }
+    return stall;
+  }
+
+  if (!(MI->isCall() || MI->isReturn() || MI->isBranch()) ||
+      MI->hasDelaySlot()) {
+    return 0;
+  }
+
+  switch (MI->getOpcode()) {
+  case Patmos::BRCFND:
+  case Patmos::BRCFNDu:
+  case Patmos::BRCFRND:
+  case Patmos::BRCFRNDu:
+  case Patmos::BRCFTND:
+  case Patmos::BRCFTNDu:
+    // the non-delayed variants of the non-local branches are treated as
+    // local branches by PatmosSubtarget::getDelaySlotCycles.
+    return STI.getCFLDelaySlotCycles(false);
+  default:
+    return STI.getDelaySlotCycles(MI);
+  }
+}
+
+
+int64_t
+PatmosSPCycleEstimator::getExecutionCount(const MachineLoop *Loop) const {
+  int64_t Count = 1;
+  for (; Loop; Loop = Loop->getParentLoop()) {
+    // scan the header for loopbound info
+    const MachineBasicBlock *Header = Loop->getHeader();
+    int64_t LoopBound = -1;
+    for (MachineBasicBlock::const_instr_iterator MI = Header->instr_begin(),
+         ME = Header->instr_end(); MI != ME; ++MI) {
+      if (MI->getOpcode() == Patmos::PSEUDO_LOOPBOUND) {
+        // max is the second operand (idx 1)
+        LoopBound = MI->getOperand(1).getImm() + 1;
+        break;
+      }
+    }
+    if (LoopBound < 0)
+      return -1;
+
+    Count *= LoopBound;
+  }
+  return Count;
+}
+
+
+void PatmosSPCycleEstimator::computeLocalCycles(MachineFunction &MF,
+                                                FunctionCycles &FC) {
+  DEBUG(dbgs() << "In function '" << MF.getName() << "':\n");
+
+  Function *F = const_cast<Function*>(MF.getFunction());
+  MachineLoopInfo &MLI = getAnalysis<MachineLoopInfo>(*F);
+
+  for (MachineFunction::iterator MBB = MF.begin(), MBBE = MF.end();
+       MBB != MBBE; ++MBB) {
+    int64_t Count = getExecutionCount(MLI.getLoopFor(MBB));
+    if (Count < 0) {
+      DEBUG(dbgs() << "  BB#" << MBB->getNumber() << ": no loop bound\n");
+      FC.Exact = false;
+      continue;
+    }
+
+    int64_t BlockCycles = 0;
+    for (MachineBasicBlock::iterator MI = MBB->begin(), ME = MBB->end();
+         MI != ME; ++MI) {
+      if (TII->isPseudo(MI))
+        continue;
+
+      if (MI->isInlineAsm()) {
+        FC.Exact = false;
+        continue;
+      }
+
+      BlockCycles += 1 + getStallCycles(MI);
+
+      // calls, also inside of bundles
+      MachineBasicBlock::instr_iterator II = MI.getInstrIterator(),
+                                        IE = MBB->instr_end();
+      do {
+        if (II->isCall()) {
+          const MachineFunction *Callee = getCallTargetMF(II);
+          if (Callee) {
+            FC.Calls[Callee] += Count;
+          } else {
+            DEBUG(dbgs() << "  BB#" << MBB->getNumber()
+                         << ": unknown callee\n");
+            FC.Exact = false;
+          }
+        }
+      } while (++II != IE && II->isInsideBundle());
+    }
+
+    DEBUG(dbgs() << "  BB#" << MBB->getNumber() << ": " << BlockCycles
+                 << " cycles x " << Count << "\n");
+    FC.Local += BlockCycles * Count;
+  }
+}
+
+
+int64_t
+PatmosSPCycleEstimator::computeTotalCycles(const MachineFunction *MF) {
+  std::map<const MachineFunction*, int64_t>::iterator it =
+    TotalCycles.find(MF);
+  if (it != TotalCycles.end())
+    return it->second;
+
+  // callees that are not single-path have no fixed execution time, recursive
+  // functions are reported as unknown as well.
+  TotalCycles[MF] = -1;
+
+  FunctionCyclesMap::const_iterator fc = LocalCycles.find(MF);
+  if (fc == LocalCycles.end() || !fc->second.Exact)
+    return -1;
+
+  int64_t Cycles = fc->second.Local;
+  for (std::map<const MachineFunction*, int64_t>::const_iterator
+       i = fc->second.Calls.begin(), ie = fc->second.Calls.end(); i != ie; ++i)
+  {
+    int64_t CalleeCycles = computeTotalCycles(i->first);
+    if (CalleeCycles < 0)
+      return -1;
+
+    Cycles += CalleeCycles * i->second;
+  }
+
+  TotalCycles[MF] = Cycles;
+  return Cycles;
+}
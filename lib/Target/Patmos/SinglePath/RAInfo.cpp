@@ -9,6 +9,18 @@
 //
 // The RAInfo class handles predicate register allocation for single-path code.
 //
+// Within a scope, predicate locations are assigned by a linear scan over the
+// blocks in topological order, spilling the predicates with the furthest next
+// use. Definitions on the exit edges of subscopes are executed in every
+// iteration of the subscope, so they are weighted by the subscope's loop bound
+// when deciding which predicates get a register.
+//
+// Across scopes, a subscope only has to preserve the registers of its parent
+// that hold predicates live across the subscope's position in the parent. It
+// avoids spilling the predicate register file if it fits into the registers
+// above them. Stack spill locations are only live while their scope executes,
+// so sibling scopes share the same spill locations.
+//
 //===----------------------------------------------------------------------===//
 #include "RAInfo.h"
 
@@ -27,6 +39,8 @@ STATISTIC( SPNumPredicates, "Number of predicates for single-path code");
 STATISTIC( PredSpillLocs, "Number of required spill bits for predicates");
 STATISTIC( NoSpillScopes,
                   "Number of SPScopes (loops) where S0 spill can be omitted");
+STATISTIC( ScopeSpillLocs,
+                  "Number of spill bits for predicates, summed over all scopes");
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -192,9 +206,15 @@ public:
   // The total number of predicate locations used by this instance.
   unsigned NumLocs;
 
-  // The maximum number of location used by any child.
+  // The maximum number of locations used by any child, including the
+  // registers of this instance that are live across the child.
   unsigned ChildrenMaxCumLocs;
 
+  /// The number of registers of this instance a child has to preserve, i.e.,
+  /// one past the highest register holding a predicate that is live across
+  /// the position of the child's header in this scope.
+  std::map<const SPScope*, unsigned> ChildRegBoundaries;
+
   /// The index of the first register this instance can use.
   /// The registers below the index are used by a parent scope.
   unsigned FirstUsableReg;
@@ -264,7 +284,47 @@ public:
 
   // getCumLocs - Get the maximum number of locations
   // used by this scope and any of its children
-  unsigned getCumLocs(void) const { return NumLocs + ChildrenMaxCumLocs; }
+  unsigned getCumLocs(void) const { return max(NumLocs, ChildrenMaxCumLocs); }
+
+  // getNumStackLocs - Get the number of stack spill locations used by this
+  // scope.
+  unsigned getNumStackLocs(void) const {
+    return NumLocs > MaxRegs ? NumLocs - MaxRegs : 0;
+  }
+
+  // getChildRegBoundary - Get the number of registers the given child has to
+  // preserve.
+  unsigned getChildRegBoundary(const SPScope *child) const {
+    auto found = ChildRegBoundaries.find(child);
+    return found != ChildRegBoundaries.end() ? found->second : NumLocs;
+  }
+
+  // getPositionWeight - Get how often the accesses at the given position are
+  // executed per execution of this scope. Definitions at the position of a
+  // subscope are on its exit edges and executed in every iteration of it.
+  unsigned getPositionWeight(PredicatedBlock *block) const {
+    if (Pub.Scope->isSubheader(block)) {
+      const SPScope *child = Pub.Scope->findScopeOf(block);
+      if (child->hasLoopBound()) {
+        return max(1u, child->getLoopBound());
+      }
+    }
+    return 1;
+  }
+
+  // getSpillCost - Get the weighted number of accesses to the predicate
+  // at or after the given position, which have to access the stack if the
+  // predicate is not assigned a register.
+  unsigned getSpillCost(unsigned pred, unsigned pos,
+                        const vector<PredicatedBlock*> &blocks) const {
+    const LiveRange &LR = LRs.at(pred);
+    unsigned cost = 0;
+    for (unsigned i = pos; i < blocks.size(); i++) {
+      if (LR.isUse(i)) cost++;
+      if (LR.isDef(i)) cost += getPositionWeight(blocks[i]);
+    }
+    return cost;
+  }
 
   void createLiveRanges(void) {
 
@@ -343,6 +403,13 @@ public:
 
         sortFurthestNextUse(i, order);
 
+        // If not all predicates get a register, prefer the ones accessed most
+        // often, e.g., those defined in loops, and then those used next.
+        std::stable_sort(order.begin(), order.end(),
+          [&](unsigned a, unsigned b){
+            return getSpillCost(a, i + 1, blocks) > getSpillCost(b, i + 1, blocks);
+          });
+
         // nearest use is in front
         for (auto pred: order) {
           Location l = getAvailLoc(FreeLocs);
@@ -362,6 +429,19 @@ public:
                         << DefLocs.at(pred).getLoc() << ", ");
         }
       }
+
+      // Record which registers are live across a subscope, the subscope may
+      // use all registers above
+      if (Pub.Scope->isSubheader(block)) {
+        unsigned boundary = 0;
+        for (auto curLoc: curLocs) {
+          if (curLoc.second.getType() == Register) {
+            boundary = max(boundary, curLoc.second.getLoc() + 1);
+          }
+        }
+        ChildRegBoundaries[Pub.Scope->findScopeOf(block)] = boundary;
+        DEBUG( dbgs() << "subscope boundary " << boundary << ", ");
+      }
       DEBUG(dbgs() << "\n");
     } // end of forall MBB
 
@@ -404,15 +484,20 @@ public:
 
   /// Unifies with parent, such that this RAInfo knows which registers it can use
   /// and where its spill slots are.
-  void unifyWithParent(const RAInfo::Impl &parent, int parentSpillLocCnt, bool topLevel){
+  void unifyWithParent(const RAInfo::Impl &parent, bool topLevel){
+
+      // The registers of the parent holding predicates that are live across
+      // this scope
+      unsigned parentRegs = parent.getChildRegBoundary(Pub.Scope);
 
       // We can avoid a spill if the total number of locations
-      // used by the parent, this instance, and any child is less
-      // than/equal to the number of registers available to the function.
-      if ( !topLevel && parent.NumLocs + getCumLocs() <= MaxRegs ) {
+      // used by the live registers of the parent, this instance, and any
+      // child is less than/equal to the number of registers available to the
+      // function.
+      if ( !topLevel && parentRegs + getCumLocs() <= MaxRegs ) {
 
         // Compute the first register not used by an ancestor.
-        FirstUsableReg = parent.FirstUsableReg + parent.NumLocs;
+        FirstUsableReg = parent.FirstUsableReg + parentRegs;
 
         // If the total number of locations the parent, myself, and my children need
         // are less than/equal to the number of available registers
@@ -420,15 +505,17 @@ public:
         NeedsScopeSpill = false;
       }
 
-    if (NumLocs > MaxRegs) {
-      FirstUsableStackSlot = parentSpillLocCnt;
-    }
+    // The stack spill locations of the ancestors are live during this scope,
+    // the ones of siblings are not.
+    FirstUsableStackSlot = parent.FirstUsableStackSlot
+                           + parent.getNumStackLocs();
   }
 
   /// Unifies with child, such that this RAInfo knows how many locations will
   /// be used by the given child.
   void unifyWithChild(const RAInfo::Impl &child){
-    ChildrenMaxCumLocs = max(child.getCumLocs(), ChildrenMaxCumLocs);
+    ChildrenMaxCumLocs = max(getChildRegBoundary(child.Pub.Scope)
+                             + child.getCumLocs(), ChildrenMaxCumLocs);
   }
 
   UseLoc calculateNotHeaderUseLoc(unsigned blockIndex, unsigned usePred,
@@ -739,7 +826,7 @@ std::map<const SPScope*, RAInfo> RAInfo::computeRegAlloc(SPScope *rootScope, uns
 
   // Visit all scopes in depth-first order to compute offsets:
   // - Offset is inherited during traversal
-  // - SpillOffset is assigned increased depth-first, from left to right
+  // - SpillOffset is inherited during traversal, siblings share locations
   unsigned spillLocCnt = 0;
   for (auto iter = df_begin(rootScope), end = df_end(rootScope);
         iter!=end; ++iter) {
@@ -747,10 +834,12 @@ std::map<const SPScope*, RAInfo> RAInfo::computeRegAlloc(SPScope *rootScope, uns
     RAInfo &RI = RAInfos.at(scope);
 
     if (!scope->isTopLevel()) {
-       RI.Priv->unifyWithParent(*(RAInfos.at(scope->getParent()).Priv), spillLocCnt, scope->isTopLevel());
+       RI.Priv->unifyWithParent(*(RAInfos.at(scope->getParent()).Priv), scope->isTopLevel());
       if (!RI.needsScopeSpill()) NoSpillScopes++; // STATISTIC
     }
-    spillLocCnt += RI.neededSpillLocs();
+    spillLocCnt = max(spillLocCnt,
+                      RI.Priv->FirstUsableStackSlot + RI.neededSpillLocs());
+    ScopeSpillLocs += RI.neededSpillLocs(); // STATISTIC
     DEBUG( RI.dump() );
   } // end df
 
@@ -7,17 +7,36 @@
 //
 //===----------------------------------------------------------------------===//
 //
+// List scheduler for single-path code.
+//
+// Single-path code has no branches that could hide latencies, every NOP is
+// executed on every run. The blocks produced by PatmosSPReduce are split into
+// regions at scheduling barriers and control-flow instructions. The
+// instructions of a region are list-scheduled on a dependence graph built from
+// the itineraries: loads and multiplies are followed by independent
+// instructions instead of NOPs, pairs of instructions are bundled if they can
+// be issued in the two slots (unless VLIW bundling is disabled), and the delay
+// slots of a region's control-flow instruction are filled with instructions
+// it does not depend on. NOPs are only inserted where no instruction is ready.
 //
 //===----------------------------------------------------------------------===//
 
 #include "SPScheduler.h"
 
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/MC/MCRegisterInfo.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Statistic.h"
 
+#include <algorithm>
+
 using namespace llvm;
 
 STATISTIC(SPInstructions,     "Number of instruction bundles in single-path code (both single and double)");
+STATISTIC(SPNops,             "Number of NOPs inserted into single-path code");
+STATISTIC(SPBundled,          "Number of instruction pairs bundled in single-path code");
+STATISTIC(SPFilledSlots,      "Number of delay slots filled in single-path code");
 
 char SPScheduler::ID = 0;
 
@@ -25,6 +44,37 @@ FunctionPass *llvm::createSPSchedulerPass(const PatmosTargetMachine &tm) {
   return new SPScheduler(tm);
 }
 
+namespace {
+  /// RegDef - The last definition of a register unit within a region.
+  struct RegDef {
+    unsigned Node;
+    const MachineInstr *MI;
+    int Idx;
+
+    RegDef() : Node(0), MI(NULL), Idx(-1) {}
+    RegDef(unsigned node, const MachineInstr *mi, int idx)
+    : Node(node), MI(mi), Idx(idx) {}
+  };
+
+  /// isControlFlow - Return true if the instruction or a bundled instruction
+  /// is a call, branch or return.
+  bool isControlFlow(const MachineInstr *MI) {
+    MachineBasicBlock::const_instr_iterator I = MI,
+                                            E = MI->getParent()->instr_end();
+    do {
+      if (I->isCall() || I->isBranch() || I->isReturn())
+        return true;
+    } while (++I != E && I->isBundledWithPred());
+    return false;
+  }
+
+  /// isZeroCycle - Return true if the instruction is not emitted.
+  bool isZeroCycle(const MachineInstr *MI) {
+    return MI->isDebugValue() || MI->isLabel() || MI->isKill() ||
+           MI->isImplicitDef();
+  }
+}
+
 bool SPScheduler::runOnMachineFunction(MachineFunction &mf){
 
   // Only schedule single-path function
@@ -37,17 +87,12 @@ bool SPScheduler::runOnMachineFunction(MachineFunction &mf){
   auto reduceAnalysis = &getAnalysis<PatmosSPReduce>();
   auto rootScope = reduceAnalysis->RootScope;
 
+  EnableBundling = STC.enableBundling(TM.getOptLevel());
+
   for(auto mbbIter = mf.begin(), mbbEnd = mf.end(); mbbIter != mbbEnd; mbbIter++){
     auto mbb = &(*mbbIter);
     DEBUG(dbgs() << "MBB: [" << mbb << "]: #" << mbb->getNumber() << "\n");
-    for(auto instrIter = mbb->begin(), instrEnd = mbb->end();
-        instrIter != instrEnd; instrIter++)
-    {
-      SPInstructions++;
-	  calculateLatency(instrIter);
-    }
-
-
+    scheduleBlock(*mbb);
   }
 
   DEBUG( dbgs() << "AFTER Single-Path Schedule\n"; mf.dump() );
@@ -58,30 +103,423 @@ bool SPScheduler::runOnMachineFunction(MachineFunction &mf){
   return true;
 }
 
-unsigned SPScheduler::calculateLatency(MachineBasicBlock::iterator instr){
-  auto instrInfo = TM.getInstrInfo();
-
-  auto mbb = instr->getParent();
-  if(instr->isBranch() || instr->isCall() || instr->isReturn()){
-    DEBUG(dbgs() << "Inserting 3xNOP after instruction: "; instr->print(dbgs(), NULL, false));
-
-    // We simply add 3 nops after any branch, call or return, as its
-    // the highest possible delay.
-    // The delay slot filler pass will remove most of these afterwards
-    instr++;
-    instrInfo->insertNoop(*mbb, instr);
-    instrInfo->insertNoop(*mbb, instr);
-    instrInfo->insertNoop(*mbb, instr);
-  } else if (instr->mayLoad() || (instr->getOpcode() == Patmos::MUL) || (instr->getOpcode() == Patmos::MULU)){
-    DEBUG(dbgs() << "Inserting NOP after instruction: "; instr->print(dbgs(), NULL, false));
-    instr++;
-    auto sizebefore = mbb->size();
-    instrInfo->insertNoop(*mbb, instr);
-    assert(mbb->size() == (sizebefore+1));
-    // TODO: make it cleverer, e.g. no reason for a nop
-    // if the next instruction does not use the loaded value.
+bool SPScheduler::isSchedulingBarrier(const MachineInstr *MI) const {
+  MachineBasicBlock::const_instr_iterator I = MI,
+                                          E = MI->getParent()->instr_end();
+  do {
+    if (I->isPseudo() || I->isInlineAsm() || TII->isStackControl(I))
+      return true;
+
+    // MTS/MFS are modeled as having side-effects in general
+    if (I->hasUnmodeledSideEffects() && !TII->isSideEffectFreeSRegAccess(I))
+      return true;
+  } while (++I != E && I->isBundledWithPred());
+  return false;
+}
+
+unsigned SPScheduler::getDefLatency(const MachineInstr *MI,
+                                    unsigned DefIdx) const {
+  if (!ItinData || ItinData->isEmpty())
+    return std::max(1u, TII->getInstrLatency(ItinData, MI));
+
+  // Registers are read in the first cycle at the earliest (GPRs through the
+  // bypass), so results are available one cycle before the write-back.
+  int Cycle = ItinData->getOperandCycle(MI->getDesc().getSchedClass(), DefIdx);
+  return Cycle > 1 ? Cycle - 1 : 1;
+}
+
+void SPScheduler::scheduleBlock(MachineBasicBlock &MBB) {
+  MachineBasicBlock::iterator Begin = MBB.begin(), I = MBB.begin(),
+                              E = MBB.end();
+  while (I != E) {
+    if (isControlFlow(I)) {
+      // The region includes the control-flow instruction and its delay slots
+      MachineBasicBlock::iterator Next = llvm::next(I);
+      SPInstructions += scheduleRegion(MBB, Begin, Next);
+      Begin = I = Next;
+    }
+    else if (isSchedulingBarrier(I)) {
+      SPInstructions += scheduleRegion(MBB, Begin, I);
+
+      // Keep the barrier in place and wait for its results.
+      unsigned Latency = 0;
+      if (!isZeroCycle(I)) {
+        MachineBasicBlock::instr_iterator J = I.getInstrIterator();
+        do {
+          for (unsigned i = 0, e = J->getNumOperands(); i != e; i++) {
+            const MachineOperand &MO = J->getOperand(i);
+            if (MO.isReg() && MO.isDef())
+              Latency = std::max(Latency, getDefLatency(J, i));
+          }
+        } while (++J != MBB.instr_end() && J->isBundledWithPred());
+        SPInstructions++;
+      }
+      ++I;
+      for (; Latency > 1; Latency--) {
+        TII->insertNoop(MBB, I);
+        SPNops++;
+        SPInstructions++;
+      }
+      Begin = I;
+    }
+    else {
+      ++I;
+    }
+  }
+  SPInstructions += scheduleRegion(MBB, Begin, E);
+}
+
+void SPScheduler::addEdge(SchedNodes &Nodes, unsigned Pred, unsigned Succ,
+                          unsigned Latency) const {
+  assert(Pred < Succ && "Dependence against program order.");
+  Nodes[Pred].Succs.push_back(std::make_pair(Succ, Latency));
+  Nodes[Succ].NumPreds++;
+}
+
+void SPScheduler::buildDAG(SchedNodes &Nodes) const {
+  const TargetRegisterInfo *TRI = TM.getRegisterInfo();
+
+  // The last definition and the uses since then for each register unit
+  DenseMap<unsigned, RegDef> Defs;
+  DenseMap<unsigned, std::vector<unsigned> > Uses;
+  std::vector<unsigned> MemNodes;
+
+  for (unsigned n = 0, e = Nodes.size(); n != e; n++) {
+    SchedNode &N = Nodes[n];
+
+    // Collect the register operands of the node. For calls and returns only
+    // the explicit operands are relevant, the implicit ones (arguments and
+    // return values) are accessed after the delay slots.
+    SmallVector<std::pair<MachineInstr*, int>, 8> UseOps, DefOps;
+    MachineBasicBlock::instr_iterator MI = N.MI,
+                                      ME = N.MI->getParent()->instr_end();
+    do {
+      unsigned NumOps = (MI->isCall() || MI->isReturn()) ?
+                        MI->getDesc().getNumOperands() : MI->getNumOperands();
+      for (unsigned i = 0; i != NumOps; i++) {
+        const MachineOperand &MO = MI->getOperand(i);
+        if (!MO.isReg() || !MO.getReg())
+          continue;
+        if (MO.isDef())
+          DefOps.push_back(std::make_pair(&*MI, i));
+        else
+          UseOps.push_back(std::make_pair(&*MI, i));
+      }
+      if (MI->isCall())   DefOps.push_back(std::make_pair(&*MI, -1));
+      if (MI->isReturn()) UseOps.push_back(std::make_pair(&*MI, -1));
+    } while (++MI != ME && MI->isBundledWithPred());
+
+    // All instructions of a node read their operands before any writes.
+    for (unsigned u = 0; u != UseOps.size(); u++) {
+      MachineInstr *UseMI = UseOps[u].first;
+      int UseIdx = UseOps[u].second;
+      unsigned Reg = UseIdx < 0 ? (unsigned)Patmos::SRB :
+                                  UseMI->getOperand(UseIdx).getReg();
+
+      for (MCRegUnitIterator Unit(Reg, TRI); Unit.isValid(); ++Unit) {
+        DenseMap<unsigned, RegDef>::iterator D = Defs.find(*Unit);
+        if (D != Defs.end() && D->second.Node != n) {
+          const RegDef &Def = D->second;
+          int Latency = -1;
+          if (Def.Idx >= 0 && UseIdx >= 0) {
+            Latency = TII->getOperandLatency(ItinData, Def.MI, Def.Idx,
+                                             UseMI, UseIdx);
+          }
+          if (Latency < 0) {
+            Latency = Def.Idx >= 0 ? getDefLatency(Def.MI, Def.Idx) : 1;
+          }
+          addEdge(Nodes, Def.Node, n, std::max(Latency, 1));
+        }
+        Uses[*Unit].push_back(n);
+      }
+    }
+
+    for (unsigned d = 0; d != DefOps.size(); d++) {
+      MachineInstr *DefMI = DefOps[d].first;
+      int DefIdx = DefOps[d].second;
+      unsigned Reg = DefIdx < 0 ? (unsigned)Patmos::SRB :
+                                  DefMI->getOperand(DefIdx).getReg();
+
+      for (MCRegUnitIterator Unit(Reg, TRI); Unit.isValid(); ++Unit) {
+        // Output dependence: write after the previous result is written.
+        DenseMap<unsigned, RegDef>::iterator D = Defs.find(*Unit);
+        if (D != Defs.end() && D->second.Node != n) {
+          const RegDef &Def = D->second;
+          addEdge(Nodes, Def.Node, n,
+                  Def.Idx >= 0 ? getDefLatency(Def.MI, Def.Idx) : 1);
+        }
+
+        // Anti dependence: a bundle reads its operands before writing.
+        std::vector<unsigned> &UnitUses = Uses[*Unit];
+        for (unsigned u = 0; u != UnitUses.size(); u++) {
+          if (UnitUses[u] != n)
+            addEdge(Nodes, UnitUses[u], n, 0);
+        }
+        UnitUses.clear();
+
+        Defs[*Unit] = RegDef(n, DefMI, DefIdx);
+      }
+    }
+
+    // Loads may pass each other, everything else stays in order.
+    if (N.IsLoad || N.IsStore) {
+      for (unsigned m = 0; m != MemNodes.size(); m++) {
+        if (N.IsStore || Nodes[MemNodes[m]].IsStore)
+          addEdge(Nodes, MemNodes[m], n, 1);
+      }
+      MemNodes.push_back(n);
+    }
+  }
+
+  // Compute the length of the critical path to the end of the region
+  for (unsigned n = Nodes.size(); n-- > 0; ) {
+    SchedNode &N = Nodes[n];
+    N.Height = N.IsControlFlow ? N.DelaySlots + 1 : N.ExitLatency;
+    for (unsigned s = 0; s != N.Succs.size(); s++) {
+      N.Height = std::max(N.Height,
+                          N.Succs[s].second + Nodes[N.Succs[s].first].Height);
+    }
+  }
+}
+
+void SPScheduler::scheduleNode(SchedNodes &Nodes, unsigned Node,
+                               unsigned Cycle) const {
+  SchedNode &N = Nodes[Node];
+  assert(!N.Scheduled && N.NumPreds == 0 && N.Earliest <= Cycle);
+  N.Scheduled = true;
+  N.Cycle = Cycle;
+
+  for (unsigned s = 0; s != N.Succs.size(); s++) {
+    SchedNode &Succ = Nodes[N.Succs[s].first];
+    Succ.NumPreds--;
+    Succ.Earliest = std::max(Succ.Earliest, Cycle + N.Succs[s].second);
+  }
+}
+
+bool SPScheduler::canFillDelaySlot(const SchedNode &Node,
+                                   const SchedNode &CFL) const {
+  // Same restrictions as in the delay slot filler: no long-latency multiplies,
+  // and only single-issue 32bit instructions for calls.
+  if (TII->hasOpcode(Node.MI, Patmos::MUL) ||
+      TII->hasOpcode(Node.MI, Patmos::MULU))
+    return false;
+
+  if (CFL.MI->isCall() &&
+      (Node.IsBundle || TII->getInstrSize(Node.MI) != 4))
+    return false;
+
+  return true;
+}
+
+namespace {
+  /// Order delay slot fillers by decreasing exit latency.
+  template<typename NodesT>
+  struct ExitLatencyOrder {
+    const NodesT &Nodes;
+    ExitLatencyOrder(const NodesT &nodes) : Nodes(nodes) {}
+    bool operator()(unsigned A, unsigned B) const {
+      return Nodes[A].ExitLatency > Nodes[B].ExitLatency;
+    }
+  };
+}
+
+bool SPScheduler::fillDelaySlots(SchedNodes &Nodes, unsigned CFL,
+                                 unsigned Cycle, Schedule &S) const {
+  const SchedNode &C = Nodes[CFL];
+  if (C.NumPreds != 0 || C.Earliest > Cycle)
+    return false;
+
+  // Code following the region starts after the delay slots, all results
+  // have to be available by then.
+  unsigned End = Cycle + C.DelaySlots + 1;
+
+  std::vector<unsigned> Fillers;
+  for (unsigned n = 0, e = Nodes.size(); n != e; n++) {
+    const SchedNode &N = Nodes[n];
+    if (n == CFL)
+      continue;
+    if (N.Scheduled) {
+      if (N.Cycle + N.ExitLatency > End)
+        return false;
+    }
+    else {
+      // Remaining nodes must not depend on each other.
+      if (N.NumPreds != 0 || !canFillDelaySlot(N, C))
+        return false;
+      Fillers.push_back(n);
+    }
+  }
+
+  if (Fillers.size() > C.DelaySlots)
+    return false;
+
+  std::stable_sort(Fillers.begin(), Fillers.end(),
+                   ExitLatencyOrder<SchedNodes>(Nodes));
+
+  for (unsigned i = 0; i != Fillers.size(); i++) {
+    const SchedNode &N = Nodes[Fillers[i]];
+    unsigned Slot = Cycle + 1 + i;
+    if (N.Earliest > Slot || Slot + N.ExitLatency > End)
+      return false;
   }
+
+  scheduleNode(Nodes, CFL, Cycle);
+  S.push_back(std::make_pair((int)CFL, -1));
+  for (unsigned i = 0; i != C.DelaySlots; i++) {
+    if (i < Fillers.size()) {
+      scheduleNode(Nodes, Fillers[i], Cycle + 1 + i);
+      S.push_back(std::make_pair((int)Fillers[i], -1));
+      SPFilledSlots++;
+    }
+    else {
+      S.push_back(std::make_pair(-1, -1));
+    }
+  }
+  return true;
+}
+
+bool SPScheduler::canPair(const SchedNode &First, const SchedNode &Second,
+                          bool &Swap) const {
+  if (First.IsBundle || Second.IsBundle ||
+      First.IsControlFlow || Second.IsControlFlow)
+    return false;
+
+  if (TII->getIssueWidth(First.MI) > 1 || TII->getIssueWidth(Second.MI) > 1)
+    return false;
+
+  if (TII->canIssueInSlot(First.MI, 0) && TII->canIssueInSlot(Second.MI, 1)) {
+    Swap = false;
+    return true;
+  }
+  if (TII->canIssueInSlot(Second.MI, 0) && TII->canIssueInSlot(First.MI, 1)) {
+    Swap = true;
+    return true;
+  }
+  return false;
 }
 
+unsigned SPScheduler::scheduleRegion(MachineBasicBlock &MBB,
+                                     MachineBasicBlock::iterator Begin,
+                                     MachineBasicBlock::iterator End) {
+  if (Begin == End)
+    return 0;
+
+  SchedNodes Nodes;
+  for (MachineBasicBlock::iterator I = Begin; I != End; ++I) {
+    SchedNode N(I);
+    N.IsBundle = I->isBundledWithSucc();
 
+    MachineBasicBlock::instr_iterator MI = I.getInstrIterator();
+    do {
+      if (MI->isCall() || MI->isBranch() || MI->isReturn()) {
+        N.IsControlFlow = true;
+        N.DelaySlots = std::max(N.DelaySlots, STC.getDelaySlotCycles(MI));
+      }
+      else {
+        N.IsLoad |= MI->mayLoad();
+        N.IsStore |= MI->mayStore() || MI->hasOrderedMemoryRef();
+      }
+      for (unsigned i = 0, e = MI->getNumOperands(); i != e; i++) {
+        const MachineOperand &MO = MI->getOperand(i);
+        if (MO.isReg() && MO.isDef())
+          N.ExitLatency = std::max(N.ExitLatency, getDefLatency(MI, i));
+      }
+    } while (++MI != MBB.instr_end() && MI->isBundledWithPred());
 
+    assert((!N.IsControlFlow || llvm::next(I) == End) &&
+           "Control-flow instruction inside a scheduling region.");
+    Nodes.push_back(N);
+  }
+
+  buildDAG(Nodes);
+
+  int CFL = Nodes.back().IsControlFlow ? (int)Nodes.size() - 1 : -1;
+
+  Schedule S;
+  unsigned Remaining = Nodes.size();
+  for (unsigned Cycle = 0; Remaining > 0; Cycle++) {
+    if (CFL >= 0 && fillDelaySlots(Nodes, CFL, Cycle, S))
+      break;
+
+    // Pick the ready node with the longest path to the end of the region.
+    int First = -1;
+    for (unsigned n = 0, e = Nodes.size(); n != e; n++) {
+      const SchedNode &N = Nodes[n];
+      if ((int)n == CFL || N.Scheduled || N.NumPreds != 0 || N.Earliest > Cycle)
+        continue;
+      if (First < 0 || N.Height > Nodes[First].Height)
+        First = n;
+    }
+
+    if (First < 0) {
+      S.push_back(std::make_pair(-1, -1));
+      continue;
+    }
+
+    scheduleNode(Nodes, First, Cycle);
+    Remaining--;
+
+    // Try to find a node for the second slot.
+    int Second = -1;
+    bool Swap = false;
+    if (EnableBundling) {
+      for (unsigned n = 0, e = Nodes.size(); n != e; n++) {
+        const SchedNode &N = Nodes[n];
+        bool SwapN;
+        if ((int)n == CFL || N.Scheduled || N.NumPreds != 0 ||
+            N.Earliest > Cycle || !canPair(Nodes[First], N, SwapN))
+          continue;
+        if (Second < 0 || N.Height > Nodes[Second].Height) {
+          Second = n;
+          Swap = SwapN;
+        }
+      }
+    }
+
+    if (Second >= 0) {
+      scheduleNode(Nodes, Second, Cycle);
+      Remaining--;
+      S.push_back(Swap ? std::make_pair(Second, First) :
+                         std::make_pair(First, Second));
+    } else {
+      S.push_back(std::make_pair(First, -1));
+    }
+  }
+
+  // Wait for all results before leaving the region, unless this has been
+  // ensured by the delay slots already.
+  if (CFL < 0) {
+    unsigned Ready = 0;
+    for (unsigned n = 0, e = Nodes.size(); n != e; n++) {
+      Ready = std::max(Ready, Nodes[n].Cycle + Nodes[n].ExitLatency);
+    }
+    while (S.size() < Ready) {
+      S.push_back(std::make_pair(-1, -1));
+    }
+  }
+
+  // Reorder the instructions according to the schedule.
+  for (Schedule::iterator I = S.begin(), E = S.end(); I != E; ++I) {
+    if (I->first < 0) {
+      assert(I->second < 0);
+      TII->insertNoop(MBB, End);
+      SPNops++;
+      continue;
+    }
+
+    MBB.splice(End, &MBB, MachineBasicBlock::iterator(Nodes[I->first].MI));
+    if (I->second >= 0) {
+      MachineInstr *MI = Nodes[I->second].MI;
+      MBB.splice(End, &MBB, MachineBasicBlock::iterator(MI));
+      MI->bundleWithPred();
+      SPBundled++;
+    }
+  }
+
+  DEBUG({
+    dbgs() << "Scheduled region of " << Nodes.size() << " nodes in "
+           << S.size() << " cycles\n";
+  });
+
+  return S.size();
+}
@@ -18,6 +18,8 @@
 #include "PatmosTargetMachine.h"
 #include "PatmosSPReduce.h"
 
+#include <vector>
+
 #define DEBUG_TYPE "patmos-singlepath"
 
 namespace llvm{
@@ -28,7 +30,10 @@ public:
   static char ID;
 
   SPScheduler(const PatmosTargetMachine &tm):
-    MachineFunctionPass(ID), TM(tm)
+    MachineFunctionPass(ID), TM(tm),
+    STC(tm.getSubtarget<PatmosSubtarget>()),
+    TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())),
+    ItinData(tm.getInstrItineraryData())
   {}
 
   // Override MachineFunctionPass::runOnMachineFunction
@@ -48,15 +53,102 @@ public:
 private:
 
   const PatmosTargetMachine &TM;
-
-  /// Calculates the latency that must be observed between these two instructions.
-  /// E.g. if the first instruction loads a value into a register and the
-  /// second instruction uses that value the latency is 1, and there must be at
-  /// least 1 cycle between the two instructions.
-  /// If the instructions are part of bundles, the whole bundle is taken into
-  /// account.
-  unsigned calculateLatency(MachineBasicBlock::iterator);
-
+  const PatmosSubtarget &STC;
+  const PatmosInstrInfo *TII;
+  const InstrItineraryData *ItinData;
+
+  /// Whether instructions may be paired into bundles.
+  bool EnableBundling;
+
+  /// SchedNode - An instruction or a bundle formed before scheduling (e.g.,
+  /// by PatmosSPBundling) that is scheduled as a unit.
+  struct SchedNode {
+    /// The (first) instruction of the node.
+    MachineInstr *MI;
+
+    /// Successors of the node and the latency of the dependence.
+    std::vector<std::pair<unsigned, unsigned> > Succs;
+
+    /// Number of predecessors that are not yet scheduled.
+    unsigned NumPreds;
+
+    /// Earliest cycle at which all dependences to scheduled predecessors
+    /// are satisfied.
+    unsigned Earliest;
+
+    /// Length of the longest latency path to the end of the region.
+    unsigned Height;
+
+    /// Cycle the node is scheduled in.
+    unsigned Cycle;
+
+    /// Number of cycles until all results of the node are available to any
+    /// instruction following the region.
+    unsigned ExitLatency;
+
+    /// Number of delay slot cycles of a control-flow node, 0 otherwise.
+    unsigned DelaySlots;
+
+    bool IsBundle, IsControlFlow, IsLoad, IsStore, Scheduled;
+
+    SchedNode(MachineInstr *mi) : MI(mi), NumPreds(0), Earliest(0),
+      Height(0), Cycle(0), ExitLatency(1), DelaySlots(0), IsBundle(false),
+      IsControlFlow(false), IsLoad(false), IsStore(false), Scheduled(false)
+    {}
+  };
+
+  typedef std::vector<SchedNode> SchedNodes;
+
+  /// A cycle of the schedule, i.e., the nodes issued in the first and second
+  /// slot, or -1 if the slot is empty.
+  typedef std::vector<std::pair<int, int> > Schedule;
+
+  /// isSchedulingBarrier - Return true if instructions must not be moved
+  /// across the instruction (or bundle).
+  bool isSchedulingBarrier(const MachineInstr *MI) const;
+
+  /// getDefLatency - Return the number of cycles after which the value
+  /// defined by the given operand can be read by any instruction.
+  unsigned getDefLatency(const MachineInstr *MI, unsigned DefIdx) const;
+
+  /// scheduleBlock - Schedule all regions between scheduling barriers and
+  /// control-flow instructions of the basic block.
+  void scheduleBlock(MachineBasicBlock &MBB);
+
+  /// scheduleRegion - List-schedule the instructions in [Begin, End), and
+  /// reorder them, form bundles and insert NOPs to honor the latencies.
+  /// If the region ends with a control-flow instruction, its delay slots
+  /// are filled with independent instructions of the region.
+  /// Returns the number of cycles of the region.
+  unsigned scheduleRegion(MachineBasicBlock &MBB,
+                          MachineBasicBlock::iterator Begin,
+                          MachineBasicBlock::iterator End);
+
+  /// buildDAG - Create the dependence graph of the region's nodes.
+  void buildDAG(SchedNodes &Nodes) const;
+
+  /// addEdge - Add a dependence between two nodes of the region.
+  void addEdge(SchedNodes &Nodes, unsigned Pred, unsigned Succ,
+               unsigned Latency) const;
+
+  /// scheduleNode - Mark the node as scheduled in the given cycle, and
+  /// release its successors.
+  void scheduleNode(SchedNodes &Nodes, unsigned Node, unsigned Cycle) const;
+
+  /// canFillDelaySlot - Return true if the node may be placed in a delay slot
+  /// of the given control-flow node.
+  bool canFillDelaySlot(const SchedNode &Node, const SchedNode &CFL) const;
+
+  /// fillDelaySlots - Try to issue the control-flow node CFL of the region in
+  /// the given cycle, placing all remaining nodes into its delay slots.
+  /// Returns false, without modifying the schedule, if this is not possible.
+  bool fillDelaySlots(SchedNodes &Nodes, unsigned CFL, unsigned Cycle,
+                      Schedule &S) const;
+
+  /// canPair - Return true if the two nodes can be issued in the same cycle,
+  /// Swap is set if the second node has to go into the first slot.
+  bool canPair(const SchedNode &First, const SchedNode &Second,
+               bool &Swap) const;
 };
 
 }
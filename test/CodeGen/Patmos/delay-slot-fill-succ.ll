@@ -0,0 +1,61 @@
+; REQUIRES: asserts
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -mpatmos-disable-post-ra \
+; RUN:     | FileCheck %s
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -mpatmos-disable-post-ra \
+; RUN:     -mpatmos-disable-delay-filler-succ | FileCheck %s --check-prefix=NOSUCC
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -mpatmos-disable-post-ra \
+; RUN:     -print-machineinstrs -o /dev/null 2>&1 | FileCheck %s --check-prefix=MI
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -mpatmos-disable-post-ra \
+; RUN:     -stats -o /dev/null 2>&1 | FileCheck %s --check-prefix=STATS
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that the delay slot filler fills the delay slot of a conditional branch
+; with the first instruction of the branch target when the branch block has no
+; filler left. The instruction is moved out of the target block and is guarded
+; by the branch predicate, which the branch therefore must not kill.
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+; CHECK-LABEL: f:
+; CHECK: cmple [[P:\$p[0-9]]] = $r3, $r4
+; CHECK-NEXT: ( [[P]]) br [[ELSE:.LBB[0-9_]+]]
+; CHECK-NEXT: sws
+; CHECK-NEXT: ( [[P]]) sub $r3 = $r4, 3
+; CHECK: call foo
+; CHECK: [[ELSE]]:
+; CHECK-NEXT: callnd bar
+
+; NOSUCC-LABEL: f:
+; NOSUCC: br [[ELSE:.LBB[0-9_]+]]
+; NOSUCC-NEXT: nop
+; NOSUCC-NEXT: sws
+; NOSUCC: [[ELSE]]:
+; NOSUCC-NEXT: call bar
+; NOSUCC: sub $r3 = $r4, 3
+
+; MI: # After PreEmit passes:
+; MI: BR pred:[[P:%P[0-9]]], pred:0, <BB#{{[0-9]+}}>
+; MI-NEXT: SWS
+; MI-NEXT: SUBi pred:[[P]], pred:0,
+
+; STATS: 1 delay-slot-filler - Number of NOPs avoided by filling from successors
+
+declare void @foo(i32)
+declare void @bar(i32)
+
+define void @f(i32 %x, i32 %y) {
+entry:
+  %c = icmp sgt i32 %x, %y
+  br i1 %c, label %then, label %else
+
+then:
+  %a = add i32 %x, 7
+  call void @foo(i32 %a)
+  ret void
+
+else:
+  %b = sub i32 %y, 3
+  call void @bar(i32 %b)
+  ret void
+}
@@ -0,0 +1,101 @@
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 | FileCheck %s
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-memop-inline-words=31 | FileCheck %s --check-prefix=THRESHOLD
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test the inline expansion of memcpy: word-aligned copies of constant size up
+; to -mpatmos-memop-inline-words words are expanded into unrolled loads and
+; stores, larger ones into a copy loop with a constant trip count, followed by
+; the copy of the remaining words, halfword and byte. Unaligned copies and
+; copies of variable size are left to the library.
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+declare void @llvm.memcpy.p0i8.p0i8.i32(i8* nocapture, i8* nocapture readonly, i32, i32, i1)
+
+; 32 words are unrolled.
+; CHECK-LABEL: unrolled:
+; CHECK-NOT: call
+; CHECK-NOT: br
+; CHECK-DAG: lwc $r{{[0-9]+}} = [$r4 + 31]
+; CHECK-DAG: swc [$r3 + 31] = $r{{[0-9]+}}
+; CHECK: ret
+; CHECK-LABEL: .size unrolled
+
+; Below the threshold, the same copy is expanded into a loop.
+; THRESHOLD-LABEL: unrolled:
+; THRESHOLD: li [[CNT:\$r[0-9]+]] = 8
+; THRESHOLD: [[LOOP:.LBB[0-9_]+]]:
+; THRESHOLD-SAME: Loop bound: [7, 7]
+; THRESHOLD: br [[LOOP]]
+; THRESHOLD-NOT: lwc
+; THRESHOLD: ret
+; THRESHOLD-LABEL: .size unrolled
+define void @unrolled(i8* %d, i8* %s) {
+entry:
+  call void @llvm.memcpy.p0i8.p0i8.i32(i8* %d, i8* %s, i32 128, i32 4, i1 false)
+  ret void
+}
+
+; 33 words are copied by 8 iterations of 4 words and a remaining word.
+; CHECK-LABEL: loop:
+; CHECK: li [[CNT:\$r[0-9]+]] = 8
+; CHECK: [[LOOP:.LBB[0-9_]+]]:
+; CHECK-SAME: Loop bound: [7, 7]
+; CHECK-DAG: lwc $r{{[0-9]+}} = [$r{{[0-9]+}} + 3]
+; CHECK-DAG: sub [[CNT]] = [[CNT]], 1
+; CHECK-DAG: cmpneq [[P:\$p[0-9]+]] = [[CNT]], 0
+; CHECK: ( [[P]]) br [[LOOP]]
+; CHECK-DAG: swc [$r{{[0-9]+}} + 3] = $r{{[0-9]+}}
+; CHECK-DAG: lwc $r{{[0-9]+}} = [$r4 + 32]
+; CHECK-DAG: swc [$r3 + 32] = $r{{[0-9]+}}
+; CHECK-DAG: ret
+; CHECK-NOT: call
+; CHECK-LABEL: .size loop
+define void @loop(i8* %d, i8* %s) {
+entry:
+  call void @llvm.memcpy.p0i8.p0i8.i32(i8* %d, i8* %s, i32 132, i32 4, i1 false)
+  ret void
+}
+
+; 263 bytes are copied by 16 iterations, a word, a halfword and a byte.
+; CHECK-LABEL: loop_remainder:
+; CHECK: li [[CNT:\$r[0-9]+]] = 16
+; CHECK: [[LOOP:.LBB[0-9_]+]]:
+; CHECK-SAME: Loop bound: [15, 15]
+; CHECK: br [[LOOP]]
+; CHECK-DAG: lwc $r{{[0-9]+}} = [$r4 + 64]
+; CHECK-DAG: swc [$r3 + 64] = $r{{[0-9]+}}
+; CHECK-DAG: lhuc
+; CHECK-DAG: shc
+; CHECK-DAG: lbuc
+; CHECK-DAG: sbc
+; CHECK-DAG: ret
+; CHECK-NOT: call
+; CHECK-LABEL: .size loop_remainder
+define void @loop_remainder(i8* %d, i8* %s) {
+entry:
+  call void @llvm.memcpy.p0i8.p0i8.i32(i8* %d, i8* %s, i32 263, i32 4, i1 false)
+  ret void
+}
+
+; CHECK-LABEL: unaligned:
+; CHECK-NOT: lwc
+; CHECK: call memcpy
+; CHECK-LABEL: .size unaligned
+define void @unaligned(i8* %d, i8* %s) {
+entry:
+  call void @llvm.memcpy.p0i8.p0i8.i32(i8* %d, i8* %s, i32 256, i32 1, i1 false)
+  ret void
+}
+
+; CHECK-LABEL: variable:
+; CHECK-NOT: lwc
+; CHECK: call memcpy
+; CHECK-LABEL: .size variable
+define void @variable(i8* %d, i8* %s, i32 %n) {
+entry:
+  call void @llvm.memcpy.p0i8.p0i8.i32(i8* %d, i8* %s, i32 %n, i32 4, i1 false)
+  ret void
+}
@@ -0,0 +1,103 @@
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 | FileCheck %s
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-memop-inline-words=30 | FileCheck %s --check-prefix=THRESHOLD
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test the inline expansion of memset: word-aligned memsets of constant size up
+; to -mpatmos-memop-inline-words words are expanded into unrolled stores,
+; larger ones into a store loop with a constant trip count, followed by the
+; stores of the remaining words, halfword and byte. The byte is replicated
+; into a word, by a multiplication if it is not a constant. Unaligned memsets
+; and memsets of variable size are left to the library.
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+declare void @llvm.memset.p0i8.i32(i8* nocapture, i8, i32, i32, i1)
+
+; 31 words, a halfword and a byte exceed MaxStoresPerMemset and are unrolled.
+; CHECK-LABEL: unrolled:
+; CHECK-NOT: call
+; CHECK-NOT: br
+; CHECK-DAG: li [[V:\$r[0-9]+]] = 117901063
+; CHECK-DAG: swc [$r3 + 30] = [[V]]
+; CHECK-DAG: swc [$r3] = [[V]]
+; CHECK-DAG: shc
+; CHECK-DAG: sbc
+; CHECK-DAG: ret
+; CHECK-LABEL: .size unrolled
+
+; Above the threshold, the same memset is expanded into a loop of 7
+; iterations, followed by 3 words, a halfword and a byte.
+; THRESHOLD-LABEL: unrolled:
+; THRESHOLD: [[LOOP:.LBB[0-9_]+]]:
+; THRESHOLD-SAME: Loop bound: [6, 6]
+; THRESHOLD: br [[LOOP]]
+; THRESHOLD-DAG: swc [$r3 + 30] = $r{{[0-9]+}}
+; THRESHOLD-DAG: swc [$r3 + 28] = $r{{[0-9]+}}
+; THRESHOLD-DAG: shc
+; THRESHOLD-DAG: sbc
+; THRESHOLD-DAG: ret
+; THRESHOLD-LABEL: .size unrolled
+define void @unrolled(i8* %d) {
+entry:
+  call void @llvm.memset.p0i8.i32(i8* %d, i8 7, i32 127, i32 4, i1 false)
+  ret void
+}
+
+; 256 bytes are set by 16 iterations of 4 words, without a remainder.
+; CHECK-LABEL: loop:
+; CHECK-DAG: and [[B:\$r[0-9]+]] = $r4, 255
+; CHECK-DAG: li [[M:\$r[0-9]+]] = 16843009
+; CHECK: mul [[B]], [[M]]
+; CHECK: mfs [[V:\$r[0-9]+]] = $s2
+; CHECK: [[LOOP:.LBB[0-9_]+]]:
+; CHECK-SAME: Loop bound: [15, 15]
+; CHECK: swc [$r3] = [[V]]
+; CHECK: br [[LOOP]]
+; CHECK: add $r3 = $r3, 16
+; CHECK-NOT: swc
+; CHECK: ret
+; CHECK-LABEL: .size loop
+define void @loop(i8* %d, i8 %v) {
+entry:
+  call void @llvm.memset.p0i8.i32(i8* %d, i8 %v, i32 256, i32 4, i1 false)
+  ret void
+}
+
+; 263 bytes are set by 16 iterations, a word, a halfword and a byte.
+; CHECK-LABEL: loop_remainder:
+; CHECK: [[LOOP:.LBB[0-9_]+]]:
+; CHECK-SAME: Loop bound: [15, 15]
+; CHECK: br [[LOOP]]
+; CHECK-DAG: swc [$r3 + 64] = $r{{[0-9]+}}
+; CHECK-DAG: shc
+; CHECK-DAG: sbc
+; CHECK-DAG: ret
+; CHECK-NOT: call
+; CHECK-LABEL: .size loop_remainder
+define void @loop_remainder(i8* %d) {
+entry:
+  call void @llvm.memset.p0i8.i32(i8* %d, i8 0, i32 263, i32 4, i1 false)
+  ret void
+}
+
+; CHECK-LABEL: unaligned:
+; CHECK-NOT: swc
+; CHECK: call memset
+; CHECK-LABEL: .size unaligned
+define void @unaligned(i8* %d) {
+entry:
+  call void @llvm.memset.p0i8.i32(i8* %d, i8 0, i32 256, i32 2, i1 false)
+  ret void
+}
+
+; CHECK-LABEL: variable:
+; CHECK-NOT: swc
+; CHECK: call memset
+; CHECK-LABEL: .size variable
+define void @variable(i8* %d, i32 %n) {
+entry:
+  call void @llvm.memset.p0i8.i32(i8* %d, i8 0, i32 %n, i32 4, i1 false)
+  ret void
+}
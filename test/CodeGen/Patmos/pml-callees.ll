@@ -0,0 +1,67 @@
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -o /dev/null \
+; RUN:     -mimport-pml=%p/Inputs/indirect-callees.pml -mserialize=%t.pml
+; RUN: FileCheck %s < %t.pml
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -o /dev/null \
+; RUN:     -mserialize=%t.unknown.pml
+; RUN: FileCheck %s --check-prefix=UNKNOWN < %t.unknown.pml
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that the targets of indirect calls are taken from the callees of an
+; imported bitcode PML. The function pointers are loaded from external globals,
+; so the targets cannot be found on the IR. Without the PML, the callees are
+; unknown and a, b and c are not exported as reachable from main.
+;
+; The call sites of the PML are matched by their position among the calls of
+; the block, not by their instruction index: the imported PML was exported
+; from a version of main with more instructions before each call.
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+; CHECK: machine-functions:
+; CHECK: mapsto: main
+; CHECK: opcode: CALLR
+; CHECK-NEXT: callees: [ a, b ]
+; CHECK: opcode: CALLR
+; CHECK-NEXT: callees: [ c ]
+; CHECK-DAG: mapsto: a
+; CHECK-DAG: mapsto: b
+; CHECK-DAG: mapsto: c
+
+; UNKNOWN: machine-functions:
+; UNKNOWN: mapsto: main
+; UNKNOWN: opcode: CALLR
+; UNKNOWN-NEXT: callees: [ __any__ ]
+; UNKNOWN: opcode: CALLR
+; UNKNOWN-NEXT: callees: [ __any__ ]
+; UNKNOWN-NOT: mapsto: a
+
+@fp = external global i32 (i32)*
+@gp = external global i32 (i32)*
+
+define i32 @a(i32 %x) {
+entry:
+  %y = add i32 %x, 1
+  ret i32 %y
+}
+
+define i32 @b(i32 %x) {
+entry:
+  %y = mul i32 %x, 3
+  ret i32 %y
+}
+
+define i32 @c(i32 %x) {
+entry:
+  %y = sub i32 %x, 7
+  ret i32 %y
+}
+
+define i32 @main() {
+entry:
+  %f = load i32 (i32)** @fp
+  %r = call i32 %f(i32 5)
+  %g = load i32 (i32)** @gp
+  %s = call i32 %g(i32 %r)
+  ret i32 %s
+}
@@ -0,0 +1,42 @@
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -mpatmos-disable-vliw \
+; RUN:     -mpatmos-enable-bypass-from-pml \
+; RUN:     -mimport-pml=%p/Inputs/bypass-from-pml.pml \
+; RUN:     -mimport-pml-write-index=%t.idx -o %t.yaml.s
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -mpatmos-disable-vliw \
+; RUN:     -mpatmos-enable-bypass-from-pml -mimport-pml=%t.idx -o %t.idx.s
+; RUN: FileCheck %s < %t.yaml.s
+; RUN: FileCheck %s < %t.idx.s
+; RUN: diff %t.yaml.s %t.idx.s
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that a PML index written by -mimport-pml-write-index holds the same
+; PML as the imported file: the value fact with the wide address range of the
+; load in the loop makes the load bypass the data cache in both cases.
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+; CHECK-LABEL: sum:
+; CHECK: lwm
+; CHECK-NOT: lwc
+; CHECK: ret
+
+@buf = global [16 x i32] zeroinitializer
+
+define i32 @sum() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s.next, %loop ]
+  %p = getelementptr [16 x i32]* @buf, i32 0, i32 %i
+  %v = load i32* %p
+  %s.next = add i32 %s, %v
+  %i.next = add i32 %i, 1
+  %c = icmp slt i32 %i.next, 16
+  br i1 %c, label %loop, label %exit
+
+exit:
+  ret i32 %s.next
+}
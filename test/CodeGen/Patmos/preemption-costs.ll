@@ -0,0 +1,100 @@
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-enable-stack-cache-analysis -mpatmos-sca-preemption \
+; RUN:     -mpatmos-emit-preemption-note -mserialize=%t.pml | FileCheck %s
+; RUN: FileCheck %s --check-prefix=PML < %t.pml
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -filetype=obj \
+; RUN:     -mpatmos-enable-stack-cache-analysis -mpatmos-sca-preemption \
+; RUN:     -mpatmos-emit-preemption-note -o %t.o
+; RUN: llvm-readobj -s -r %t.o | FileCheck %s --check-prefix=OBJ
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test the export of the stack cache preemption costs: the PML gets a
+; preemption-costs entry for the entry of each basic block and for each call,
+; and the ELF note lists the address of each block and call with the bytes to
+; save and to restore.
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+; The call is labeled, and the note has an entry for the block and the call.
+; CHECK-LABEL: main:
+; CHECK: [[BLOCK:.Ltmp[0-9]+]]:
+; CHECK-NEXT: sres
+; CHECK: [[CALL:.Ltmp[0-9]+]]:
+; CHECK-NEXT: call{{(nd)?}} leaf
+; CHECK: .section .note.patmos.preemption,"",@note
+; CHECK-NEXT: .align 4
+; CHECK-NEXT: .word 7
+; CHECK-NEXT: .word 24
+; CHECK-NEXT: .word 1
+; CHECK-NEXT: .ascii "Patmos"
+; CHECK-NEXT: .byte 0
+; CHECK-NEXT: .align 4
+; CHECK-NEXT: .word [[BLOCK]]
+; CHECK-NEXT: .word {{[0-9]+}}
+; CHECK-NEXT: .word {{[0-9]+}}
+; CHECK-NEXT: .word [[CALL]]
+; CHECK-NEXT: .word {{[0-9]+}}
+; CHECK-NEXT: .word {{[0-9]+}}
+; CHECK-NEXT: .text
+
+; PML: preemption-costs:
+; PML: - reference:
+; PML-NEXT: function: [[MAIN:[0-9]+]]
+; PML-NEXT: block: 0
+; PML-NEXT: origin: llvm.sca
+; PML-NEXT: saving:
+; PML-NEXT: restoring:
+; PML-NEXT: restoring-explicit:
+; PML-NEXT: local-ensure:
+; PML-NEXT: global-ensure:
+; PML-NEXT: reserve-gain:
+; PML-NEXT: - reference:
+; PML-NEXT: function: [[MAIN]]
+; PML-NEXT: block: 0
+; PML-NEXT: instruction: {{[0-9]+}}
+; PML-NEXT: origin: llvm.sca
+; PML-NEXT: saving:
+; PML-NEXT: restoring:
+; PML-NEXT: restoring-explicit: 0
+; PML-NEXT: local-ensure:
+; PML-NEXT: global-ensure:
+; PML-NEXT: reserve-gain: 0
+
+; OBJ: Name: .note.patmos.preemption
+; OBJ-NEXT: Type: SHT_NOTE
+; OBJ: .rel.note.patmos.preemption {
+; OBJ-NEXT: R_PATMOS_ABS_32 .Ltmp{{[0-9]+}}
+; OBJ-NEXT: R_PATMOS_ABS_32 .Ltmp{{[0-9]+}}
+; OBJ-NEXT: R_PATMOS_ABS_32 .Ltmp{{[0-9]+}}
+; OBJ-NEXT: R_PATMOS_ABS_32 .Ltmp{{[0-9]+}}
+; OBJ-NEXT: R_PATMOS_ABS_32 .Ltmp{{[0-9]+}}
+; OBJ-NEXT: }
+
+define i32 @leaf(i32 %x) {
+entry:
+  %a = alloca [8 x i32]
+  %p = getelementptr [8 x i32]* %a, i32 0, i32 0
+  store i32 %x, i32* %p
+  %q = getelementptr [8 x i32]* %a, i32 0, i32 3
+  %v = load volatile i32* %q
+  ret i32 %v
+}
+
+define i32 @main() {
+entry:
+  %a = alloca [4 x i32]
+  %p = getelementptr [4 x i32]* %a, i32 0, i32 1
+  store volatile i32 1, i32* %p
+  %r = call i32 @leaf(i32 5)
+  %v = load volatile i32* %p
+  %s = add i32 %r, %v
+  ret i32 %s
+}
+
+; The stack cache analysis starts from _start.
+define void @_start() {
+entry:
+  %r = call i32 @main()
+  ret void
+}
@@ -0,0 +1,91 @@
+; RUN: rm -rf %t && mkdir -p %t/single %t/threads
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -o /dev/null \
+; RUN:     -mserialize=%t/export.pml
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -o /dev/null \
+; RUN:     -mserialize=%t/single/export.pml -mserialize-shards
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -o /dev/null \
+; RUN:     -mserialize=%t/threads/export.pml -mserialize-shards \
+; RUN:     -mpatmos-serialize-threads=4
+; RUN: FileCheck %s < %t/threads/export.pml
+; RUN: diff -r %t/single %t/threads
+; RUN: grep -v -e '^---$' -e '^\.\.\.$' -e '^[a-z-]*:' %t/export.pml | \
+; RUN:     sort > %t/export.sorted
+; RUN: cat %t/threads/export.*.pml | \
+; RUN:     grep -v -e '^---$' -e '^\.\.\.$' -e '^[a-z-]*:' | sort > %t/shards.sorted
+; RUN: diff %t/export.sorted %t/shards.sorted
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that the sharded PML export is the same whether the shards are written
+; by one or by several threads, and that the shards together contain the same
+; PML as the export to a single file.
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+; CHECK: format: pml-0.1-manifest
+; CHECK: shards:
+; CHECK-DAG: function: a
+; CHECK-DAG: file: export.a.pml
+; CHECK-DAG: function: b
+; CHECK-DAG: file: export.b.pml
+; CHECK-DAG: function: c
+; CHECK-DAG: file: export.c.pml
+; CHECK-DAG: function: d
+; CHECK-DAG: file: export.d.pml
+; CHECK-DAG: function: main
+; CHECK-DAG: file: export.main.pml
+
+@buf = global [16 x i32] zeroinitializer
+
+define i32 @a() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s.next, %loop ]
+  %p = getelementptr [16 x i32]* @buf, i32 0, i32 %i
+  %v = load i32* %p
+  %s.next = add i32 %s, %v
+  %i.next = add i32 %i, 1
+  %c = icmp slt i32 %i.next, 16
+  br i1 %c, label %loop, label %exit
+
+exit:
+  ret i32 %s.next
+}
+
+define i32 @b(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 0
+  br i1 %c, label %then, label %else
+
+then:
+  %y = mul i32 %x, 3
+  ret i32 %y
+
+else:
+  ret i32 0
+}
+
+define i32 @c(i32 %x) {
+entry:
+  %y = call i32 @b(i32 %x)
+  %z = add i32 %y, 1
+  ret i32 %z
+}
+
+define void @d(i32 %x) {
+entry:
+  %p = getelementptr [16 x i32]* @buf, i32 0, i32 3
+  store i32 %x, i32* %p
+  ret void
+}
+
+define i32 @main() {
+entry:
+  %r = call i32 @a()
+  %s = call i32 @c(i32 %r)
+  call void @d(i32 %s)
+  ret i32 %s
+}
@@ -0,0 +1,54 @@
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -o /dev/null \
+; RUN:     -mserialize=%t.pml
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 -o /dev/null \
+; RUN:     -mserialize=%t.streamed.pml -mserialize-streaming
+; RUN: FileCheck %s < %t.pml
+; RUN: FileCheck %s < %t.streamed.pml
+; RUN: grep -v -e '^---$' -e '^\.\.\.$' -e '^[a-z-]*:' %t.pml | sort > %t.sorted
+; RUN: grep -v -e '^---$' -e '^\.\.\.$' -e '^[a-z-]*:' %t.streamed.pml | \
+; RUN:     sort > %t.streamed.sorted
+; RUN: diff %t.sorted %t.streamed.sorted
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that -mserialize-streaming exports the same PML as the export of the
+; whole module. The streamed export writes a document per function, so the
+; outputs are compared without the document separators and headers.
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+; CHECK-DAG: machine-functions:
+; CHECK-DAG: mapsto: sum
+; CHECK-DAG: mapsto: main
+; CHECK-DAG: variable: mem-address-read
+; CHECK-DAG: bitcode-functions:
+; CHECK-DAG: callees: [ sum ]
+; CHECK-DAG: flowfacts:
+; CHECK-DAG: loop: loop
+; CHECK-DAG: relation-graphs:
+
+@buf = global [16 x i32] zeroinitializer
+
+define i32 @sum() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s.next, %loop ]
+  %p = getelementptr [16 x i32]* @buf, i32 0, i32 %i
+  %v = load i32* %p
+  %s.next = add i32 %s, %v
+  %i.next = add i32 %i, 1
+  %c = icmp slt i32 %i.next, 16
+  br i1 %c, label %loop, label %exit
+
+exit:
+  ret i32 %s.next
+}
+
+define i32 @main() {
+entry:
+  %r = call i32 @sum()
+  ret i32 %r
+}
@@ -0,0 +1,74 @@
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-singlepath=sp_func,sp_loop -mpatmos-sp-report-cycles \
+; RUN:     -o /dev/null 2>&1 | FileCheck %s
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-singlepath=sp_func,sp_loop -o /dev/null \
+; RUN:     -mserialize=%t.pml -mserialize-roots=sp_func,sp_loop
+; RUN: FileCheck %s --check-prefix=PML < %t.pml
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test the execution time of single-path functions computed by the single-path
+; cycle estimator, and its export to the PML.
+;
+; sp_func is a single block of 11 bundles ending in a non-delayed return,
+; which stalls for 3 cycles. sp_loop has an entry of 6 bundles, a loop body of
+; 8 bundles executed 4 times (the loop bound plus one) and an exit of 5
+; bundles ending in a non-delayed return: 6 + 4 * 8 + 5 + 3 = 46 cycles.
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+; CHECK-DAG: [Single-Path] sp_func: 14 cycles
+; CHECK-DAG: [Single-Path] sp_loop: 46 cycles
+
+; PML: timing:
+; PML-NEXT: - origin: llvm.sp
+; PML-NEXT: level: machinecode
+; PML-NEXT: scope:
+; PML-NEXT: function: 0
+; PML-NEXT: cycles: 14
+; PML-NEXT: - origin: llvm.sp
+; PML-NEXT: level: machinecode
+; PML-NEXT: scope:
+; PML-NEXT: function: 1
+; PML-NEXT: cycles: 46
+
+@_1 = global i32 1
+
+define i32 @sp_func(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 5
+  br i1 %c, label %then, label %end
+
+then:
+  %v = load volatile i32* @_1
+  %a = add i32 %x, %v
+  br label %end
+
+end:
+  %r = phi i32 [ %a, %then ], [ %x, %entry ]
+  ret i32 %r
+}
+
+define i32 @sp_loop(i32 %x) {
+entry:
+  br label %for.cond
+
+for.cond:
+  %result.0 = phi i32 [ 0, %entry ], [ %add, %for.body ]
+  %i.0 = phi i32 [ 0, %entry ], [ %inc, %for.body ]
+  call void @llvm.loopbound(i32 0, i32 3)
+  %cmp = icmp slt i32 %i.0, %x
+  br i1 %cmp, label %for.body, label %for.end
+
+for.body:
+  %0 = load volatile i32* @_1
+  %add = add nsw i32 %result.0, %0
+  %inc = add nsw i32 %i.0, 1
+  br label %for.cond
+
+for.end:
+  ret i32 %result.0
+}
+
+declare void @llvm.loopbound(i32, i32)
@@ -0,0 +1,60 @@
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-spm-alloc-size=64 -mpatmos-disable-delay-filler \
+; RUN:     -mpatmos-disable-vliw | FileCheck %s
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that the scratchpad allocation copies the initial values of globals
+; in front of all accesses of main, also if the first instruction of main
+; accesses an allocated global and is rewritten, and if the bitcast and
+; lifetime marker of an allocated stack object follow the allocas.
+; The following is the equivalent C code:
+;
+; static int g[4] = {1, 2, 3, 4};
+;
+; int main(){
+; 	volatile int buf[4];
+; 	g[0] = 0;
+; 	buf[1] = 5;
+; 	return ((volatile int*)g)[1] + buf[1];
+; }
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+@g = internal global [4 x i32] [i32 1, i32 2, i32 3, i32 4], align 4
+
+; The initial value of g is copied word by word from the data cache to the
+; start of the scratchpad, before g[0] is overwritten.
+; CHECK-LABEL: main:
+; CHECK: [[LOOP:\.LBB[0-9]+_[0-9]+]]:
+; CHECK: lwc $r{{[0-9]+}} = [$r{{[0-9]+}}
+; CHECK-DAG: swl [$r{{[0-9]+}}] = $r{{[0-9]+}}
+; CHECK-DAG: br [[LOOP]]
+; CHECK: %spm.entry
+
+; The accesses of g and buf (placed behind g) use the scratchpad.
+; CHECK-DAG: swl [0] = $r{{[0-9]+}}
+; CHECK-DAG: swl [5] = $r{{[0-9]+}}
+; CHECK-DAG: lwl $r{{[0-9]+}} = [1]
+; CHECK-DAG: lwl $r{{[0-9]+}} = [5]
+; CHECK-NOT: lwc
+; CHECK-NOT: swc
+; CHECK: ret
+define i32 @main() {
+entry:
+  %buf = alloca [4 x i32], align 4
+  store i32 0, i32* getelementptr inbounds ([4 x i32]* @g, i32 0, i32 0), align 4
+  %0 = bitcast [4 x i32]* %buf to i8*
+  call void @llvm.lifetime.start(i64 16, i8* %0)
+  %arrayidx = getelementptr inbounds [4 x i32]* %buf, i32 0, i32 1
+  store volatile i32 5, i32* %arrayidx, align 4
+  %1 = load volatile i32* getelementptr inbounds ([4 x i32]* @g, i32 0, i32 1), align 4
+  %2 = load volatile i32* %arrayidx, align 4
+  %add = add nsw i32 %1, %2
+  call void @llvm.lifetime.end(i64 16, i8* %0)
+  ret i32 %add
+}
+
+declare void @llvm.lifetime.start(i64, i8* nocapture)
+
+declare void @llvm.lifetime.end(i64, i8* nocapture)
@@ -0,0 +1,44 @@
+; REQUIRES: asserts
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-enable-stack-cache-placement | FileCheck %s
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-enable-stack-cache-placement -stats -o /dev/null 2>&1 | \
+; RUN:     FileCheck %s --check-prefix=STATS
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that the ensure following a call is removed when nothing of the stack
+; frame is accessed before the next ensure.
+; The following is the equivalent C code:
+;
+; void f(void);
+; void g(void);
+;
+; int main(){
+; 	f();
+; 	g();
+; 	return 0;
+; }
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+; CHECK-LABEL: main:
+; CHECK: sres
+; CHECK: call{{(nd)?}} f
+; CHECK-NOT: sens
+; CHECK: call{{(nd)?}} g
+; CHECK: sens
+; CHECK-DAG: sfree
+; CHECK-DAG: ret
+define i32 @main() {
+entry:
+  call void @f()
+  call void @g()
+  ret i32 0
+}
+
+declare void @f()
+
+declare void @g()
+
+; STATS: patmos-stack-cache-placement - SENS instructions removed (dead).
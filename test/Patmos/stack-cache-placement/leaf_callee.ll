@@ -0,0 +1,55 @@
+; REQUIRES: asserts
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-enable-stack-cache-placement | FileCheck %s
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-enable-stack-cache-placement -stats -o /dev/null 2>&1 | \
+; RUN:     FileCheck %s --check-prefix=STATS
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that the ensure following a call is removed when the callee and all
+; functions reachable from it fit into the stack cache together with the live
+; area of the caller, i.e., when the callee cannot evict the caller's frame.
+; The following is the equivalent C code:
+;
+; volatile int v;
+;
+; __attribute__((noinline))
+; int leaf(int x){
+; 	return x + 1;
+; }
+;
+; int main(){
+; 	v = leaf(v);
+; 	return 0;
+; }
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+@v = global i32 0, align 4
+
+; The leaf does not reserve any stack cache space.
+; CHECK-LABEL: leaf:
+; CHECK-NOT: sres
+; CHECK: ret
+define i32 @leaf(i32 %x) noinline {
+entry:
+  %add = add nsw i32 %x, 1
+  ret i32 %add
+}
+
+; CHECK-LABEL: main:
+; CHECK: sres
+; CHECK: call{{(nd)?}} leaf
+; CHECK-NOT: sens
+; CHECK-DAG: sfree
+; CHECK-DAG: ret
+define i32 @main() {
+entry:
+  %0 = load volatile i32* @v, align 4
+  %call = call i32 @leaf(i32 %0)
+  store volatile i32 %call, i32* @v, align 4
+  ret i32 0
+}
+
+; STATS: patmos-stack-cache-placement - SENS instructions removed (callee fits into the stack cache).
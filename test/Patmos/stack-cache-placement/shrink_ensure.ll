@@ -0,0 +1,101 @@
+; REQUIRES: asserts
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-enable-stack-cache-placement \
+; RUN:     -mpatmos-stack-cache-block-size=4 | FileCheck %s
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-enable-stack-cache-placement \
+; RUN:     -mpatmos-stack-cache-block-size=4 -stats -o /dev/null 2>&1 | \
+; RUN:     FileCheck %s --check-prefix=STATS
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that an ensure is shrunk to the live area of the stack frame, i.e., to
+; the part of the frame accessed before the next ensure. More values are live
+; across the call of f than there are callee-saved registers, such that some
+; are spilled. Only their spill slots are reloaded between the calls, while
+; the callee-saved registers placed behind them are only restored after the
+; call of g.
+; The following is the equivalent C code:
+;
+; volatile int a[16];
+; int f(void);
+; void g(int);
+;
+; int main(){
+; 	int v0 = a[0], v1 = a[1], ..., v15 = a[15];
+; 	int r = f();
+; 	g((v0 ^ r) + (v1 ^ r) + ... + (v15 ^ r));
+; 	return 0;
+; }
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+@a = global [16 x i32] zeroinitializer, align 4
+
+; CHECK-LABEL: main:
+; CHECK: sres [[FRAME:[0-9]+]]
+; CHECK: call{{(nd)?}} f
+; CHECK: sens 8
+; CHECK: call{{(nd)?}} g
+; CHECK: sens [[FRAME]]
+; CHECK-DAG: sfree [[FRAME]]
+; CHECK-DAG: ret
+define i32 @main() {
+entry:
+  %v0 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 0), align 4
+  %v1 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 1), align 4
+  %v2 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 2), align 4
+  %v3 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 3), align 4
+  %v4 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 4), align 4
+  %v5 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 5), align 4
+  %v6 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 6), align 4
+  %v7 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 7), align 4
+  %v8 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 8), align 4
+  %v9 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 9), align 4
+  %v10 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 10), align 4
+  %v11 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 11), align 4
+  %v12 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 12), align 4
+  %v13 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 13), align 4
+  %v14 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 14), align 4
+  %v15 = load volatile i32* getelementptr inbounds ([16 x i32]* @a, i32 0, i32 15), align 4
+  %r = call i32 @f()
+  %x0 = xor i32 %v0, %r
+  %x1 = xor i32 %v1, %r
+  %x2 = xor i32 %v2, %r
+  %x3 = xor i32 %v3, %r
+  %x4 = xor i32 %v4, %r
+  %x5 = xor i32 %v5, %r
+  %x6 = xor i32 %v6, %r
+  %x7 = xor i32 %v7, %r
+  %x8 = xor i32 %v8, %r
+  %x9 = xor i32 %v9, %r
+  %x10 = xor i32 %v10, %r
+  %x11 = xor i32 %v11, %r
+  %x12 = xor i32 %v12, %r
+  %x13 = xor i32 %v13, %r
+  %x14 = xor i32 %v14, %r
+  %x15 = xor i32 %v15, %r
+  %s1 = add i32 %x0, %x1
+  %s2 = add i32 %s1, %x2
+  %s3 = add i32 %s2, %x3
+  %s4 = add i32 %s3, %x4
+  %s5 = add i32 %s4, %x5
+  %s6 = add i32 %s5, %x6
+  %s7 = add i32 %s6, %x7
+  %s8 = add i32 %s7, %x8
+  %s9 = add i32 %s8, %x9
+  %s10 = add i32 %s9, %x10
+  %s11 = add i32 %s10, %x11
+  %s12 = add i32 %s11, %x12
+  %s13 = add i32 %s12, %x13
+  %s14 = add i32 %s13, %x14
+  %s15 = add i32 %s14, %x15
+  call void @g(i32 %s15)
+  ret i32 0
+}
+
+declare i32 @f()
+
+declare void @g(i32)
+
+; STATS: patmos-stack-cache-placement - SENS instructions shrunk to the live area.
@@ -0,0 +1,62 @@
+; REQUIRES: asserts
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-enable-stack-cache-placement \
+; RUN:     -mpatmos-disable-delay-filler | FileCheck %s
+; RUN: llc < %s -mtriple=patmos-unknown-unknown-elf -O2 \
+; RUN:     -mpatmos-enable-stack-cache-placement -stats -o /dev/null 2>&1 | \
+; RUN:     FileCheck %s --check-prefix=STATS
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that the ensure following a call within a loop is sunk out of the loop
+; into the loop exit, where the stack frame is accessed again.
+; The following is the equivalent C code:
+;
+; volatile int n;
+; void f(void);
+;
+; int main(){
+; 	int i = 0, e = n;
+; 	do {
+; 		f();
+; 		i++;
+; 	} while (i < e);
+; 	return i;
+; }
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+@n = global i32 0, align 4
+
+; The delay slot filler is disabled to keep the ensure in the exit block behind
+; the branch of the loop, i.e., out of the branch's delay slots.
+; CHECK-LABEL: main:
+; CHECK: sres
+; CHECK: [[LOOP:\.LBB[0-9]+_[0-9]+]]:
+; CHECK: call{{(nd)?}} f
+; CHECK-NOT: sens
+; CHECK: br{{(nd)?}} [[LOOP]]
+; CHECK-NOT: sens
+; CHECK: %exit
+; CHECK: sens
+; CHECK-DAG: sfree
+; CHECK-DAG: ret
+define i32 @main() {
+entry:
+  %e = load volatile i32* @n, align 4
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inc, %loop ]
+  call void @f()
+  %inc = add nsw i32 %i, 1
+  %cmp = icmp slt i32 %inc, %e
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  ret i32 %inc
+}
+
+declare void @f()
+
+; STATS: patmos-stack-cache-placement - SENS instructions sunk into successors.
@@ -0,0 +1,153 @@
+#!/bin/bash
+# Ensures that a program, when compiled with dual-issue (VLIW) scheduling,
+# produces the same output as when compiled for single-issue, and that it
+# does not take more cycles to execute.
+#
+# The program is expected to be in LLVM IR. The script will compile it twice,
+# once with the default settings and once with '-mpatmos-disable-vliw',
+# run both executables using 'pasim' once for each execution argument, and
+# compare the cycles spent in the given function.
+#
+# usage:
+# It takes >= 6 arguments:
+#	1. The path to LLVM's binary folder. E.g. '$t-crest-home/llvm/build/bin'.
+#		May contain a '.'. If so, everything after (and including) the '.' is ignored.
+#		This allows the use of llvm-lit's substition, where 'llc' will give the correct path.
+#		The llvm binary folder must be exactly 3 levels below '$t-crest-home', otherwise the script
+#		will fail.
+#	2. Additional build arguments for llc, used for both builds. E.g. '-O2'.
+#		Must be exactly 1 argument to the script, so multiple arguments
+#		should be wrapped in quotes. If no arguments are needed, "" must be used.
+#	3. The path to the source program to test.
+#	4. The function to run statistics on.
+#	5. The path to the directory containing newlib and compiler-rt object files to
+#		link with the program. If empty (I.e. ""), uses the default location used
+#		when the the machine has been setup using 'misc/build.sh'.
+#	>5. a list of execution arguments.
+#		Each execution argument has the input to send to the program through stdin
+#		and the expected output of the program (on stdout), separated by '='.
+#		E.g '1=2' will run the program, send it '1' through the stdin and ensure
+#		that the program outputs '2' on stdout.
+#
+# Requirements:
+#	Same as for '../singlepath/assert_singlepath.sh': 'pasim' and 'patmos-ld'
+#	must be discoverable on the path and the 'local' directory created by
+#	'build.sh' of the patmos-misc repository must be next to LLVM.
+#
+# Notes:
+#	For each .ll test file, a folder will be created by this script
+#	(named the same as the test file without .ll) that contains temporary files.
+#
+
+# Reads pasim's statistics from stdin and prints the cycle count of the
+# function the statistics were collected for.
+read -r -d '' python_pasim_cycles << EndOfPython
+import fileinput
+
+for line in fileinput.input():
+	if line.strip().startswith("Cycles:"):
+		print(line.split()[1])
+		break
+else:
+	raise ValueError("No pasim statistics given.")
+EndOfPython
+
+# Executes the given program (arg 1), running statistics on the given function (arg 2).
+# Argument 3 is the execution argument (see top of file for description).
+# Tests that the output of the program matches the expected output. If not, reports an error.
+# Returns the cycle count of the function.
+execute_and_count(){
+	input=${3%%=*}
+	expected_out=${3#*=}
+
+	# See '../singlepath/assert_singlepath.sh' for an explanation of this line.
+	. <({ pasim_stats=$({ actual_out=$(echo "$input" | pasim "$1" --print-stats "$2" -V -D ideal); pasim_return_code=$?; } 2>&1; declare -p actual_out pasim_return_code>&2); declare -p pasim_stats; } 2>&1)
+
+	if [ "$expected_out" != "$actual_out" ]; then
+		(>&2 echo "The execution of '$1' for input '$input' gave the wrong output.")
+		(>&2 echo "Expected: '$expected_out', actual: '$actual_out'")
+		if [ $pasim_return_code -ne 0 ] ; then
+			(>&2 echo "$pasim_stats")
+		fi
+		return 1
+	fi
+
+	cycles=$(echo "$pasim_stats" | python3 -c "$python_pasim_cycles" 2> /dev/null)
+	if [ $? -ne 0 ]; then
+		(>&2 echo "Failed to read the cycle count of '$2' from the run of '$1'.")
+		(>&2 echo "$pasim_stats")
+		return 1
+	fi
+	echo "$cycles"
+	return 0
+}
+
+# Compiles the linked program (arg 1) to the executable (arg 2), passing the
+# remaining arguments to llc.
+compile(){
+	out="$2"
+	linked="$1"
+	shift 2
+	$bin_dir/llc $linked $llc_args "$@" -filetype=obj -o $out.o &> $out.debug
+	if [ $? -ne 0 ]; then
+		echo "Failed to compile '$linked' with '$llc_args $@'."
+		return 1
+	fi
+	patmos-ld -nostdlib -static --defsym __heap_start=end --defsym __heap_end=0x100000 --defsym _shadow_stack_base=0x1f8000 --defsym _stack_cache_base=0x200000 -o $out $out.o
+	if [ $? -ne 0 ]; then
+		echo "Failed to generate executable from '$out.o'."
+		return 1
+	fi
+	$bin_dir/llvm-objdump -d $out > $out-objdump.asm
+}
+
+#------------------------------------ Start of script execution -----------------------------------
+
+if ! [ -x "$(command -v patmos-ld)" ] ; then
+	echo "Patmos port of the Gold linker 'patmos-ld' could not be found."
+	exit 1
+fi
+if ! [ -x "$(command -v pasim)" ] ; then
+	echo "Patmos simulator 'pasim' could not be found."
+	exit 1
+fi
+if [ $# -lt 6 ]; then
+	echo "Must have at least 1 execution argument."
+	exit 1
+fi
+
+bin_dir=(${1//./ })
+llc_args="$2"
+bitcode="$3"
+function="$4"
+link_libs_dir=${5:-$bin_dir../../../local/patmos-unknown-unknown-elf/lib}
+
+generated_dir=${bitcode%.ll}
+mkdir -p $generated_dir
+generated_prefix="$generated_dir/${generated_dir##*/}"
+linked="$generated_prefix.link"
+
+$bin_dir/llvm-link -nostdlib -L$link_libs_dir/ $link_libs_dir/crt0.o $link_libs_dir/crtbegin.o $bitcode $link_libs_dir/libcsyms.o -lc -lpatmos $link_libs_dir/librtsfsyms.o -lrtsf $link_libs_dir/librtsyms.o -lrt $link_libs_dir/crtend.o -o $linked
+if [ $? -ne 0 ]; then
+	echo "Failed to link '$bitcode'."
+	exit 1
+fi
+
+compile $linked $generated_prefix-dual || exit 1
+compile $linked $generated_prefix-single -mpatmos-disable-vliw || exit 1
+
+ret_code=0
+for i in "${@:6}"
+do
+	dual=$(execute_and_count "$generated_prefix-dual" "$function" "$i") || ret_code=1
+	single=$(execute_and_count "$generated_prefix-single" "$function" "$i") || ret_code=1
+	if [ $ret_code -ne 0 ]; then
+		break
+	fi
+	if [ $dual -gt $single ]; then
+		echo "Dual-issue code of '$function' took $dual cycles for '$i', single-issue code only $single cycles."
+		ret_code=1
+	fi
+done
+
+exit $ret_code
@@ -0,0 +1,62 @@
+; RUN: %p/assert_vliw.sh llc -O2 %s vliw_func %LINK_LIBS 1=41 5=65
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that independent arithmetic operations are scheduled into both slots
+; without changing the result.
+; The following is the equivalent C code:
+; #include <stdio.h>
+;
+; volatile int _a = 3;
+; volatile int _b = 7;
+;
+; int vliw_func(int x){
+; 	int a = _a, b = _b;
+; 	int s = (x + a) + (x - b) + (x << 2) + (x | b) + (a ^ b) + (b << 2);
+; 	return s;
+; }
+;
+; int main(){
+; 	int x;
+; 	scanf("%d", &x);
+; 	printf("%d\n", vliw_func(x));
+; }
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+@_a = global i32 3
+@_b = global i32 7
+@.str = private unnamed_addr constant [3 x i8] c"%d\00"
+@.str1 = private unnamed_addr constant [4 x i8] c"%d\0A\00"
+
+define i32 @vliw_func(i32 %x)  {
+entry:
+  %a = load volatile i32* @_a
+  %b = load volatile i32* @_b
+  %add = add nsw i32 %x, %a
+  %sub = sub nsw i32 %x, %b
+  %shl = shl i32 %x, 2
+  %or = or i32 %x, %b
+  %xor = xor i32 %a, %b
+  %shl1 = shl i32 %b, 2
+  %s1 = add nsw i32 %add, %sub
+  %s2 = add nsw i32 %shl, %or
+  %s3 = add nsw i32 %xor, %shl1
+  %s4 = add nsw i32 %s1, %s2
+  %s = add nsw i32 %s4, %s3
+  ret i32 %s
+}
+
+define i32 @main()  {
+entry:
+  %x = alloca i32
+  %call = call i32 (i8*, ...)* @scanf(i8* getelementptr inbounds ([3 x i8]* @.str, i32 0, i32 0), i32* %x)
+  %0 = load i32* %x
+  %call1 = call i32 @vliw_func(i32 %0)
+  %call2 = call i32 (i8*, ...)* @printf(i8* getelementptr inbounds ([4 x i8]* @.str1, i32 0, i32 0), i32 %call1)
+  ret i32 0
+}
+
+declare i32 @scanf(i8*, ...)
+
+declare i32 @printf(i8*, ...)
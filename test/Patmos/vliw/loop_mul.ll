@@ -0,0 +1,67 @@
+; RUN: %p/assert_vliw.sh llc -O2 %s vliw_func %LINK_LIBS 0=0 4=14 10=285
+; END.
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+;
+; Test that a loop with loads, multiplications and a loop-carried sum is
+; scheduled into both slots, across the delay slots of the loop branch,
+; without changing the result.
+; The following is the equivalent C code:
+; #include <stdio.h>
+;
+; volatile int _arr[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+;
+; int vliw_func(int n){
+; 	int sum = 0;
+; 	for(int i = 0; i < n; i++){
+; 		int v = _arr[i];
+; 		sum += v * v;
+; 	}
+; 	return sum;
+; }
+;
+; int main(){
+; 	int x;
+; 	scanf("%d", &x);
+; 	printf("%d\n", vliw_func(x));
+; }
+;
+;//////////////////////////////////////////////////////////////////////////////////////////////////
+
+@_arr = global [10 x i32] [i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7, i32 8, i32 9]
+@.str = private unnamed_addr constant [3 x i8] c"%d\00"
+@.str1 = private unnamed_addr constant [4 x i8] c"%d\0A\00"
+
+define i32 @vliw_func(i32 %n)  {
+entry:
+  %cmp4 = icmp sgt i32 %n, 0
+  br i1 %cmp4, label %for.body, label %for.end
+
+for.body:                                         ; preds = %entry, %for.body
+  %i.06 = phi i32 [ %inc, %for.body ], [ 0, %entry ]
+  %sum.05 = phi i32 [ %add, %for.body ], [ 0, %entry ]
+  %arrayidx = getelementptr inbounds [10 x i32]* @_arr, i32 0, i32 %i.06
+  %0 = load volatile i32* %arrayidx
+  %mul = mul nsw i32 %0, %0
+  %add = add nsw i32 %mul, %sum.05
+  %inc = add nsw i32 %i.06, 1
+  %exitcond = icmp eq i32 %inc, %n
+  br i1 %exitcond, label %for.end, label %for.body
+
+for.end:                                          ; preds = %for.body, %entry
+  %sum.0.lcssa = phi i32 [ 0, %entry ], [ %add, %for.body ]
+  ret i32 %sum.0.lcssa
+}
+
+define i32 @main()  {
+entry:
+  %x = alloca i32
+  %call = call i32 (i8*, ...)* @scanf(i8* getelementptr inbounds ([3 x i8]* @.str, i32 0, i32 0), i32* %x)
+  %0 = load i32* %x
+  %call1 = call i32 @vliw_func(i32 %0)
+  %call2 = call i32 (i8*, ...)* @printf(i8* getelementptr inbounds ([4 x i8]* @.str1, i32 0, i32 0), i32 %call1)
+  ret i32 0
+}
+
+declare i32 @scanf(i8*, ...)
+
+declare i32 @printf(i8*, ...)
@@ -0,0 +1,223 @@
+#!/usr/bin/env python
+#
+# Generate the Patmos executables used by the llvm-patmos-sim tests.
+#
+# The programs are encoded by hand, such that the tests do not depend on a
+# Patmos assembler and linker. Each executable has a single PT_LOAD segment
+# and a symbol table with its functions. Every function is preceded by the
+# word holding its size, as expected by the method cache.
+#
+# usage: gen-elf-patmos.py <output directory>
+
+import os
+import struct
+import sys
+
+EM_PATMOS = 48875
+
+R = dict(('r%d' % i, i) for i in range(32))
+S = {'s0': 0, 'sl': 2, 'sh': 3, 'ss': 5, 'st': 6, 'srb': 7, 'sro': 8}
+
+def guard(p):
+    """Encode a guard like 'p1' or '!p2' in bits 30-27."""
+    neg = p.startswith('!')
+    return ((8 if neg else 0) | int(p.lstrip('!p'))) << 27
+
+def alui(func, rd, rs1, imm, p='p0'):
+    assert 0 <= imm < 4096
+    return guard(p) | (func << 22) | (rd << 17) | (rs1 << 12) | imm
+
+def li(rd, imm, p='p0'):   return alui(0, R[rd], 0, imm, p)
+def addi(rd, rs, imm, p='p0'): return alui(0, R[rd], R[rs], imm, p)
+def nop():                 return alui(1, 0, 0, 0)
+
+def alu(func, opc, rd, rs1, rs2, p='p0'):
+    return (guard(p) | (0b01000 << 22) | (rd << 17) | (rs1 << 12) |
+            (rs2 << 7) | (opc << 4) | func)
+
+def add(rd, rs1, rs2, p='p0'): return alu(0, 0b000, R[rd], R[rs1], R[rs2], p)
+def mul(rs1, rs2, p='p0'):     return alu(0, 0b010, 0, R[rs1], R[rs2], p)
+def cmpeq(pd, rs1, rs2, p='p0'):
+    return alu(0, 0b011, int(pd.lstrip('p')), R[rs1], R[rs2], p)
+
+def mfs(rd, ss, p='p0'):
+    return guard(p) | (0b01001 << 22) | (R[rd] << 17) | (0b011 << 4) | S[ss]
+def mts(sd, rs, p='p0'):
+    return guard(p) | (0b01001 << 22) | (R[rs] << 12) | (0b010 << 4) | S[sd]
+
+def lwc(rd, ra, imm, p='p0'):
+    # typed load of a word through the data cache
+    return (guard(p) | (0b01010 << 22) | (R[rd] << 17) | (R[ra] << 12) |
+            (0b00010 << 7) | imm)
+
+def cfli(op, target, p='p0'):
+    return guard(p) | (0b10 << 25) | (op << 23) | (1 << 22) | \
+           (target & 0x3FFFFF)
+
+def br(offset, p='p0'):  return cfli(0b01, offset, p)
+def call(target, p='p0'): return cfli(0b00, target >> 2, p)
+def ret(p='p0'):          return guard(p) | (0b1100 << 23) | (1 << 22)
+
+def bundle(first, second):
+    return [first | (1 << 31), second]
+
+
+class Program:
+    """A single segment with data words and functions."""
+    def __init__(self, address):
+        self.address = address
+        self.words = []
+        self.functions = []
+
+    def here(self):
+        return self.address + 4 * len(self.words)
+
+    def data(self, words):
+        self.words.extend(words)
+
+    def function(self, name, code):
+        self.words.append(4 * len(code))
+        self.functions.append((name, self.here(), 4 * len(code)))
+        self.words.extend(code)
+
+
+def strtab(names):
+    data = b'\0'
+    offsets = {}
+    for n in names:
+        offsets[n] = len(data)
+        data += n.encode() + b'\0'
+    return data, offsets
+
+def write_elf(path, prog, entry):
+    code = b''.join(struct.pack('>I', w) for w in prog.words)
+
+    sym_names, sym_offsets = strtab([f[0] for f in prog.functions])
+    sh_names, sh_offsets = strtab(['.text', '.symtab', '.strtab',
+                                   '.shstrtab'])
+
+    symtab = struct.pack('>IIIBBH', 0, 0, 0, 0, 0, 0)
+    for name, address, size in prog.functions:
+        # STB_GLOBAL, STT_FUNC, section 1
+        symtab += struct.pack('>IIIBBH', sym_offsets[name], address, size,
+                              (1 << 4) | 2, 0, 1)
+
+    ehsize, phsize, shsize = 52, 32, 40
+    text_off = ehsize + phsize
+    symtab_off = text_off + len(code)
+    strtab_off = symtab_off + len(symtab)
+    shstrtab_off = strtab_off + len(sym_names)
+    sh_off = (shstrtab_off + len(sh_names) + 3) & ~3
+
+    ident = b'\x7fELF' + bytes([1, 2, 1]) + b'\0' * 9
+    header = ident + struct.pack('>HHIIIIIHHHHHH', 2, EM_PATMOS, 1, entry,
+                                 ehsize, sh_off, 0, ehsize, phsize, 1,
+                                 shsize, 5, 4)
+    # PT_LOAD, read/write/execute
+    phdr = struct.pack('>IIIIIIII', 1, text_off, prog.address, prog.address,
+                       len(code), len(code), 7, 4)
+
+    sections = [
+        struct.pack('>IIIIIIIIII', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+        # .text: SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR | SHF_WRITE
+        struct.pack('>IIIIIIIIII', sh_offsets['.text'], 1, 7, prog.address,
+                    text_off, len(code), 0, 0, 4, 0),
+        # .symtab: SHT_SYMTAB, linked to .strtab, one local symbol
+        struct.pack('>IIIIIIIIII', sh_offsets['.symtab'], 2, 0, 0,
+                    symtab_off, len(symtab), 3, 1, 4, 16),
+        # .strtab and .shstrtab: SHT_STRTAB
+        struct.pack('>IIIIIIIIII', sh_offsets['.strtab'], 3, 0, 0,
+                    strtab_off, len(sym_names), 0, 0, 1, 0),
+        struct.pack('>IIIIIIIIII', sh_offsets['.shstrtab'], 3, 0, 0,
+                    shstrtab_off, len(sh_names), 0, 0, 1, 0),
+    ]
+
+    image = header + phdr + code + symtab + sym_names + sh_names
+    image += b'\0' * (sh_off - len(image))
+    image += b''.join(sections)
+
+    with open(path, 'wb') as f:
+        f.write(image)
+
+
+def guards_and_delays():
+    """Guarded instructions and the delays of loads and multiplications.
+
+    The exit code sums up r7 = 0 (sl read in the bundle after the mul),
+    r8 = 42 (sl read in the second bundle), r10 = 0 (load result read in the
+    next bundle), r11 = 100 (load result read in the second bundle),
+    r12 = 1 (only '(p1) li' executed) and r13 = 4 (only '(!p2) add'
+    executed), i.e., 147.
+    """
+    prog = Program(0x800)
+    prog.data([100, 0, 0, 0])
+    prog.function('main', [
+        li('r3', 0x800),
+        ] + bundle(li('r5', 6), li('r6', 7)) + [
+        mul('r5', 'r6'),
+        mfs('r7', 'sl'),
+        mfs('r8', 'sl'),
+        lwc('r9', 'r3', 0),
+        addi('r10', 'r9', 0),
+        addi('r11', 'r9', 0),
+        cmpeq('p1', 'r3', 'r3'),
+        li('r12', 1, p='p1'),
+        li('r12', 2, p='!p1'),
+        li('r13', 3, p='p2'),
+        addi('r13', 'r13', 4, p='!p2'),
+        add('r1', 'r7', 'r8'),
+        add('r1', 'r1', 'r10'),
+        add('r1', 'r1', 'r11'),
+        add('r1', 'r1', 'r12'),
+        add('r1', 'r1', 'r13'),
+        ret(),
+        nop(), nop(), nop(),
+    ])
+    return prog
+
+def branches_and_calls():
+    """Delay slots of branches and calls, and the return address.
+
+    r1 starts at 128. Both delay slots of the branch (+1, +2) are executed,
+    the instruction following them (+128) is skipped. All three delay slots
+    of the call (+4, +8, +16) are executed before f (+32), which returns
+    behind the delay slots (+64). The exit code thus is 255. It must not be
+    127, which the test tools take for a program that could not be run.
+    """
+    prog = Program(0x800)
+    main = 0x804
+    f = main + 4 * 18 + 4
+    prog.function('main', [
+        mfs('r20', 'srb'),
+        mfs('r21', 'sro'),
+        li('r1', 128),
+        br(4),
+        addi('r1', 'r1', 1),
+        addi('r1', 'r1', 2),
+        addi('r1', 'r1', 128),
+        call(f),
+        addi('r1', 'r1', 4),
+        addi('r1', 'r1', 8),
+        addi('r1', 'r1', 16),
+        addi('r1', 'r1', 64),
+        mts('srb', 'r20'),
+        mts('sro', 'r21'),
+        ret(),
+        nop(), nop(), nop(),
+    ])
+    prog.function('f', [
+        addi('r1', 'r1', 32),
+        ret(),
+        nop(), nop(), nop(),
+    ])
+    assert prog.functions[0][1] == main and prog.functions[1][1] == f
+    return prog
+
+
+if __name__ == '__main__':
+    out = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(__file__)
+    for name, gen in [('guards-delays', guards_and_delays),
+                      ('branches-calls', branches_and_calls)]:
+        prog = gen()
+        write_elf(os.path.join(out, name + '.elf-patmos'), prog,
+                  prog.functions[0][1])
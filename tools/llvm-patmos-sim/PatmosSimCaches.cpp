@@ -0,0 +1,145 @@
+//===-- PatmosSimCaches.cpp - Cache models of the Patmos simulator --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosSimCaches.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::patmossim;
+
+unsigned MethodCache::access(uint32_t Base, unsigned MethodSize) {
+  for (unsigned i = 0, e = Methods.size(); i != e; i++) {
+    if (Methods[i].first == Base) {
+      Hits++;
+      return 0;
+    }
+  }
+
+  if (MethodSize > Size) {
+    report_fatal_error("Method at " + Twine(Base) + " with " +
+                       Twine(MethodSize) + " bytes is larger than the method "
+                       "cache!");
+  }
+
+  // evict the oldest methods until the new method fits
+  while (!Methods.empty() &&
+         (UsedSize + MethodSize > Size || Methods.size() >= MaxMethods)) {
+    UsedSize -= Methods.front().second;
+    Methods.pop_front();
+  }
+
+  Methods.push_back(std::make_pair(Base, MethodSize));
+  UsedSize += MethodSize;
+
+  Misses++;
+  // the size word in front of the method is transferred as well
+  TransferredBytes += MethodSize + 4;
+  return Timing.getTransferCycles(MethodSize + 4);
+}
+
+unsigned StackCache::reserve(uint32_t &ST, uint32_t &SS, unsigned Bytes) {
+  Reserves++;
+  ST -= Bytes;
+
+  unsigned Occupied = SS - ST;
+  if (Occupied <= Size)
+    return 0;
+
+  unsigned Spill = Occupied - Size;
+  SS -= Spill;
+  SpilledBytes += Spill;
+  return Timing.getTransferCycles(Spill);
+}
+
+unsigned StackCache::ensure(uint32_t &ST, uint32_t &SS, unsigned Bytes) {
+  Ensures++;
+
+  if (Bytes > Size) {
+    report_fatal_error("Cannot ensure " + Twine(Bytes) + " bytes in the "
+                       "stack cache!");
+  }
+
+  unsigned Occupied = SS - ST;
+  if (Occupied >= Bytes)
+    return 0;
+
+  unsigned Fill = Bytes - Occupied;
+  SS += Fill;
+  FilledBytes += Fill;
+  return Timing.getTransferCycles(Fill);
+}
+
+unsigned StackCache::free(uint32_t &ST, uint32_t &SS, unsigned Bytes) {
+  Frees++;
+  ST += Bytes;
+
+  // freed frames that have been spilled do not need to be filled again
+  if (ST > SS)
+    SS = ST;
+  return 0;
+}
+
+unsigned StackCache::spill(uint32_t &ST, uint32_t &SS, unsigned Bytes) {
+  unsigned Spill = std::min(Bytes, SS - ST);
+  SS -= Spill;
+  SpilledBytes += Spill;
+  return Timing.getTransferCycles(Spill);
+}
+
+DataCache::DataCache(const MemoryTiming &timing, Kind k, unsigned size,
+                     unsigned lineSize, unsigned associativity)
+  : Timing(timing), K(k), LineSize(lineSize), NumSets(1),
+    Associativity(associativity), Hits(0), Misses(0)
+{
+  if (K != DC_LRU)
+    return;
+
+  if (LineSize == 0 || Associativity == 0 ||
+      size < LineSize * Associativity) {
+    report_fatal_error("Invalid data cache configuration!");
+  }
+
+  NumSets = size / (LineSize * Associativity);
+  Tags.resize(NumSets);
+}
+
+unsigned DataCache::load(uint32_t Address) {
+  switch (K) {
+  case DC_Ideal:
+    Hits++;
+    return 0;
+  case DC_None:
+    Misses++;
+    return Timing.getTransferCycles(4);
+  case DC_LRU:
+    break;
+  }
+
+  uint32_t Line = Address / LineSize;
+  std::vector<uint32_t> &Set = Tags[Line % NumSets];
+
+  std::vector<uint32_t>::iterator it = std::find(Set.begin(), Set.end(), Line);
+  if (it != Set.end()) {
+    // move to the front
+    Set.erase(it);
+    Set.insert(Set.begin(), Line);
+    Hits++;
+    return 0;
+  }
+
+  if (Set.size() >= Associativity)
+    Set.pop_back();
+  Set.insert(Set.begin(), Line);
+
+  Misses++;
+  return Timing.getTransferCycles(LineSize);
+}
@@ -0,0 +1,138 @@
+//===-- PatmosSimCaches.h - Cache models of the simulator -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Timing models of the main memory, the method cache, the stack cache and the
+// data cache of Patmos. The models only compute stall cycles; the contents of
+// all caches are always backed by the simulated main memory.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_PATMOS_SIM_CACHES_H
+#define LLVM_PATMOS_SIM_CACHES_H
+
+#include "llvm/Support/DataTypes.h"
+
+#include <deque>
+#include <vector>
+
+namespace llvm {
+namespace patmossim {
+
+  /// MemoryTiming - Timing of burst transfers from and to the main memory.
+  struct MemoryTiming {
+    /// Latency - Cycles until the first word of a transfer arrives.
+    unsigned Latency;
+
+    /// WordCycles - Cycles per transferred word.
+    unsigned WordCycles;
+
+    MemoryTiming(unsigned latency, unsigned wordCycles)
+      : Latency(latency), WordCycles(wordCycles) {}
+
+    /// getTransferCycles - Get the cycles needed to transfer Bytes bytes.
+    unsigned getTransferCycles(unsigned Bytes) const {
+      if (Bytes == 0) return 0;
+      return Latency + ((Bytes + 3) / 4) * WordCycles;
+    }
+  };
+
+  /// MethodCache - A FIFO cache holding whole methods, i.e., functions and
+  /// subfunctions, limited by its total size and the number of methods.
+  class MethodCache {
+  private:
+    const MemoryTiming &Timing;
+    unsigned Size;
+    unsigned MaxMethods;
+
+    /// Methods - Base address and size of the cached methods, oldest first.
+    std::deque<std::pair<uint32_t, unsigned> > Methods;
+    unsigned UsedSize;
+
+  public:
+    uint64_t Hits;
+    uint64_t Misses;
+    uint64_t TransferredBytes;
+
+    MethodCache(const MemoryTiming &timing, unsigned size, unsigned maxMethods)
+      : Timing(timing), Size(size), MaxMethods(maxMethods), UsedSize(0),
+        Hits(0), Misses(0), TransferredBytes(0) {}
+
+    unsigned getSize() const { return Size; }
+
+    /// access - Ensure that the method at Base with MethodSize bytes is
+    /// cached. Returns the number of stall cycles.
+    unsigned access(uint32_t Base, unsigned MethodSize);
+  };
+
+  /// StackCache - The stack cache, a window of the stack between the stack
+  /// top pointer ST and the spill pointer SS.
+  class StackCache {
+  private:
+    const MemoryTiming &Timing;
+    unsigned Size;
+
+  public:
+    uint64_t Reserves;
+    uint64_t Ensures;
+    uint64_t Frees;
+    uint64_t SpilledBytes;
+    uint64_t FilledBytes;
+
+    StackCache(const MemoryTiming &timing, unsigned size)
+      : Timing(timing), Size(size), Reserves(0), Ensures(0), Frees(0),
+        SpilledBytes(0), FilledBytes(0) {}
+
+    unsigned getSize() const { return Size; }
+
+    /// reserve - Reserve Bytes on the stack cache, spilling the oldest
+    /// contents if the cache overflows. Returns the number of stall cycles.
+    unsigned reserve(uint32_t &ST, uint32_t &SS, unsigned Bytes);
+
+    /// ensure - Ensure that Bytes of the top of the stack are cached.
+    unsigned ensure(uint32_t &ST, uint32_t &SS, unsigned Bytes);
+
+    /// free - Free Bytes from the top of the stack.
+    unsigned free(uint32_t &ST, uint32_t &SS, unsigned Bytes);
+
+    /// spill - Spill Bytes from the bottom of the stack cache.
+    unsigned spill(uint32_t &ST, uint32_t &SS, unsigned Bytes);
+  };
+
+  /// DataCache - A set-associative LRU data cache for typed loads through the
+  /// data cache. Stores are written through without allocation.
+  class DataCache {
+  public:
+    enum Kind { DC_Ideal, DC_LRU, DC_None };
+
+  private:
+    const MemoryTiming &Timing;
+    Kind K;
+    unsigned LineSize;
+    unsigned NumSets;
+    unsigned Associativity;
+
+    /// Tags - Tags of the cached lines of each set, most recently used first.
+    std::vector<std::vector<uint32_t> > Tags;
+
+  public:
+    uint64_t Hits;
+    uint64_t Misses;
+
+    DataCache(const MemoryTiming &timing, Kind k, unsigned size,
+              unsigned lineSize, unsigned associativity);
+
+    /// load - Access the line containing Address for a load. Returns the
+    /// number of stall cycles.
+    unsigned load(uint32_t Address);
+  };
+
+}
+}
+
+#endif
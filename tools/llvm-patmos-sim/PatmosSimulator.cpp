@@ -0,0 +1,865 @@
+//===-- PatmosSimulator.cpp - Cycle-approximate Patmos simulator ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The simulator executes one bundle at a time. All instructions of a bundle
+// read the register state before the bundle; their results are written at
+// the end of the bundle. Loads and multiplications write their results one
+// bundle later, i.e., reading the result in the next bundle is a hazard that
+// yields the old value.
+//
+// Control flow instructions transfer control after their delay slots, or
+// stall for the same number of cycles if they are non-delayed. Calls,
+// returns and cross-function branches access the method cache, which loads
+// the method using the size word in front of it.
+//
+// Memory accesses above IOBase are mapped to I/O devices. The UART reads
+// from stdin and writes to the output stream of the simulator. A transfer
+// of control to address 0 halts the simulation; r1 holds the exit code.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosSimulator.h"
+#include "MCTargetDesc/PatmosBaseInfo.h"
+#include "MCTargetDesc/PatmosMCTargetDesc.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/MC/MCDisassembler.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryObject.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace llvm;
+using namespace llvm::patmossim;
+
+/// Addresses of the simulated I/O devices.
+enum {
+  IOBase             = 0xF0000000,
+  CpuIdAddress       = 0xF0000000,
+  CpuFreqAddress     = 0xF0000004,
+  TimerHiClkAddress  = 0xF0020000,
+  TimerLoClkAddress  = 0xF0020004,
+  TimerHiUSecAddress = 0xF0020008,
+  TimerLoUSecAddress = 0xF002000C,
+  UARTStatusAddress  = 0xF0080000,
+  UARTDataAddress    = 0xF0080004
+};
+
+/// Frequency of the simulated processor in MHz, used for the timer.
+static const unsigned CpuFreqMHz = 80;
+
+/// Indices of special registers.
+enum { SpecialSL = 2, SpecialSH = 3, SpecialSS = 5, SpecialST = 6,
+       SpecialSRB = 7, SpecialSRO = 8, SpecialSXB = 9, SpecialSXO = 10 };
+
+static std::string toHex(uint32_t Value) {
+  return "0x" + utohexstr(Value);
+}
+
+namespace {
+  /// SimMemoryObject - Provide the simulated memory to the disassembler.
+  class SimMemoryObject : public MemoryObject {
+    const SimMemory &Memory;
+  public:
+    SimMemoryObject(const SimMemory &memory) : Memory(memory) {}
+
+    virtual uint64_t getBase() const { return 0; }
+    virtual uint64_t getExtent() const { return 1ULL << 32; }
+
+    virtual int readByte(uint64_t Address, uint8_t *Ptr) const {
+      if (Address >= getExtent()) return -1;
+      *Ptr = Memory.readByte(Address);
+      return 0;
+    }
+  };
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SimMemory
+///////////////////////////////////////////////////////////////////////////////
+
+SimMemory::~SimMemory() {
+  for (DenseMap<uint32_t, uint8_t*>::iterator it = Pages.begin(),
+       ie = Pages.end(); it != ie; ++it) {
+    delete[] it->second;
+  }
+}
+
+uint8_t *SimMemory::getPage(uint32_t Address) {
+  uint8_t *&Page = Pages[Address >> PageBits];
+  if (!Page) {
+    Page = new uint8_t[PageSize];
+    memset(Page, 0, PageSize);
+  }
+  return Page;
+}
+
+uint8_t SimMemory::readByte(uint32_t Address) const {
+  DenseMap<uint32_t, uint8_t*>::const_iterator it =
+                                                Pages.find(Address >> PageBits);
+  if (it == Pages.end()) return 0;
+  return it->second[Address & (PageSize - 1)];
+}
+
+void SimMemory::writeByte(uint32_t Address, uint8_t Value) {
+  getPage(Address)[Address & (PageSize - 1)] = Value;
+}
+
+uint32_t SimMemory::read(uint32_t Address, unsigned Size) const {
+  uint32_t Value = 0;
+  for (unsigned i = 0; i < Size; i++) {
+    Value = (Value << 8) | readByte(Address + i);
+  }
+  return Value;
+}
+
+void SimMemory::write(uint32_t Address, uint32_t Value, unsigned Size) {
+  for (unsigned i = 0; i < Size; i++) {
+    writeByte(Address + i, Value >> (8 * (Size - i - 1)));
+  }
+}
+
+void SimMemory::load(uint32_t Address, StringRef Data) {
+  for (unsigned i = 0, e = Data.size(); i != e; i++) {
+    writeByte(Address + i, Data[i]);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Instruction semantics
+///////////////////////////////////////////////////////////////////////////////
+
+static uint32_t computeALU(unsigned Opcode, uint32_t A, uint32_t B) {
+  switch (Opcode) {
+  case Patmos::ADDi:   case Patmos::ADDl:   case Patmos::ADDr:
+    return A + B;
+  case Patmos::SUBi:   case Patmos::SUBl:   case Patmos::SUBr:
+    return A - B;
+  case Patmos::XORi:   case Patmos::XORl:   case Patmos::XORr:
+    return A ^ B;
+  case Patmos::SLi:    case Patmos::SLl:    case Patmos::SLr:
+    return A << (B & 31);
+  case Patmos::SRi:    case Patmos::SRl:    case Patmos::SRr:
+    return A >> (B & 31);
+  case Patmos::SRAi:   case Patmos::SRAl:   case Patmos::SRAr:
+    return (uint32_t)((int32_t)A >> (B & 31));
+  case Patmos::ORi:    case Patmos::ORl:    case Patmos::ORr:
+    return A | B;
+  case Patmos::ANDi:   case Patmos::ANDl:   case Patmos::ANDr:
+    return A & B;
+  case Patmos::NORl:   case Patmos::NORr:
+    return ~(A | B);
+  case Patmos::SHADDl: case Patmos::SHADDr:
+    return (A << 1) + B;
+  case Patmos::SHADD2l: case Patmos::SHADD2r:
+    return (A << 2) + B;
+  default:
+    llvm_unreachable("Unknown ALU instruction");
+  }
+}
+
+static bool computeCompare(unsigned Opcode, uint32_t A, uint32_t B) {
+  switch (Opcode) {
+  case Patmos::CMPEQ:  case Patmos::CMPIEQ:  return A == B;
+  case Patmos::CMPNEQ: case Patmos::CMPINEQ: return A != B;
+  case Patmos::CMPLT:  case Patmos::CMPILT:  return (int32_t)A <  (int32_t)B;
+  case Patmos::CMPLE:  case Patmos::CMPILE:  return (int32_t)A <= (int32_t)B;
+  case Patmos::CMPULT: case Patmos::CMPIULT: return A <  B;
+  case Patmos::CMPULE: case Patmos::CMPIULE: return A <= B;
+  case Patmos::BTEST:  case Patmos::BTESTI:  return (A >> (B & 31)) & 1;
+  default:
+    llvm_unreachable("Unknown compare instruction");
+  }
+}
+
+static PatmosII::MemType getMemType(unsigned Opcode) {
+  switch (Opcode) {
+  case Patmos::LWS: case Patmos::LHS: case Patmos::LBS:
+  case Patmos::LHUS: case Patmos::LBUS:
+  case Patmos::SWS: case Patmos::SHS: case Patmos::SBS:
+    return PatmosII::MEM_S;
+  case Patmos::LWL: case Patmos::LHL: case Patmos::LBL:
+  case Patmos::LHUL: case Patmos::LBUL:
+  case Patmos::SWL: case Patmos::SHL: case Patmos::SBL:
+    return PatmosII::MEM_L;
+  case Patmos::LWC: case Patmos::LHC: case Patmos::LBC:
+  case Patmos::LHUC: case Patmos::LBUC:
+  case Patmos::SWC: case Patmos::SHC: case Patmos::SBC:
+    return PatmosII::MEM_C;
+  default:
+    return PatmosII::MEM_M;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PatmosSimulator
+///////////////////////////////////////////////////////////////////////////////
+
+PatmosSimulator::PatmosSimulator(const MCDisassembler &disassembler,
+                                 const MCInstrInfo &mii,
+                                 const MCRegisterInfo &mri,
+                                 const SimConfig &config, raw_ostream &out)
+  : Disassembler(disassembler), MII(mii), MRI(mri), Config(config), Out(out),
+    Timing(config.MemLatency, config.MemWordCycles),
+    MC(Timing, config.MethodCacheSize, config.MethodCacheMethods),
+    SC(Timing, config.StackCacheSize),
+    DC(Timing, config.DataCacheKind, config.DataCacheSize,
+       config.DataCacheLineSize, config.DataCacheAssociativity)
+{
+  reset(0);
+}
+
+void PatmosSimulator::addFunction(StringRef Name, uint32_t Address,
+                                  uint32_t Size) {
+  SimFunction F(Name, Address, Size);
+  Functions.insert(std::upper_bound(Functions.begin(), Functions.end(), F), F);
+}
+
+int PatmosSimulator::findFunction(uint32_t Address) const {
+  SimFunction Key("", Address, 0);
+  std::vector<SimFunction>::const_iterator it =
+                  std::upper_bound(Functions.begin(), Functions.end(), Key);
+  if (it == Functions.begin())
+    return -1;
+  --it;
+  if (it->Size && Address - it->Address >= it->Size)
+    return -1;
+  return it - Functions.begin();
+}
+
+void PatmosSimulator::reset(uint32_t Entry) {
+  memset(R, 0, sizeof(R));
+  memset(S, 0, sizeof(S));
+  memset(P, 0, sizeof(P));
+  P[0] = true;
+
+  Writes.clear();
+  Pending = PendingCFL();
+  IssuedCFL = false;
+  Halted = false;
+  CallStack.clear();
+
+  Cycles = Bundles = Instructions = NOPs = 0;
+  MethodCacheStalls = StackCacheStalls = DataCacheStalls = BranchStalls = 0;
+
+  for (std::vector<SimFunction>::iterator it = Functions.begin(),
+       ie = Functions.end(); it != ie; ++it) {
+    it->Calls = it->Bundles = it->Instructions = 0;
+    it->Cycles = it->InclusiveCycles = 0;
+    it->Active = 0;
+  }
+
+  PC = NextPC = Base = Entry;
+  if (Entry) {
+    // the entry function is activated without a call
+    int F = findFunction(Entry);
+    if (F >= 0) {
+      Functions[F].Calls++;
+      Functions[F].Active++;
+    }
+    CallStack.push_back(std::make_pair(F, Cycles));
+
+    Cycles += enterMethod(Entry);
+  }
+}
+
+const PatmosSimulator::Bundle &PatmosSimulator::decode(uint32_t Address) {
+  DenseMap<uint32_t, unsigned>::iterator it = DecodedIndex.find(Address);
+  if (it != DecodedIndex.end())
+    return Decoded[it->second];
+
+  SimMemoryObject Region(Memory);
+  Bundle B;
+  B.Size = 0;
+
+  bool Bundled = true;
+  while (Bundled) {
+    if (B.Ops.size() == 2) {
+      report_fatal_error("Bundle at " + toHex(Address) + " has more than two "
+                         "instructions!");
+    }
+
+    MCInst MI;
+    uint64_t Size;
+    if (Disassembler.getInstruction(MI, Size, Region, Address + B.Size,
+                                    nulls(), nulls()) !=
+        MCDisassembler::Success)
+    {
+      report_fatal_error("Invalid instruction at " +
+                         toHex(Address + B.Size) + "!");
+    }
+
+    // The disassembler appends the bundle bit as last operand
+    Bundled = MI.getOperand(MI.getNumOperands() - 1).getImm();
+
+    B.Ops.push_back(MI);
+    B.Addresses.push_back(Address + B.Size);
+    B.Size += Size;
+  }
+
+  DecodedIndex[Address] = Decoded.size();
+  Decoded.push_back(B);
+  return Decoded.back();
+}
+
+uint32_t PatmosSimulator::readSpecial(unsigned Index) const {
+  if (Index == 0) {
+    // s0 holds the predicate registers
+    uint32_t Value = 0;
+    for (unsigned i = 0; i < 8; i++) {
+      Value |= P[i] << i;
+    }
+    return Value;
+  }
+  return S[Index];
+}
+
+uint32_t PatmosSimulator::readReg(const MCOperand &MO) const {
+  unsigned Reg = MO.getReg();
+  unsigned Index = getPatmosRegisterNumbering(Reg);
+
+  if (MRI.getRegClass(Patmos::SRegsRegClassID).contains(Reg))
+    return readSpecial(Index);
+  if (MRI.getRegClass(Patmos::PRegsRegClassID).contains(Reg))
+    return P[Index];
+  return R[Index];
+}
+
+bool PatmosSimulator::readPred(const MCInst &MI, unsigned OpNo) const {
+  bool Value = readReg(MI.getOperand(OpNo));
+  return MI.getOperand(OpNo + 1).getImm() ? !Value : Value;
+}
+
+void PatmosSimulator::writeReg(unsigned Reg, uint32_t Value, unsigned Delay) {
+  unsigned Index = getPatmosRegisterNumbering(Reg);
+
+  RegWrite::Kind K = RegWrite::RReg;
+  if (MRI.getRegClass(Patmos::SRegsRegClassID).contains(Reg))
+    K = RegWrite::SReg;
+  else if (MRI.getRegClass(Patmos::PRegsRegClassID).contains(Reg))
+    K = RegWrite::PReg;
+
+  Writes.push_back(RegWrite(K, Index, Value, Delay));
+}
+
+void PatmosSimulator::commitWrites() {
+  unsigned j = 0;
+  for (unsigned i = 0, e = Writes.size(); i != e; i++) {
+    RegWrite W = Writes[i];
+
+    if (W.Delay > 0) {
+      W.Delay--;
+      Writes[j++] = W;
+      continue;
+    }
+
+    switch (W.K) {
+    case RegWrite::RReg:
+      // r0 is hard-wired to zero
+      if (W.Index) R[W.Index] = W.Value;
+      break;
+    case RegWrite::PReg:
+      // p0 is hard-wired to true
+      if (W.Index) P[W.Index] = W.Value;
+      break;
+    case RegWrite::SReg:
+      if (W.Index == 0) {
+        for (unsigned p = 1; p < 8; p++) {
+          P[p] = (W.Value >> p) & 1;
+        }
+      } else {
+        S[W.Index] = W.Value;
+      }
+      break;
+    }
+  }
+  Writes.erase(Writes.begin() + j, Writes.end());
+}
+
+uint32_t PatmosSimulator::loadIO(uint32_t Address) {
+  switch (Address) {
+  case CpuIdAddress:
+    return 0;
+  case CpuFreqAddress:
+    return CpuFreqMHz * 1000000;
+  case TimerHiClkAddress:
+    return Cycles >> 32;
+  case TimerLoClkAddress:
+    return Cycles;
+  case TimerHiUSecAddress:
+    return (Cycles / CpuFreqMHz) >> 32;
+  case TimerLoUSecAddress:
+    return Cycles / CpuFreqMHz;
+  case UARTStatusAddress:
+    // always ready to transmit, and data is always available; reading the
+    // data blocks until stdin provides the next character.
+    return 0x3;
+  case UARTDataAddress: {
+    int c = getchar();
+    // signal the end of the input by EOT
+    return c == EOF ? 0x4 : c;
+  }
+  default:
+    return 0;
+  }
+}
+
+void PatmosSimulator::storeIO(uint32_t Address, uint32_t Value) {
+  if (Address == UARTDataAddress) {
+    Out << (char)(Value & 0xFF);
+  }
+}
+
+unsigned PatmosSimulator::enterMethod(uint32_t NewBase) {
+  Base = NewBase;
+
+  // the size of a method is stored in the word in front of it
+  unsigned Size = Memory.read(NewBase - 4, 4);
+  unsigned Stall = MC.access(NewBase, Size);
+
+  MethodCacheStalls += Stall;
+  return Stall;
+}
+
+unsigned PatmosSimulator::executeLoad(const MCInst &MI, unsigned Size,
+                                      bool Signed) {
+  unsigned Opcode = MI.getOpcode();
+  const MCInstrDesc &MID = MII.get(Opcode);
+
+  uint32_t Address = readReg(MI.getOperand(3)) +
+        (MI.getOperand(4).getImm() << getPatmosImmediateShift(MID.TSFlags));
+
+  PatmosII::MemType Type = getMemType(Opcode);
+  if (Type == PatmosII::MEM_S)
+    Address += S[SpecialST];
+
+  if (Address % Size) {
+    report_fatal_error("Unaligned load from " + toHex(Address) + " at " +
+                       toHex(PC) + "!");
+  }
+
+  unsigned Stall = 0;
+  uint32_t Value;
+  if (Type != PatmosII::MEM_S && Address >= IOBase) {
+    Value = loadIO(Address);
+  } else {
+    Value = Memory.read(Address, Size);
+
+    if (Type == PatmosII::MEM_C) {
+      Stall = DC.load(Address);
+    } else if (Type == PatmosII::MEM_M) {
+      Stall = Timing.getTransferCycles(Size);
+    }
+    DataCacheStalls += Stall;
+  }
+
+  if (Signed && Size < 4) {
+    unsigned Shift = 32 - Size * 8;
+    Value = (uint32_t)((int32_t)(Value << Shift) >> Shift);
+  }
+
+  // the loaded value is available in the second bundle after the load
+  writeReg(MI.getOperand(0).getReg(), Value, 1);
+  return Stall;
+}
+
+unsigned PatmosSimulator::executeStore(const MCInst &MI, unsigned Size) {
+  unsigned Opcode = MI.getOpcode();
+  const MCInstrDesc &MID = MII.get(Opcode);
+
+  uint32_t Address = readReg(MI.getOperand(2)) +
+        (MI.getOperand(3).getImm() << getPatmosImmediateShift(MID.TSFlags));
+  uint32_t Value = readReg(MI.getOperand(4));
+
+  PatmosII::MemType Type = getMemType(Opcode);
+  if (Type == PatmosII::MEM_S)
+    Address += S[SpecialST];
+
+  if (Address % Size) {
+    report_fatal_error("Unaligned store to " + toHex(Address) + " at " +
+                       toHex(PC) + "!");
+  }
+
+  // Stores are written through a write buffer and do not stall
+  if (Type != PatmosII::MEM_S && Address >= IOBase) {
+    storeIO(Address, Value);
+  } else {
+    Memory.write(Address, Value, Size);
+  }
+  return 0;
+}
+
+unsigned PatmosSimulator::issueCFL(PendingCFL::Kind K, uint32_t NewBase,
+                                   uint32_t Target, unsigned Slots,
+                                   bool Delayed) {
+  if (Pending.Active) {
+    report_fatal_error("Control flow instruction at " + toHex(PC) +
+                       " in the delay slots of another one!");
+  }
+
+  Pending.K = K;
+  Pending.Active = true;
+  Pending.Base = NewBase;
+  Pending.Target = Target;
+  Pending.Remaining = Delayed ? Slots : 0;
+  IssuedCFL = true;
+
+  if (Delayed)
+    return 0;
+
+  BranchStalls += Slots;
+  return Slots;
+}
+
+unsigned PatmosSimulator::transfer() {
+  Pending.Active = false;
+
+  // the instruction after the delay slots is the return address of calls
+  uint32_t ReturnPC = NextPC;
+
+  NextPC = Pending.Target;
+  if (NextPC == 0) {
+    Halted = true;
+    return 0;
+  }
+
+  switch (Pending.K) {
+  case PendingCFL::Branch:
+    return 0;
+  case PendingCFL::BranchCF:
+    return enterMethod(Pending.Base);
+  case PendingCFL::Call: {
+    S[SpecialSRB] = Base;
+    S[SpecialSRO] = ReturnPC - Base;
+
+    int F = findFunction(Pending.Target);
+    if (F >= 0) {
+      Functions[F].Calls++;
+      Functions[F].Active++;
+    }
+    CallStack.push_back(std::make_pair(F, Cycles));
+    return enterMethod(Pending.Base);
+  }
+  case PendingCFL::Return:
+    if (!CallStack.empty()) {
+      int F = CallStack.back().first;
+      if (F >= 0 && --Functions[F].Active == 0) {
+        Functions[F].InclusiveCycles += Cycles - CallStack.back().second;
+      }
+      CallStack.pop_back();
+    }
+    return enterMethod(Pending.Base);
+  }
+  llvm_unreachable("Unknown control flow transfer");
+}
+
+unsigned PatmosSimulator::execute(const MCInst &MI, uint32_t Address) {
+  unsigned Opcode = MI.getOpcode();
+  const MCInstrDesc &MID = MII.get(Opcode);
+
+  Instructions++;
+
+  // the guard follows the defined registers
+  if (!readPred(MI, MID.getNumDefs()))
+    return 0;
+
+  switch (Opcode) {
+  case Patmos::NOP:
+    NOPs++;
+    return 0;
+
+  case Patmos::ADDi: case Patmos::SUBi: case Patmos::XORi: case Patmos::SLi:
+  case Patmos::SRi:  case Patmos::SRAi: case Patmos::ORi:  case Patmos::ANDi:
+  case Patmos::ADDl: case Patmos::SUBl: case Patmos::XORl: case Patmos::SLl:
+  case Patmos::SRl:  case Patmos::SRAl: case Patmos::ORl:  case Patmos::ANDl:
+  case Patmos::NORl: case Patmos::SHADDl: case Patmos::SHADD2l:
+    writeReg(MI.getOperand(0).getReg(),
+             computeALU(Opcode, readReg(MI.getOperand(3)),
+                        (uint32_t)MI.getOperand(4).getImm()));
+    return 0;
+
+  case Patmos::ADDr: case Patmos::SUBr: case Patmos::XORr: case Patmos::SLr:
+  case Patmos::SRr:  case Patmos::SRAr: case Patmos::ORr:  case Patmos::ANDr:
+  case Patmos::NORr: case Patmos::SHADDr: case Patmos::SHADD2r:
+    writeReg(MI.getOperand(0).getReg(),
+             computeALU(Opcode, readReg(MI.getOperand(3)),
+                        readReg(MI.getOperand(4))));
+    return 0;
+
+  case Patmos::MOV:
+    writeReg(MI.getOperand(0).getReg(), readReg(MI.getOperand(3)));
+    return 0;
+  case Patmos::CLR:
+    writeReg(MI.getOperand(0).getReg(), 0);
+    return 0;
+  case Patmos::LIi:
+  case Patmos::LIl:
+    writeReg(MI.getOperand(0).getReg(), (uint32_t)MI.getOperand(3).getImm());
+    return 0;
+  case Patmos::LIin:
+    writeReg(MI.getOperand(0).getReg(), -(uint32_t)MI.getOperand(3).getImm());
+    return 0;
+  case Patmos::NEG:
+    writeReg(MI.getOperand(0).getReg(), -readReg(MI.getOperand(3)));
+    return 0;
+  case Patmos::NOT:
+    writeReg(MI.getOperand(0).getReg(), ~readReg(MI.getOperand(3)));
+    return 0;
+
+  case Patmos::MUL:
+  case Patmos::MULU: {
+    uint32_t A = readReg(MI.getOperand(2));
+    uint32_t B = readReg(MI.getOperand(3));
+    uint64_t Result = Opcode == Patmos::MUL ?
+                      (uint64_t)((int64_t)(int32_t)A * (int64_t)(int32_t)B) :
+                      (uint64_t)A * (uint64_t)B;
+    // the result is available in the second bundle after the mul
+    writeReg(Patmos::SL, (uint32_t)Result, 1);
+    writeReg(Patmos::SH, (uint32_t)(Result >> 32), 1);
+    return 0;
+  }
+
+  case Patmos::CMPEQ:  case Patmos::CMPNEQ: case Patmos::CMPLT:
+  case Patmos::CMPLE:  case Patmos::CMPULT: case Patmos::CMPULE:
+  case Patmos::BTEST:
+    writeReg(MI.getOperand(0).getReg(),
+             computeCompare(Opcode, readReg(MI.getOperand(3)),
+                            readReg(MI.getOperand(4))));
+    return 0;
+  case Patmos::CMPIEQ:  case Patmos::CMPINEQ: case Patmos::CMPILT:
+  case Patmos::CMPILE:  case Patmos::CMPIULT: case Patmos::CMPIULE:
+  case Patmos::BTESTI:
+    writeReg(MI.getOperand(0).getReg(),
+             computeCompare(Opcode, readReg(MI.getOperand(3)),
+                            (uint32_t)MI.getOperand(4).getImm()));
+    return 0;
+  case Patmos::ISODD:
+    writeReg(MI.getOperand(0).getReg(), readReg(MI.getOperand(3)) & 1);
+    return 0;
+  case Patmos::MOVrp:
+    writeReg(MI.getOperand(0).getReg(), readReg(MI.getOperand(3)) != 0);
+    return 0;
+
+  case Patmos::POR:
+    writeReg(MI.getOperand(0).getReg(), readPred(MI, 3) || readPred(MI, 5));
+    return 0;
+  case Patmos::PAND:
+    writeReg(MI.getOperand(0).getReg(), readPred(MI, 3) && readPred(MI, 5));
+    return 0;
+  case Patmos::PXOR:
+    writeReg(MI.getOperand(0).getReg(), readPred(MI, 3) != readPred(MI, 5));
+    return 0;
+  case Patmos::PMOV:
+    writeReg(MI.getOperand(0).getReg(), readPred(MI, 3));
+    return 0;
+  case Patmos::PNOT:
+    writeReg(MI.getOperand(0).getReg(), !readPred(MI, 3));
+    return 0;
+  case Patmos::PSET:
+    writeReg(MI.getOperand(0).getReg(), 1);
+    return 0;
+  case Patmos::PCLR:
+    writeReg(MI.getOperand(0).getReg(), 0);
+    return 0;
+
+  case Patmos::BCOPY: {
+    uint32_t Bit = MI.getOperand(4).getImm() & 31;
+    uint32_t Value = readReg(MI.getOperand(3)) & ~(1U << Bit);
+    writeReg(MI.getOperand(0).getReg(),
+             Value | ((uint32_t)readPred(MI, 5) << Bit));
+    return 0;
+  }
+  case Patmos::MOVpr:
+    writeReg(MI.getOperand(0).getReg(), readPred(MI, 3));
+    return 0;
+
+  case Patmos::MTS:
+  case Patmos::MFS:
+    writeReg(MI.getOperand(0).getReg(), readReg(MI.getOperand(3)));
+    return 0;
+
+  case Patmos::LWS: case Patmos::LWL: case Patmos::LWC: case Patmos::LWM:
+    return executeLoad(MI, 4, false);
+  case Patmos::LHS: case Patmos::LHL: case Patmos::LHC: case Patmos::LHM:
+    return executeLoad(MI, 2, true);
+  case Patmos::LHUS: case Patmos::LHUL: case Patmos::LHUC: case Patmos::LHUM:
+    return executeLoad(MI, 2, false);
+  case Patmos::LBS: case Patmos::LBL: case Patmos::LBC: case Patmos::LBM:
+    return executeLoad(MI, 1, true);
+  case Patmos::LBUS: case Patmos::LBUL: case Patmos::LBUC: case Patmos::LBUM:
+    return executeLoad(MI, 1, false);
+
+  case Patmos::SWS: case Patmos::SWL: case Patmos::SWC: case Patmos::SWM:
+    return executeStore(MI, 4);
+  case Patmos::SHS: case Patmos::SHL: case Patmos::SHC: case Patmos::SHM:
+    return executeStore(MI, 2);
+  case Patmos::SBS: case Patmos::SBL: case Patmos::SBC: case Patmos::SBM:
+    return executeStore(MI, 1);
+
+  case Patmos::SRESi: case Patmos::SENSi: case Patmos::SFREEi:
+  case Patmos::SSPILLi: case Patmos::SENSr: case Patmos::SSPILLr: {
+    // the stack cache operands are given in words
+    uint32_t Words = MI.getOperand(2).isReg() ? readReg(MI.getOperand(2))
+                                              : MI.getOperand(2).getImm();
+    uint32_t &ST = S[SpecialST];
+    uint32_t &SS = S[SpecialSS];
+    unsigned Stall;
+    switch (Opcode) {
+    case Patmos::SRESi:  Stall = SC.reserve(ST, SS, Words * 4); break;
+    case Patmos::SFREEi: Stall = SC.free(ST, SS, Words * 4);    break;
+    case Patmos::SENSi:
+    case Patmos::SENSr:  Stall = SC.ensure(ST, SS, Words * 4);  break;
+    default:             Stall = SC.spill(ST, SS, Words * 4);   break;
+    }
+    StackCacheStalls += Stall;
+    return Stall;
+  }
+
+  case Patmos::BR:
+  case Patmos::BRND:
+    return issueCFL(PendingCFL::Branch, Base,
+                    Address + (MI.getOperand(2).getImm() << 2), 2,
+                    Opcode == Patmos::BR);
+  case Patmos::BRR:
+  case Patmos::BRRND:
+    return issueCFL(PendingCFL::Branch, Base, readReg(MI.getOperand(2)), 2,
+                    Opcode == Patmos::BRR);
+  case Patmos::BRCF:
+  case Patmos::BRCFND: {
+    uint32_t Target = (MI.getOperand(2).getImm() & 0x3FFFFF) << 2;
+    return issueCFL(PendingCFL::BranchCF, Target, Target, 3,
+                    Opcode == Patmos::BRCF);
+  }
+  case Patmos::BRCFR:
+  case Patmos::BRCFRND: {
+    uint32_t Target = readReg(MI.getOperand(2));
+    return issueCFL(PendingCFL::BranchCF, Target, Target, 3,
+                    Opcode == Patmos::BRCFR);
+  }
+  case Patmos::CALL:
+  case Patmos::CALLND: {
+    uint32_t Target = (MI.getOperand(2).getImm() & 0x3FFFFF) << 2;
+    return issueCFL(PendingCFL::Call, Target, Target, 3,
+                    Opcode == Patmos::CALL);
+  }
+  case Patmos::CALLR:
+  case Patmos::CALLRND: {
+    uint32_t Target = readReg(MI.getOperand(2));
+    return issueCFL(PendingCFL::Call, Target, Target, 3,
+                    Opcode == Patmos::CALLR);
+  }
+  case Patmos::RET:
+  case Patmos::RETND:
+    return issueCFL(PendingCFL::Return, S[SpecialSRB],
+                    S[SpecialSRB] + S[SpecialSRO], 3, Opcode == Patmos::RET);
+  case Patmos::XRET:
+  case Patmos::XRETND:
+    return issueCFL(PendingCFL::Return, S[SpecialSXB],
+                    S[SpecialSXB] + S[SpecialSXO], 3, Opcode == Patmos::XRET);
+
+  default:
+    report_fatal_error("Unsupported instruction " +
+                       Twine(MII.getName(Opcode)) + " at " + toHex(Address) +
+                       "!");
+  }
+}
+
+bool PatmosSimulator::run(uint64_t MaxCycles) {
+  int CurFunction = -1;
+
+  while (!Halted) {
+    if (MaxCycles && Cycles >= MaxCycles)
+      return false;
+
+    uint64_t Start = Cycles;
+
+    const Bundle &B = decode(PC);
+    NextPC = PC + B.Size;
+    IssuedCFL = false;
+
+    unsigned Stall = 0;
+    for (unsigned i = 0, e = B.Ops.size(); i != e; i++) {
+      Stall += execute(B.Ops[i], B.Addresses[i]);
+    }
+    commitWrites();
+
+    Cycles += 1 + Stall;
+    Bundles++;
+
+    // count the delay slots of a pending control flow transfer
+    if (Pending.Active) {
+      if (!IssuedCFL) Pending.Remaining--;
+      if (Pending.Remaining == 0) Cycles += transfer();
+    }
+
+    if (CurFunction < 0 ||
+        PC - Functions[CurFunction].Address >= Functions[CurFunction].Size) {
+      CurFunction = findFunction(PC);
+    }
+    if (CurFunction >= 0) {
+      SimFunction &F = Functions[CurFunction];
+      F.Bundles++;
+      F.Instructions += B.Ops.size();
+      F.Cycles += Cycles - Start;
+    }
+
+    PC = NextPC;
+  }
+
+  // account the functions that did not return, e.g., main calling exit
+  while (!CallStack.empty()) {
+    int F = CallStack.back().first;
+    if (F >= 0 && --Functions[F].Active == 0) {
+      Functions[F].InclusiveCycles += Cycles - CallStack.back().second;
+    }
+    CallStack.pop_back();
+  }
+
+  return true;
+}
+
+void PatmosSimulator::printStats(raw_ostream &OS) {
+  OS << "Cycles:       " << Cycles << "\n"
+     << "Bundles:      " << Bundles << "\n"
+     << "Instructions: " << Instructions << " (" << NOPs << " NOPs)\n";
+
+  OS << "\nStall cycles:\n"
+     << "  Method cache: " << MethodCacheStalls << "\n"
+     << "  Stack cache:  " << StackCacheStalls << "\n"
+     << "  Data cache:   " << DataCacheStalls << "\n"
+     << "  Branches:     " << BranchStalls << "\n";
+
+  OS << "\nMethod cache: " << MC.Hits << " hits, " << MC.Misses
+     << " misses, " << MC.TransferredBytes << " bytes transferred\n";
+  OS << "Stack cache:  " << SC.Reserves << " reserves, " << SC.Ensures
+     << " ensures, " << SC.Frees << " frees, " << SC.SpilledBytes
+     << " bytes spilled, " << SC.FilledBytes << " bytes filled\n";
+  OS << "Data cache:   " << DC.Hits << " hits, " << DC.Misses << " misses\n";
+
+  OS << "\nFunction statistics:\n";
+  OS << "  Function                              Calls      Bundles"
+     << " Instructions       Cycles Incl. Cycles\n";
+  for (std::vector<SimFunction>::iterator it = Functions.begin(),
+       ie = Functions.end(); it != ie; ++it) {
+    if (!it->Bundles) continue;
+    OS << format("  %-32s %10llu %12llu", it->Name.c_str(),
+                 (unsigned long long)it->Calls,
+                 (unsigned long long)it->Bundles)
+       << format(" %12llu %12llu %12llu\n",
+                 (unsigned long long)it->Instructions,
+                 (unsigned long long)it->Cycles,
+                 (unsigned long long)it->InclusiveCycles);
+  }
+}
@@ -0,0 +1,253 @@
+//===-- PatmosSimulator.h - Cycle-approximate Patmos simulator --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A cycle-approximate simulator for statically linked Patmos executables.
+// Instructions are decoded by the Patmos MC disassembler; every bundle takes
+// one cycle plus the stall cycles of the method cache, the stack cache, the
+// data cache and of non-delayed control flow instructions.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_PATMOS_SIM_SIMULATOR_H
+#define LLVM_PATMOS_SIM_SIMULATOR_H
+
+#include "PatmosSimCaches.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/MC/MCInst.h"
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+  class MCDisassembler;
+  class MCInstrInfo;
+  class MCRegisterInfo;
+  class raw_ostream;
+
+namespace patmossim {
+
+  /// SimConfig - Configuration of the simulated processor.
+  struct SimConfig {
+    unsigned MemLatency;
+    unsigned MemWordCycles;
+
+    unsigned MethodCacheSize;
+    unsigned MethodCacheMethods;
+
+    unsigned StackCacheSize;
+
+    DataCache::Kind DataCacheKind;
+    unsigned DataCacheSize;
+    unsigned DataCacheLineSize;
+    unsigned DataCacheAssociativity;
+
+    SimConfig()
+      : MemLatency(7), MemWordCycles(1),
+        MethodCacheSize(4096), MethodCacheMethods(16),
+        StackCacheSize(2048),
+        DataCacheKind(DataCache::DC_LRU), DataCacheSize(2048),
+        DataCacheLineSize(16), DataCacheAssociativity(4) {}
+  };
+
+  /// SimMemory - Sparse big-endian memory of the simulated processor.
+  class SimMemory {
+  private:
+    enum { PageBits = 12, PageSize = 1 << PageBits };
+
+    DenseMap<uint32_t, uint8_t*> Pages;
+
+    uint8_t *getPage(uint32_t Address);
+
+  public:
+    SimMemory() {}
+    ~SimMemory();
+
+    uint8_t readByte(uint32_t Address) const;
+    void writeByte(uint32_t Address, uint8_t Value);
+
+    /// read - Read a big-endian value with Size bytes.
+    uint32_t read(uint32_t Address, unsigned Size) const;
+
+    /// write - Write a big-endian value with Size bytes.
+    void write(uint32_t Address, uint32_t Value, unsigned Size);
+
+    /// load - Copy a segment of the executable into memory.
+    void load(uint32_t Address, StringRef Data);
+  };
+
+  class PatmosSimulator {
+  public:
+    /// SimFunction - Statistics of a function of the executable.
+    struct SimFunction {
+      std::string Name;
+      uint32_t Address;
+      uint32_t Size;
+
+      uint64_t Calls;
+      uint64_t Bundles;
+      uint64_t Instructions;
+      uint64_t Cycles;
+      uint64_t InclusiveCycles;
+
+      /// Active - Number of activations of the function on the call stack.
+      unsigned Active;
+
+      SimFunction(StringRef name, uint32_t address, uint32_t size)
+        : Name(name), Address(address), Size(size), Calls(0), Bundles(0),
+          Instructions(0), Cycles(0), InclusiveCycles(0), Active(0) {}
+
+      bool operator<(const SimFunction &F) const {
+        return Address < F.Address;
+      }
+    };
+
+  private:
+    /// Bundle - A decoded bundle of one or two instructions.
+    struct Bundle {
+      unsigned Size;
+      SmallVector<MCInst, 2> Ops;
+      SmallVector<uint32_t, 2> Addresses;
+    };
+
+    /// RegWrite - A register write that becomes visible at the end of the
+    /// current bundle, or Delay bundles later.
+    struct RegWrite {
+      enum Kind { RReg, SReg, PReg } K;
+      unsigned Index;
+      uint32_t Value;
+      unsigned Delay;
+
+      RegWrite(Kind k, unsigned index, uint32_t value, unsigned delay)
+        : K(k), Index(index), Value(value), Delay(delay) {}
+    };
+
+    /// PendingCFL - A control flow transfer waiting for its delay slots.
+    struct PendingCFL {
+      enum Kind { Branch, BranchCF, Call, Return } K;
+      bool Active;
+      unsigned Remaining;
+      uint32_t Base;
+      uint32_t Target;
+
+      PendingCFL() : K(Branch), Active(false), Remaining(0), Base(0),
+                     Target(0) {}
+    };
+
+    const MCDisassembler &Disassembler;
+    const MCInstrInfo &MII;
+    const MCRegisterInfo &MRI;
+    const SimConfig &Config;
+
+    raw_ostream &Out;
+
+    SimMemory Memory;
+
+    MemoryTiming Timing;
+    MethodCache MC;
+    StackCache SC;
+    DataCache DC;
+
+    uint32_t R[32];
+    uint32_t S[16];
+    bool P[8];
+
+    uint32_t PC;
+    uint32_t NextPC;
+    uint32_t Base;
+
+    SmallVector<RegWrite, 8> Writes;
+    PendingCFL Pending;
+
+    /// IssuedCFL - Set if the current bundle issued a control flow transfer.
+    bool IssuedCFL;
+
+    bool Halted;
+
+    uint64_t Cycles;
+    uint64_t Bundles;
+    uint64_t Instructions;
+    uint64_t NOPs;
+    uint64_t MethodCacheStalls;
+    uint64_t StackCacheStalls;
+    uint64_t DataCacheStalls;
+    uint64_t BranchStalls;
+
+    /// Decoded - Cache of decoded bundles, indexed by their address.
+    std::vector<Bundle> Decoded;
+    DenseMap<uint32_t, unsigned> DecodedIndex;
+
+    /// Functions - Functions of the executable, sorted by address.
+    std::vector<SimFunction> Functions;
+
+    /// CallStack - The called functions and the cycle count at the call.
+    std::vector<std::pair<int, uint64_t> > CallStack;
+
+    const Bundle &decode(uint32_t Address);
+
+    int findFunction(uint32_t Address) const;
+
+    uint32_t readReg(const MCOperand &MO) const;
+    bool readPred(const MCInst &MI, unsigned OpNo) const;
+    void writeReg(unsigned Reg, uint32_t Value, unsigned Delay = 0);
+    uint32_t readSpecial(unsigned Index) const;
+    void commitWrites();
+
+    uint32_t loadIO(uint32_t Address);
+    void storeIO(uint32_t Address, uint32_t Value);
+
+    /// execute - Execute a single instruction at Address. Returns the number
+    /// of stall cycles.
+    unsigned execute(const MCInst &MI, uint32_t Address);
+
+    unsigned executeLoad(const MCInst &MI, unsigned Size, bool Signed);
+    unsigned executeStore(const MCInst &MI, unsigned Size);
+
+    /// issueCFL - Issue a control flow transfer to Target in the method at
+    /// NewBase, after Slots delay slots or Slots stall cycles if the
+    /// instruction is not delayed. Returns the number of stall cycles.
+    unsigned issueCFL(PendingCFL::Kind K, uint32_t NewBase, uint32_t Target,
+                      unsigned Slots, bool Delayed);
+
+    /// transfer - Perform the pending control flow transfer. Returns the
+    /// number of stall cycles.
+    unsigned transfer();
+
+    unsigned enterMethod(uint32_t NewBase);
+
+  public:
+    PatmosSimulator(const MCDisassembler &disassembler,
+                    const MCInstrInfo &mii, const MCRegisterInfo &mri,
+                    const SimConfig &config, raw_ostream &out);
+
+    SimMemory &getMemory() { return Memory; }
+
+    void addFunction(StringRef Name, uint32_t Address, uint32_t Size);
+
+    /// reset - Prepare the execution starting at the entry point.
+    void reset(uint32_t Entry);
+
+    /// run - Simulate until the program halts or MaxCycles cycles have been
+    /// executed (0 for no limit). Returns true if the program halted.
+    bool run(uint64_t MaxCycles);
+
+    /// getExitCode - Get the exit code of the halted program.
+    int getExitCode() const { return R[1]; }
+
+    uint64_t getCycles() const { return Cycles; }
+
+    void printStats(raw_ostream &OS);
+  };
+
+}
+}
+
+#endif
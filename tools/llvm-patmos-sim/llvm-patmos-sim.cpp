@@ -0,0 +1,225 @@
+//===-- llvm-patmos-sim.cpp - Cycle-approximate Patmos simulator ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program executes statically linked Patmos ELF executables and reports
+// an approximation of their execution time, without the need for an external
+// simulator. The exit code of the simulated program is returned.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosSimulator.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/MC/MCDisassembler.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/system_error.h"
+
+using namespace llvm;
+using namespace llvm::object;
+using namespace llvm::patmossim;
+
+static cl::opt<std::string>
+InputFilename(cl::Positional, cl::desc("<input executable>"), cl::Required);
+
+static cl::opt<unsigned long long>
+MaxCycles("max-cycles", cl::init(0),
+  cl::desc("Stop the simulation after the given number of cycles "
+           "(default: 0, no limit)"));
+
+static cl::opt<bool>
+PrintStats("print-stats", cl::init(false),
+  cl::desc("Print cycle and cache statistics and the exit code to stderr"));
+
+static cl::opt<unsigned>
+MemLatency("mem-latency", cl::init(7),
+  cl::desc("Latency of a main memory transfer in cycles (default: 7)"));
+
+static cl::opt<unsigned>
+MemWordCycles("mem-word-cycles", cl::init(1),
+  cl::desc("Cycles per word of a main memory transfer (default: 1)"));
+
+static cl::opt<unsigned>
+MethodCacheSize("mcache-size", cl::init(4096),
+  cl::desc("Size of the method cache in bytes (default: 4096)"));
+
+static cl::opt<unsigned>
+MethodCacheMethods("mcache-methods", cl::init(16),
+  cl::desc("Maximum number of methods in the method cache (default: 16)"));
+
+static cl::opt<unsigned>
+StackCacheSize("scache-size", cl::init(2048),
+  cl::desc("Size of the stack cache in bytes (default: 2048)"));
+
+static cl::opt<DataCache::Kind>
+DataCacheKind("dcache", cl::init(DataCache::DC_LRU),
+  cl::desc("Kind of the data cache (default: lru)"),
+  cl::values(
+    clEnumValN(DataCache::DC_Ideal, "ideal", "Every access hits"),
+    clEnumValN(DataCache::DC_LRU,   "lru",   "Set-associative LRU cache"),
+    clEnumValN(DataCache::DC_None,  "no",    "Every access goes to memory"),
+    clEnumValEnd));
+
+static cl::opt<unsigned>
+DataCacheSize("dcache-size", cl::init(2048),
+  cl::desc("Size of the data cache in bytes (default: 2048)"));
+
+static cl::opt<unsigned>
+DataCacheLineSize("dcache-line", cl::init(16),
+  cl::desc("Line size of the data cache in bytes (default: 16)"));
+
+static cl::opt<unsigned>
+DataCacheAssociativity("dcache-assoc", cl::init(4),
+  cl::desc("Associativity of the data cache (default: 4)"));
+
+static const char *ToolName;
+
+static int error(const Twine &Message) {
+  errs() << ToolName << ": " << InputFilename << ": " << Message << "\n";
+  return 1;
+}
+
+/// loadExecutable - Load the segments and the function symbols of the
+/// executable into the simulator and get its entry point.
+static bool loadExecutable(const ELF32BEObjectFile &Obj, PatmosSimulator &Sim,
+                           uint32_t &Entry) {
+  const ELFFile<ELFType<support::big, 2, false> > *ELF = Obj.getELFFile();
+
+  if (ELF->getHeader()->e_type != ELF::ET_EXEC) {
+    error("not an executable");
+    return false;
+  }
+  Entry = ELF->getHeader()->e_entry;
+
+  StringRef Data = Obj.getData();
+  for (ELFFile<ELFType<support::big, 2, false> >::Elf_Phdr_Iter
+       it = ELF->begin_program_headers(), ie = ELF->end_program_headers();
+       it != ie; ++it)
+  {
+    if (it->p_type != ELF::PT_LOAD)
+      continue;
+
+    if (it->p_offset + it->p_filesz > Data.size()) {
+      error("segment exceeds the file");
+      return false;
+    }
+    // the remainder up to p_memsz is zero-initialized by the memory
+    Sim.getMemory().load(it->p_vaddr,
+                         Data.substr(it->p_offset, it->p_filesz));
+  }
+
+  error_code ec;
+  for (symbol_iterator it = Obj.begin_symbols(), ie = Obj.end_symbols();
+       it != ie; it.increment(ec))
+  {
+    if (ec) {
+      error(ec.message());
+      return false;
+    }
+
+    SymbolRef::Type Type;
+    StringRef Name;
+    uint64_t Address, Size;
+    if (it->getType(Type) || Type != SymbolRef::ST_Function ||
+        it->getName(Name) || it->getAddress(Address) || it->getSize(Size))
+      continue;
+
+    Sim.addFunction(Name, Address, Size);
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  // Print a stack trace if we signal out.
+  sys::PrintStackTraceOnErrorSignal();
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
+
+  LLVMInitializePatmosTargetInfo();
+  LLVMInitializePatmosTargetMC();
+  LLVMInitializePatmosDisassembler();
+
+  cl::ParseCommandLineOptions(argc, argv, "Patmos simulator\n");
+  ToolName = argv[0];
+
+  OwningPtr<MemoryBuffer> Buffer;
+  if (error_code ec = MemoryBuffer::getFileOrSTDIN(InputFilename, Buffer))
+    return error(ec.message());
+
+  OwningPtr<ObjectFile> Obj(ObjectFile::createObjectFile(Buffer.take()));
+  if (!Obj)
+    return error("unrecognized file format");
+
+  const ELF32BEObjectFile *ELFObj = dyn_cast<ELF32BEObjectFile>(Obj.get());
+  if (!ELFObj || Obj->getArch() != Triple::patmos)
+    return error("not a Patmos ELF file");
+
+  std::string TripleName("patmos-unknown-unknown-elf");
+  std::string Error;
+  const Target *TheTarget = TargetRegistry::lookupTarget(TripleName, Error);
+  if (!TheTarget)
+    return error(Error);
+
+  OwningPtr<const MCRegisterInfo> MRI(TheTarget->createMCRegInfo(TripleName));
+  OwningPtr<const MCInstrInfo> MII(TheTarget->createMCInstrInfo());
+  OwningPtr<const MCSubtargetInfo> STI(
+                      TheTarget->createMCSubtargetInfo(TripleName, "", ""));
+  if (!MRI || !MII || !STI)
+    return error("could not create the target description");
+
+  OwningPtr<const MCDisassembler> Disassembler(
+                                      TheTarget->createMCDisassembler(*STI));
+  if (!Disassembler)
+    return error("no disassembler for the Patmos target");
+
+  SimConfig Config;
+  Config.MemLatency = MemLatency;
+  Config.MemWordCycles = MemWordCycles;
+  Config.MethodCacheSize = MethodCacheSize;
+  Config.MethodCacheMethods = MethodCacheMethods;
+  Config.StackCacheSize = StackCacheSize;
+  Config.DataCacheKind = DataCacheKind;
+  Config.DataCacheSize = DataCacheSize;
+  Config.DataCacheLineSize = DataCacheLineSize;
+  Config.DataCacheAssociativity = DataCacheAssociativity;
+
+  PatmosSimulator Sim(*Disassembler, *MII, *MRI, Config, outs());
+
+  uint32_t Entry;
+  if (!loadExecutable(*ELFObj, Sim, Entry))
+    return 1;
+
+  Sim.reset(Entry);
+  bool Halted = Sim.run(MaxCycles);
+  outs().flush();
+
+  if (PrintStats)
+    Sim.printStats(errs());
+
+  if (!Halted) {
+    errs() << ToolName << ": simulation stopped after " << Sim.getCycles()
+           << " cycles\n";
+    return 1;
+  }
+
+  if (PrintStats)
+    errs() << "\nExit code:    " << Sim.getExitCode() << "\n";
+
+  return Sim.getExitCode();
+}
@@ -0,0 +1,187 @@
+#include "gtest/gtest.h"
+#include "PatmosILPSolver.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace {
+
+/// Parse an LP problem and solve it using the builtin solver.
+PatmosILPSolver::Status solveLP(StringRef LP, double &Result)
+{
+  ILPModel Model;
+  std::string ErrMsg;
+  EXPECT_TRUE(Model.parseLP(LP, ErrMsg)) << ErrMsg;
+  return solveILP(Model, 10000, Result);
+}
+
+TEST(ILPSolverTest, ParseTest){
+  /*
+   * We test that the sections, labels, comments and relations of the LP
+   * format are understood.
+   */
+  ILPModel Model;
+  std::string ErrMsg;
+
+  ASSERT_TRUE(Model.parseLP("Minimize\n"
+                            " + 3 x \\ a comment\n"
+                            " + y\n"
+                            "Subject To\n"
+                            "c0:\t + x + y >= 2\n"
+                            "c1: x - y =< 1\n"
+                            "Generals\n"
+                            "x\n"
+                            "y\n"
+                            "End\n", ErrMsg)) << ErrMsg;
+
+  EXPECT_FALSE(Model.isMaximize());
+  EXPECT_EQ(2u, Model.getNumVariables());
+  EXPECT_EQ(2u, Model.getConstraints().size());
+  EXPECT_EQ(ILPModel::GE, Model.getConstraints()[0].Rel);
+  EXPECT_EQ(ILPModel::LE, Model.getConstraints()[1].Rel);
+  EXPECT_TRUE(Model.isIntegral(Model.getVariable("x")));
+}
+
+TEST(ILPSolverTest, ParseErrorTest){
+  /*
+   * We test that malformed constraints are rejected.
+   */
+  ILPModel Model;
+  std::string ErrMsg;
+
+  EXPECT_FALSE(Model.parseLP("Maximize\n x\nSubject To\n x + y\nEnd\n",
+                             ErrMsg));
+  EXPECT_FALSE(ErrMsg.empty());
+}
+
+/// Return the canonical form of an LP problem.
+std::string canonicalLP(StringRef LP)
+{
+  ILPModel Model;
+  std::string ErrMsg, Result;
+  EXPECT_TRUE(Model.parseLP(LP, ErrMsg)) << ErrMsg;
+
+  raw_string_ostream OS(Result);
+  Model.printCanonical(OS);
+  return OS.str();
+}
+
+TEST(ILPSolverTest, CanonicalTest){
+  /*
+   * We test that ILPs differing only in constraint names and in the order of
+   * their terms and constraints share their canonical form, while different
+   * costs do not.
+   */
+  std::string A = canonicalLP("Maximize\n + 8 WXfoo + 4 WSfoo_0\n"
+                              "Subject To\n"
+                              "c0: WXfoo - WSfoo_0 = 0\n"
+                              "c1: WSfoo_0 + WSfoo_1 <= 2\n"
+                              "Generals\nWXfoo\nWSfoo_0\nEnd\n");
+  std::string B = canonicalLP("Maximize\n + 4 WSfoo_0 + 8 WXfoo\n"
+                              "Subject To\n"
+                              "x1: WSfoo_1 + WSfoo_0 <= 2\n"
+                              "x0: - WSfoo_0 + WXfoo = 0\n"
+                              "Generals\nWSfoo_0\nWXfoo\nEnd\n");
+  std::string C = canonicalLP("Maximize\n + 8 WXfoo + 2 WSfoo_0\n"
+                              "Subject To\n"
+                              "c0: WXfoo - WSfoo_0 = 0\n"
+                              "c1: WSfoo_0 + WSfoo_1 <= 2\n"
+                              "Generals\nWXfoo\nWSfoo_0\nEnd\n");
+
+  EXPECT_EQ(A, B);
+  EXPECT_NE(A, C);
+}
+
+TEST(ILPSolverTest, LinearProgramTest){
+  /*
+   * We test a plain LP, whose optimum is at a fractional vertex.
+   */
+  double Result;
+  ASSERT_EQ(PatmosILPSolver::Optimal,
+            solveLP("Maximize\n x + y\n"
+                    "Subject To\n 2 x + y <= 4\n x + 2 y <= 4\nEnd\n", Result));
+  EXPECT_NEAR(8.0 / 3.0, Result, 1e-6);
+}
+
+TEST(ILPSolverTest, IntegralTest){
+  /*
+   * We test that branching finds the integral optimum of the same problem.
+   */
+  double Result;
+  ASSERT_EQ(PatmosILPSolver::Optimal,
+            solveLP("Maximize\n x + y\n"
+                    "Subject To\n 2 x + y <= 4\n x + 2 y <= 4\n"
+                    "Generals\n x\n y\nEnd\n", Result));
+  EXPECT_NEAR(2.0, Result, 1e-6);
+}
+
+TEST(ILPSolverTest, NodeLimitTest){
+  /*
+   * We test that the bound of the LP relaxation is returned when the node
+   * limit does not even allow to branch.
+   */
+  ILPModel Model;
+  std::string ErrMsg;
+  ASSERT_TRUE(Model.parseLP("Maximize\n x + y\n"
+                            "Subject To\n 2 x + y <= 4\n x + 2 y <= 4\n"
+                            "Generals\n x\n y\nEnd\n", ErrMsg)) << ErrMsg;
+
+  double Result;
+  ASSERT_EQ(PatmosILPSolver::Optimal, solveILP(Model, 0, Result));
+  EXPECT_NEAR(8.0 / 3.0, Result, 1e-6);
+}
+
+TEST(ILPSolverTest, FlowTest){
+  /*
+   * We test a small network-flow problem similar to those of the stack cache
+   * analysis: an entry edge, a recursive call bounded by a user constraint, and
+   * an exit edge.
+   */
+  double Result;
+  ASSERT_EQ(PatmosILPSolver::Optimal,
+            solveLP("Maximize\n + 16 Wf + 8 Wexit\n"
+                    "Subject To\n"
+                    "path:\t Wf >= 1\n"
+                    "if:\t + Wentry + Wrec - Wf = 0\n"
+                    "of:\t + Wrec + Wexit - Wf = 0\n"
+                    "entries:\t + Wentry = 1\n"
+                    "usr:\t + Wf <= 3\n"
+                    "Generals\n Wf\n Wrec\n Wentry\n Wexit\n"
+                    "End\n", Result));
+  EXPECT_NEAR(56.0, Result, 1e-6);
+}
+
+TEST(ILPSolverTest, BoundsTest){
+  /*
+   * We test variable bounds and equality constraints with constants.
+   */
+  double Result;
+  ASSERT_EQ(PatmosILPSolver::Optimal,
+            solveLP("Minimize\n 2 x + 3 y + 1\n"
+                    "Subject To\n x + y = 5\n"
+                    "Bounds\n 1 <= x <= 3\n y >= 0\n"
+                    "End\n", Result));
+  EXPECT_NEAR(13.0, Result, 1e-6);
+}
+
+TEST(ILPSolverTest, InfeasibleTest){
+  /*
+   * We test that infeasibility is detected.
+   */
+  double Result;
+  EXPECT_EQ(PatmosILPSolver::Infeasible,
+            solveLP("Maximize\n x\nSubject To\n x >= 3\n x <= 2\nEnd\n",
+                    Result));
+}
+
+TEST(ILPSolverTest, UnboundedTest){
+  /*
+   * We test that an unbounded recursion, i.e., a missing user bound, is
+   * detected.
+   */
+  double Result;
+  EXPECT_EQ(PatmosILPSolver::Unbounded,
+            solveLP("Maximize\n x\nSubject To\n x - y = 0\nEnd\n", Result));
+}
+
+}
@@ -0,0 +1,71 @@
+#include "gtest/gtest.h"
+#include "PatmosThreadPool.h"
+
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+/// Record how often each index was visited and compute a value per index.
+class CountingTask : public PatmosParallelTask {
+public:
+  std::vector<unsigned> Visits;
+  std::vector<unsigned> Squares;
+
+  CountingTask(unsigned N) : Visits(N, 0), Squares(N, 0) {}
+
+  virtual void run(unsigned Index) {
+    Visits[Index]++;
+    Squares[Index] = Index * Index;
+  }
+};
+
+TEST(ThreadPoolTest, SerialTest){
+  /*
+   * We test that a single-threaded pool runs every task exactly once.
+   */
+  PatmosThreadPool Pool(1);
+  CountingTask Task(100);
+
+  EXPECT_FALSE(Pool.isParallel());
+  Pool.run(Task, 100);
+
+  for (unsigned i = 0; i < 100; i++) {
+    EXPECT_EQ(1u, Task.Visits[i]);
+    EXPECT_EQ(i * i, Task.Squares[i]);
+  }
+}
+
+TEST(ThreadPoolTest, ParallelTest){
+  /*
+   * We test that a pool with more threads than tasks, as well as a pool with
+   * fewer threads than tasks, runs every task exactly once.
+   */
+  PatmosThreadPool Pool(4);
+
+  CountingTask Few(3);
+  Pool.run(Few, 3);
+  for (unsigned i = 0; i < 3; i++) {
+    EXPECT_EQ(1u, Few.Visits[i]);
+  }
+
+  CountingTask Many(1000);
+  Pool.run(Many, 1000);
+  for (unsigned i = 0; i < 1000; i++) {
+    EXPECT_EQ(1u, Many.Visits[i]);
+    EXPECT_EQ(i * i, Many.Squares[i]);
+  }
+}
+
+TEST(ThreadPoolTest, EmptyTest){
+  /*
+   * We test that running no tasks at all is fine.
+   */
+  PatmosThreadPool Pool(0);
+  CountingTask Task(0);
+  Pool.run(Task, 0);
+  EXPECT_LE(1u, Pool.getNumThreads());
+}
+
+}